@@ -0,0 +1,287 @@
+// Renders the same warm-up trace as JSON (SensorPayload/AlertPayload) and as
+// MessagePack (SensorMsgPack/AlertMsgPack), then a full /history response in
+// both encodings. Reports bytes and ns per encode. Every MessagePack payload
+// is decoded again and compared with its source; exits non-zero on a
+// mismatch or if MessagePack is not the smaller encoding.
+//
+//   pio run -e bench_binary && .pio/build/bench_binary/program [samples]
+
+#include <Arduino.h>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include "bench_support.h"
+#include "history_log.h"
+#include "payload_serializer.h"
+
+namespace {
+
+// Just enough MessagePack to read back what MsgPackWriter produces.
+class MsgPackReader {
+public:
+  MsgPackReader(const uint8_t* data, size_t length) : p(data), end(data + length) {}
+
+  bool ok() const { return !bad; }
+  bool atEnd() const { return p == end; }
+
+  uint32_t mapHeader() { return container(0x80, 0xde); }
+  uint32_t arrayHeader() { return container(0x90, 0xdc); }
+
+  std::string str() {
+    uint8_t type = next();
+    size_t n = 0;
+    if ((type & 0xe0) == 0xa0) {
+      n = type & 0x1f;
+    } else if (type == 0xd9) {
+      n = next();
+    } else {
+      bad = true;
+    }
+    if (static_cast<size_t>(end - p) < n) {
+      bad = true;
+      return std::string();
+    }
+    std::string text(reinterpret_cast<const char*>(p), n);
+    p += n;
+    return text;
+  }
+
+  uint32_t uint() {
+    uint8_t type = next();
+    if (type < 0x80) return type;
+    if (type == 0xcc) return bigEndian(1);
+    if (type == 0xcd) return bigEndian(2);
+    if (type == 0xce) return bigEndian(4);
+    bad = true;
+    return 0;
+  }
+
+  // NaN for nil.
+  float number() {
+    uint8_t type = next();
+    if (type == 0xc0) {
+      return NAN;
+    }
+    if (type != 0xca) {
+      bad = true;
+      return NAN;
+    }
+    uint32_t bits = bigEndian(4);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+private:
+  uint8_t next() {
+    if (p == end) {
+      bad = true;
+      return 0xc1;  // never used
+    }
+    return *p++;
+  }
+
+  uint32_t bigEndian(uint8_t bytes) {
+    uint32_t value = 0;
+    while (bytes--) {
+      value = (value << 8) | next();
+    }
+    return value;
+  }
+
+  uint32_t container(uint8_t fixType, uint8_t wideType) {
+    uint8_t type = next();
+    if ((type & 0xf0) == fixType) return type & 0x0f;
+    if (type == wideType) return bigEndian(2);
+    bad = true;
+    return 0;
+  }
+
+  const uint8_t* p;
+  const uint8_t* end;
+  bool bad = false;
+};
+
+// Collects a response body the way AsyncResponseStream would.
+class BodyPrint : public Print {
+public:
+  size_t write(uint8_t c) override {
+    body.push_back(static_cast<char>(c));
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    body.append(reinterpret_cast<const char*>(buffer), size);
+    return size;
+  }
+  std::string body;
+};
+
+// What a JSON consumer would read for the same field.
+bool sameValue(float decoded, float source, uint8_t decimals) {
+  float scale = decimals == 1 ? 10.0f : 100.0f;
+  return fabsf(decoded - roundf(source * scale) / scale) < 0.005f;
+}
+
+struct Sample {
+  float temperature;
+  float humidity;
+  PrinterStatus status;
+};
+
+// 20 °C to 38 °C over the first half, then held with a little noise.
+Sample traceSample(uint32_t i, uint32_t count) {
+  float progress = static_cast<float>(i) / static_cast<float>(count);
+  float temperature = progress < 0.5f ? 20.0f + 36.0f * progress : 38.0f + static_cast<float>(i % 7) * 0.031f;
+  float humidity = 55.0f - 10.0f * progress + static_cast<float>(i % 5) * 0.017f;
+  PrinterStatus status = temperature > 35.0f ? TOO_HOT : (temperature > 25.0f ? READY : NOT_READY);
+  return {temperature, humidity, status};
+}
+
+const char* statusName(PrinterStatus status) {
+  return status == TOO_HOT ? "TOO HOT" : (status == READY ? "READY" : "NOT READY");
+}
+
+bool checkSensor(const uint8_t* data, size_t length, const SensorPayload::Fields& fields) {
+  MsgPackReader in(data, length);
+  uint32_t entries = in.mapHeader();
+  bool ok = entries == 3;
+  for (uint32_t e = 0; e < entries && in.ok(); ++e) {
+    std::string key = in.str();
+    if (key == "temperature") {
+      ok = ok && sameValue(in.number(), fields.temperature, 2);
+    } else if (key == "humidity") {
+      ok = ok && sameValue(in.number(), fields.humidity, 2);
+    } else if (key == "status") {
+      ok = ok && in.str() == fields.status;
+    } else {
+      ok = false;
+    }
+  }
+  return ok && in.ok() && in.atEnd();
+}
+
+bool checkAlert(const uint8_t* data, size_t length, const char* alert, float temperature, float threshold) {
+  MsgPackReader in(data, length);
+  bool ok = in.mapHeader() == 3;
+  ok = ok && in.str() == "alert" && in.str() == alert;
+  ok = ok && in.str() == "temperature" && sameValue(in.number(), temperature, 2);
+  ok = ok && in.str() == "threshold" && sameValue(in.number(), threshold, 1);
+  return ok && in.ok() && in.atEnd();
+}
+
+// Walks the MessagePack /history body; counts the points and checks each
+// timestamp against the JSON body's.
+bool checkHistory(const std::string& packed, const std::string& json, uint32_t& points) {
+  MsgPackReader in(reinterpret_cast<const uint8_t*>(packed.data()), packed.size());
+  bool ok = in.mapHeader() == 5;
+  ok = ok && in.str() == "from";
+  in.uint();
+  ok = ok && in.str() == "to";
+  in.uint();
+  ok = ok && in.str() == "step";
+  in.uint();
+  ok = ok && in.str() == "statuses" && in.arrayHeader() == 3;
+  ok = ok && in.str() == "NOT READY" && in.str() == "READY" && in.str() == "TOO HOT";
+  ok = ok && in.str() == "points";
+  points = in.arrayHeader();
+  size_t cursor = json.find("\"points\":[") + strlen("\"points\":");  // the array's own [
+  for (uint32_t i = 0; i < points && ok && in.ok(); ++i) {
+    ok = in.arrayHeader() == 4;
+    uint32_t timestamp = in.uint();
+    in.number();
+    in.number();
+    ok = ok && in.uint() <= TOO_HOT;
+    cursor = json.find('[', cursor + 1);
+    ok = ok && cursor != std::string::npos && strtoul(json.c_str() + cursor + 1, nullptr, 10) == timestamp;
+  }
+  return ok && in.ok() && in.atEnd();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const uint32_t samples = argc > 1 ? static_cast<uint32_t>(atol(argv[1])) : 200000;
+
+  SensorPayload json;
+  SensorMsgPack packed;
+  AlertPayload alertJson;
+  AlertMsgPack alertPacked;
+  bench::Series jsonNs, packedNs, alertJsonNs, alertPackedNs;
+  uint64_t jsonBytes = 0, packedBytes = 0, alertJsonBytes = 0, alertPackedBytes = 0;
+  uint32_t mismatches = 0;
+
+  for (uint32_t i = 0; i < samples; ++i) {
+    Sample s = traceSample(i, samples);
+    SensorPayload::Fields fields = {s.temperature, s.humidity, true, false, statusName(s.status)};
+
+    uint64_t t0 = bench::nowNs();
+    json.render(fields);
+    uint64_t t1 = bench::nowNs();
+    packed.render(fields);
+    uint64_t t2 = bench::nowNs();
+    alertJson.render("temperature_high", s.temperature, 30.0f);
+    uint64_t t3 = bench::nowNs();
+    alertPacked.render("temperature_high", s.temperature, 30.0f);
+    uint64_t t4 = bench::nowNs();
+
+    jsonNs.add(static_cast<double>(t1 - t0));
+    packedNs.add(static_cast<double>(t2 - t1));
+    alertJsonNs.add(static_cast<double>(t3 - t2));
+    alertPackedNs.add(static_cast<double>(t4 - t3));
+    jsonBytes += json.length();
+    packedBytes += packed.length();
+    alertJsonBytes += alertJson.length();
+    alertPackedBytes += alertPacked.length();
+
+    if (!checkSensor(packed.data(), packed.length(), fields) ||
+        !checkAlert(alertPacked.data(), alertPacked.length(), "temperature_high", s.temperature, 30.0f)) {
+      if (mismatches++ == 0) {
+        printf("mismatch at sample %u: %s\n", i, json.c_str());
+      }
+    }
+  }
+
+  printf("%u samples\n", samples);
+  printf("sensor JSON        %6.1f bytes\n", static_cast<double>(jsonBytes) / samples);
+  printf("sensor MessagePack %6.1f bytes\n", static_cast<double>(packedBytes) / samples);
+  jsonNs.print("sensor JSON encode", "ns");
+  packedNs.print("sensor MessagePack encode", "ns");
+  printf("alert JSON         %6.1f bytes\n", static_cast<double>(alertJsonBytes) / samples);
+  printf("alert MessagePack  %6.1f bytes\n", static_cast<double>(alertPackedBytes) / samples);
+  alertJsonNs.print("alert JSON encode", "ns");
+  alertPackedNs.print("alert MessagePack encode", "ns");
+
+  // A full RAM ring at the 2 s cadence, decimated to HISTORY_MAX_POINTS; the
+  // flash log is left unbegun so only the ring is read.
+  HistoryBuffer recent;
+  HistoryLog archive;
+  recent.begin();
+  const uint32_t ringSamples = static_cast<uint32_t>(recent.capacity());
+  for (uint32_t i = 0; i < ringSamples; ++i) {
+    Sample s = traceSample(i, ringSamples);
+    recent.append(makeHistoryRecord(1700000000UL + 2 * i, s.temperature, s.humidity, i % 50 != 0, s.status));
+  }
+  BodyPrint jsonBody, packedBody;
+  uint64_t t0 = bench::nowNs();
+  writeHistoryJson(jsonBody, archive, recent, 0, UINT32_MAX, 1);
+  uint64_t t1 = bench::nowNs();
+  bool allocated = writeHistoryMsgPack(packedBody, archive, recent, 0, UINT32_MAX, 1);
+  uint64_t t2 = bench::nowNs();
+  uint32_t points = 0;
+  bool historyOk = allocated && checkHistory(packedBody.body, jsonBody.body, points);
+  printf("history JSON        %6zu bytes %8.1f us\n", jsonBody.body.size(), static_cast<double>(t1 - t0) / 1000.0);
+  printf("history MessagePack %6zu bytes %8.1f us (%u points)\n", packedBody.body.size(),
+         static_cast<double>(t2 - t1) / 1000.0, points);
+
+  if (mismatches > 0 || !historyOk) {
+    printf("FAIL: %u payloads and %s history body did not decode to their source\n", mismatches,
+           historyOk ? "no" : "the");
+    return 1;
+  }
+  if (packedBytes >= jsonBytes || alertPackedBytes >= alertJsonBytes || packedBody.body.size() >= jsonBody.body.size()) {
+    printf("FAIL: MessagePack is not smaller than JSON\n");
+    return 1;
+  }
+  printf("every MessagePack payload decodes to its source\n");
+  return 0;
+}
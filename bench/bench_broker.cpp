@@ -0,0 +1,208 @@
+// Churns hundreds of simulated MQTT clients through subscribe, unsubscribe
+// and disconnect, feeding the same trace to the sensor-only linear tracker
+// the broker used to have and to the per-topic subscriber index. Reports
+// ns per hook call for each. Exits non-zero if any topic's audience
+// disagrees with a brute-force recount of the live subscriptions.
+//
+//   pio run -e bench_broker && .pio/build/bench_broker/program [clients] [operations]
+
+#include <Arduino.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "bench_support.h"
+#include "mqtt_broker_wrapper.h"
+
+namespace {
+
+// The pre-index TrackingMqttBroker, kept verbatim (less the LocalMqttBroker
+// wrapper) as the reference.
+class LegacyTrackingBroker : public PicoMQTT::Server {
+public:
+  using PicoMQTT::Server::Server;
+
+  size_t sensorSubscriberCount() const {
+    return sensorSubscribers.size();
+  }
+
+protected:
+  void on_subscribe(const char* client_id, const char* topic) override {
+    if (matchesSensorTopic(topic)) {
+      updateClientSubscription(client_id, 1);
+    }
+  }
+
+  void on_unsubscribe(const char* client_id, const char* topic) override {
+    if (matchesSensorTopic(topic)) {
+      updateClientSubscription(client_id, -1);
+    }
+  }
+
+  void on_disconnected(const char* client_id) override {
+    removeClient(client_id);
+  }
+
+private:
+  struct ClientSubscription {
+    String clientId;
+    uint16_t matchCount;
+  };
+
+  std::vector<ClientSubscription> sensorSubscribers;
+
+  bool matchesSensorTopic(const char* topic_filter) const {
+    return PicoMQTT::Subscriber::topic_matches(topic_filter, "mqtt/sensor");
+  }
+
+  int findClientIndex(const char* client_id) const {
+    for (size_t i = 0; i < sensorSubscribers.size(); ++i) {
+      if (sensorSubscribers[i].clientId == client_id) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+  void updateClientSubscription(const char* client_id, int delta) {
+    int index = findClientIndex(client_id);
+    if (index < 0) {
+      if (delta > 0) {
+        sensorSubscribers.push_back({String(client_id), static_cast<uint16_t>(delta)});
+      }
+      return;
+    }
+
+    int newCount = static_cast<int>(sensorSubscribers[index].matchCount) + delta;
+    if (newCount <= 0) {
+      sensorSubscribers.erase(sensorSubscribers.begin() + index);
+    } else {
+      sensorSubscribers[index].matchCount = static_cast<uint16_t>(newCount);
+    }
+  }
+
+  void removeClient(const char* client_id) {
+    int index = findClientIndex(client_id);
+    if (index >= 0) {
+      sensorSubscribers.erase(sensorSubscribers.begin() + index);
+    }
+  }
+};
+
+// Dashboards, loggers and unrelated home-automation clients.
+const char* const FILTERS[] = {"mqtt/sensor", "mqtt/alerts", "mqtt/#", "mqtt/+", "#",
+                               "home/+/state", "zigbee/#", "mqtt/sensor/+", "+/alerts", "other/topic"};
+const size_t FILTER_COUNT = sizeof(FILTERS) / sizeof(FILTERS[0]);
+
+enum Op : uint8_t { SUBSCRIBE, UNSUBSCRIBE, DISCONNECT };
+
+struct Event {
+  Op op;
+  uint16_t client;
+  uint8_t filter;
+};
+
+// Live subscriptions per client, as the brute-force reference.
+typedef std::map<uint16_t, std::multiset<uint8_t>> Subscriptions;
+
+std::vector<Event> makeTrace(size_t clients, size_t operations, Subscriptions& live) {
+  std::vector<Event> trace;
+  trace.reserve(operations);
+  for (size_t i = 0; i < operations; ++i) {
+    uint16_t client = static_cast<uint16_t>(random(static_cast<long>(clients)));
+    long roll = random(100);
+    std::multiset<uint8_t>& mine = live[client];
+    Event event;
+    event.client = client;
+    if (roll < 55 || mine.empty()) {
+      // Mostly unrelated topics, as on a shared broker
+      event.op = SUBSCRIBE;
+      event.filter = static_cast<uint8_t>(random(100) < 70 ? 5 + random(FILTER_COUNT - 5) : random(5));
+      mine.insert(event.filter);
+    } else if (roll < 90) {
+      event.op = UNSUBSCRIBE;
+      auto it = mine.begin();
+      std::advance(it, random(static_cast<long>(mine.size())));
+      event.filter = *it;
+      mine.erase(it);
+    } else {
+      event.op = DISCONNECT;
+      event.filter = 0;
+      mine.clear();
+    }
+    trace.push_back(event);
+  }
+  return trace;
+}
+
+size_t recount(const Subscriptions& live, MqttTopic topic) {
+  size_t count = 0;
+  for (const auto& entry : live) {
+    for (uint8_t filter : entry.second) {
+      if (PicoMQTT::Subscriber::topic_matches(FILTERS[filter], mqttTopicName(topic))) {
+        ++count;
+        break;
+      }
+    }
+  }
+  return count;
+}
+
+template <typename Broker>
+double replay(Broker& broker, const std::vector<Event>& trace, const std::vector<std::string>& ids) {
+  uint64_t t0 = bench::nowNs();
+  for (const Event& event : trace) {
+    const char* id = ids[event.client].c_str();
+    switch (event.op) {
+      case SUBSCRIBE:
+        broker.simulateSubscribe(id, FILTERS[event.filter]);
+        break;
+      case UNSUBSCRIBE:
+        broker.simulateUnsubscribe(id, FILTERS[event.filter]);
+        break;
+      case DISCONNECT:
+        broker.simulateDisconnect(id);
+        break;
+    }
+  }
+  return static_cast<double>(bench::nowNs() - t0) / static_cast<double>(trace.size());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const size_t clients = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 300;
+  const size_t operations = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 200000;
+
+  randomSeed(42);
+  std::vector<std::string> ids;
+  for (size_t i = 0; i < clients; ++i) {
+    ids.push_back("client-" + std::to_string(i * 7919 % 100003));
+  }
+  Subscriptions live;
+  std::vector<Event> trace = makeTrace(clients, operations, live);
+
+  LegacyTrackingBroker legacy;
+  TrackingMqttBroker indexed;
+  double legacyNs = replay(legacy, trace, ids);
+  double indexedNs = replay(indexed, trace, ids);
+
+  printf("%zu clients, %zu hook calls\n", clients, operations);
+  printf("legacy sensor tracker   %8.1f ns/call\n", legacyNs);
+  printf("per-topic index         %8.1f ns/call (%zu clients tracked)\n", indexedNs, indexed.clientCount());
+
+  bool ok = legacy.sensorSubscriberCount() == indexed.sensorSubscriberCount();
+  for (uint8_t t = 0; t < MQTT_TOPIC_COUNT; ++t) {
+    MqttTopic topic = static_cast<MqttTopic>(t);
+    size_t expected = recount(live, topic);
+    printf("%-12s audience %4zu (recount %4zu)%s\n", mqttTopicName(topic), indexed.subscriberCount(topic), expected,
+           indexed.subscriberCount(topic) == expected ? "" : " MISMATCH");
+    ok = ok && indexed.subscriberCount(topic) == expected;
+  }
+
+  if (!ok) {
+    printf("FAIL: subscriber index disagrees with the live subscriptions\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,121 @@
+// Encodes sample traces with the TsCodec block codec into history-log sized
+// pages and reports bytes per sample against the 9-byte fixed-point record,
+// plus encode/decode throughput. Exits non-zero if any trace fails to
+// round-trip exactly.
+//
+//   pio run -e bench_codec && .pio/build/bench_codec/program [samples]
+
+#include <Arduino.h>
+#include <vector>
+#include "bench_support.h"
+#include "history_log.h"
+#include "sensor.h"
+#include "ts_codec.h"
+
+namespace {
+
+const size_t RAW_RECORD_BYTES = 9;
+
+PrinterStatus statusFor(float temperature) {
+  if (temperature >= 30.0f) return TOO_HOT;
+  if (temperature >= 20.0f) return READY;
+  return NOT_READY;
+}
+
+// Enclosure warm-up as in bench_loop: 14 C to ~33 C, +/-0.15 C noise, BME280
+// humidity, one sample every 2 s with an occasional late tick.
+std::vector<HistoryRecord> warmupTrace(size_t samples) {
+  std::vector<HistoryRecord> trace;
+  uint32_t timestamp = 1760000000;
+  for (size_t i = 0; i < samples; ++i) {
+    float minutes = static_cast<float>(i) * 2.0f / 60.0f;
+    float temperature = 14.0f + 19.0f * (1.0f - expf(-minutes / 7.0f)) + static_cast<float>(random(-15, 16)) / 100.0f;
+    float humidity = 42.0f + 3.0f * sinf(minutes / 10.0f) + static_cast<float>(random(-20, 21)) / 100.0f;
+    timestamp += random(100) == 0 ? 3 : 2;
+    trace.push_back(makeHistoryRecord(timestamp, temperature, humidity, true, statusFor(temperature)));
+  }
+  return trace;
+}
+
+// The firmware's own USE_DEBUG sensor: random-walk temperature and humidity,
+// with humidity present for ten samples and absent for the next ten.
+std::vector<HistoryRecord> debugTrace(size_t samples) {
+  Sensor sensor;
+  sensor.begin();
+  std::vector<HistoryRecord> trace;
+  uint32_t timestamp = 1760000000;
+  for (size_t i = 0; i < samples; ++i) {
+    float temperature = 0.0f;
+    float humidity = 0.0f;
+    sensor.read(temperature, humidity);
+    bool hasHumidity = sensor.reportsHumidity();
+    timestamp += 2;
+    trace.push_back(makeHistoryRecord(timestamp, temperature, humidity, hasHumidity, statusFor(temperature)));
+  }
+  return trace;
+}
+
+bool sameRecord(const HistoryRecord& a, const HistoryRecord& b) {
+  return a.timestamp == b.timestamp && a.temperatureCenti == b.temperatureCenti &&
+         a.humidityCenti == b.humidityCenti && a.status == b.status;
+}
+
+bool run(const char* label, const std::vector<HistoryRecord>& trace) {
+  std::vector<HistoryLog::Page> pages;
+  TsCodec::BlockEncoder encoder;
+
+  uint64_t t0 = bench::nowNs();
+  pages.emplace_back();
+  encoder.reset(pages.back().bytes, HISTORY_LOG_PAGE_SIZE);
+  for (const HistoryRecord& record : trace) {
+    if (!encoder.append(record)) {
+      pages.emplace_back();
+      encoder.reset(pages.back().bytes, HISTORY_LOG_PAGE_SIZE);
+      encoder.append(record);
+    }
+  }
+  uint64_t encodeNs = bench::nowNs() - t0;
+
+  size_t index = 0;
+  bool exact = true;
+  t0 = bench::nowNs();
+  for (const HistoryLog::Page& page : pages) {
+    TsCodec::BlockDecoder decoder;
+    decoder.begin(page.bytes, HISTORY_LOG_PAGE_SIZE);
+    HistoryRecord record;
+    while (decoder.next(record)) {
+      if (index >= trace.size() || !sameRecord(record, trace[index])) {
+        exact = false;
+      }
+      ++index;
+    }
+  }
+  uint64_t decodeNs = bench::nowNs() - t0;
+  exact = exact && index == trace.size();
+
+  double samples = static_cast<double>(trace.size());
+  double flashBytes = static_cast<double>(pages.size() * HISTORY_LOG_PAGE_SIZE);
+  printf("%-8s samples=%-8zu pages=%-6zu %.2f B/sample (raw %zu, %.1fx)  %.0f samples/page\n", label, trace.size(),
+         pages.size(), flashBytes / samples, RAW_RECORD_BYTES, RAW_RECORD_BYTES * samples / flashBytes,
+         samples / static_cast<double>(pages.size()));
+  printf("%-8s encode %.1f Msamples/s, decode %.1f Msamples/s, round trip %s\n", label,
+         samples * 1000.0 / static_cast<double>(encodeNs), samples * 1000.0 / static_cast<double>(decodeNs),
+         exact ? "exact" : "MISMATCH");
+  return exact;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const size_t samples = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 43200;  // one day at 2 s
+
+  randomSeed(42);
+  bool ok = run("warmup", warmupTrace(samples));
+  ok = run("debug", debugTrace(samples)) && ok;
+
+  if (!ok) {
+    printf("FAIL: decoded samples differ from the input\n");
+    return 1;
+  }
+  return 0;
+}
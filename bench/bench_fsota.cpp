@@ -0,0 +1,343 @@
+// Flashes a filesystem image through /update and reboots, then checks what
+// is left of the user's data: settings.json as POSTed to /settings, an
+// unsent email in the outbox and the history log's first segment. Run with
+// no snapshot (the old behaviour), with UserData's NVS snapshot on the
+// default partition table, and with the optional "userdata" partition. Then
+// again with samples and alerts arriving during the upload, as they do on
+// the device: nothing may write to SPIFFS while the image is written, and
+// the alert must still be in the outbox after the reboot. Also fails an
+// update on its hash, with the same traffic, and then saves newer settings
+// (they must not be rolled back, and the log and outbox must write again),
+// and fills NVS so the snapshot cannot be taken (the image must not be
+// written). First checks that HistoryLog::flushNow(), run before every
+// restart, leaves no sample behind. Reports what survived, SPIFFS writes
+// during the upload, the NVS bytes used and the time taken. Exits non-zero
+// if a sample is left unflushed, settings or the outbox are lost with the
+// snapshot, anything is lost with the partition, SPIFFS is written during a
+// snapshotted upload or a failure case goes wrong.
+//
+//   pio run -e bench_fsota && .pio/build/bench_fsota/program
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <Preferences.h>
+#include <SPIFFS.h>
+#include <mbedtls/sha256.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bench_support.h"
+#include "email_outbox.h"
+#include "history_log.h"
+#include "ota_update.h"
+#include "settings.h"
+#include "user_data.h"
+
+namespace {
+
+const size_t IMAGE_BYTES = 192 * 1024;
+const uint32_t SAMPLES_PER_CHUNK = 20;  // ~1436 bytes per chunk; far more samples than the device takes
+const char* const SETTINGS_JSON =
+    "{\"ready_to_print_threshold\":23.5,\"temperature_high_threshold\":34,\"camera_url\":"
+    "\"http://10.0.0.7:8080/?action=stream\",\"email_enabled\":true,\"smtp_host\":\"mail.example.net\","
+    "\"smtp_port\":465,\"email_recipient\":\"me@example.net\"}";
+const char* const SEGMENT_PATH = HISTORY_LOG_DIR "/00000000.seg";
+const char* const KEPT[] = {"/settings.json", EMAIL_OUTBOX_FILE, SEGMENT_PATH};
+const size_t KEPT_COUNT = sizeof(KEPT) / sizeof(KEPT[0]);
+
+typedef std::map<std::string, std::vector<uint8_t>> Files;
+
+// The device: its user data and the two writers that share SPIFFS with it.
+// Each reset() starts a new one; the old ones are left, as their tasks are
+// still parked.
+std::unique_ptr<UserData> device;
+HistoryLog* historyLog = nullptr;
+EmailOutbox* outbox = nullptr;
+uint32_t nextSample = HISTORY_EPOCH_MIN + 86400;
+uint64_t snapshotNs = 0;
+
+// What wifi_setup.h hands OtaUpdate.
+bool prepareDevice() {
+  uint64_t t0 = bench::nowNs();
+  bool ok = device->prepareFilesystemUpdate(*historyLog, *outbox);
+  snapshotNs = bench::nowNs() - t0;
+  return ok;
+}
+
+void resumeDevice() { device->resumeAfterFailedUpdate(*historyLog, *outbox); }
+
+bool neverSends(const char*, const char*) { return false; }
+
+void writeFile(fs::FS& fs, const char* path, const uint8_t* data, size_t len) {
+  File file = fs.open(path, "w");
+  file.write(data, len);
+  file.close();
+}
+
+std::vector<uint8_t> readFile(fs::FS& fs, const char* path) {
+  std::vector<uint8_t> bytes;
+  if (!fs.exists(path)) {
+    return bytes;
+  }
+  File file = fs.open(path, "r");
+  bytes.resize(file.size());
+  file.read(bytes.data(), bytes.size());
+  return bytes;
+}
+
+void appendSamples(uint32_t count) {
+  for (uint32_t i = 0; i < count; ++i) {
+    HistoryRecord record = {nextSample, static_cast<int16_t>(2150 + (nextSample % 7)), 4000, 1};
+    nextSample += 2;
+    historyLog->append(record);
+  }
+}
+
+// Lets the flush task catch up with what was queued.
+void waitForFlush(uint32_t pages) {
+  for (int i = 0; i < 100 && historyLog->pagesWritten() < pages; ++i) {
+    delay(10);
+  }
+}
+
+// What a device that has been running for a while has on flash.
+Files seed() {
+  writeFile(device->fs(), "/settings.json", reinterpret_cast<const uint8_t*>(SETTINGS_JSON), strlen(SETTINGS_JSON));
+  outbox->addStatusChange(TOO_HOT, 31.5f);
+  outbox->service(millis());
+  appendSamples(400);
+  historyLog->flushNow();
+
+  Files files;
+  for (const char* path : KEPT) {
+    files[path] = readFile(device->fs(), path);
+  }
+  return files;
+}
+
+std::string hexHash(const std::vector<uint8_t>& data) {
+  mbedtls_sha256_context sha;
+  uint8_t digest[32];
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  mbedtls_sha256_update(&sha, data.data(), data.size());
+  mbedtls_sha256_finish(&sha, digest);
+  char hex[65];
+  for (int i = 0; i < 32; ++i) {
+    snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+  }
+  return hex;
+}
+
+struct Upload {
+  int status = 0;
+  uint32_t spiffsWrites = 0;  // between the first chunk and the last
+};
+
+// Uploads a filesystem image as the update page does; when busy, samples
+// and an alert arrive between chunks. When the image is committed the
+// device reboots into it: the outbox goes into NVS as serviceOta() does,
+// then everything on SPIFFS is gone and the new assets are there.
+Upload flashFilesystem(OtaUpdate::PrepareFunction prepare, OtaUpdate::ResumeFunction resume, bool busy,
+                       bool corrupt = false) {
+  std::vector<uint8_t> image(IMAGE_BYTES);
+  for (size_t i = 0; i < image.size(); ++i) {
+    image[i] = static_cast<uint8_t>(i >> 5);
+  }
+  std::string hash = hexHash(image);
+  if (corrupt) {
+    image[image.size() / 2] ^= 1;
+  }
+
+  Upload result;
+  uint32_t firstChunkWrites = 0;
+  OtaUpdate ota;
+  ota.begin(prepare, resume);
+  AsyncWebServer server(80);
+  server.on("/update", HTTP_POST, [&](AsyncWebServerRequest* request) { ota.respond(request); },
+            [&](AsyncWebServerRequest* request, const String&, size_t index, uint8_t* data, size_t len, bool final) {
+              if (index == 0) {
+                ota.start(request);
+                firstChunkWrites = SPIFFS.mutations();
+              }
+              if (final) {
+                // Before the last write: a failed update remounts and writes again
+                result.spiffsWrites = SPIFFS.mutations() - firstChunkWrites;
+              }
+              ota.write(request, data, len, final);
+              if (busy && !final) {
+                appendSamples(SAMPLES_PER_CHUNK);
+                if (index == 64 * 1024 / len * len) {
+                  outbox->addStatusChange(READY, 22.5f);
+                }
+                outbox->service(millis());
+                delay(1);  // the flush task gets its turn
+              }
+            });
+  AsyncWebServerRequest request(HTTP_POST, "/update");
+  request.addArg("uploadType", "filesystem");
+  request.addArg("sha256", hash.c_str());
+  request.setContentLength(image.size() + 300);
+  int commitsBefore = Update.commits;
+  server.upload(request, "spiffs.bin", image.data(), image.size());
+  if (Update.commits != commitsBefore) {
+    device->finishFilesystemUpdate(*outbox);
+    SPIFFS.format();
+    SPIFFS.begin();
+    const char page[] = "<html>new dashboard</html>";
+    writeFile(SPIFFS, "/index.html", reinterpret_cast<const uint8_t*>(page), sizeof(page) - 1);
+  }
+  result.status = request.responseCode();
+  return result;
+}
+
+// setup()'s order: user data first, then everything that reads it. Returns
+// the unsent emails the outbox came back with.
+size_t boot(uint64_t* restoreNs = nullptr) {
+  uint64_t t0 = bench::nowNs();
+  device->begin();
+  if (restoreNs) {
+    *restoreNs = bench::nowNs() - t0;
+  }
+  Settings settings;
+  settings.begin(device->fs());
+  EmailOutbox reloaded;
+  reloaded.begin(device->fs(), neverSends, nullptr, false);
+  return reloaded.pending();
+}
+
+size_t nvsBytes() { return hal::nvs().usedBytes(); }
+
+bool snapshotPending() {
+  Preferences nvs;
+  nvs.begin(USER_DATA_NVS_NAMESPACE, true);
+  bool pending = nvs.getUInt("pending", 0) != 0;
+  nvs.end();
+  return pending;
+}
+
+void reset(bool partition) {
+  SPIFFS.format();
+  SPIFFS.begin();
+  hal::nvs().namespaces.clear();
+  hal::system().extraPartitions.clear();
+  if (partition) {
+    hal::system().extraPartitions.insert(USER_DATA_PARTITION);
+  }
+  device.reset(new UserData());
+  device->begin();
+  historyLog = new HistoryLog();
+  historyLog->begin(device->fs());
+  outbox = new EmailOutbox();
+  outbox->begin(device->fs(), neverSends, nullptr, false);
+}
+
+struct Outcome {
+  Upload upload;
+  bool kept[KEPT_COUNT] = {};
+  size_t unsent = 0;
+  size_t nvsBytes = 0;
+  uint64_t restoreNs = 0;
+};
+
+Outcome updateAndReboot(bool partition, bool snapshot, bool busy) {
+  reset(partition);
+  Files before = seed();
+  Outcome outcome;
+  snapshotNs = 0;
+  outcome.upload = flashFilesystem(snapshot ? prepareDevice : nullptr, snapshot ? resumeDevice : nullptr, busy);
+  outcome.nvsBytes = nvsBytes();
+  outcome.unsent = boot(&outcome.restoreNs);
+  for (size_t i = 0; i < KEPT_COUNT; ++i) {
+    std::vector<uint8_t> now = readFile(device->fs(), KEPT[i]);
+    // A busy upload queues an alert and appends to the history segment
+    const std::vector<uint8_t>& then = before[KEPT[i]];
+    bool grown = now.size() >= then.size() && std::equal(then.begin(), then.end(), now.begin());
+    outcome.kept[i] = !now.empty() && (now == then || (busy && (i == 1 || grown)));
+  }
+  return outcome;
+}
+
+void report(const char* name, const Outcome& outcome) {
+  printf("%-36s HTTP %d  SPIFFS writes during upload %3u  settings %-4s unsent emails %zu  history %-4s  NVS %4zu B"
+         "  snapshot %5.1f us  boot restore %5.1f us\n",
+         name, outcome.upload.status, static_cast<unsigned>(outcome.upload.spiffsWrites),
+         outcome.kept[0] ? "kept" : "LOST", outcome.kept[1] ? outcome.unsent : 0, outcome.kept[2] ? "kept" : "LOST",
+         outcome.nvsBytes, snapshotNs / 1000.0, outcome.restoreNs / 1000.0);
+}
+
+}  // namespace
+
+int main() {
+  // What serviceOta() does before any restart: the part-filled page is
+  // written too, so no sample is lost; while paused it returns at once
+  reset(false);
+  appendSamples(130);
+  bool flushed = historyLog->flushNow();
+  uint32_t onFlash = 0;
+  historyLog->forEach(0, UINT32_MAX, [&](const HistoryRecord&) { ++onFlash; });
+  historyLog->pause();
+  bool skippedWhilePaused = !historyLog->flushNow();
+  historyLog->resume();
+  printf("flushNow before a restart: %u of 130 samples on flash, %s while paused\n", static_cast<unsigned>(onFlash),
+         skippedWhilePaused ? "skipped" : "WRITTEN");
+
+  Outcome legacy = updateAndReboot(false, false, false);
+  report("no snapshot (before)", legacy);
+  Outcome snapshot = updateAndReboot(false, true, false);
+  report("NVS snapshot, default partitions", snapshot);
+  Outcome partition = updateAndReboot(true, true, false);
+  report("userdata partition", partition);
+  Outcome legacyBusy = updateAndReboot(false, false, true);
+  report("no snapshot, samples + alert", legacyBusy);
+  Outcome snapshotBusy = updateAndReboot(false, true, true);
+  report("NVS snapshot, samples + alert", snapshotBusy);
+  Outcome partitionBusy = updateAndReboot(true, true, true);
+  report("userdata partition, samples + alert", partitionBusy);
+
+  // A failed update leaves SPIFFS as it was and the log and outbox write
+  // again; settings saved after it are newer than the snapshot and must stay
+  reset(false);
+  seed();
+  uint32_t pagesBefore = historyLog->pagesWritten();
+  Upload failed = flashFilesystem(prepareDevice, resumeDevice, true, true);
+  outbox->service(millis());
+  waitForFlush(pagesBefore + 1);
+  bool writesResumed = historyLog->pagesWritten() > pagesBefore && SPIFFS.exists(EMAIL_OUTBOX_FILE);
+  const char newer[] = "{\"ready_to_print_threshold\":25}";
+  writeFile(SPIFFS, "/settings.json", reinterpret_cast<const uint8_t*>(newer), sizeof(newer) - 1);
+  size_t unsentAfterFailed = boot();
+  std::vector<uint8_t> afterFailed = readFile(SPIFFS, "/settings.json");
+  bool newerKept = afterFailed == std::vector<uint8_t>(newer, newer + sizeof(newer) - 1);
+  bool failedCleared = !snapshotPending() && !SPIFFS.exists(USER_DATA_MARKER);
+  printf("hash mismatch: HTTP %d, SPIFFS writes during upload %u, log and outbox %s, unsent emails %zu, newer "
+         "settings %s, snapshot %s\n",
+         failed.status, static_cast<unsigned>(failed.spiffsWrites), writesResumed ? "resumed" : "STILL PAUSED",
+         unsentAfterFailed, newerKept ? "kept" : "ROLLED BACK", failedCleared ? "dropped" : "STILL PENDING");
+
+  // No room in NVS: the image must not be written at all
+  reset(false);
+  seed();
+  size_t capacity = hal::nvs().capacityBytes;
+  hal::nvs().capacityBytes = 128;
+  int commitsBefore = Update.commits;
+  Upload full = flashFilesystem(prepareDevice, resumeDevice, false);
+  bool refused = full.status == 500 && Update.commits == commitsBefore && SPIFFS.exists("/settings.json");
+  hal::nvs().capacityBytes = capacity;
+  printf("NVS full: HTTP %d, image %s\n", full.status, refused ? "not written" : "WRITTEN");
+
+  bool ok = flushed && onFlash == 130 && skippedWhilePaused && snapshot.upload.status == 200 && snapshot.kept[0] && snapshot.kept[1] && snapshot.unsent == 1 &&
+            partition.upload.status == 200 && partition.kept[0] && partition.kept[1] && partition.kept[2] &&
+            snapshotBusy.upload.status == 200 && snapshotBusy.upload.spiffsWrites == 0 && snapshotBusy.kept[0] &&
+            snapshotBusy.unsent == 2 && partitionBusy.upload.status == 200 &&
+            partitionBusy.upload.spiffsWrites == 0 && partitionBusy.kept[0] && partitionBusy.kept[2] &&
+            partitionBusy.unsent == 2 && failed.status == 400 && failed.spiffsWrites == 0 && writesResumed &&
+            unsentAfterFailed == 2 && newerKept && failedCleared && refused;
+  if (!ok) {
+    printf("FAIL: user data lost or SPIFFS written during a filesystem update, or a failed update handled wrongly\n");
+    return 1;
+  }
+  return 0;
+}
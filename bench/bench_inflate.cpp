@@ -0,0 +1,184 @@
+// Round-trips real binaries through GzipInflater: each image is compressed
+// with the host's gzip -9 (as gzip_images.py does after a build), inflated
+// in 1436-byte chunks as the upload handler receives it, and compared with
+// the original. Also fed 1 and 7 bytes at a time, corrupted and truncated,
+// and uploaded compressed through OtaUpdate. Reports the compression ratio,
+// inflate throughput on this host, decoder memory and the upload time saved
+// on a congested 40 KB/s link. With no arguments it uses its own
+// executable; pass firmware.bin / spiffs.bin to measure those. Exits
+// non-zero if an image does not round-trip, a damaged stream is accepted or
+// the compressed upload does not commit the inflated image.
+//
+//   pio run -e bench_inflate && .pio/build/bench_inflate/program [image.bin ...]
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <mbedtls/sha256.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bench_support.h"
+#include "gzip_inflater.h"
+#include "ota_update.h"
+
+namespace {
+
+const size_t CHUNK_BYTES = 1436;
+const double LINK_BYTES_PER_S = 40 * 1024.0;
+
+std::vector<uint8_t> inflatedBytes;
+
+bool collect(const uint8_t* data, size_t len) {
+  inflatedBytes.insert(inflatedBytes.end(), data, data + len);
+  return true;
+}
+
+bool discard(const uint8_t* data, size_t len) {
+  (void)data;
+  (void)len;
+  return true;
+}
+
+bool readFile(const char* path, std::vector<uint8_t>& out) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    return false;
+  }
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    out.insert(out.end(), buffer, buffer + n);
+  }
+  fclose(file);
+  return true;
+}
+
+bool gzipFile(const char* path, std::vector<uint8_t>& out) {
+  std::string command = std::string("gzip -9 -n -c '") + path + "'";
+  FILE* pipe = popen(command.c_str(), "r");
+  if (!pipe) {
+    return false;
+  }
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+    out.insert(out.end(), buffer, buffer + n);
+  }
+  return pclose(pipe) == 0 && !out.empty();
+}
+
+// Feeds gz in chunks; GZIP_DONE only if the whole stream checked out.
+GzipInflater::Result inflate(const std::vector<uint8_t>& gz, size_t chunk, GzipInflater::OutputFunction output,
+                             std::string* error = nullptr) {
+  std::unique_ptr<GzipInflater> inflater(new GzipInflater());
+  inflater->begin(output);
+  GzipInflater::Result result = GzipInflater::GZIP_MORE;
+  for (size_t i = 0; i < gz.size() && result == GzipInflater::GZIP_MORE; i += chunk) {
+    result = inflater->write(gz.data() + i, std::min(chunk, gz.size() - i));
+  }
+  if (error) {
+    *error = inflater->error();
+  }
+  return result;
+}
+
+std::string hexHash(const std::vector<uint8_t>& data) {
+  mbedtls_sha256_context sha;
+  uint8_t digest[32];
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  mbedtls_sha256_update(&sha, data.data(), data.size());
+  mbedtls_sha256_finish(&sha, digest);
+  char hex[65];
+  for (int i = 0; i < 32; ++i) {
+    snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+  }
+  return hex;
+}
+
+// Uploads gz to /update as the firmware's routes do; returns the bytes
+// committed to flash, 0 if nothing was.
+size_t upload(const std::vector<uint8_t>& gz) {
+  OtaUpdate ota;
+  ota.begin();
+  AsyncWebServer server(80);
+  server.on("/update", HTTP_POST, [&](AsyncWebServerRequest* request) { ota.respond(request); },
+            [&](AsyncWebServerRequest* request, const String&, size_t index, uint8_t* data, size_t len, bool final) {
+              if (index == 0) {
+                ota.start(request);
+              }
+              ota.write(request, data, len, final);
+            });
+  AsyncWebServerRequest request(HTTP_POST, "/update");
+  request.addArg("uploadType", "firmware");
+  request.addArg("sha256", hexHash(gz).c_str());
+  request.setContentLength(gz.size() + 300);
+  int commitsBefore = Update.commits;
+  server.upload(request, "firmware.bin.gz", gz.data(), gz.size(), CHUNK_BYTES);
+  return request.responseCode() == 200 && Update.commits == commitsBefore + 1 ? Update.committedBytes : 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<const char*> paths;
+  for (int i = 1; i < argc; ++i) {
+    paths.push_back(argv[i]);
+  }
+  if (paths.empty()) {
+    paths.push_back(argv[0]);
+  }
+
+  printf("decoder memory: %zu B window + %zu B state, input in %zu B chunks\n", static_cast<size_t>(GZIP_WINDOW_SIZE),
+         sizeof(GzipInflater), CHUNK_BYTES);
+  bool ok = true;
+  for (const char* path : paths) {
+    std::vector<uint8_t> raw, gz;
+    if (!readFile(path, raw) || !gzipFile(path, gz)) {
+      printf("%s: cannot read or gzip\n", path);
+      ok = false;
+      continue;
+    }
+
+    inflatedBytes.clear();
+    bool roundTrip = inflate(gz, CHUNK_BYTES, collect) == GzipInflater::GZIP_DONE && inflatedBytes == raw;
+    bool tinyChunks = true;
+    for (size_t chunk : {static_cast<size_t>(1), static_cast<size_t>(7)}) {
+      inflatedBytes.clear();
+      tinyChunks = tinyChunks && inflate(gz, chunk, collect) == GzipInflater::GZIP_DONE && inflatedBytes == raw;
+    }
+
+    // Best of five, output discarded
+    uint64_t bestNs = UINT64_MAX;
+    for (int run = 0; run < 5; ++run) {
+      uint64_t t0 = bench::nowNs();
+      inflate(gz, CHUNK_BYTES, discard);
+      bestNs = std::min(bestNs, bench::nowNs() - t0);
+    }
+
+    std::vector<uint8_t> corrupt = gz;
+    corrupt[corrupt.size() / 2] ^= 0x10;
+    std::string corruptError;
+    bool corruptRejected = inflate(corrupt, CHUNK_BYTES, discard, &corruptError) == GzipInflater::GZIP_ERROR;
+    std::vector<uint8_t> truncated(gz.begin(), gz.end() - 5);
+    bool truncatedHeld = inflate(truncated, CHUNK_BYTES, discard) == GzipInflater::GZIP_MORE;
+
+    size_t committed = upload(gz);
+
+    printf("%s\n", path);
+    printf("  %zu -> %zu bytes (%.1f%%), inflate %.1f MB/s, round trip %s, 1/7-byte chunks %s\n", raw.size(),
+           gz.size(), 100.0 * gz.size() / raw.size(), raw.size() * 1000.0 / bestNs, roundTrip ? "ok" : "FAILED",
+           tinyChunks ? "ok" : "FAILED");
+    printf("  corrupted: %s (%s), truncated: %s\n", corruptRejected ? "rejected" : "ACCEPTED", corruptError.c_str(),
+           truncatedHeld ? "incomplete" : "WRONG");
+    printf("  upload through OtaUpdate: %zu bytes committed; at 40 KB/s %.1f s instead of %.1f s\n", committed,
+           gz.size() / LINK_BYTES_PER_S, raw.size() / LINK_BYTES_PER_S);
+    ok = ok && roundTrip && tinyChunks && corruptRejected && truncatedHeld && committed == raw.size();
+  }
+
+  if (!ok) {
+    printf("FAIL: an image did not round-trip, a damaged stream was accepted or the upload did not commit\n");
+    return 1;
+  }
+  return 0;
+}
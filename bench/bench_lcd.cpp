@@ -0,0 +1,254 @@
+// Drives the pre-framebuffer LCDDisplay and the diff-flushing one through the
+// same hour of updates (clock every second, BME280 warm-up readings every
+// 2 s, status changes, a sensor error and an upload message) and reports I2C
+// bytes per update of each kind, and any screens where the two show
+// different text (other than characters the old code left behind). The
+// framebuffer's own checks are the Unity tests in test/test_lcd_framebuffer.
+//
+//   pio run -e bench_lcd && .pio/build/bench_lcd/program [virtual-seconds]
+
+#include <Arduino.h>
+#include <LiquidCrystal_I2C.h>
+#include <map>
+#include <string>
+#include "bench_support.h"
+#include "lcd_display.h"
+
+namespace {
+
+// The LCDDisplay the firmware used before the shadow frame, kept verbatim
+// (less the constructor comments) as the reference.
+class LegacyLCDDisplay {
+public:
+  LegacyLCDDisplay(uint8_t address = 0x27) : lcd(address, 20, 4),
+    lastTemp(-999.0), lastHumidity(-999.0), ipDisplayed(false) {}
+
+  bool begin(const char* version = "") {
+    lcd.init();
+    lcd.backlight();
+    lcd.setCursor(0, 0);
+    lcd.print("Temperature Monitor");
+    lcd.setCursor(0, 1);
+    lcd.print("Initializing...");
+    if (version && version[0] != '\0') {
+      lcd.setCursor(0, 2);
+      lcd.print("Version: ");
+      lcd.print(version);
+    }
+    delay(2000);
+    lcd.clear();
+    return true;
+  }
+
+  void displayIPAddress(const char* ipAddress) {
+    if (!ipDisplayed) {
+      lcd.setCursor(0, 2);
+      lcd.print("                    ");
+      lcd.setCursor(0, 2);
+      if (ipAddress && ipAddress[0] != '\0') {
+        lcd.print("IP: ");
+        lcd.print(ipAddress);
+      } else {
+        lcd.print("IP: Connecting...");
+      }
+      ipDisplayed = true;
+    }
+  }
+
+  void updateStatus(const char* status) {
+    lcd.setCursor(0, 2);
+    lcd.print("                    ");
+    lcd.setCursor(0, 2);
+    lcd.print("Status: ");
+    lcd.print(status);
+  }
+
+  void updateTemperature(float temperature) {
+    if (fabsf(temperature - lastTemp) >= 0.1) {
+      lastTemp = temperature;
+      lcd.setCursor(0, 0);
+      lcd.print("Temp: ");
+      lcd.print(temperature, 1);
+      lcd.print("C  ");
+    }
+  }
+
+  void updateHumidity(float humidity, bool isBME280) {
+    if (!isBME280) {
+      return;
+    }
+    if (fabsf(humidity - lastHumidity) >= 1.0) {
+      lastHumidity = humidity;
+      lcd.setCursor(0, 1);
+      lcd.print("Humidity: ");
+      lcd.print(humidity, 1);
+      lcd.print("%   ");
+    }
+  }
+
+  void updateTime() {
+    lcd.setCursor(0, 3);
+    unsigned long totalSeconds = millis() / 1000;
+    unsigned long hours = totalSeconds / 3600;
+    unsigned long minutes = (totalSeconds % 3600) / 60;
+    unsigned long secs = totalSeconds % 60;
+    lcd.print("Time: ");
+    if (hours < 10) lcd.print("0");
+    lcd.print(hours);
+    lcd.print(":");
+    if (minutes < 10) lcd.print("0");
+    lcd.print(minutes);
+    lcd.print(":");
+    if (secs < 10) lcd.print("0");
+    lcd.print(secs);
+    lcd.print(" ");
+  }
+
+  void displayError(const char* errorMsg) {
+    lcd.clear();
+    lcd.setCursor(0, 0);
+    lcd.print("ERROR");
+    lcd.setCursor(0, 1);
+    lcd.print(errorMsg);
+    lcd.setCursor(0, 3);
+    lcd.print("Check connections");
+  }
+
+  void displayUploadMessage(const char* message) {
+    lcd.clear();
+    lcd.setCursor(0, 0);
+    lcd.print(message);
+    lcd.setCursor(0, 2);
+    lcd.print("Please wait...");
+  }
+
+private:
+  LiquidCrystal_I2C lcd;
+  float lastTemp;
+  float lastHumidity;
+  bool ipDisplayed;
+};
+
+struct Totals {
+  uint64_t calls = 0;
+  uint64_t legacyBytes = 0;
+  uint64_t framedBytes = 0;
+};
+
+std::map<std::string, Totals> totals;
+LiquidCrystal_I2C* legacyGlass = nullptr;
+LiquidCrystal_I2C* framedGlass = nullptr;
+LCDDisplay* framedDisplay = nullptr;
+uint32_t mismatches = 0;
+uint32_t staleRows = 0;
+
+std::string trimmedRow(const LiquidCrystal_I2C* glass, uint8_t row) {
+  char text[LCD_COLS + 1];
+  std::string line = glass->rowText(row, text);
+  line.erase(line.find_last_not_of(' ') + 1);
+  return line;
+}
+
+// Runs one update on both displays (flushing the framebuffer one, as the
+// display task does after each render), charging each its I2C bytes, then
+// checks that the two screens read the same (trailing blanks aside).
+template <typename LegacyFn, typename FramedFn>
+void step(const char* kind, LegacyFn legacy, FramedFn framed) {
+  uint64_t before = hal::i2c().bytes.load();
+  legacy();
+  uint64_t middle = hal::i2c().bytes.load();
+  framed();
+  framedDisplay->flush();
+  uint64_t after = hal::i2c().bytes.load();
+
+  Totals& t = totals[kind];
+  t.calls++;
+  t.legacyBytes += middle - before;
+  t.framedBytes += after - middle;
+
+  for (uint8_t row = 0; row < LCD_ROWS; ++row) {
+    std::string expected = trimmedRow(legacyGlass, row);
+    std::string actual = trimmedRow(framedGlass, row);
+    if (expected == actual) {
+      continue;
+    }
+    // The old code never cleared past what it printed, so after the error
+    // screen the clock row reads "Time: 00:30:04 ns". Count that separately.
+    if (expected.compare(0, actual.size() + 1, actual + " ") == 0) {
+      staleRows++;
+    } else {
+      if (mismatches++ < 5) {
+        printf("mismatch after %s, row %u: legacy '%s', framebuffer '%s'\n", kind, row, expected.c_str(),
+               actual.c_str());
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const uint32_t seconds = argc > 1 ? static_cast<uint32_t>(atol(argv[1])) : 3600;
+
+  LegacyLCDDisplay legacy;
+  LCDDisplay framed;
+  legacyGlass = LiquidCrystal_I2C::instances()[0];
+  framedGlass = LiquidCrystal_I2C::instances()[1];
+  framedDisplay = &framed;
+
+  step("begin", [&] { legacy.begin("1.1.96"); }, [&] {
+    framed.begin("1.1.96");
+    framed.clear();
+  });
+  step("ip", [&] { legacy.displayIPAddress("192.168.0.42"); }, [&] { framed.displayIPAddress("192.168.0.42"); });
+
+  const char* statuses[] = {"NOT READY", "READY", "TOO HOT"};
+  uint32_t start = millis();
+  for (uint32_t s = 1; s <= seconds; ++s) {
+    // Mid-second, so both displays see the same clock whatever the I2C cost
+    uint32_t target = start + s * 1000 + 500;
+    delay(target - millis());
+
+    if (s % 2 == 0) {
+      float minutes = static_cast<float>(s) / 60.0f;
+      float temperature = 14.0f + 19.0f * (1.0f - expf(-minutes / 7.0f)) + static_cast<float>(random(-15, 16)) / 100.0f;
+      float humidity = 42.0f + 3.0f * sinf(minutes / 10.0f) + static_cast<float>(random(-20, 21)) / 100.0f;
+      step("temperature", [&] { legacy.updateTemperature(temperature); },
+           [&] { framed.updateTemperature(temperature); });
+      step("humidity", [&] { legacy.updateHumidity(humidity, true); }, [&] { framed.updateHumidity(humidity, true); });
+    }
+    if (s % 600 == 300) {
+      const char* status = statuses[(s / 600) % 3];
+      step("status", [&] { legacy.updateStatus(status); }, [&] { framed.updateStatus(status); });
+    }
+    if (s == seconds / 2) {
+      step("error", [&] { legacy.displayError("Sensor Error"); }, [&] { framed.displayError("Sensor Error"); });
+    }
+    if (s == seconds - 10) {
+      step("upload", [&] { legacy.displayUploadMessage("Uploading firmware"); },
+           [&] { framed.displayUploadMessage("Uploading firmware"); });
+    }
+    step("time", [&] { legacy.updateTime(); }, [&] { framed.updateTime(); });
+  }
+
+  uint64_t legacyTotal = 0;
+  uint64_t framedTotal = 0;
+  printf("%-12s %8s %16s %16s %8s\n", "update", "calls", "legacy B/call", "framebuf B/call", "saved");
+  for (const auto& entry : totals) {
+    const Totals& t = entry.second;
+    legacyTotal += t.legacyBytes;
+    framedTotal += t.framedBytes;
+    double legacyAvg = static_cast<double>(t.legacyBytes) / static_cast<double>(t.calls);
+    double framedAvg = static_cast<double>(t.framedBytes) / static_cast<double>(t.calls);
+    printf("%-12s %8llu %16.1f %16.1f %7.0f%%\n", entry.first.c_str(), static_cast<unsigned long long>(t.calls),
+           legacyAvg, framedAvg, legacyAvg > 0 ? 100.0 * (1.0 - framedAvg / legacyAvg) : 0.0);
+  }
+  // 9 bit times per byte plus start/stop at 100 kHz, as in hal::I2CStats
+  printf("total I2C bytes: legacy %llu, framebuffer %llu (%.1f s vs %.1f s of bus time)\n",
+         static_cast<unsigned long long>(legacyTotal), static_cast<unsigned long long>(framedTotal),
+         static_cast<double>(legacyTotal) * 9e-5, static_cast<double>(framedTotal) * 9e-5);
+
+  printf("rows where the legacy display kept stale characters: %u\n", staleRows);
+  printf("screen mismatches: %u\n", mismatches);
+  return 0;
+}
@@ -0,0 +1,112 @@
+// Drives the firmware's setup()/loop() from src/main.cpp on the host at full
+// speed and reports per-iteration CPU time (time blocked waiting for the
+// next job or sample excluded) and heap traffic, separating idle
+// iterations from the ones that ran the sample -> serialize -> threshold ->
+// publish path. With no SSE clients and no MQTT subscribers it shows what an
+// unwatched device spends per sample.
+//
+//   pio run -e native && .pio/build/native/program [virtual-seconds] [sse-clients] [mqtt-clients]
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <LiquidCrystal_I2C.h>
+#include <PicoMQTT.h>
+#include "bench_support.h"
+#include "sink_registry.h"
+
+void setup();
+void loop();
+extern SinkRegistry sampleSinks;
+
+namespace {
+
+// Enclosure warm-up: heater brings the chamber from 14 C to ~33 C over
+// twenty minutes, with +/-0.15 C sensor noise.
+float warmupTemperature(uint32_t ms) {
+  float minutes = static_cast<float>(ms) / 60000.0f;
+  float base = 14.0f + 19.0f * (1.0f - expf(-minutes / 7.0f));
+  return base + static_cast<float>(random(-15, 16)) / 100.0f;
+}
+
+float steadyHumidity(uint32_t ms) {
+  return 42.0f + 3.0f * sinf(static_cast<float>(ms) / 600000.0f) + static_cast<float>(random(-20, 21)) / 100.0f;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const uint32_t virtualSeconds = argc > 1 ? static_cast<uint32_t>(atol(argv[1])) : 3600;
+  const size_t sseClients = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 1;
+  const size_t mqttClients = argc > 3 ? static_cast<size_t>(atol(argv[3])) : 1;
+
+  randomSeed(42);
+  hal::sensorModel().kind = hal::SensorModel::BME280;
+  hal::sensorModel().temperature = warmupTemperature;
+  hal::sensorModel().humidity = steadyHumidity;
+
+  setup();
+  for (AsyncEventSource* source : AsyncEventSource::instances()) {
+    source->setClientCount(sseClients);
+  }
+  // MQTT clients watching everything, so the broker has an audience
+  for (PicoMQTT::Server* broker : PicoMQTT::Server::instances()) {
+    for (size_t i = 0; i < mqttClients; ++i) {
+      broker->simulateSubscribe(("bench-client-" + std::to_string(i)).c_str(), "mqtt/#");
+    }
+  }
+
+  bench::Series idleLatency;
+  bench::Series publishLatency;
+  bench::Series publishAllocs;
+  bench::Series publishAllocBytes;
+  bench::Series publishSerialBytes;
+  bench::Series publishI2cBytes;
+  uint64_t iterations = 0;
+
+  const uint32_t start = millis();
+  const uint32_t endMs = start + virtualSeconds * 1000UL;
+  while (millis() < endMs) {
+    uint32_t renderedBefore = sampleSinks.rendered();
+    uint64_t serialBefore = hal::serial().bytes;
+    uint64_t i2cBefore = hal::i2c().bytes;
+    bench::AllocCounter allocBefore = bench::allocs();
+    uint64_t t0 = bench::threadCpuNs();
+
+    loop();
+
+    double elapsedUs = static_cast<double>(bench::threadCpuNs() - t0) / 1000.0;
+    uint64_t allocations = bench::allocs().allocations - allocBefore.allocations;
+    uint64_t allocatedBytes = bench::allocs().bytes - allocBefore.bytes;
+    ++iterations;
+    if (sampleSinks.rendered() != renderedBefore) {
+      publishLatency.add(elapsedUs);
+      publishAllocs.add(static_cast<double>(allocations));
+      publishAllocBytes.add(static_cast<double>(allocatedBytes));
+      publishSerialBytes.add(static_cast<double>(hal::serial().bytes - serialBefore));
+      publishI2cBytes.add(static_cast<double>(hal::i2c().bytes - i2cBefore));
+    } else {
+      idleLatency.add(elapsedUs);
+    }
+  }
+
+  printf("virtual time: %u s, loop iterations: %llu, sse clients: %zu, mqtt clients: %zu\n", virtualSeconds,
+         static_cast<unsigned long long>(iterations), sseClients, mqttClients);
+  idleLatency.print("idle iteration cpu time", "us");
+  publishLatency.print("publish iteration cpu time", "us");
+  publishAllocs.print("allocations / publish", "allocs");
+  publishAllocBytes.print("heap bytes / publish", "bytes");
+  publishSerialBytes.print("serial bytes / publish", "bytes");
+  publishI2cBytes.print("i2c bytes / publish", "bytes");
+  printf("mqtt: %llu msgs %llu bytes, sse: %llu msgs %llu bytes\n",
+         static_cast<unsigned long long>(hal::publishes().mqttMessages.load()),
+         static_cast<unsigned long long>(hal::publishes().mqttBytes.load()),
+         static_cast<unsigned long long>(hal::publishes().sseMessages.load()),
+         static_cast<unsigned long long>(hal::publishes().sseBytes.load()));
+  printf("samples rendered: %u, not rendered: %u (%u with no audience), avg render+send %u us, ~%llu us saved\n",
+         sampleSinks.rendered(), sampleSinks.skipped(), sampleSinks.unwatched(), sampleSinks.averageRenderUs(),
+         static_cast<unsigned long long>(sampleSinks.savedUs()));
+  printf("uart time at 115200 baud: %.1f ms per publish\n", publishSerialBytes.mean() * 10.0 / 115.2);
+  printf("i2c bus time: %.1f ms total, lcd clears: %llu\n", hal::i2c().busTimeUs / 1000.0,
+         static_cast<unsigned long long>(hal::lcd().clears.load()));
+  return 0;
+}
@@ -0,0 +1,240 @@
+// A 1.2 MB firmware image uploaded in 1436-byte chunks four ways: intact,
+// with one byte corrupted in transit, with flash writes failing half way,
+// and with the connection dropping at 40% followed by a clean retry. Sent
+// once through the old /update handlers (static upload state, delay(3000)
+// and ESP.restart() inside the upload handler) and once through OtaUpdate
+// wired as in WifiSetup, with its main-loop service run every 250 ms.
+// Reports per case what was committed, the HTTP answer, whether the device
+// rebooted and from where, and the ms the upload handler blocked the
+// async_tcp task. Exits non-zero if OtaUpdate commits a bad image, reboots
+// inside a handler or before answering, or does not recover for the retry.
+//
+//   pio run -e bench_ota && .pio/build/bench_ota/program
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <mbedtls/sha256.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bench_support.h"
+#include "ota_update.h"
+
+namespace {
+
+const size_t IMAGE_BYTES = 1200 * 1024;
+const size_t CHUNK_BYTES = 1436;
+
+// The old handlers, state and all
+namespace legacy {
+void handlePostUpdate(AsyncWebServerRequest* request) {
+  String response = (Update.hasError()) ? "Update Failed" : "Update Successful. Rebooting...";
+  request->send(200, "text/plain", response);
+  delay(3000);
+  ESP.restart();
+}
+
+void handlePostUpload(AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data, size_t len,
+                      bool final) {
+  (void)filename;
+  static uint32_t updateSize = 0;
+  if (index == 0) {
+    updateSize = 0;
+    if (!Update.begin(UPDATE_SIZE_UNKNOWN, U_FLASH)) {
+      request->send(500, "text/plain", "OTA begin failed");
+      return;
+    }
+  }
+  if (!Update.hasError()) {
+    if (Update.write(data, len) != len) {
+      Update.printError(Serial);
+    }
+    updateSize += len;
+  }
+  if (final) {
+    if (Update.end(true)) {
+      delay(3000);
+      ESP.restart();
+    } else {
+      request->send(500, "text/plain", "OTA end failed");
+    }
+  }
+}
+}  // namespace legacy
+
+std::unique_ptr<OtaUpdate> ota;
+uint32_t progressEvents = 0;
+bool rebootedInHandler = false;
+uint32_t handlerMs = 0;
+
+void serviceOta() {
+  char progress[OTA_PROGRESS_MAX_LENGTH];
+  OtaState state;
+  if (ota->takeProgress(progress, sizeof(progress), state) > 0) {
+    progressEvents++;
+  }
+  if (ota->rebootDue(millis())) {
+    ESP.restart();
+  }
+}
+
+struct Case {
+  const char* name;
+  bool corrupt;
+  size_t failAt;  // flash write failure offset
+  size_t dropAt;  // connection drop offset
+};
+
+struct Outcome {
+  int commits = 0;
+  size_t committedBytes = 0;
+  int code = 0;
+  bool answeredBeforeReboot = false;
+  bool rebooted = false;
+  bool rebootedInHandler = false;
+  uint32_t handlerMs = 0;
+  bool retryCommitted = true;  // the retry after a drop committed exactly the image
+};
+
+std::string hexHash(const std::vector<uint8_t>& image) {
+  mbedtls_sha256_context sha;
+  uint8_t digest[32];
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  mbedtls_sha256_update(&sha, image.data(), image.size());
+  mbedtls_sha256_finish(&sha, digest);
+  char hex[65];
+  for (int i = 0; i < 32; ++i) {
+    snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+  }
+  return hex;
+}
+
+// One POST /update; the upload handler is timed and the device's restart
+// flag checked after every chunk.
+template <typename Server>
+Outcome post(Server& server, const std::vector<uint8_t>& image, const std::string& hash, const Case& c,
+             bool serviceLoop) {
+  Outcome out;
+  std::vector<uint8_t> sent = image;
+  if (c.corrupt) {
+    sent[sent.size() / 3] ^= 0x40;
+  }
+  Update.failAt = c.failAt;
+  int commitsBefore = Update.commits;
+  hal::system().restartRequested = false;
+  rebootedInHandler = false;
+  handlerMs = 0;
+
+  AsyncWebServerRequest request(HTTP_POST, "/update");
+  request.addArg("uploadType", "firmware");
+  request.addArg("sha256", hash.c_str());
+  request.setContentLength(sent.size() + 300);
+  server.upload(request, "firmware.bin", sent.data(), sent.size(), CHUNK_BYTES, c.dropAt);
+  out.code = request.responseCode();
+  out.answeredBeforeReboot = out.code != 0 && !rebootedInHandler;
+  out.rebootedInHandler = rebootedInHandler;
+  out.handlerMs = handlerMs;
+
+  // The client reads the answer and closes; the main loop runs on
+  if (out.code != 0) {
+    request.disconnect();
+  }
+  for (int tick = 0; serviceLoop && tick < 20 && !hal::system().restartRequested; ++tick) {
+    delay(250);
+    serviceOta();
+  }
+  out.rebooted = hal::system().restartRequested;
+  if (out.rebooted && serviceLoop) {
+    // Comes back up with nothing in progress
+    ota.reset(new OtaUpdate());
+    ota->begin();
+  }
+  out.commits = Update.commits - commitsBefore;
+  out.committedBytes = out.commits > 0 ? Update.committedBytes : 0;
+  Update.failAt = SIZE_MAX;
+  return out;
+}
+
+// Wraps a handler pair so time spent inside and restarts from inside are seen
+template <typename Request, typename Upload>
+void route(AsyncWebServer& server, Request onRequest, Upload onUpload) {
+  server.on("/update", HTTP_POST,
+            [onRequest](AsyncWebServerRequest* request) {
+              uint32_t t0 = millis();
+              onRequest(request);
+              handlerMs += millis() - t0;
+              rebootedInHandler = rebootedInHandler || hal::system().restartRequested;
+            },
+            [onUpload](AsyncWebServerRequest* request, const String& filename, size_t index, uint8_t* data,
+                       size_t len, bool final) {
+              uint32_t t0 = millis();
+              onUpload(request, filename, index, data, len, final);
+              handlerMs += millis() - t0;
+              rebootedInHandler = rebootedInHandler || hal::system().restartRequested;
+            });
+}
+
+void print(const char* who, const Case& c, const Outcome& o) {
+  printf("%-7s %-22s committed %7zu B  answer %3d  reboot %-10s  handler %4u ms%s\n", who, c.name,
+         o.committedBytes, o.code,
+         !o.rebooted ? "no" : o.rebootedInHandler ? "in handler" : "from loop", o.handlerMs,
+         c.dropAt != SIZE_MAX ? (o.retryCommitted ? ", retry committed intact" : ", retry committed corrupt") : "");
+}
+
+}  // namespace
+
+int main() {
+  std::vector<uint8_t> image(IMAGE_BYTES);
+  for (size_t i = 0; i < image.size(); ++i) {
+    image[i] = static_cast<uint8_t>((i * 2654435761u) >> 13);
+  }
+  std::string hash = hexHash(image);
+  const Case cases[] = {
+      {"intact", false, SIZE_MAX, SIZE_MAX},
+      {"corrupted in transit", true, SIZE_MAX, SIZE_MAX},
+      {"flash write fails", false, IMAGE_BYTES / 2, SIZE_MAX},
+      {"drop at 40%, retry", false, SIZE_MAX, IMAGE_BYTES * 2 / 5},
+  };
+
+  AsyncWebServer oldServer(80);
+  route(oldServer, legacy::handlePostUpdate, legacy::handlePostUpload);
+  AsyncWebServer newServer(80);
+  ota.reset(new OtaUpdate());
+  ota->begin();
+  route(newServer, [](AsyncWebServerRequest* request) { ota->respond(request); },
+        [](AsyncWebServerRequest* request, const String&, size_t index, uint8_t* data, size_t len, bool final) {
+          if (index == 0) {
+            ota->start(request);
+          }
+          ota->write(request, data, len, final);
+        });
+
+  bool ok = true;
+  for (const Case& c : cases) {
+    Outcome before = post(oldServer, image, hash, c, false);
+    if (c.dropAt != SIZE_MAX) {
+      before.retryCommitted = post(oldServer, image, hash, cases[0], false).committedBytes == image.size();
+    }
+    print("legacy", c, before);
+
+    uint32_t failuresBefore = ota->failures();
+    Outcome after = post(newServer, image, hash, c, true);
+    if (c.dropAt != SIZE_MAX) {
+      after.retryCommitted =
+          ota->failures() == failuresBefore + 1 && post(newServer, image, hash, cases[0], true).committedBytes == image.size();
+    }
+    print("ota", c, after);
+
+    bool good = !c.corrupt && c.failAt == SIZE_MAX && c.dropAt == SIZE_MAX;
+    ok = ok && after.committedBytes == (good ? image.size() : 0) && !after.rebootedInHandler && after.rebooted == good &&
+         after.retryCommitted && (c.dropAt != SIZE_MAX || after.answeredBeforeReboot);
+  }
+  printf("%u progress events\n", progressEvents);
+
+  if (!ok) {
+    printf("FAIL: a bad image was committed, the reboot came from a handler or before the answer, or no recovery\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,176 @@
+// Three hours of status emails: a burst of four status changes every 20
+// minutes and a periodic report every 15, with the SMTP server unreachable
+// from minute 60 to 95 and a reboot at minute 81. Fed once through the old
+// 6-slot queue (one SMTP session per request, dropped when the queue is
+// full, the send fails or the device reboots) and once through EmailOutbox
+// over the host SPIFFS. Reports SMTP sessions, what reached the server and
+// what was lost. Exits non-zero if the outbox loses the newest entry of any
+// kind or uses more sessions than the queue.
+//
+//   pio run -e bench_outbox && .pio/build/bench_outbox/program [virtual-minutes]
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <string>
+#include <vector>
+#include "bench_support.h"
+#include "email_outbox.h"
+
+namespace {
+
+const uint32_t SESSION_MS = 4000;           // connect, TLS, auth and send
+const uint32_t CONNECT_TIMEOUT_MS = 30000;  // what a send costs while the server is unreachable
+const uint32_t OUTAGE_FROM_S = 60 * 60;
+const uint32_t OUTAGE_TO_S = 95 * 60;
+const uint32_t REBOOT_AT_S = 81 * 60;
+const uint32_t LEGACY_QUEUE_DEPTH = 6;
+
+struct Queued {
+  std::string status;
+  float temperature;
+};
+
+// What the simulated server accepted, newest last
+struct Server {
+  uint32_t sessions = 0;
+  uint32_t accepted = 0;
+  std::vector<Queued> delivered;
+};
+
+Server outboxServer;
+uint32_t startMs = 0;
+
+bool reachable() {
+  uint32_t s = (millis() - startMs) / 1000;
+  return s < OUTAGE_FROM_S || s >= OUTAGE_TO_S;
+}
+
+// Reads "Status: X\nTemperature: T C" out of every block of a digest.
+bool acceptDigest(const char* subject, const char* body) {
+  (void)subject;
+  outboxServer.sessions++;
+  if (!reachable()) {
+    return false;
+  }
+  outboxServer.accepted++;
+  for (const char* p = strstr(body, "Status: "); p; p = strstr(p + 1, "Status: ")) {
+    char status[16] = {};
+    float temperature = 0.0f;
+    if (sscanf(p, "Status: %15[^\n]\nTemperature: %f C", status, &temperature) == 2) {
+      outboxServer.delivered.push_back({status, temperature});
+    }
+  }
+  return true;
+}
+
+// One status burst every 20 minutes (the hysteresis rarely makes it this
+// bad, but a thermostat near a threshold can), a report every 15.
+template <typename StatusChange, typename Report>
+void emit(uint32_t s, StatusChange statusChange, Report report) {
+  static const PrinterStatus BURST[] = {READY, TOO_HOT, READY, TOO_HOT};
+  uint32_t inCycle = s % (20 * 60);
+  if (s >= 60 && inCycle % 10 == 0 && inCycle / 10 < 4) {
+    statusChange(BURST[inCycle / 10], 30.0f + static_cast<float>(s % 997) / 100.0f);
+  }
+  if (s > 0 && s % (15 * 60) == 0) {
+    report("READY", 28.0f + static_cast<float>(s % 503) / 100.0f);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const uint32_t minutes = argc > 1 ? static_cast<uint32_t>(atol(argv[1])) : 180;
+  const uint32_t seconds = minutes * 60;
+
+  // The old path: xQueueSend with zero timeout into 6 slots, drained by a
+  // task that holds one request for a whole SMTP session
+  uint32_t legacySessions = 0, legacyAccepted = 0, legacyQueueFull = 0, legacyFailed = 0, legacyRebootLost = 0;
+  uint32_t requests = 0;
+  std::vector<Queued> legacyQueue;
+  uint32_t busyUntil = 0;
+  startMs = millis();
+  for (uint32_t s = 0; s < seconds; ++s) {
+    if (s == REBOOT_AT_S) {
+      legacyRebootLost += static_cast<uint32_t>(legacyQueue.size());
+      legacyQueue.clear();
+    }
+    auto enqueue = [&](const char* status, float temperature) {
+      requests++;
+      if (legacyQueue.size() == LEGACY_QUEUE_DEPTH) {
+        legacyQueueFull++;
+      } else {
+        legacyQueue.push_back({status, temperature});
+      }
+    };
+    emit(s, [&](PrinterStatus status, float t) { enqueue(printerStatusName(status), t); }, enqueue);
+    if (millis() >= busyUntil && !legacyQueue.empty()) {
+      legacyQueue.erase(legacyQueue.begin());
+      legacySessions++;
+      (reachable() ? legacyAccepted : legacyFailed)++;
+      busyUntil = millis() + (reachable() ? SESSION_MS : CONNECT_TIMEOUT_MS);
+    }
+    delay(1000);
+  }
+
+  // The outbox, serviced once a second as its task would be at the latest,
+  // and started again over the same flash at the reboot
+  uint32_t flashBefore = static_cast<uint32_t>(hal::flash().bytesWritten.load());
+  Queued lastStatus[PRINTER_STATUS_COUNT] = {};
+  Queued lastReport = {};
+  uint32_t outboxSuperseded = 0;
+  std::unique_ptr<EmailOutbox> outbox(new EmailOutbox());
+  outbox->begin(SPIFFS, acceptDigest, nullptr, false);
+  startMs = millis();
+  for (uint32_t s = 0; s < seconds + 3600; ++s) {
+    if (s == REBOOT_AT_S) {
+      outboxSuperseded += outbox->superseded();
+      outbox.reset(new EmailOutbox());
+      outbox->begin(SPIFFS, acceptDigest, nullptr, false);
+    }
+    if (s < seconds) {
+      emit(s,
+           [&](PrinterStatus status, float t) {
+             outbox->addStatusChange(status, t);
+             lastStatus[status] = {printerStatusName(status), t};
+           },
+           [&](const char* status, float t) {
+             outbox->addReport(status, t);
+             lastReport = {status, t};
+           });
+    }
+    outbox->service(millis());
+    delay(1000);
+  }
+  outboxSuperseded += outbox->superseded();
+  uint32_t flashBytes = static_cast<uint32_t>(hal::flash().bytesWritten.load()) - flashBefore;
+
+  // Whatever else was superseded, the newest entry of each kind must have
+  // reached the server
+  bool newestDelivered = true;
+  for (uint8_t k = 0; k <= PRINTER_STATUS_COUNT; ++k) {
+    const Queued& expected = k < PRINTER_STATUS_COUNT ? lastStatus[k] : lastReport;
+    if (expected.status.empty()) {
+      continue;
+    }
+    bool found = false;
+    for (const Queued& d : outboxServer.delivered) {
+      found = found || (d.status == expected.status && fabsf(d.temperature - expected.temperature) < 0.006f);
+    }
+    newestDelivered = newestDelivered && found;
+  }
+
+  printf("%u min, %u email requests, SMTP down %u-%u min, reboot at %u min\n", minutes, requests,
+         OUTAGE_FROM_S / 60, OUTAGE_TO_S / 60, REBOOT_AT_S / 60);
+  printf("queue   %4u SMTP sessions, %4u emails accepted, lost: %u queue full, %u failed sends, %u at reboot\n",
+         legacySessions, legacyAccepted, legacyQueueFull, legacyFailed, legacyRebootLost);
+  printf("outbox  %4u SMTP sessions, %4u digests accepted (%zu entries), %u superseded, %zu left, %u flash bytes\n",
+         outboxServer.sessions, outboxServer.accepted, outboxServer.delivered.size(), outboxSuperseded,
+         outbox->pending(), flashBytes);
+
+  if (!newestDelivered || outbox->pending() > 0 || outboxServer.sessions >= legacySessions) {
+    printf("FAIL: the newest entry of a kind was not delivered or the outbox used more sessions\n");
+    return 1;
+  }
+  return 0;
+}
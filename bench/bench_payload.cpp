@@ -0,0 +1,80 @@
+// Compares the String-concatenation publish payloads the loop used to build
+// with the fixed-buffer SensorPayload/AlertPayload renderers. Exits non-zero
+// if the fixed-buffer path touches the heap.
+//
+//   pio run -e bench_payload && .pio/build/bench_payload/program [cycles]
+
+#include <Arduino.h>
+#include "bench_support.h"
+#include "payload_serializer.h"
+
+namespace {
+
+// The pre-serializer loop body: base payload, copy, chop, append status,
+// then one alert String. Kept verbatim as the reference.
+size_t legacyCycle(float temperature, float humidity, const char* statusStr, float threshold) {
+  String payload = String(F("{\"temperature\": ")) + String(temperature, 2);
+  payload += String(F(", \"humidity\": ")) + String(humidity, 2);
+  payload += F(" }");
+
+  String webPayload = payload;
+  webPayload.remove(webPayload.length() - 2);
+  webPayload += String(F(", \"status\": \"")) + statusStr + F("\" }");
+
+  String alertPayload = String(F("{\"alert\": \"ready_to_print\", \"temperature\": ")) +
+                        String(temperature, 2) + F(", \"threshold\": ") + String(threshold, 1) + F("}");
+  return payload.length() + webPayload.length() + alertPayload.length();
+}
+
+SensorPayload samplePayload;
+AlertPayload alertPayload;
+
+size_t serializerCycle(float temperature, float humidity, const char* statusStr, float threshold) {
+  samplePayload.render({temperature, humidity, true, false, statusStr});
+  alertPayload.render("ready_to_print", temperature, threshold);
+  return samplePayload.length() + alertPayload.length();
+}
+
+template <typename Fn>
+void run(const char* label, Fn cycle, uint32_t cycles, bench::Series& allocsPerCycle) {
+  bench::Series latency;
+  volatile size_t sink = 0;
+  for (uint32_t i = 0; i < cycles; ++i) {
+    float temperature = 18.0f + static_cast<float>(i % 1700) / 100.0f;
+    float humidity = 40.0f + static_cast<float>(i % 900) / 100.0f;
+    bench::AllocCounter before = bench::allocs();
+    uint64_t t0 = bench::nowNs();
+    sink = sink + cycle(temperature, humidity, "READY", 20.0f);
+    uint64_t elapsed = bench::nowNs() - t0;
+    uint64_t allocated = bench::allocs().allocations - before.allocations;
+    latency.add(static_cast<double>(elapsed));
+    allocsPerCycle.add(static_cast<double>(allocated));
+  }
+  char title[64];
+  snprintf(title, sizeof(title), "%s latency", label);
+  latency.print(title, "ns");
+  snprintf(title, sizeof(title), "%s allocations", label);
+  allocsPerCycle.print(title, "allocs/cycle");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const uint32_t cycles = argc > 1 ? static_cast<uint32_t>(atol(argv[1])) : 200000;
+
+  // Long fractions and negative values must not leave SSO territory either.
+  printf("sample: %s\n", samplePayload.render({-12.345f, 100.0f, true, true, "TOO HOT"}));
+  printf("alert:  %s\n", alertPayload.render("temperature_high", 39.1f, 30.0f));
+
+  bench::Series legacyAllocs;
+  bench::Series serializerAllocs;
+  run("legacy String", legacyCycle, cycles, legacyAllocs);
+  run("fixed buffer", serializerCycle, cycles, serializerAllocs);
+
+  if (serializerAllocs.percentile(1.0) != 0.0) {
+    printf("FAIL: fixed-buffer path allocated on the heap\n");
+    return 1;
+  }
+  printf("fixed-buffer path: zero heap allocations per cycle\n");
+  return 0;
+}
@@ -0,0 +1,140 @@
+// A day of outbox digests over STARTTLS (port 587): a status burst every
+// 20 minutes that produces a digest a minute for three minutes, and a
+// periodic report every 15 minutes. Sent once with a fresh EmailNotifier per
+// email, as the firmware used to, and once through one long-lived notifier
+// whose idle session is closed as the email task would. The simulated
+// network charges a TCP connect, a TLS handshake and SMTP round trips in
+// virtual time. A third run uses a server that silently drops clients idle
+// for 45 s, so the NOOP before each reuse finds a dead connection and the
+// email goes out on a new session. Reports sessions, handshakes and time
+// spent per email, and each kept notifier's session counters. Exits non-zero
+// if an email fails, the long-lived session does not save handshakes or a
+// dropped session is only found by a failed send.
+//
+//   pio run -e bench_smtp && .pio/build/bench_smtp/program [virtual-hours]
+
+#include <Arduino.h>
+#include <vector>
+#include "bench_support.h"
+#include "email_notifier.h"
+
+namespace {
+
+const uint32_t CONNECT_MS = 300;
+const uint32_t HANDSHAKE_MS = 1800;  // RSA key exchange on an ESP32
+const uint32_t ROUND_TRIP_MS = 120;
+
+struct Result {
+  uint32_t emails = 0;
+  uint32_t failed = 0;
+  uint64_t connects = 0;
+  uint64_t handshakes = 0;
+  uint64_t smtpMs = 0;
+};
+
+// Seconds into the run at which a digest is sent.
+std::vector<uint32_t> sendTimes(uint32_t seconds) {
+  std::vector<uint32_t> times;
+  for (uint32_t s = 1; s < seconds; ++s) {
+    uint32_t inCycle = s % (20 * 60);
+    if (inCycle == 60 || inCycle == 120 || inCycle == 180 || s % (15 * 60) == 0) {
+      times.push_back(s);
+    }
+  }
+  return times;
+}
+
+template <typename Send, typename Idle>
+Result run(const std::vector<uint32_t>& times, uint32_t seconds, uint32_t idleDropMs, Send send, Idle idle) {
+  hal::NetworkSim& net = hal::network();
+  net.idleDropMs = idleDropMs;
+  uint64_t connectsBefore = net.connects, handshakesBefore = net.handshakes;
+  Result result;
+  uint32_t start = millis();
+  size_t next = 0;
+  for (uint32_t s = 0; s < seconds; ++s) {
+    uint32_t elapsed = millis() - start;
+    if (elapsed < s * 1000UL) {
+      delay(s * 1000UL - elapsed);
+    }
+    if (next < times.size() && times[next] == s) {
+      uint32_t t0 = millis();
+      bool ok = send("Temperature Monitor Status", "Status: READY\nTemperature: 30.00 C\nReading Time: unknown\n");
+      result.smtpMs += millis() - t0;
+      result.emails++;
+      result.failed += ok ? 0 : 1;
+      next++;
+    }
+    idle(millis());
+  }
+  result.connects = net.connects - connectsBefore;
+  result.handshakes = net.handshakes - handshakesBefore;
+  return result;
+}
+
+void print(const char* label, const Result& r) {
+  printf("%-28s %4u emails, %2u failed, %4llu connects, %4llu handshakes, %6.0f ms per email\n", label, r.emails,
+         r.failed, static_cast<unsigned long long>(r.connects), static_cast<unsigned long long>(r.handshakes),
+         r.emails ? static_cast<double>(r.smtpMs) / r.emails : 0.0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const uint32_t hours = argc > 1 ? static_cast<uint32_t>(atol(argv[1])) : 24;
+  const uint32_t seconds = hours * 3600;
+
+  hal::NetworkSim& net = hal::network();
+  net.reachable = true;
+  net.connectMs = CONNECT_MS;
+  net.handshakeMs = HANDSHAKE_MS;
+  net.roundTripMs = ROUND_TRIP_MS;
+
+  Settings settings;
+  settings.setEmailEnabled(true);
+  std::vector<uint32_t> times = sendTimes(seconds);
+
+  Result fresh = run(times, seconds, 0, [&](const char* subject, const char* body) {
+    EmailNotifier notifier;
+    return notifier.send(settings, subject, body);
+  }, [](uint32_t) {});
+
+  EmailNotifier kept;
+  Result reused = run(times, seconds, 0, [&](const char* subject, const char* body) {
+    return kept.send(settings, subject, body);
+  }, [&](uint32_t now) { kept.closeIfIdle(now); });
+
+  EmailNotifier dropped;
+  Result early = run(times, seconds, 45000, [&](const char* subject, const char* body) {
+    return dropped.send(settings, subject, body);
+  }, [&](uint32_t now) { dropped.closeIfIdle(now); });
+
+  printf("%u h, STARTTLS: connect %u ms, handshake %u ms, round trip %u ms\n", hours, CONNECT_MS, HANDSHAKE_MS,
+         ROUND_TRIP_MS);
+  print("session per email", fresh);
+  print("kept session", reused);
+  print("kept, server drops at 45 s", early);
+  printf("kept session: %u sessions, %u sends reused, %u found dropped\n", kept.sessions(), kept.reused(),
+         kept.stale());
+  printf("kept, server drops at 45 s: %u sessions, %u sends reused, %u found dropped\n", dropped.sessions(),
+         dropped.reused(), dropped.stale());
+  printf("/metrics smtp fields of the kept session:\n  ");
+  struct StdoutPrint : Print {
+    size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+  } out;
+  kept.writeJsonFields(out);
+  printf("\n");
+
+  if (fresh.failed || reused.failed || early.failed || reused.handshakes >= fresh.handshakes) {
+    printf("FAIL: an email was not sent or the kept session did not save handshakes\n");
+    return 1;
+  }
+  // Each dropped session costs one connect for the email; a failed send on
+  // it would have cost a second session
+  if (early.connects != early.emails) {
+    printf("FAIL: %llu connects for %u emails against the dropping server\n",
+           static_cast<unsigned long long>(early.connects), early.emails);
+    return 1;
+  }
+  return 0;
+}
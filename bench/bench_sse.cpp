@@ -0,0 +1,145 @@
+// Feeds an hour of samples (every 2 s) and alerts to three dashboards, one
+// healthy, one whose Wi-Fi stalls for 60 s in every 300 s and one that stops
+// reading altogether, once through the AsyncEventSource broadcast the
+// firmware used to call and once through SseFanout. Reports the largest
+// queue each client built up and what it was sent. Exits non-zero if a
+// fan-out queue exceeds SSE_CLIENT_MAX_QUEUED_BYTES, a connected client
+// misses an alert or a sample is held back from the healthy client.
+//
+//   pio run -e bench_sse && .pio/build/bench_sse/program [virtual-seconds] [alert-period-seconds]
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "bench_support.h"
+#include "payload_serializer.h"
+#include "sse_fanout.h"
+
+namespace {
+
+enum Behaviour { HEALTHY, FLAKY, DEAD, BEHAVIOUR_COUNT };
+const char* const BEHAVIOUR_NAMES[] = {"healthy", "flaky", "dead"};
+
+const uint32_t SAMPLE_PERIOD_MS = 2000;
+const uint32_t SERVICE_PERIOD_MS = 250;
+
+struct ClientReport {
+  size_t maxQueuedBytes = 0;
+  size_t samples = 0;
+  size_t alerts = 0;
+  bool closed = false;
+};
+
+bool stalledAt(Behaviour behaviour, uint32_t seconds) {
+  switch (behaviour) {
+    case FLAKY:
+      return seconds % 300 >= 240;
+    case DEAD:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Drives one event source; send(sample/alert) is the path under test and
+// service() is offered every SERVICE_PERIOD_MS.
+template <typename SendSample, typename SendAlert, typename Service>
+void run(AsyncEventSource& source, uint32_t seconds, uint32_t alertPeriod, SendSample sendSample, SendAlert sendAlert,
+         Service service, ClientReport (&report)[BEHAVIOUR_COUNT], size_t& alertsSent) {
+  source.setClientCount(BEHAVIOUR_COUNT);
+  AsyncEventSourceClient* clients[BEHAVIOUR_COUNT];
+  for (int b = 0; b < BEHAVIOUR_COUNT; ++b) {
+    clients[b] = &source.client(b);
+  }
+
+  SensorPayload payload;
+  AlertPayload alert;
+  uint32_t start = millis();
+  alertsSent = 0;
+  for (uint32_t step = 0; step * SAMPLE_PERIOD_MS < seconds * 1000UL; ++step) {
+    uint32_t elapsedS = (millis() - start) / 1000;
+    float temperature = 18.0f + static_cast<float>(step % 900) / 50.0f;
+    sendSample(payload.render({temperature, 45.0f, true, false, "READY"}));
+    if (step > 0 && (step * SAMPLE_PERIOD_MS / 1000) % alertPeriod == 0) {
+      sendAlert(alert.render("temperature_high", temperature, 30.0f));
+      alertsSent++;
+    }
+    for (uint32_t t = 0; t < SAMPLE_PERIOD_MS; t += SERVICE_PERIOD_MS) {
+      for (int b = 0; b < BEHAVIOUR_COUNT; ++b) {
+        if (report[b].closed) {
+          continue;
+        }
+        clients[b]->stall(stalledAt(static_cast<Behaviour>(b), elapsedS));
+        if (!stalledAt(static_cast<Behaviour>(b), elapsedS)) {
+          clients[b]->deliver();
+        }
+        size_t queued = clients[b]->queuedBytes();
+        report[b].maxQueuedBytes = queued > report[b].maxQueuedBytes ? queued : report[b].maxQueuedBytes;
+        report[b].samples = clients[b]->events("sensor_data");
+        report[b].alerts = clients[b]->events("alert");
+        report[b].closed = !clients[b]->connected();
+      }
+      delay(SERVICE_PERIOD_MS);
+      service();
+    }
+  }
+}
+
+void print(const char* label, const ClientReport (&report)[BEHAVIOUR_COUNT], size_t alertsSent) {
+  printf("%s\n", label);
+  for (int b = 0; b < BEHAVIOUR_COUNT; ++b) {
+    printf("  %-8s max queued %7zu bytes, %4zu samples, %2zu/%zu alerts%s\n", BEHAVIOUR_NAMES[b],
+           report[b].maxQueuedBytes, report[b].samples, report[b].alerts, alertsSent,
+           report[b].closed ? ", closed" : "");
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const uint32_t seconds = argc > 1 ? static_cast<uint32_t>(atol(argv[1])) : 3600;
+  const uint32_t alertPeriod = argc > 2 ? static_cast<uint32_t>(atol(argv[2])) : 60;
+
+  AsyncEventSource legacySource("/legacy");
+  ClientReport legacy[BEHAVIOUR_COUNT];
+  size_t legacyAlerts = 0;
+  run(legacySource, seconds, alertPeriod, [&](const char* json) { legacySource.send(json, "sensor_data", millis()); },
+      [&](const char* json) { legacySource.send(json, "alert", millis()); }, [] {}, legacy, legacyAlerts);
+
+  AsyncEventSource source("/events");
+  SseFanout fanout;
+  fanout.begin(source, "snapshot", 0, nullptr);
+  ClientReport fanned[BEHAVIOUR_COUNT];
+  size_t alerts = 0;
+  uint32_t services = 0;
+  uint32_t serviceSlots = 0;
+  // As loop() does: only while a sample is held
+  run(source, seconds, alertPeriod, [&](const char* json) { fanout.sendSample(json); },
+      [&](const char* json) { fanout.sendAlert(json); },
+      [&] {
+        serviceSlots++;
+        if (fanout.holdsSamples()) {
+          fanout.service();
+          services++;
+        }
+      },
+      fanned, alerts);
+  source.reap();
+
+  printf("%u s, samples every %u ms, alerts every %u s\n", seconds, SAMPLE_PERIOD_MS, alertPeriod);
+  print("broadcast (events.send)", legacy, legacyAlerts);
+  print("SseFanout", fanned, alerts);
+  printf("coalesced %u, closed for backlog %u, clients left %zu, service() ran %u of %u times\n",
+         fanout.coalesced(), fanout.closedForBacklog(), fanout.count(), services, serviceSlots);
+
+  bool ok = fanned[HEALTHY].samples == legacy[HEALTHY].samples;
+  for (int b = 0; b < BEHAVIOUR_COUNT; ++b) {
+    ok = ok && fanned[b].maxQueuedBytes <= SSE_CLIENT_MAX_QUEUED_BYTES;
+    ok = ok && (fanned[b].closed || fanned[b].alerts == alerts);
+  }
+  ok = ok && fanout.count() == static_cast<size_t>(BEHAVIOUR_COUNT) - fanout.closedForBacklog();
+  if (!ok) {
+    printf("FAIL: a queue passed the bound, an alert was lost or the healthy client was held back\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,191 @@
+// Replays noisy temperature traces through the three-flag alert logic the
+// loop used to run and through PrinterStateMachine with the default settings,
+// counting status transitions (each one an MQTT alert and a queued email) and
+// spurious ones that revert within a minute, plus the update cost and the
+// step response. The pass/fail checks are unit tests in
+// test/test_printer_state.
+//
+//   pio run -e bench_status && .pio/build/bench_status/program
+
+#include <Arduino.h>
+#include <vector>
+#include "bench_support.h"
+#include "printer_state.h"
+#include "settings.h"
+
+namespace {
+
+const uint32_t SAMPLE_MS = 2000;
+const uint32_t SPURIOUS_WINDOW_MS = 60000;
+
+struct Trace {
+  const char* name;
+  std::vector<float> temperatures;
+  uint32_t expectedTransitions;  // of the noise-free signal, initial classification included
+};
+
+struct Transition {
+  uint32_t atMs;
+  PrinterStatus to;
+};
+
+struct Result {
+  std::vector<Transition> transitions;
+  uint32_t spurious() const {
+    uint32_t count = 0;
+    for (size_t i = 1; i + 1 < transitions.size(); ++i) {
+      bool reverted = transitions[i + 1].to == transitions[i - 1].to;
+      if (reverted && transitions[i + 1].atMs - transitions[i].atMs < SPURIOUS_WINDOW_MS) {
+        ++count;
+      }
+    }
+    return count;
+  }
+};
+
+// The pre-state-machine loop body, kept verbatim (less the sinks) as the
+// reference: every branch that published an alert counts as a transition.
+class LegacyFlags {
+public:
+  bool update(float temperature, float readyThreshold, float highThreshold, PrinterStatus& status) {
+    bool changed = false;
+    if (temperature < readyThreshold && !temperatureBelowThreshold) {
+      temperatureBelowThreshold = true;
+      status = NOT_READY;
+      changed = true;
+    } else if (temperature >= readyThreshold && temperatureBelowThreshold) {
+      temperatureBelowThreshold = false;
+    }
+    if (temperature >= readyThreshold && temperature < highThreshold &&
+        (!temperatureAboveThreshold || temperatureAboveHighThreshold)) {
+      temperatureAboveThreshold = true;
+      status = READY;
+      changed = true;
+    } else if (temperature < readyThreshold && temperatureAboveThreshold) {
+      temperatureAboveThreshold = false;
+    }
+    if (temperature >= highThreshold && !temperatureAboveHighThreshold) {
+      temperatureAboveHighThreshold = true;
+      status = TOO_HOT;
+      changed = true;
+    } else if (temperature < highThreshold && temperatureAboveHighThreshold) {
+      temperatureAboveHighThreshold = false;
+    }
+    return changed;
+  }
+
+private:
+  bool temperatureAboveThreshold = false;
+  bool temperatureAboveHighThreshold = false;
+  bool temperatureBelowThreshold = false;
+};
+
+float noise(int centi) { return static_cast<float>(random(-centi, centi + 1)) / 100.0f; }
+
+// A minute at 18 C, then an hour sitting on the ready threshold with
+// +/-0.3 C of sensor noise: one real NOT READY -> READY transition.
+Trace hoverTrace() {
+  Trace trace = {"hover", {}, 2};
+  for (uint32_t i = 0; i < 1800; ++i) {
+    trace.temperatures.push_back(i < 30 ? 18.0f : DEFAULT_READY_THRESHOLD + 0.05f + noise(30));
+  }
+  return trace;
+}
+
+// Enclosure warm-up from 14 C to ~33 C: NOT READY, READY, TOO HOT.
+Trace warmupTrace() {
+  Trace trace = {"warmup", {}, 3};
+  for (uint32_t i = 0; i < 1800; ++i) {
+    float minutes = static_cast<float>(i * SAMPLE_MS) / 60000.0f;
+    trace.temperatures.push_back(14.0f + 19.0f * (1.0f - expf(-minutes / 7.0f)) + noise(15));
+  }
+  return trace;
+}
+
+// Steady 25 C with a one-sample glitch above the high threshold every ~5 min.
+Trace glitchTrace() {
+  Trace trace = {"glitch", {}, 1};
+  for (uint32_t i = 0; i < 1800; ++i) {
+    trace.temperatures.push_back(i % 150 == 75 ? 38.0f : 25.0f + noise(15));
+  }
+  return trace;
+}
+
+// Thermostat cycling 18-32 C with a 20 minute period: four real transitions
+// per cycle after the first classification.
+Trace cycleTrace() {
+  Trace trace = {"cycle", {}, 1 + 4 * 3};
+  for (uint32_t i = 0; i < 1800; ++i) {
+    float phase = static_cast<float>(i * SAMPLE_MS) / 1200000.0f * 2.0f * static_cast<float>(M_PI);
+    trace.temperatures.push_back(25.0f - 7.0f * cosf(phase) + noise(30));
+  }
+  return trace;
+}
+
+Result runLegacy(const Trace& trace) {
+  LegacyFlags flags;
+  PrinterStatus status = NOT_READY;
+  Result result;
+  for (size_t i = 0; i < trace.temperatures.size(); ++i) {
+    if (flags.update(trace.temperatures[i], DEFAULT_READY_THRESHOLD, DEFAULT_HIGH_THRESHOLD, status)) {
+      result.transitions.push_back({static_cast<uint32_t>(i) * SAMPLE_MS, status});
+    }
+  }
+  return result;
+}
+
+Result runStateMachine(const Trace& trace, const PrinterThresholds& thresholds, bench::Series& latency) {
+  PrinterStateMachine machine;
+  PrinterStatusEvent event;
+  Result result;
+  for (size_t i = 0; i < trace.temperatures.size(); ++i) {
+    uint32_t nowMs = static_cast<uint32_t>(i) * SAMPLE_MS;
+    uint64_t t0 = bench::nowNs();
+    bool changed = machine.update(trace.temperatures[i], nowMs, thresholds, event);
+    latency.add(static_cast<double>(bench::nowNs() - t0));
+    if (changed) {
+      result.transitions.push_back({nowMs, event.to});
+    }
+  }
+  return result;
+}
+
+// How long after a clean step across the ready threshold it is committed.
+void reportDwell(const PrinterThresholds& thresholds) {
+  PrinterStateMachine machine;
+  PrinterStatusEvent event;
+  uint32_t stepMs = 60000;
+  uint32_t committedMs = 0;
+  uint32_t events = 0;
+  for (uint32_t nowMs = 0; nowMs < 180000; nowMs += SAMPLE_MS) {
+    float temperature = nowMs < stepMs ? 15.0f : 25.0f;
+    if (machine.update(temperature, nowMs, thresholds, event) && !event.initial) {
+      committedMs = nowMs;
+      ++events;
+    }
+  }
+  printf("step response: %u event(s), committed %u ms after the step (dwell %u ms)\n", events, committedMs - stepMs,
+         thresholds.minDwellMs);
+}
+
+}  // namespace
+
+int main() {
+  randomSeed(42);
+  PrinterThresholds thresholds = {DEFAULT_READY_THRESHOLD, DEFAULT_HIGH_THRESHOLD, DEFAULT_THRESHOLD_HYSTERESIS,
+                                  DEFAULT_MIN_DWELL_SECONDS * 1000UL};
+
+  std::vector<Trace> traces = {hoverTrace(), warmupTrace(), glitchTrace(), cycleTrace()};
+  bench::Series latency;
+
+  printf("%-8s %10s %10s %12s %12s %10s\n", "trace", "expected", "legacy", "legacy spur", "machine", "mach spur");
+  for (const Trace& trace : traces) {
+    Result legacy = runLegacy(trace);
+    Result machine = runStateMachine(trace, thresholds, latency);
+    printf("%-8s %10u %10zu %12u %12zu %10u\n", trace.name, trace.expectedTransitions, legacy.transitions.size(),
+           legacy.spurious(), machine.transitions.size(), machine.spurious());
+  }
+  latency.print("state machine update", "ns");
+  reportDwell(thresholds);
+  return 0;
+}
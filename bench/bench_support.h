@@ -0,0 +1,100 @@
+#pragma once
+// Shared helpers for the host benchmarks. Include from exactly one
+// translation unit per executable: it replaces the global operator new so
+// heap traffic can be attributed per thread.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <vector>
+
+namespace bench {
+
+struct AllocCounter {
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+};
+
+inline AllocCounter& allocs() {
+  static thread_local AllocCounter counter;
+  return counter;
+}
+
+inline uint64_t nowNs() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// CPU time of the calling thread only: excludes time spent blocked, e.g.
+// loop() waiting for a task notification.
+inline uint64_t threadCpuNs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Collects samples and prints min/avg/p50/p99/max in one line.
+class Series {
+public:
+  void add(double value) { values.push_back(value); }
+  size_t size() const { return values.size(); }
+
+  double mean() const {
+    if (values.empty()) return 0.0;
+    double sum = 0.0;
+    for (double v : values) sum += v;
+    return sum / static_cast<double>(values.size());
+  }
+
+  double percentile(double p) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t idx = static_cast<size_t>(p * static_cast<double>(values.size() - 1) + 0.5);
+    return values[idx];
+  }
+
+  void print(const char* label, const char* unit) {
+    if (values.empty()) {
+      printf("%-28s (no samples)\n", label);
+      return;
+    }
+    double avg = mean();
+    printf("%-28s n=%-7zu min=%-9.2f avg=%-9.2f p50=%-9.2f p99=%-9.2f max=%.2f %s\n", label, values.size(),
+           percentile(0.0), avg, percentile(0.5), percentile(0.99), percentile(1.0), unit);
+  }
+
+private:
+  std::vector<double> values;
+};
+
+}  // namespace bench
+
+void* operator new(size_t size) {
+  bench::allocs().allocations++;
+  bench::allocs().bytes += size;
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+// Every form of new and delete goes through the operator new above and the
+// operator delete below, so each pair matches and new (std::nothrow) is
+// counted too.
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return operator new(size);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return operator new(size, std::nothrow); }
+// Not inlined: GCC would see free() on a pointer from operator new
+__attribute__((noinline)) void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { operator delete(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { operator delete(p); }
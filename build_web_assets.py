@@ -0,0 +1,111 @@
+import gzip
+import hashlib
+import os
+import re
+import shutil
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+}
+
+MANIFEST = "assets.txt"
+# Limits of StaticAssets (include/static_assets.h): STATIC_ASSETS_MAX
+# entries, URLs of up to 28 bytes so "<url>.gz" fits a SPIFFS name, and
+# STATIC_ASSETS_MAX_LINE bytes per manifest line
+MAX_ASSETS = 8
+MAX_URL = 28
+MAX_LINE = 96
+
+# Filled in by the firmware's template processor (WifiSetup::templateProcessor)
+TEMPLATE_PLACEHOLDER = re.compile(r"%[A-Z_]+%")
+
+
+def check_manifest(manifest):
+    # The firmware would not serve what does not fit, so the build stops
+    if len(manifest) > MAX_ASSETS:
+        raise SystemExit(f"{len(manifest)} web assets, the firmware serves at most {MAX_ASSETS} (STATIC_ASSETS_MAX)")
+    for line in manifest:
+        url = line.split(" ", 1)[0]
+        if len(url) > MAX_URL or len(line) > MAX_LINE:
+            raise SystemExit(f"Web asset {url}: URL or manifest line too long for the firmware")
+
+
+def content_hash(data):
+    return hashlib.sha256(data).hexdigest()[:8]
+
+
+def hashed_name(name, digest):
+    # style.css -> style.1a2b3c4d.css; SPIFFS names stay under 32 bytes
+    base, ext = os.path.splitext(name)
+    return f"{base}.{digest}{ext}"
+
+
+def write_gzip(path, data):
+    # mtime=0 keeps the image identical for identical sources
+    with open(path, "wb") as file:
+        file.write(gzip.compress(data, compresslevel=9, mtime=0))
+
+
+def build_assets(data_dir, out_dir):
+    """Writes the SPIFFS image contents to out_dir.
+
+    Every .css/.js/.html asset is stored gzipped as <name>.gz. Stylesheets and
+    scripts get their content hash in the file name and the pages are
+    rewritten to reference the hashed names, so the firmware can send them as
+    immutable; pages keep their names and are revalidated by ETag. A page
+    with %NAME% placeholders is stored plain, since the firmware fills them
+    in while streaming it. Other files are copied unchanged. assets.txt lists
+    "<url> <etag> <type> <immutable> <templated>" for the firmware.
+    """
+    shutil.rmtree(out_dir, ignore_errors=True)
+    os.makedirs(out_dir)
+
+    names = sorted(n for n in os.listdir(data_dir) if os.path.isfile(os.path.join(data_dir, n)))
+    renamed = {}
+    manifest = []
+    for name in names:
+        ext = os.path.splitext(name)[1]
+        if ext not in CONTENT_TYPES or ext == ".html":
+            continue
+        with open(os.path.join(data_dir, name), "rb") as file:
+            data = file.read()
+        digest = content_hash(data)
+        renamed[name] = hashed_name(name, digest)
+        write_gzip(os.path.join(out_dir, renamed[name] + ".gz"), data)
+        manifest.append(f"/{renamed[name]} {digest} {CONTENT_TYPES[ext]} 1 0")
+
+    for name in names:
+        source = os.path.join(data_dir, name)
+        if name.endswith(".html"):
+            with open(source, "r", encoding="utf-8") as file:
+                page = file.read()
+            for original, target in renamed.items():
+                page = re.sub(r'(?<=["\'/])' + re.escape(original) + r'(?=["\'])', target, page)
+            data = page.encode("utf-8")
+            templated = TEMPLATE_PLACEHOLDER.search(page) is not None
+            if templated:
+                with open(os.path.join(out_dir, name), "wb") as file:
+                    file.write(data)
+            else:
+                write_gzip(os.path.join(out_dir, name + ".gz"), data)
+            manifest.append(f"/{name} {content_hash(data)} text/html 0 {int(templated)}")
+        elif name not in renamed:
+            shutil.copyfile(source, os.path.join(out_dir, name))
+
+    check_manifest(manifest)
+    with open(os.path.join(out_dir, MANIFEST), "w") as file:
+        file.write("\n".join(manifest) + "\n")
+
+    total = sum(os.path.getsize(os.path.join(out_dir, n)) for n in os.listdir(out_dir))
+    print(f"Web assets: {len(manifest)} into {out_dir} ({total} bytes)")
+
+
+# Hook into PlatformIO's build process: only filesystem image targets
+# build from the generated directory.
+Import("env")
+if any(target in COMMAND_LINE_TARGETS for target in ("buildfs", "uploadfs", "uploadfsota")):
+    out_dir = os.path.join(env.subst("$PROJECT_BUILD_DIR"), "webdata")
+    build_assets(env.subst("$PROJECT_DATA_DIR"), out_dir)
+    env.Replace(PROJECT_DATA_DIR=out_dir)
@@ -0,0 +1,256 @@
+// Canvas gauges for the dashboard, served from the device so the page works
+// without internet access. Takes the subset of the canvas-gauges 2.1.7
+// options script.js uses (same names, same defaults where it matters):
+// new LinearGauge(options).draw(), gauge.update(options), gauge.value = v.
+
+(function () {
+  'use strict';
+
+  var DEFAULTS = {
+    width: 200,
+    height: 200,
+    units: '',
+    minValue: 0,
+    maxValue: 100,
+    majorTicks: [],
+    minorTicks: 0,
+    highlights: [],
+    valueInt: 3,
+    valueDec: 2,
+    colorPlate: '#fff',
+    colorTicks: '#444',
+    colorNumbers: '#444',
+    colorUnits: '#444',
+    colorValueBoxRect: '#888',
+    colorValueBoxBackground: '#fff',
+    colorValueText: '#444',
+    colorNeedle: 'rgba(240, 128, 128, 1)',
+    colorBarProgress: '#888',
+    colorBar: '#ddd',
+    barWidth: 10,
+    needleWidth: 2,
+    animationDuration: 500
+  };
+
+  function Gauge(options) {
+    this.options = {};
+    this.update(options, true);
+    this.canvas = typeof options.renderTo === 'string' ? document.getElementById(options.renderTo) : options.renderTo;
+    var ratio = window.devicePixelRatio || 1;
+    this.canvas.width = this.options.width * ratio;
+    this.canvas.height = this.options.height * ratio;
+    this.canvas.style.width = this.options.width + 'px';
+    this.canvas.style.height = this.options.height + 'px';
+    this.context = this.canvas.getContext('2d');
+    this.context.scale(ratio, ratio);
+    this.shown = this.options.minValue;
+    this.target = this.options.minValue;
+  }
+
+  Gauge.prototype.update = function (options, quiet) {
+    var key;
+    for (key in DEFAULTS) {
+      if (!(key in this.options)) {
+        this.options[key] = DEFAULTS[key];
+      }
+    }
+    for (key in options) {
+      this.options[key] = options[key];
+    }
+    if (!quiet) {
+      this.draw();
+    }
+    return this;
+  };
+
+  Gauge.prototype.draw = function () {
+    var o = this.options;
+    var c = this.context;
+    c.clearRect(0, 0, o.width, o.height);
+    c.fillStyle = o.colorPlate;
+    c.fillRect(0, 0, o.width, o.height);
+    this.render(c, o);
+    return this;
+  };
+
+  // Fraction of the scale for a value, clamped to it.
+  Gauge.prototype.fraction = function (value) {
+    var o = this.options;
+    var f = (value - o.minValue) / (o.maxValue - o.minValue);
+    return Math.max(0, Math.min(1, f));
+  };
+
+  // valueInt digits at least before the point, valueDec after it.
+  Gauge.prototype.valueText = function () {
+    var o = this.options;
+    var parts = Math.abs(this.target).toFixed(o.valueDec).split('.');
+    while (parts[0].length < o.valueInt) {
+      parts[0] = '0' + parts[0];
+    }
+    return (this.target < 0 ? '-' : '') + parts.join('.');
+  };
+
+  Gauge.prototype.drawValueBox = function (c, o, x, y) {
+    var text = this.valueText();
+    c.font = '16px sans-serif';
+    var w = c.measureText(text).width + 12;
+    c.fillStyle = o.colorValueBoxBackground;
+    c.strokeStyle = o.colorValueBoxRect;
+    c.lineWidth = 2;
+    c.fillRect(x - w / 2, y - 12, w, 24);
+    c.strokeRect(x - w / 2, y - 12, w, 24);
+    c.fillStyle = o.colorValueText;
+    c.textAlign = 'center';
+    c.textBaseline = 'middle';
+    c.fillText(text, x, y);
+  };
+
+  // Eases the shown value to the new one over animationDuration ms.
+  Object.defineProperty(Gauge.prototype, 'value', {
+    get: function () { return this.target; },
+    set: function (value) {
+      var gauge = this;
+      var from = this.shown;
+      var to = Number(value);
+      var duration = this.options.animationDuration;
+      var start = null;
+      this.target = to;
+      if (!window.requestAnimationFrame || duration <= 0) {
+        this.shown = to;
+        this.draw();
+        return;
+      }
+      window.requestAnimationFrame(function step(now) {
+        start = start === null ? now : start;
+        var t = Math.min(1, (now - start) / duration);
+        gauge.shown = from + (to - from) * t;
+        gauge.draw();
+        if (t < 1 && gauge.target === to) {
+          window.requestAnimationFrame(step);
+        }
+      });
+    }
+  });
+
+  function inherit(Child) {
+    Child.prototype = Object.create(Gauge.prototype);
+    Child.prototype.constructor = Child;
+    return Child;
+  }
+
+  // Vertical bar with the scale on its left.
+  var LinearGauge = inherit(function LinearGauge(options) {
+    Gauge.call(this, options);
+  });
+
+  LinearGauge.prototype.render = function (c, o) {
+    var x = o.width / 2 + 10;
+    var top = 30;
+    var bottom = o.height - 60;
+    var span = bottom - top;
+    var self = this;
+    var y = function (value) { return bottom - self.fraction(value) * span; };
+
+    o.highlights.forEach(function (h) {
+      c.fillStyle = h.color;
+      c.fillRect(x + o.barWidth / 2 + 2, y(h.to), 4, y(h.from) - y(h.to));
+    });
+    c.fillStyle = o.colorBar;
+    c.fillRect(x - o.barWidth / 2, top, o.barWidth, span);
+    c.fillStyle = o.colorBarProgress;
+    c.fillRect(x - o.barWidth / 2, y(this.shown), o.barWidth, bottom - y(this.shown));
+
+    var count = o.majorTicks.length;
+    c.strokeStyle = o.colorTicks;
+    c.fillStyle = o.colorNumbers;
+    c.font = '11px sans-serif';
+    c.textAlign = 'right';
+    c.textBaseline = 'middle';
+    for (var i = 0; i < count; i++) {
+      var ty = bottom - (count > 1 ? i / (count - 1) : 0) * span;
+      c.beginPath();
+      c.moveTo(x - o.barWidth / 2 - 10, ty);
+      c.lineTo(x - o.barWidth / 2 - 2, ty);
+      c.stroke();
+      c.fillText(o.majorTicks[i], x - o.barWidth / 2 - 13, ty);
+      for (var m = 1; i < count - 1 && m <= o.minorTicks; m++) {
+        var my = ty - m * span / (count - 1) / (o.minorTicks + 1);
+        c.beginPath();
+        c.moveTo(x - o.barWidth / 2 - 6, my);
+        c.lineTo(x - o.barWidth / 2 - 2, my);
+        c.stroke();
+      }
+    }
+
+    c.fillStyle = o.colorUnits;
+    c.textAlign = 'center';
+    c.fillText(o.units, o.width / 2, 12);
+    this.drawValueBox(c, o, o.width / 2, o.height - 30);
+  };
+
+  // 270 degree dial opening at the bottom, needle from the centre.
+  var RadialGauge = inherit(function RadialGauge(options) {
+    Gauge.call(this, options);
+  });
+
+  RadialGauge.prototype.render = function (c, o) {
+    var cx = o.width / 2;
+    var cy = o.height / 2;
+    var r = Math.min(cx, cy) - 10;
+    var start = Math.PI * 0.75;
+    var sweep = Math.PI * 1.5;
+    var self = this;
+    var angle = function (value) { return start + self.fraction(value) * sweep; };
+
+    o.highlights.forEach(function (h) {
+      c.strokeStyle = h.color;
+      c.lineWidth = 8;
+      c.beginPath();
+      c.arc(cx, cy, r - 4, angle(h.from), angle(h.to));
+      c.stroke();
+    });
+
+    var count = o.majorTicks.length;
+    c.strokeStyle = o.colorTicks;
+    c.fillStyle = o.colorNumbers;
+    c.font = '13px sans-serif';
+    c.textAlign = 'center';
+    c.textBaseline = 'middle';
+    for (var i = 0; i < count; i++) {
+      var a = start + (count > 1 ? i / (count - 1) : 0) * sweep;
+      c.lineWidth = 2;
+      c.beginPath();
+      c.moveTo(cx + Math.cos(a) * (r - 16), cy + Math.sin(a) * (r - 16));
+      c.lineTo(cx + Math.cos(a) * (r - 2), cy + Math.sin(a) * (r - 2));
+      c.stroke();
+      c.fillText(o.majorTicks[i], cx + Math.cos(a) * (r - 30), cy + Math.sin(a) * (r - 30));
+      for (var m = 1; i < count - 1 && m <= o.minorTicks; m++) {
+        var ma = a + m * sweep / (count - 1) / (o.minorTicks + 1);
+        c.lineWidth = 1;
+        c.beginPath();
+        c.moveTo(cx + Math.cos(ma) * (r - 8), cy + Math.sin(ma) * (r - 8));
+        c.lineTo(cx + Math.cos(ma) * (r - 2), cy + Math.sin(ma) * (r - 2));
+        c.stroke();
+      }
+    }
+
+    var needle = angle(this.shown);
+    c.strokeStyle = o.colorNeedle;
+    c.lineWidth = o.needleWidth;
+    c.beginPath();
+    c.moveTo(cx, cy);
+    c.lineTo(cx + Math.cos(needle) * (r - 20), cy + Math.sin(needle) * (r - 20));
+    c.stroke();
+    c.fillStyle = o.colorNeedle;
+    c.beginPath();
+    c.arc(cx, cy, 4, 0, Math.PI * 2);
+    c.fill();
+
+    c.fillStyle = o.colorUnits;
+    c.fillText(o.units, cx, cy - r / 3);
+    this.drawValueBox(c, o, cx, cy + r / 2);
+  };
+
+  window.LinearGauge = LinearGauge;
+  window.RadialGauge = RadialGauge;
+})();
@@ -1,7 +1,12 @@
-// Get current sensor readings when the page loads  
+// Without EventSource the snapshot is fetched once; otherwise it arrives as
+// the first event on /events
 window.addEventListener('load', function () {
-  getReadings();
-  loadSettings();
+  if (!window.EventSource) {
+    fetch('/api/snapshot')
+      .then(r => r.json())
+      .then(applySnapshot)
+      .catch(() => showCamera(null));
+  }
 });
 
 // Create Temperature Gauge
@@ -104,21 +109,43 @@ var gaugeHum = new RadialGauge({
   animationRule: "linear"
 }).draw();
 
-// Function to get current readings on the webpage when it loads for the first time
-function getReadings(){
-  var xhr = new XMLHttpRequest();
-  xhr.onreadystatechange = function() {
-    if (this.readyState == 4 && this.status == 200) {
-      var myObj = JSON.parse(this.responseText);
-      console.log(myObj);
-      var temp = myObj.temperature;
-      var hum = myObj.humidity;
-      gaugeTemp.value = temp;
-      gaugeHum.value = hum;
-    }
-  }; 
-  xhr.open("GET", "/readings", true);
-  xhr.send();
+// Everything the page needs at startup, from /api/snapshot or the
+// 'snapshot' event (sent again on every reconnect)
+function applySnapshot(snapshot) {
+  if (snapshot.reading) {
+    showReading(snapshot.reading);
+  }
+  gaugeTemp.update({
+    highlights: [
+      { from: snapshot.thresholds.ready, to: snapshot.thresholds.high, color: "rgba(0, 128, 0, .75)" },
+      { from: snapshot.thresholds.high, to: 40, color: "rgba(200, 50, 50, .75)" }
+    ]
+  });
+  showCamera(snapshot.camera_url);
+  document.getElementById('version').textContent = snapshot.version;
+}
+
+function showReading(myObj) {
+  gaugeTemp.value = myObj.temperature;
+  if (myObj.temperature >= 15 && !alertPlayed) {
+    // playAlertTone();
+    alertPlayed = true;
+  }
+  if ('humidity' in myObj) {
+    // Property exists - you can access myObj.humidity
+    document.getElementById("humidity-card").style.display = "";
+    document.querySelector('.card-grid').classList.remove('single-card');
+    gaugeHum.value = myObj.humidity;
+  } else {
+    // Property does not exist - handle accordingly (e.g., hide the gauge or set a default)
+    document.getElementById("humidity-card").style.display = "none";
+    document.querySelector('.card-grid').classList.add('single-card');
+  }
+
+  // Update printer status if included
+  if ('status' in myObj) {
+    updatePrinterStatus(myObj.status);
+  }
 }
 
 function playAlertTone() {
@@ -137,27 +164,26 @@ function playAlertTone() {
     osc.stop(ctx.currentTime + 0.4); // 400ms beep
 }
 
-function loadSettings() {
-  fetch('/settings')
-    .then(r => r.json())
-    .then(settings => {
-      if (settings.camera_url) {
-        const stream = document.getElementById('camera-stream');
-        const placeholder = document.getElementById('camera-placeholder');
-        stream.src = settings.camera_url;
-        stream.onload = function () {
-          if (placeholder) placeholder.style.display = 'none';
-          stream.style.display = 'block';
-        };
-        stream.onerror = function () {
-          if (placeholder) placeholder.textContent = 'Camera stream unavailable';
-        };
-      }
-    })
-    .catch(() => {
-      const placeholder = document.getElementById('camera-placeholder');
-      if (placeholder) placeholder.textContent = 'Unable to load camera settings';
-    });
+// Only (re)loads the stream when the URL changes, so a reconnect does not
+// restart it
+function showCamera(url) {
+  const stream = document.getElementById('camera-stream');
+  const placeholder = document.getElementById('camera-placeholder');
+  if (!url) {
+    if (placeholder) placeholder.textContent = 'Unable to load camera settings';
+    return;
+  }
+  if (stream.getAttribute('src') === url) {
+    return;
+  }
+  stream.src = url;
+  stream.onload = function () {
+    if (placeholder) placeholder.style.display = 'none';
+    stream.style.display = 'block';
+  };
+  stream.onerror = function () {
+    if (placeholder) placeholder.textContent = 'Camera stream unavailable';
+  };
 }
 
 alertPlayed = false;
@@ -178,29 +204,14 @@ if (!!window.EventSource) {
     console.log("message", e.data);
   }, false);
 
+  source.addEventListener('snapshot', function(e) {
+    applySnapshot(JSON.parse(e.data));
+  }, false);
+
   source.addEventListener('sensor_data', function(e) {
     var myObj = JSON.parse(e.data);
     console.log(myObj);
-    gaugeTemp.value = myObj.temperature;
-    if (myObj.temperature >= 15 && !alertPlayed) {
-      // playAlertTone();
-      alertPlayed = true;
-    }
-    if ('humidity' in myObj) {
-      // Property exists - you can access myObj.humidity
-      document.getElementById("humidity-card").style.display = "";
-      document.querySelector('.card-grid').classList.remove('single-card');
-      gaugeHum.value = myObj.humidity;
-    } else {
-      // Property does not exist - handle accordingly (e.g., hide the gauge or set a default)
-      document.getElementById("humidity-card").style.display = "none";
-      document.querySelector('.card-grid').classList.add('single-card');
-    }
-    
-    // Update printer status if included
-    if ('status' in myObj) {
-      updatePrinterStatus(myObj.status);
-    }
+    showReading(myObj);
   }, false);
 }
 
@@ -0,0 +1,174 @@
+// Uploads the image with its SHA-256, which the device checks before
+// committing the update. Progress comes from the device's "ota" events;
+// the upload's own progress stands in until the first one arrives.
+
+var form = document.getElementById('update-form');
+var button = document.getElementById('upload-button');
+var bar = document.getElementById('upload-progress');
+var statusText = document.getElementById('upload-status');
+var deviceProgress = false;
+
+// The page is served gzipped as is; the version comes from /version
+fetch('/version', { cache: 'no-store' })
+  .then(r => r.json())
+  .then(v => { document.getElementById('version').textContent = v.version; })
+  .catch(() => {});
+
+function showStatus(text) {
+  statusText.textContent = text;
+}
+
+function showProgress(done, total) {
+  bar.hidden = false;
+  bar.value = total > 0 ? Math.min(100, Math.round(done * 100 / total)) : 0;
+}
+
+// crypto.subtle is only there on https and localhost; the device serves
+// plain http, so the digest is usually computed here
+function sha256Hex(buffer) {
+  if (window.crypto && crypto.subtle && window.isSecureContext) {
+    return crypto.subtle.digest('SHA-256', buffer).then(toHex);
+  }
+  return Promise.resolve(toHex(sha256(new Uint8Array(buffer))));
+}
+
+function toHex(digest) {
+  return Array.from(new Uint8Array(digest), b => b.toString(16).padStart(2, '0')).join('');
+}
+
+function sha256(bytes) {
+  var K = new Uint32Array([
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  ]);
+  var H = new Uint32Array([
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  ]);
+  // Padding: 0x80, zeros, then the bit length as a 64-bit big-endian number
+  var padded = new Uint8Array(((bytes.length + 72) >> 6) << 6);
+  padded.set(bytes);
+  padded[bytes.length] = 0x80;
+  var view = new DataView(padded.buffer);
+  view.setUint32(padded.length - 8, Math.floor(bytes.length / 0x20000000));
+  view.setUint32(padded.length - 4, bytes.length << 3);
+
+  var w = new Uint32Array(64);
+  var rotr = (x, n) => (x >>> n) | (x << (32 - n));
+  for (var offset = 0; offset < padded.length; offset += 64) {
+    for (var i = 0; i < 16; i++) {
+      w[i] = view.getUint32(offset + i * 4);
+    }
+    for (i = 16; i < 64; i++) {
+      var s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >>> 3);
+      var s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >>> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    var a = H[0], b = H[1], c = H[2], d = H[3], e = H[4], f = H[5], g = H[6], h = H[7];
+    for (i = 0; i < 64; i++) {
+      var t1 = (h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i]) >>> 0;
+      var t2 = ((rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c))) >>> 0;
+      h = g; g = f; f = e; e = (d + t1) >>> 0;
+      d = c; c = b; b = a; a = (t1 + t2) >>> 0;
+    }
+    H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+    H[4] += e; H[5] += f; H[6] += g; H[7] += h;
+  }
+  var digest = new Uint8Array(32);
+  var out = new DataView(digest.buffer);
+  for (i = 0; i < 8; i++) {
+    out.setUint32(i * 4, H[i]);
+  }
+  return digest;
+}
+
+// The device is back once /version answers again
+function waitForReboot() {
+  showStatus('Update verified. Rebooting...');
+  setTimeout(function poll() {
+    fetch('/version', { cache: 'no-store' })
+      .then(r => r.json())
+      .then(v => {
+        showStatus('Running version ' + v.version + '.');
+        setTimeout(() => { window.location.href = '/'; }, 2000);
+      })
+      .catch(() => setTimeout(poll, 1000));
+  }, 3000);
+}
+
+function upload(file, type, hash) {
+  var data = new FormData();
+  // The device reads these before the file arrives
+  data.append('uploadType', type);
+  data.append('sha256', hash);
+  data.append('file', file, file.name);
+
+  var xhr = new XMLHttpRequest();
+  xhr.open('POST', '/update');
+  xhr.upload.addEventListener('progress', function (e) {
+    if (!deviceProgress && e.lengthComputable) {
+      showProgress(e.loaded, e.total);
+    }
+  });
+  xhr.addEventListener('load', function () {
+    var result = {};
+    try {
+      result = JSON.parse(xhr.responseText);
+    } catch (e) {
+      result.error = xhr.responseText || ('HTTP ' + xhr.status);
+    }
+    if (xhr.status == 200 && result.ok) {
+      showProgress(1, 1);
+      waitForReboot();
+    } else {
+      showStatus('Update failed: ' + (result.error || ('HTTP ' + xhr.status)));
+      button.disabled = false;
+    }
+  });
+  xhr.addEventListener('error', function () {
+    showStatus('Upload interrupted; nothing was committed.');
+    button.disabled = false;
+  });
+  showStatus('Uploading ' + file.name + '...');
+  xhr.send(data);
+}
+
+form.addEventListener('submit', function (e) {
+  e.preventDefault();
+  var file = document.getElementById('file').files[0];
+  if (!file) {
+    return;
+  }
+  var type = form.querySelector('input[name="uploadType"]:checked').value;
+  button.disabled = true;
+  deviceProgress = false;
+  showStatus('Computing SHA-256...');
+  file.arrayBuffer()
+    .then(sha256Hex)
+    .then(hash => upload(file, type, hash))
+    .catch(err => {
+      showStatus('Could not read the file: ' + err);
+      button.disabled = false;
+    });
+});
+
+// What the device has written to flash, as it goes
+if (!!window.EventSource) {
+  var source = new EventSource('/events');
+  source.addEventListener('ota', function (e) {
+    var ota = JSON.parse(e.data);
+    if (ota.state == 'receiving') {
+      deviceProgress = true;
+      showProgress(ota.written, ota.total);
+      showStatus('Writing ' + ota.target + ': ' + Math.round(ota.image / 1024) + ' KB' +
+                 (ota.compressed ? ' (inflated from ' + Math.round(ota.written / 1024) + ' KB)' : ''));
+    } else if (ota.state == 'failed') {
+      showStatus('Update failed: ' + ota.error);
+    }
+  });
+}
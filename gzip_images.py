@@ -0,0 +1,30 @@
+import gzip
+import hashlib
+import os
+
+# Writes <image>.gz next to firmware.bin and spiffs.bin after they are
+# built, and prints the SHA-256 that /update expects for each. The device
+# inflates gzip images while writing them, so the .gz is what to upload.
+
+
+def write_gzip_image(path):
+    with open(path, "rb") as file:
+        data = file.read()
+    # mtime=0 keeps the image identical for identical sources
+    packed = gzip.compress(data, compresslevel=9, mtime=0)
+    with open(path + ".gz", "wb") as file:
+        file.write(packed)
+    name = os.path.basename(path)
+    print(f"{name}.gz: {len(packed)} of {len(data)} bytes ({100 * len(packed) / max(len(data), 1):.0f}%)")
+    print(f"  sha256 {hashlib.sha256(packed).hexdigest()}")
+
+
+def after_image(source, target, env):
+    for node in target:
+        write_gzip_image(node.get_abspath())
+
+
+# Hook into PlatformIO's build process
+Import("env")
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", after_image)
+env.AddPostAction("$BUILD_DIR/${ESP32_FS_IMAGE_NAME}.bin", after_image)
@@ -0,0 +1,25 @@
+#pragma once
+// BME280 driver stand-in backed by hal::sensorModel().
+
+#include "Arduino.h"
+#include "Wire.h"
+
+class Adafruit_BME280 {
+public:
+  bool begin(uint8_t /*address*/ = 0x77, TwoWire* /*wire*/ = &Wire) {
+    hal::i2c().transfer(2);  // chip-id probe
+    return hal::sensorModel().kind == hal::SensorModel::BME280;
+  }
+
+  float readTemperature() {
+    hal::i2c().transfer(4);  // register pointer + 3-byte ADC read
+    return hal::sensorModel().temperature(millis());
+  }
+
+  float readHumidity() {
+    // The driver re-reads temperature for t_fine compensation.
+    readTemperature();
+    hal::i2c().transfer(3);
+    return hal::sensorModel().humidity(millis());
+  }
+};
@@ -0,0 +1,21 @@
+#pragma once
+// BMP180 driver stand-in backed by hal::sensorModel().
+
+#include "Arduino.h"
+#include "Wire.h"
+
+class Adafruit_BMP085 {
+public:
+  bool begin(uint8_t /*mode*/ = 3, TwoWire* /*wire*/ = &Wire) {
+    hal::i2c().transfer(2);  // chip-id probe
+    return hal::sensorModel().kind == hal::SensorModel::BMP180;
+  }
+
+  float readTemperature() {
+    // Start conversion, wait 4.5 ms, read two bytes.
+    hal::i2c().transfer(2);
+    delayMicroseconds(4500);
+    hal::i2c().transfer(3);
+    return hal::sensorModel().temperature(millis());
+  }
+};
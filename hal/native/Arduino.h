@@ -0,0 +1,309 @@
+#pragma once
+// Minimal Arduino core for the native build. Only what the firmware headers
+// use is provided; String is backed by std::string, so short strings stay in
+// the small-string buffer much like the ESP32 core's SSO String.
+
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <unistd.h>
+#include "native_hal.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// Firmware time() calls follow the virtual clock: this definition takes the
+// place of libc's in every host build.
+extern "C" inline time_t time(time_t* out) noexcept { return hal::epochNow(out); }
+
+#define F(string_literal) (string_literal)
+#define PROGMEM
+#define DEC 10
+#define HEX 16
+#define LOW 0x0
+#define HIGH 0x1
+
+inline unsigned long millis() { return hal::clock().nowMs(); }
+inline unsigned long micros() { return static_cast<unsigned long>(hal::clock().nowUs()); }
+inline void delay(uint32_t ms) { hal::clock().delayUs(static_cast<uint64_t>(ms) * 1000ULL); }
+inline void delayMicroseconds(uint32_t us) { hal::clock().delayUs(us); }
+inline void yield() { std::this_thread::yield(); }
+
+// Hardware RNG stand-in; fixed so host runs stay reproducible.
+inline uint32_t esp_random() { return 0x5eed0001U; }
+inline void randomSeed(unsigned long seed) { srand48(static_cast<long>(seed)); }
+inline long random(long howbig) {
+  if (howbig <= 0) return 0;
+  return static_cast<long>(lrand48() % howbig);
+}
+inline long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return random(howbig - howsmall) + howsmall;
+}
+
+class String {
+public:
+  String() = default;
+  String(const char* cstr) : s(cstr ? cstr : "") {}
+  String(const std::string& str) : s(str) {}
+  String(char c) : s(1, c) {}
+  String(int value, unsigned char base = 10) { fromLong(value, base); }
+  String(unsigned int value, unsigned char base = 10) { fromULong(value, base); }
+  String(long value, unsigned char base = 10) { fromLong(value, base); }
+  String(unsigned long value, unsigned char base = 10) { fromULong(value, base); }
+  String(float value, unsigned int decimalPlaces = 2) { fromDouble(value, decimalPlaces); }
+  String(double value, unsigned int decimalPlaces = 2) { fromDouble(value, decimalPlaces); }
+
+  const char* c_str() const { return s.c_str(); }
+  unsigned int length() const { return static_cast<unsigned int>(s.size()); }
+  bool isEmpty() const { return s.empty(); }
+  bool reserve(unsigned int size) { s.reserve(size); return true; }
+
+  bool concat(const String& str) { s += str.s; return true; }
+  bool concat(const char* cstr) { if (cstr) s += cstr; return true; }
+  bool concat(const char* cstr, unsigned int len) { if (cstr) s.append(cstr, len); return true; }
+  bool concat(char c) { s += c; return true; }
+  bool concat(int num) { return concat(String(num)); }
+  bool concat(unsigned int num) { return concat(String(num)); }
+  bool concat(long num) { return concat(String(num)); }
+  bool concat(unsigned long num) { return concat(String(num)); }
+  bool concat(float num) { return concat(String(num)); }
+  bool concat(double num) { return concat(String(num)); }
+
+  template <typename T>
+  String& operator+=(const T& rhs) { concat(rhs); return *this; }
+
+  bool equals(const String& other) const { return s == other.s; }
+  bool equals(const char* cstr) const { return s == (cstr ? cstr : ""); }
+  bool operator==(const String& rhs) const { return equals(rhs); }
+  bool operator==(const char* cstr) const { return equals(cstr); }
+  bool operator!=(const String& rhs) const { return !equals(rhs); }
+  bool operator!=(const char* cstr) const { return !equals(cstr); }
+  bool operator<(const String& rhs) const { return s < rhs.s; }
+  int compareTo(const String& other) const { return s.compare(other.s); }
+  bool startsWith(const String& prefix) const { return s.compare(0, prefix.s.size(), prefix.s) == 0; }
+  bool endsWith(const String& suffix) const {
+    return s.size() >= suffix.s.size() && s.compare(s.size() - suffix.s.size(), suffix.s.size(), suffix.s) == 0;
+  }
+
+  char charAt(unsigned int index) const { return index < s.size() ? s[index] : '\0'; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  int indexOf(char c, unsigned int from = 0) const { return toIndex(s.find(c, from)); }
+  int indexOf(const String& str, unsigned int from = 0) const { return toIndex(s.find(str.s, from)); }
+  int lastIndexOf(char c) const { return toIndex(s.rfind(c)); }
+  String substring(unsigned int from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    if (from >= s.size()) return String();
+    return String(s.substr(from, to - from));
+  }
+
+  void remove(unsigned int index) { if (index < s.size()) s.erase(index); }
+  void remove(unsigned int index, unsigned int count) { if (index < s.size()) s.erase(index, count); }
+  void trim() {
+    size_t first = s.find_first_not_of(" \t\r\n");
+    size_t last = s.find_last_not_of(" \t\r\n");
+    s = (first == std::string::npos) ? std::string() : s.substr(first, last - first + 1);
+  }
+  void toLowerCase() { for (auto& c : s) c = static_cast<char>(tolower(static_cast<unsigned char>(c))); }
+  void toUpperCase() { for (auto& c : s) c = static_cast<char>(toupper(static_cast<unsigned char>(c))); }
+  long toInt() const { return strtol(s.c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(s.c_str(), nullptr); }
+
+private:
+  static int toIndex(size_t pos) { return pos == std::string::npos ? -1 : static_cast<int>(pos); }
+
+  void fromLong(long value, unsigned char base) {
+    if (base == 10) {
+      s = std::to_string(value);
+    } else {
+      fromULong(static_cast<unsigned long>(value), base);
+    }
+  }
+
+  void fromULong(unsigned long value, unsigned char base) {
+    if (base == 10) {
+      s = std::to_string(value);
+      return;
+    }
+    char buf[8 * sizeof(long) + 1];
+    char* p = &buf[sizeof(buf) - 1];
+    *p = '\0';
+    do {
+      unsigned digit = value % base;
+      *--p = static_cast<char>(digit < 10 ? '0' + digit : 'A' + digit - 10);
+      value /= base;
+    } while (value);
+    s = p;
+  }
+
+  void fromDouble(double value, unsigned int decimals) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", static_cast<int>(decimals), value);
+    s = buf;
+  }
+
+  std::string s;
+};
+
+class StringSumHelper : public String {
+public:
+  StringSumHelper(const String& str) : String(str) {}
+};
+
+template <typename T>
+inline StringSumHelper operator+(const String& lhs, const T& rhs) {
+  StringSumHelper sum(lhs);
+  sum.concat(rhs);
+  return sum;
+}
+
+inline StringSumHelper operator+(const char* lhs, const String& rhs) {
+  StringSumHelper sum{String(lhs)};
+  sum.concat(rhs);
+  return sum;
+}
+
+class Print {
+public:
+  virtual ~Print() = default;
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+      n += write(*buffer++);
+    }
+    return n;
+  }
+  size_t write(const char* str) { return str ? write(reinterpret_cast<const uint8_t*>(str), strlen(str)) : 0; }
+  size_t write(const char* buffer, size_t size) { return write(reinterpret_cast<const uint8_t*>(buffer), size); }
+
+  size_t print(const char* str) { return write(str); }
+  size_t print(const String& str) { return write(str.c_str(), str.length()); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(int n, int base = DEC) { return print(String(n, static_cast<unsigned char>(base))); }
+  size_t print(unsigned int n, int base = DEC) { return print(String(n, static_cast<unsigned char>(base))); }
+  size_t print(long n, int base = DEC) { return print(String(n, static_cast<unsigned char>(base))); }
+  size_t print(unsigned long n, int base = DEC) { return print(String(n, static_cast<unsigned char>(base))); }
+  size_t print(double n, int digits = 2) { return print(String(n, static_cast<unsigned int>(digits))); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T& value) { size_t n = print(value); return n + println(); }
+  template <typename T>
+  size_t println(const T& value, int format) { size_t n = print(value, format); return n + println(); }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    char stackBuf[128];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(stackBuf, sizeof(stackBuf), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    if (static_cast<size_t>(len) < sizeof(stackBuf)) {
+      return write(stackBuf, static_cast<size_t>(len));
+    }
+    std::string heapBuf(static_cast<size_t>(len) + 1, '\0');
+    va_start(args, format);
+    vsnprintf(&heapBuf[0], heapBuf.size(), format, args);
+    va_end(args);
+    return write(heapBuf.data(), static_cast<size_t>(len));
+  }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long timeout) { timeoutMs = timeout; }
+
+  size_t readBytes(char* buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+      int c = read();
+      if (c < 0) break;
+      buffer[count++] = static_cast<char>(c);
+    }
+    return count;
+  }
+  size_t readBytes(uint8_t* buffer, size_t length) { return readBytes(reinterpret_cast<char*>(buffer), length); }
+
+  String readString() {
+    String ret;
+    int c;
+    while ((c = read()) >= 0) {
+      ret += static_cast<char>(c);
+    }
+    return ret;
+  }
+
+protected:
+  unsigned long timeoutMs = 1000;
+};
+
+// Serial output is counted (the 115200 baud UART is a real cost on the
+// device) and only echoed to stderr when HAL_SERIAL_ECHO is set.
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) { baudRate = baud; }
+  unsigned long baud() const { return baudRate; }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    hal::serial().bytes.fetch_add(size, std::memory_order_relaxed);
+    if (hal::serial().echo) {
+      fwrite(buffer, 1, size, stderr);
+    }
+    return size;
+  }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  operator bool() const { return true; }
+
+private:
+  unsigned long baudRate = 115200;
+};
+
+inline HardwareSerial Serial;
+
+class IPAddress {
+public:
+  IPAddress() : octets{0, 0, 0, 0} {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+  uint8_t operator[](int index) const { return octets[index]; }
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+    return String(buf);
+  }
+
+private:
+  uint8_t octets[4];
+};
+
+class EspClass {
+public:
+  void restart() { hal::system().restartRequested = true; }
+  uint32_t getFreeHeap() const { return 180 * 1024; }
+  uint32_t getMaxAllocHeap() const { return 110 * 1024; }
+  uint32_t getCpuFreqMHz() const { return 240; }
+  // The calling thread's CPU time in 240 MHz cycles, so cycle-count timing
+  // measures work done rather than the virtual clock.
+  uint32_t getCycleCount() const {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    uint64_t ns = static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+    return static_cast<uint32_t>(ns * 240 / 1000);
+  }
+};
+
+inline EspClass ESP;
@@ -0,0 +1,440 @@
+#pragma once
+// ESPAsyncWebServer subset. Routes are kept in a table and can be invoked
+// synchronously from host code through AsyncWebServer::dispatch(); responses
+// are rendered completely into the request so benches can inspect them.
+
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+#include "Arduino.h"
+#include "FS.h"
+
+typedef enum {
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_PATCH = 0b00010000,
+  HTTP_HEAD = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+
+class AsyncWebServerRequest;
+class AsyncWebServerResponse;
+
+typedef std::function<void(AsyncWebServerRequest*)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest*, const String&, size_t, uint8_t*, size_t, bool)>
+    ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest*, uint8_t*, size_t, size_t, size_t)> ArBodyHandlerFunction;
+typedef std::function<void(void)> ArDisconnectHandler;
+typedef std::function<String(const String&)> AwsTemplateProcessor;
+typedef std::function<size_t(uint8_t*, size_t, size_t)> AwsResponseFiller;
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF  // from a filler: nothing yet, call again later
+
+class AsyncWebServerResponse {
+public:
+  AsyncWebServerResponse(int status, const String& type) : code(status), contentType(type) {}
+  virtual ~AsyncWebServerResponse() = default;
+
+  void addHeader(const char* name, const char* value) { headers[name] = value; }
+  void addHeader(const String& name, const String& value) { headers[name.c_str()] = value.c_str(); }
+  void setCode(int status) { code = status; }
+  void setContentType(const String& type) { contentType = type; }
+
+  // Produce the full body; chunked and stream responses override this.
+  virtual void render(std::string& out) { out = content; }
+
+  int code;
+  String contentType;
+  std::string content;
+  std::map<std::string, std::string> headers;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print {
+public:
+  explicit AsyncResponseStream(const String& type) : AsyncWebServerResponse(200, type) {}
+  size_t write(uint8_t c) override { content.push_back(static_cast<char>(c)); return 1; }
+  size_t write(const uint8_t* data, size_t len) override {
+    content.append(reinterpret_cast<const char*>(data), len);
+    return len;
+  }
+  using Print::write;
+};
+
+class AsyncChunkedResponse : public AsyncWebServerResponse {
+public:
+  AsyncChunkedResponse(const String& type, AwsResponseFiller responseFiller)
+      : AsyncWebServerResponse(200, type), filler(std::move(responseFiller)) {}
+
+  // The host drains the filler in TCP-window sized pieces, like AsyncTCP,
+  // calling again at once where the device would wait for the next poll.
+  void render(std::string& out) override {
+    uint8_t buf[1436];
+    size_t index = 0;
+    out.clear();
+    for (;;) {
+      size_t n = filler(buf, sizeof(buf), index);
+      if (n == RESPONSE_TRY_AGAIN) {
+        ++retries;
+        continue;
+      }
+      if (n == 0) break;
+      out.append(reinterpret_cast<const char*>(buf), n);
+      index += n;
+      ++chunks;
+    }
+  }
+
+  size_t chunks = 0;
+  size_t retries = 0;
+
+private:
+  AwsResponseFiller filler;
+};
+
+class AsyncWebServerRequest {
+public:
+  AsyncWebServerRequest(WebRequestMethod requestMethod, const String& requestUrl)
+      : method(requestMethod), requestUrl(requestUrl) {}
+
+  WebRequestMethod methodType() const { return method; }
+  const String& url() const { return requestUrl; }
+
+  size_t contentLength() const { return length; }
+  void onDisconnect(ArDisconnectHandler fn) { disconnectHandler = std::move(fn); }
+
+  void addArg(const String& name, const String& value) { args[name.c_str()] = value; }
+  void setContentLength(size_t bytes) { length = bytes; }
+  void addHeader(const String& name, const String& value) { requestHeaders[name.c_str()] = value; }
+
+  bool hasArg(const char* name) const { return args.count(name) > 0; }
+  String arg(const char* name) const {
+    auto it = args.find(name);
+    return it == args.end() ? String() : it->second;
+  }
+  bool hasHeader(const char* name) const { return requestHeaders.count(name) > 0; }
+  String header(const char* name) const {
+    auto it = requestHeaders.find(name);
+    return it == requestHeaders.end() ? String() : it->second;
+  }
+
+  AsyncWebServerResponse* beginResponse(int code, const String& contentType = String(),
+                                        const String& content = String()) {
+    auto* response = new AsyncWebServerResponse(code, contentType);
+    response->content = content.c_str();
+    return response;
+  }
+  AsyncWebServerResponse* beginResponse(int code, const String& contentType, const uint8_t* content, size_t length) {
+    auto* response = new AsyncWebServerResponse(code, contentType);
+    response->content.assign(reinterpret_cast<const char*>(content), length);
+    return response;
+  }
+  // nullptr when the file does not exist, like the library. With a
+  // processor, %NAME% placeholders are replaced the way
+  // AsyncAbstractResponse does it while streaming ("%%" is a literal %).
+  AsyncWebServerResponse* beginResponse(fs::FS& fs, const String& path, const String& contentType = String(),
+                                        bool download = false, AwsTemplateProcessor processor = nullptr) {
+    (void)download;
+    File file = fs.open(path.c_str(), "r");
+    if (!file) {
+      return nullptr;
+    }
+    auto* response = new AsyncWebServerResponse(200, contentType);
+    response->content.resize(file.size());
+    file.read(reinterpret_cast<uint8_t*>(&response->content[0]), file.size());
+    if (processor) {
+      response->content = applyTemplate(response->content, processor);
+    }
+    return response;
+  }
+  AsyncResponseStream* beginResponseStream(const String& contentType, size_t = 1460) {
+    return new AsyncResponseStream(contentType);
+  }
+  AsyncWebServerResponse* beginChunkedResponse(const String& contentType, AwsResponseFiller filler) {
+    return new AsyncChunkedResponse(contentType, std::move(filler));
+  }
+
+  void send(AsyncWebServerResponse* response) {
+    result.reset(response);
+    result->render(body);
+  }
+  void send(int code, const String& contentType = String(), const String& content = String()) {
+    send(beginResponse(code, contentType, content));
+  }
+  void send(int code, const char* contentType, const char* content) {
+    send(code, String(contentType), String(content));
+  }
+  void send(fs::FS& fs, const String& path, const String& contentType = String(), bool download = false,
+            AwsTemplateProcessor processor = nullptr) {
+    AsyncWebServerResponse* response = beginResponse(fs, path, contentType, download, processor);
+    if (!response) {
+      send(404);
+      return;
+    }
+    send(response);
+  }
+
+  // Inspection helpers for host code.
+  int responseCode() const { return result ? result->code : 0; }
+  const std::string& responseBody() const { return body; }
+  const AsyncWebServerResponse* response() const { return result.get(); }
+  // The connection closing, after the response or half way through the body.
+  void disconnect() {
+    if (disconnectHandler) {
+      ArDisconnectHandler handler = std::move(disconnectHandler);
+      disconnectHandler = nullptr;
+      handler();
+    }
+  }
+
+private:
+  static std::string applyTemplate(const std::string& in, const AwsTemplateProcessor& processor) {
+    const size_t maxNameLength = 32;  // TEMPLATE_PARAM_NAME_LENGTH
+    std::string out;
+    for (size_t i = 0; i < in.size(); ++i) {
+      if (in[i] != '%') {
+        out.push_back(in[i]);
+        continue;
+      }
+      size_t close = in.find('%', i + 1);
+      if (close == i + 1) {
+        out.push_back('%');
+        i = close;
+      } else if (close != std::string::npos && close - i - 1 <= maxNameLength) {
+        out += processor(String(in.substr(i + 1, close - i - 1).c_str())).c_str();
+        i = close;
+      } else {
+        out.push_back('%');
+      }
+    }
+    return out;
+  }
+
+  WebRequestMethod method;
+  String requestUrl;
+  std::map<std::string, String> args;
+  std::map<std::string, String> requestHeaders;
+  std::unique_ptr<AsyncWebServerResponse> result;
+  std::string body;
+  size_t length = 0;
+  ArDisconnectHandler disconnectHandler;
+};
+
+class AsyncWebHandler {
+public:
+  virtual ~AsyncWebHandler() = default;
+};
+
+// A dashboard connection. Messages are delivered (and counted in
+// hal::publishes()) at once unless the host has stalled the client, in which
+// case they wait in its queue, as behind a congested TCP window, until
+// deliver() is called.
+class AsyncEventSourceClient {
+public:
+  void send(const char* message, const char* event = nullptr, uint32_t id = 0, uint32_t reconnect = 0) {
+    (void)id;
+    (void)reconnect;
+    if (closed) {
+      return;
+    }
+    eventCounts[event ? event : "message"]++;
+    queued.push_back(strlen(message));
+    if (!stalled) {
+      deliver();
+    }
+  }
+  uint32_t lastId() const { return 0; }
+  bool connected() const { return !closed; }
+  size_t packetsWaiting() const { return queued.size(); }
+  void close() { closed = true; }
+
+  // Host helpers.
+  void stall(bool on) { stalled = on; }
+  void deliver(size_t messages = SIZE_MAX) {
+    while (messages-- > 0 && !queued.empty()) {
+      hal::publishes().sseMessages.fetch_add(1, std::memory_order_relaxed);
+      hal::publishes().sseBytes.fetch_add(queued.front(), std::memory_order_relaxed);
+      deliveredBytes += queued.front();
+      queued.pop_front();
+    }
+  }
+  uint64_t delivered() const { return deliveredBytes; }
+  size_t queuedBytes() const {
+    size_t bytes = 0;
+    for (size_t size : queued) bytes += size;
+    return bytes;
+  }
+  // Events of one name accepted for sending.
+  size_t events(const char* name) const {
+    auto it = eventCounts.find(name);
+    return it == eventCounts.end() ? 0 : it->second;
+  }
+
+private:
+  std::deque<size_t> queued;  // message sizes
+  std::map<std::string, size_t> eventCounts;
+  bool stalled = false;
+  bool closed = false;
+  uint64_t deliveredBytes = 0;
+};
+
+typedef std::function<void(AsyncEventSourceClient*)> ArEventHandlerFunction;
+
+// Event source with a configurable number of simulated clients; each send()
+// is charged once per client, as AsyncEventSource fans out per connection.
+class AsyncEventSource : public AsyncWebHandler {
+public:
+  explicit AsyncEventSource(const String& url) : path(url) { instances().push_back(this); }
+
+  // Every event source constructed by the firmware, for host code to drive.
+  static std::vector<AsyncEventSource*>& instances() {
+    static std::vector<AsyncEventSource*> all;
+    return all;
+  }
+
+  void onConnect(ArEventHandlerFunction cb) { connectHandler = std::move(cb); }
+  void onDisconnect(ArEventHandlerFunction cb) { disconnectHandler = std::move(cb); }
+
+  void send(const char* message, const char* event = nullptr, uint32_t id = 0, uint32_t reconnect = 0) {
+    for (auto& client : simulatedClients) {
+      client.send(message, event, id, reconnect);
+    }
+  }
+
+  size_t count() const {
+    size_t open = 0;
+    for (const auto& client : simulatedClients) {
+      open += client.connected() ? 1 : 0;
+    }
+    return open;
+  }
+
+  // Host helper: attach or drop simulated dashboards.
+  void setClientCount(size_t clients) {
+    reap();
+    size_t before = simulatedClients.size();
+    while (simulatedClients.size() > clients) {
+      if (disconnectHandler) {
+        disconnectHandler(&simulatedClients.back());
+      }
+      simulatedClients.pop_back();
+    }
+    simulatedClients.resize(clients);
+    for (auto it = std::next(simulatedClients.begin(), static_cast<long>(before)); it != simulatedClients.end(); ++it) {
+      if (connectHandler) {
+        connectHandler(&*it);
+      }
+    }
+  }
+
+  AsyncEventSourceClient& client(size_t index) { return *std::next(simulatedClients.begin(), static_cast<long>(index)); }
+
+  // Host helper: report and forget closed clients, as the library does once
+  // their socket is gone. Returns how many were closed.
+  size_t reap() {
+    size_t reaped = 0;
+    for (auto it = simulatedClients.begin(); it != simulatedClients.end();) {
+      if (it->connected()) {
+        ++it;
+        continue;
+      }
+      if (disconnectHandler) {
+        disconnectHandler(&*it);
+      }
+      it = simulatedClients.erase(it);
+      ++reaped;
+    }
+    return reaped;
+  }
+
+private:
+  String path;
+  ArEventHandlerFunction connectHandler;
+  ArEventHandlerFunction disconnectHandler;
+  std::list<AsyncEventSourceClient> simulatedClients;  // stable addresses, like the library's pointers
+};
+
+class AsyncWebServer {
+public:
+  explicit AsyncWebServer(uint16_t port) : listenPort(port) { instances().push_back(this); }
+
+  static std::vector<AsyncWebServer*>& instances() {
+    static std::vector<AsyncWebServer*> all;
+    return all;
+  }
+
+  void on(const char* uri, WebRequestMethod method, ArRequestHandlerFunction onRequest,
+          ArUploadHandlerFunction onUpload = nullptr, ArBodyHandlerFunction onBody = nullptr) {
+    routes.push_back({uri, method, std::move(onRequest), std::move(onUpload), std::move(onBody)});
+  }
+
+  void addHandler(AsyncWebHandler* handler) { handlers.push_back(handler); }
+  void begin() {}
+
+  // Host helper: run the matching route's request handler synchronously.
+  bool dispatch(AsyncWebServerRequest& request) {
+    for (auto& route : routes) {
+      // Like AsyncCallbackWebHandler, "/x" also handles "/x/..." sub-paths.
+      bool matches = route.uri == request.url() || request.url().startsWith(route.uri + "/");
+      if (matches && (route.method & request.methodType())) {
+        route.onRequest(&request);
+        return true;
+      }
+    }
+    request.send(404);
+    return false;
+  }
+
+  // Host helper: feed a multipart file part to the matching route's upload
+  // handler in chunks of chunkSize, as AsyncWebServerRequest parses it off
+  // the socket, then run its request handler. Form fields must already be
+  // set with addArg(). With stopAfter < size the body ends there and the
+  // connection drops instead.
+  bool upload(AsyncWebServerRequest& request, const String& filename, const uint8_t* data, size_t size,
+              size_t chunkSize = 1436, size_t stopAfter = SIZE_MAX) {
+    for (auto& route : routes) {
+      if (route.uri != request.url() || !(route.method & request.methodType()) || !route.onUpload) {
+        continue;
+      }
+      std::vector<uint8_t> chunk;
+      size_t index = 0;
+      do {
+        size_t n = size - index < chunkSize ? size - index : chunkSize;
+        if (index + n > stopAfter) {
+          n = stopAfter - index;
+        }
+        chunk.assign(data + index, data + index + n);
+        bool final = index + n == size;
+        route.onUpload(&request, filename, index, chunk.data(), n, final);
+        index += n;
+        if (index == stopAfter && !final) {
+          request.disconnect();
+          return false;
+        }
+      } while (index < size);
+      route.onRequest(&request);
+      return true;
+    }
+    request.send(404);
+    return false;
+  }
+
+private:
+  struct Route {
+    String uri;
+    WebRequestMethod method;
+    ArRequestHandlerFunction onRequest;
+    ArUploadHandlerFunction onUpload;
+    ArBodyHandlerFunction onBody;
+  };
+
+  uint16_t listenPort;
+  std::vector<Route> routes;
+  std::vector<AsyncWebHandler*> handlers;
+};
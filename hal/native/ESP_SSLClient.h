@@ -0,0 +1,28 @@
+#pragma once
+
+#include "WiFiClient.h"
+
+class ESP_SSLClient : public Client {
+public:
+  void setClient(Client* client, bool enableSSL = true) { base = client; ssl = enableSSL; }
+  void setInsecure() {}
+  bool connectSSL() {
+    if (!base || !base->connected()) {
+      return false;
+    }
+    handshake();
+    return true;
+  }
+  int connect(const char* host, uint16_t port) override { return base ? base->connect(host, port) : 0; }
+  uint8_t connected() override { return base ? base->connected() : 0; }
+  void stop() override {
+    if (base) {
+      base->stop();
+    }
+  }
+  bool exchange(uint32_t roundTrips) override { return base && base->exchange(roundTrips); }
+
+private:
+  Client* base = nullptr;
+  bool ssl = true;
+};
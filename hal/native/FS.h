@@ -0,0 +1,180 @@
+#pragma once
+// In-memory flat filesystem with the fs::FS / fs::File surface of the ESP32
+// core. Paths are plain keys, as on SPIFFS; "directories" are prefixes.
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
+#include "Arduino.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+using Blob = std::shared_ptr<std::vector<uint8_t>>;
+
+class File : public Stream {
+public:
+  File() = default;
+  File(const std::string& path, Blob blob, bool writable)
+      : filePath(path), data(std::move(blob)), canWrite(writable) {}
+  File(const std::string& dirPath, std::vector<std::string> entries, std::map<std::string, Blob>* files)
+      : filePath(dirPath), dirEntries(std::move(entries)), tree(files), directory(true) {}
+
+  explicit operator bool() const { return data != nullptr || directory; }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t size) override {
+    if (!data || !canWrite) return 0;
+    if (pos + size > data->size()) data->resize(pos + size);
+    memcpy(data->data() + pos, buf, size);
+    pos += size;
+    hal::flash().bytesWritten.fetch_add(size, std::memory_order_relaxed);
+    hal::flash().writeCalls.fetch_add(1, std::memory_order_relaxed);
+    return size;
+  }
+  using Print::write;
+
+  int available() override { return data ? static_cast<int>(data->size() - pos) : 0; }
+  int read() override { return (data && pos < data->size()) ? (*data)[pos++] : -1; }
+  int peek() override { return (data && pos < data->size()) ? (*data)[pos] : -1; }
+  size_t read(uint8_t* buf, size_t size) {
+    if (!data || pos >= data->size()) return 0;
+    size_t n = std::min(size, data->size() - pos);
+    memcpy(buf, data->data() + pos, n);
+    pos += n;
+    return n;
+  }
+  void flush() {}
+
+  bool seek(uint32_t offset, SeekMode mode = SeekSet) {
+    if (!data) return false;
+    size_t base = mode == SeekSet ? 0 : (mode == SeekCur ? pos : data->size());
+    size_t target = base + offset;
+    if (target > data->size()) return false;
+    pos = target;
+    return true;
+  }
+  size_t position() const { return pos; }
+  size_t size() const { return data ? data->size() : 0; }
+  void close() { data.reset(); directory = false; }
+
+  const char* name() const {
+    size_t slash = filePath.find_last_of('/');
+    return slash == std::string::npos ? filePath.c_str() : filePath.c_str() + slash + 1;
+  }
+  const char* path() const { return filePath.c_str(); }
+  bool isDirectory() const { return directory; }
+
+  File openNextFile(const char* mode = FILE_READ) {
+    while (directory && nextEntry < dirEntries.size()) {
+      auto it = tree->find(dirEntries[nextEntry++]);
+      if (it != tree->end()) {
+        return File(it->first, it->second, mode[0] != 'r');
+      }
+    }
+    return File();
+  }
+
+private:
+  std::string filePath;
+  Blob data;
+  size_t pos = 0;
+  bool canWrite = false;
+  std::vector<std::string> dirEntries;
+  std::map<std::string, Blob>* tree = nullptr;
+  size_t nextEntry = 0;
+  bool directory = false;
+};
+
+class FS {
+public:
+  explicit FS(size_t capacity) : capacityBytes(capacity) {}
+
+  File open(const char* path, const char* mode = FILE_READ, bool create = false) {
+    if (!mounted) return File();
+    std::string key = path;
+    if (mode[0] == 'r') {
+      auto it = files.find(key);
+      if (it != files.end()) return File(key, it->second, false);
+      return openDirectory(key);
+    }
+    ++changes;
+    Blob& blob = files[key];
+    if (!blob || mode[0] == 'w') blob = std::make_shared<std::vector<uint8_t>>();
+    File file(key, blob, true);
+    if (mode[0] == 'a') file.seek(0, SeekEnd);
+    (void)create;
+    return file;
+  }
+  File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+
+  bool exists(const char* path) const {
+    if (!mounted) return false;
+    std::string key = path;
+    if (files.count(key)) return true;
+    std::string prefix = key.back() == '/' ? key : key + "/";
+    auto it = files.lower_bound(prefix);
+    return it != files.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+  }
+  bool exists(const String& path) const { return exists(path.c_str()); }
+  bool remove(const char* path) {
+    if (!mounted) return false;
+    ++changes;
+    return files.erase(path) > 0;
+  }
+  bool remove(const String& path) { return remove(path.c_str()); }
+  bool rename(const char* from, const char* to) {
+    if (!mounted) return false;
+    ++changes;
+    auto it = files.find(from);
+    if (it == files.end()) return false;
+    Blob blob = it->second;
+    files.erase(it);
+    files[to] = blob;
+    return true;
+  }
+  bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+  bool mkdir(const char*) { return true; }
+
+  size_t totalBytes() const { return capacityBytes; }
+  size_t usedBytes() const {
+    size_t used = 0;
+    for (const auto& entry : files) used += entry.second->size();
+    return used;
+  }
+  // Opens for writing, removes and renames so far: what a bench checks to
+  // see that nothing touched the filesystem over some span
+  uint32_t mutations() const { return changes; }
+
+protected:
+  void format() { files.clear(); }
+
+  bool mounted = true;  // open(), exists(), remove() and rename() fail once unmounted
+
+private:
+  File openDirectory(const std::string& key) {
+    std::string prefix = (key.empty() || key.back() != '/') ? key + "/" : key;
+    std::vector<std::string> entries;
+    for (auto it = files.lower_bound(prefix); it != files.end(); ++it) {
+      if (it->first.compare(0, prefix.size(), prefix) != 0) break;
+      entries.push_back(it->first);
+    }
+    if (entries.empty() && prefix != "/") return File();
+    return File(key, std::move(entries), &files);
+  }
+
+  size_t capacityBytes;
+  std::map<std::string, Blob> files;
+  uint32_t changes = 0;
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
@@ -0,0 +1,116 @@
+#pragma once
+// LiquidCrystal_I2C stand-in. Keeps the visible character grid so benches can
+// inspect the screen, and charges I2C traffic the way the real driver does:
+// every LCD byte goes out as two nibbles through the PCF8574 expander, each
+// nibble being three single-byte transactions (data, EN high, EN low).
+
+#include <cstring>
+#include <vector>
+#include "Arduino.h"
+#include "Wire.h"
+
+namespace hal {
+
+struct LcdStats {
+  std::atomic<uint64_t> dataBytes{0};
+  std::atomic<uint64_t> commandBytes{0};
+  std::atomic<uint64_t> clears{0};
+};
+
+inline LcdStats& lcd() {
+  static LcdStats stats;
+  return stats;
+}
+
+}  // namespace hal
+
+class LiquidCrystal_I2C : public Print {
+public:
+  LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows) : addr(address), numCols(cols), numRows(rows) {
+    memset(screen, ' ', sizeof(screen));
+    instances().push_back(this);
+  }
+
+  // Every display constructed so far, in order, for inspection from host code.
+  static std::vector<LiquidCrystal_I2C*>& instances() {
+    static std::vector<LiquidCrystal_I2C*> all;
+    return all;
+  }
+
+  void init() {
+    for (int i = 0; i < 6; ++i) {
+      command(0x33);
+    }
+    clear();
+  }
+
+  void backlight() { expanderWrite(); }
+  void noBacklight() { expanderWrite(); }
+
+  void clear() {
+    command(0x01);
+    hal::lcd().clears.fetch_add(1, std::memory_order_relaxed);
+    memset(screen, ' ', sizeof(screen));
+    col = row = 0;
+    delayMicroseconds(2000);
+  }
+
+  void home() {
+    command(0x02);
+    col = row = 0;
+    delayMicroseconds(2000);
+  }
+
+  void setCursor(uint8_t newCol, uint8_t newRow) {
+    command(0x80);
+    col = newCol;
+    row = newRow < numRows ? newRow : static_cast<uint8_t>(numRows - 1);
+  }
+
+  size_t write(uint8_t value) override {
+    sendByte();
+    hal::lcd().dataBytes.fetch_add(1, std::memory_order_relaxed);
+    if (row < kMaxRows && col < kMaxCols) {
+      screen[row][col] = static_cast<char>(value);
+    }
+    ++col;
+    return 1;
+  }
+
+  using Print::write;
+
+  // Current contents of one row, for inspection from host code.
+  const char* rowText(uint8_t r, char* out) const {
+    memcpy(out, screen[r], numCols);
+    out[numCols] = '\0';
+    return out;
+  }
+
+private:
+  static constexpr uint8_t kMaxCols = 40;
+  static constexpr uint8_t kMaxRows = 4;
+
+  void command(uint8_t) {
+    sendByte();
+    hal::lcd().commandBytes.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void sendByte() {
+    for (int nibble = 0; nibble < 2; ++nibble) {
+      expanderWrite();
+      expanderWrite();
+      delayMicroseconds(1);
+      expanderWrite();
+      delayMicroseconds(50);
+    }
+  }
+
+  void expanderWrite() { hal::i2c().transfer(2); }
+
+  uint8_t addr;
+  uint8_t numCols;
+  uint8_t numRows;
+  uint8_t col = 0;
+  uint8_t row = 0;
+  char screen[kMaxRows][kMaxCols];
+};
@@ -0,0 +1,84 @@
+#pragma once
+// PicoMQTT broker stand-in. There is no network; publishes are counted and
+// the subscription hooks can be driven directly by host code.
+
+#include <algorithm>
+#include <vector>
+#include "Arduino.h"
+
+namespace PicoMQTT {
+
+class Subscriber {
+public:
+  // MQTT topic filter matching with '+' and '#' wildcards.
+  static bool topic_matches(const char* filter, const char* topic) {
+    while (*filter && *topic) {
+      if (*filter == '#') {
+        return true;
+      }
+      if (*filter == '+') {
+        while (*topic && *topic != '/') ++topic;
+        ++filter;
+        continue;
+      }
+      if (*filter != *topic) {
+        return false;
+      }
+      ++filter;
+      ++topic;
+    }
+    if (*topic) {
+      return false;
+    }
+    // "a/#" also matches "a", and a trailing '+' matches an empty level.
+    return *filter == '\0' || strcmp(filter, "/#") == 0 || strcmp(filter, "#") == 0 || strcmp(filter, "+") == 0;
+  }
+};
+
+class Server {
+public:
+  explicit Server(uint16_t port = 1883) : listenPort(port) { instances().push_back(this); }
+  virtual ~Server() {
+    auto& all = instances();
+    all.erase(std::remove(all.begin(), all.end(), this), all.end());
+  }
+
+  static std::vector<Server*>& instances() {
+    static std::vector<Server*> all;
+    return all;
+  }
+
+  // Host-only: play a client's subscription traffic through the hooks.
+  void simulateSubscribe(const char* clientId, const char* filter) { on_subscribe(clientId, filter); }
+  void simulateUnsubscribe(const char* clientId, const char* filter) { on_unsubscribe(clientId, filter); }
+  void simulateDisconnect(const char* clientId) { on_disconnected(clientId); }
+
+  void begin() {}
+  void loop() {}
+
+  bool publish(const char* topic, const char* payload, uint8_t qos = 0, bool retain = false, uint16_t messageId = 0) {
+    return publish(topic, payload, strlen(payload), qos, retain, messageId);
+  }
+  bool publish(const char* topic, const void* payload, size_t length, uint8_t qos = 0, bool retain = false,
+               uint16_t messageId = 0) {
+    (void)topic;
+    (void)payload;
+    (void)qos;
+    (void)retain;
+    (void)messageId;
+    hal::publishes().mqttMessages.fetch_add(1, std::memory_order_relaxed);
+    hal::publishes().mqttBytes.fetch_add(length, std::memory_order_relaxed);
+    return true;
+  }
+
+protected:
+  virtual void on_connected(const char*) {}
+  virtual void on_disconnected(const char*) {}
+  virtual void on_subscribe(const char*, const char*) {}
+  virtual void on_unsubscribe(const char*, const char*) {}
+
+private:
+  uint16_t listenPort;
+};
+
+}  // namespace PicoMQTT
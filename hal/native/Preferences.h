@@ -0,0 +1,98 @@
+#pragma once
+// NVS stand-in: namespaces of byte-string keys in RAM that outlive every
+// Preferences object, as NVS outlives a reboot. Entries are charged against
+// the 20 KB nvs partition of the default table.
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+
+namespace hal {
+
+struct NvsStore {
+  std::map<std::string, std::map<std::string, std::vector<uint8_t>>> namespaces;
+  size_t capacityBytes = 0x5000;
+
+  size_t usedBytes() const {
+    size_t used = 0;
+    for (const auto& space : namespaces) {
+      for (const auto& entry : space.second) {
+        used += 32 + entry.second.size();  // one 32-byte entry header per key
+      }
+    }
+    return used;
+  }
+};
+
+inline NvsStore& nvs() {
+  static NvsStore store;
+  return store;
+}
+
+}  // namespace hal
+
+class Preferences {
+public:
+  bool begin(const char* name, bool readOnly = false, const char* /*partitionLabel*/ = nullptr) {
+    if (!name || strlen(name) > 15) return false;
+    space = name;
+    readOnlyMode = readOnly;
+    open = true;
+    return true;
+  }
+  void end() { open = false; }
+
+  bool clear() {
+    if (!open || readOnlyMode) return false;
+    hal::nvs().namespaces.erase(space);
+    return true;
+  }
+  bool remove(const char* key) {
+    if (!open || readOnlyMode) return false;
+    return entries().erase(key) > 0;
+  }
+  bool isKey(const char* key) { return open && entries().count(key) > 0; }
+
+  size_t putBytes(const char* key, const void* value, size_t len) {
+    if (!open || readOnlyMode || !key || !value || !len || strlen(key) > 15) return 0;
+    std::vector<uint8_t> old;
+    auto it = entries().find(key);
+    if (it != entries().end()) old.swap(it->second);
+    entries()[key].assign(static_cast<const uint8_t*>(value), static_cast<const uint8_t*>(value) + len);
+    if (hal::nvs().usedBytes() > hal::nvs().capacityBytes) {
+      // NVS full: the write fails and the old value stays
+      if (old.empty()) {
+        entries().erase(key);
+      } else {
+        entries()[key].swap(old);
+      }
+      return 0;
+    }
+    return len;
+  }
+  size_t getBytesLength(const char* key) {
+    if (!open) return 0;
+    auto it = entries().find(key);
+    return it == entries().end() ? 0 : it->second.size();
+  }
+  size_t getBytes(const char* key, void* buf, size_t maxLen) {
+    size_t len = getBytesLength(key);
+    if (!len || !buf || len > maxLen) return 0;
+    memcpy(buf, entries()[key].data(), len);
+    return len;
+  }
+
+  size_t putUInt(const char* key, uint32_t value) { return putBytes(key, &value, sizeof(value)) ? 4 : 0; }
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0) {
+    uint32_t value = defaultValue;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+  }
+
+private:
+  std::map<std::string, std::vector<uint8_t>>& entries() { return hal::nvs().namespaces[space]; }
+
+  std::string space;
+  bool readOnlyMode = false;
+  bool open = false;
+};
@@ -0,0 +1,74 @@
+#pragma once
+// ReadyMail SMTP subset. Transport goes through the host Client, so
+// connect() fails fast unless a bench opens hal::network(); then each SMTP
+// step costs its round trips and a send fails once the server has dropped
+// the connection.
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+enum rfc822_header_types { rfc822_from, rfc822_sender, rfc822_to, rfc822_cc, rfc822_bcc, rfc822_subject };
+enum readymail_auth_type { readymail_auth_password, readymail_auth_accesstoken };
+
+struct SMTPStatus {
+  String text;
+  bool isComplete = false;
+};
+
+typedef void (*SMTPResponseCallback)(SMTPStatus status);
+typedef void (*TLSHandshakeCallback)(bool& success);
+
+class SMTPMessage {
+public:
+  struct Headers {
+    void add(rfc822_header_types, const char*) { ++count; }
+    int count = 0;
+  } headers;
+
+  struct Text {
+    void body(const char* content) { value = content; }
+    String value;
+  } text;
+
+  time_t timestamp = 0;
+};
+
+class SMTPClient {
+public:
+  explicit SMTPClient(Client& client, TLSHandshakeCallback tlsCallback = nullptr, bool startTLS = false)
+      : transport(client), tls(tlsCallback), useStartTLS(startTLS) {}
+
+  bool connect(const char* host, uint16_t port, SMTPResponseCallback cb = nullptr, bool ssl = true) {
+    (void)ssl;
+    // Greeting and EHLO, then STARTTLS and EHLO again over TLS
+    connected = transport.connect(host, port) != 0 && transport.exchange(2);
+    if (connected && useStartTLS) {
+      bool success = false;
+      if (transport.exchange(1) && tls) {
+        tls(success);
+      }
+      connected = success && transport.exchange(1);
+    }
+    if (cb) {
+      SMTPStatus status;
+      status.text = connected ? "Connected" : "Connection failed";
+      cb(status);
+    }
+    return connected;
+  }
+  bool isConnected() { return connected && transport.connected(); }
+  bool authenticate(const char*, const char*, readymail_auth_type) {
+    return authenticated = isConnected() && transport.exchange(2);
+  }
+  bool isAuthenticated() const { return authenticated; }
+  // MAIL FROM, RCPT TO, DATA, the message and its final dot
+  bool send(SMTPMessage&) { return isConnected() && authenticated && transport.exchange(4); }
+  void stop() { connected = authenticated = false; transport.stop(); }
+
+private:
+  Client& transport;
+  TLSHandshakeCallback tls;
+  bool useStartTLS;
+  bool connected = false;
+  bool authenticated = false;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "FS.h"
+
+namespace fs {
+
+class SPIFFSFS : public FS {
+public:
+  explicit SPIFFSFS(size_t capacity = 0xC0000) : FS(capacity) {}
+
+  bool begin(bool /*formatOnFail*/ = false, const char* /*basePath*/ = "/spiffs", uint8_t /*maxOpenFiles*/ = 10,
+             const char* partitionLabel = nullptr) {
+    mounted = !partitionLabel || strcmp(partitionLabel, "spiffs") == 0 ||
+              hal::system().extraPartitions.count(partitionLabel) > 0;
+    return mounted;
+  }
+  void end() { mounted = false; }
+  bool format() {
+    FS::format();
+    return true;
+  }
+};
+
+}  // namespace fs
+
+inline fs::SPIFFSFS SPIFFS;
@@ -0,0 +1,73 @@
+#pragma once
+// OTA writer stand-in: accepts and counts bytes, never touches flash.
+
+#include "Arduino.h"
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+#define U_FLASH 0
+#define U_SPIFFS 100
+
+class UpdateClass {
+public:
+  bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH, int /*ledPin*/ = -1, uint8_t /*ledOn*/ = LOW,
+             const char* /*label*/ = nullptr) {
+    if (running) return false;  // "already running", until end() or abort()
+    expected = size;
+    target = command;
+    written = 0;
+    error = false;
+    running = true;
+    return true;
+  }
+  size_t write(uint8_t* data, size_t len) {
+    (void)data;
+    if (!running || error) return 0;
+    if (written + len > failAt) {
+      // A flash write error part way through: the partial count comes back
+      size_t accepted = failAt > written ? failAt - written : 0;
+      written += accepted;
+      error = true;
+      return accepted;
+    }
+    written += len;
+    return len;
+  }
+  bool end(bool evenIfRemaining = false) {
+    if (!running) return false;
+    running = false;
+    if (!evenIfRemaining && expected != UPDATE_SIZE_UNKNOWN && written != expected) {
+      error = true;
+    }
+    if (!error) {
+      commits++;
+      committedBytes = written;
+    }
+    return !error;
+  }
+  void abort() {
+    aborts += running ? 1 : 0;
+    running = false;
+    error = true;
+  }
+  bool hasError() const { return error; }
+  bool isRunning() const { return running; }
+  size_t progress() const { return written; }
+  void printError(Print& out) { out.println(error ? "Update error" : "No error"); }
+
+  // Host helpers: the byte offset at which flash writes start failing, and
+  // how many updates were committed (and the size of the last) or aborted.
+  size_t failAt = SIZE_MAX;
+  int commits = 0;
+  size_t committedBytes = 0;
+  int aborts = 0;
+  int command() const { return target; }
+
+private:
+  size_t expected = 0;
+  size_t written = 0;
+  int target = U_FLASH;
+  bool error = false;
+  bool running = false;
+};
+
+inline UpdateClass Update;
@@ -0,0 +1,25 @@
+#pragma once
+// WiFi stand-in: always associated, with a fixed station address.
+
+#include <ctime>
+#include "Arduino.h"
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+typedef enum { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_CONNECT_FAILED = 4, WL_DISCONNECTED = 6 } wl_status_t;
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t) { return true; }
+  bool setHostname(const char*) { return true; }
+  wl_status_t begin(const char*, const char* = nullptr) { return connected ? WL_CONNECTED : WL_DISCONNECTED; }
+  wl_status_t status() const { return connected ? WL_CONNECTED : WL_DISCONNECTED; }
+  bool softAP(const char*, const char* = nullptr) { return true; }
+  IPAddress localIP() const { return IPAddress(192, 168, 0, 50); }
+  IPAddress softAPIP() const { return IPAddress(192, 168, 4, 1); }
+
+  bool connected = true;
+};
+
+inline WiFiClass WiFi;
+
+inline void configTime(long, int, const char*, const char* = nullptr, const char* = nullptr) {}
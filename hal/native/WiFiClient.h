@@ -0,0 +1,75 @@
+#pragma once
+// Network clients are inert on the host: connections fail, so the SMTP path
+// exercises its error handling without touching the network. A bench that
+// sets hal::network().reachable gets connections that cost virtual time and
+// are dropped by the "server" once idle for hal::network().idleDropMs. The
+// drop is silent, as behind a NAT timeout: connected() only turns false when
+// the next exchange fails. A command line written to the client directly
+// (as EmailNotifier's NOOP) is one exchange and reads back "250 OK".
+
+#include <string>
+#include "Arduino.h"
+
+class Client : public Stream {
+public:
+  virtual int connect(const char*, uint16_t) {
+    hal::NetworkSim& net = hal::network();
+    if (!net.reachable) {
+      return 0;
+    }
+    delay(net.connectMs);
+    net.connects++;
+    open = true;
+    lastUseMs = millis();
+    return 1;
+  }
+  virtual uint8_t connected() { return open ? 1 : 0; }
+  virtual void stop() { open = false; }
+  // Request/response pairs with the server, for the protocol shims.
+  virtual bool exchange(uint32_t roundTrips) {
+    uint32_t idleDropMs = hal::network().idleDropMs;
+    if (open && idleDropMs > 0 && millis() - lastUseMs >= idleDropMs) {
+      open = false;
+    }
+    if (!open) {
+      return false;
+    }
+    delay(roundTrips * hal::network().roundTripMs);
+    hal::network().roundTrips += roundTrips;
+    lastUseMs = millis();
+    return true;
+  }
+  size_t write(uint8_t c) override {
+    if (!connected()) {
+      return 0;
+    }
+    if (c == '\n') {
+      reply = exchange(1) ? "250 OK\r\n" : "";
+    }
+    return 1;
+  }
+  using Print::write;
+  int available() override { return static_cast<int>(reply.size()); }
+  int read() override {
+    if (reply.empty()) {
+      return -1;
+    }
+    int c = static_cast<uint8_t>(reply[0]);
+    reply.erase(0, 1);
+    return c;
+  }
+  int peek() override { return reply.empty() ? -1 : static_cast<uint8_t>(reply[0]); }
+
+protected:
+  static void handshake() {
+    delay(hal::network().handshakeMs);
+    hal::network().handshakes++;
+  }
+
+private:
+  bool open = false;
+  uint32_t lastUseMs = 0;
+  std::string reply;
+};
+
+class WiFiClient : public Client {};
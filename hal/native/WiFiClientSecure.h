@@ -0,0 +1,15 @@
+#pragma once
+
+#include "WiFiClient.h"
+
+class WiFiClientSecure : public WiFiClient {
+public:
+  void setInsecure() {}
+  int connect(const char* host, uint16_t port) override {
+    if (!WiFiClient::connect(host, port)) {
+      return 0;
+    }
+    handshake();
+    return 1;
+  }
+};
@@ -0,0 +1,18 @@
+#pragma once
+// I2C bus stand-in: transfers are only counted, devices are simulated by
+// the individual driver shims.
+
+#include "Arduino.h"
+
+class TwoWire {
+public:
+  bool begin() { return true; }
+  bool begin(int /*sda*/, int /*scl*/, uint32_t frequency = 100000) { clockHz = frequency; return true; }
+  void setClock(uint32_t frequency) { clockHz = frequency; }
+  uint32_t getClock() const { return clockHz; }
+
+private:
+  uint32_t clockHz = 100000;
+};
+
+inline TwoWire Wire;
@@ -0,0 +1,32 @@
+#pragma once
+// FreeRTOS subset for the native build: tasks are std::threads and ticks are
+// milliseconds of the HAL virtual clock (configTICK_RATE_HZ = 1000 on ESP32).
+
+#include <cstdint>
+#include "../native_hal.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY static_cast<TickType_t>(0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms) static_cast<TickType_t>(ms)
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+namespace hal {
+
+// Convert a tick timeout into an absolute virtual-clock deadline.
+inline uint64_t deadlineUs(TickType_t ticks) {
+  if (ticks == portMAX_DELAY) {
+    return UINT64_MAX;
+  }
+  return clock().nowUs() + static_cast<uint64_t>(ticks) * 1000ULL;
+}
+
+}  // namespace hal
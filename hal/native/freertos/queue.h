@@ -0,0 +1,117 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include "FreeRTOS.h"
+
+namespace hal {
+
+// Fixed-depth copy-in/copy-out queue with FreeRTOS semantics.
+struct Queue {
+  Queue(UBaseType_t length, UBaseType_t itemSize) : depth(length), size(itemSize), storage(length * itemSize) {}
+
+  bool push(const void* item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!waitFor(lock, ticks, parkedPushers, wokenPushers, [this] { return count < depth; })) {
+      return false;
+    }
+    memcpy(&storage[((head + count) % depth) * size], item, size);
+    ++count;
+    wakeOne(parkedPoppers, wokenPoppers);
+    return true;
+  }
+
+  bool pop(void* item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!waitFor(lock, ticks, parkedPoppers, wokenPoppers, [this] { return count > 0; })) {
+      return false;
+    }
+    memcpy(item, &storage[head * size], size);
+    head = (head + 1) % depth;
+    --count;
+    wakeOne(parkedPushers, wokenPushers);
+    return true;
+  }
+
+  UBaseType_t waiting() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return count;
+  }
+
+private:
+  // A parked task about to be woken is handed off to the clock; see
+  // Clock::handOff().
+  void wakeOne(UBaseType_t parked, UBaseType_t& woken) {
+    if (parked > woken) {
+      ++woken;
+      clock().handOff();
+    }
+    cv.notify_all();
+  }
+
+  template <typename Pred>
+  bool waitFor(std::unique_lock<std::mutex>& lock, TickType_t ticks, UBaseType_t& parked, UBaseType_t& woken,
+               Pred ready) {
+    if (ready()) {
+      return true;
+    }
+    if (ticks == 0) {
+      return false;
+    }
+    uint64_t deadline = deadlineUs(ticks);
+    ++parked;
+    clock().taskBlocked(deadline);
+    bool ok = true;
+    if (ticks == portMAX_DELAY) {
+      cv.wait(lock, ready);
+    } else {
+      // Timeouts are measured on the virtual clock, polled in short real slices.
+      while (!ready()) {
+        if (clock().nowUs() >= deadline) {
+          ok = false;
+          break;
+        }
+        cv.wait_for(lock, std::chrono::milliseconds(1));
+      }
+    }
+    --parked;
+    bool handedOff = woken > 0;
+    if (handedOff) {
+      --woken;
+    }
+    clock().taskResumed(handedOff);
+    return ok;
+  }
+
+  UBaseType_t depth;
+  UBaseType_t size;
+  std::vector<uint8_t> storage;
+  UBaseType_t head = 0;
+  UBaseType_t count = 0;
+  UBaseType_t parkedPushers = 0;
+  UBaseType_t parkedPoppers = 0;
+  UBaseType_t wokenPushers = 0;  // handed off, not yet resumed
+  UBaseType_t wokenPoppers = 0;
+  std::mutex mutex;
+  std::condition_variable cv;
+};
+
+}  // namespace hal
+
+typedef hal::Queue* QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  return new hal::Queue(length, itemSize);
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+  return queue->push(item, ticks) ? pdTRUE : pdFALSE;
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+  return queue->pop(item, ticks) ? pdTRUE : pdFALSE;
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) { return queue->waiting(); }
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include "FreeRTOS.h"
+
+namespace hal {
+
+// Binary/mutex semaphore with tick timeouts on the virtual clock.
+struct Semaphore {
+  explicit Semaphore(bool available) : taken(!available) {}
+
+  bool take(TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!taken) {
+      taken = true;
+      return true;
+    }
+    if (ticks == 0) {
+      return false;
+    }
+    uint64_t deadline = deadlineUs(ticks);
+    clock().taskBlocked(deadline);
+    while (taken && clock().nowUs() < deadline) {
+      cv.wait_for(lock, std::chrono::milliseconds(1));
+    }
+    clock().taskResumed();
+    if (taken) {
+      return false;
+    }
+    taken = true;
+    return true;
+  }
+
+  void give() {
+    std::lock_guard<std::mutex> lock(mutex);
+    taken = false;
+    cv.notify_one();
+  }
+
+  bool taken;
+  std::mutex mutex;
+  std::condition_variable cv;
+};
+
+}  // namespace hal
+
+typedef hal::Semaphore* SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return new hal::Semaphore(true); }
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return new hal::Semaphore(false); }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) { return sem->take(ticks) ? pdTRUE : pdFALSE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  sem->give();
+  return pdTRUE;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include "FreeRTOS.h"
+
+namespace hal {
+
+// Per-task state behind a TaskHandle_t: just the notification counter.
+// Waiters park on the clock, which xTaskNotifyGive() wakes.
+struct Task {
+  std::mutex mutex;
+  uint32_t notifications = 0;
+};
+
+inline Task*& currentTask() {
+  thread_local Task* task = nullptr;
+  return task;
+}
+
+}  // namespace hal
+
+typedef void (*TaskFunction_t)(void*);
+typedef hal::Task* TaskHandle_t;
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* /*name*/, uint32_t /*stackDepth*/,
+                                          void* param, UBaseType_t /*priority*/, TaskHandle_t* handle,
+                                          BaseType_t /*core*/) {
+  hal::Task* state = new hal::Task();
+  hal::clock().taskCreated();
+  std::thread worker([task, param, state] {
+    hal::currentTask() = state;
+    hal::clock().taskStarted();
+    task(param);
+  });
+  if (handle) {
+    *handle = state;
+  }
+  worker.detach();
+  return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stackDepth, void* param,
+                              UBaseType_t priority, TaskHandle_t* handle) {
+  return xTaskCreatePinnedToCore(task, name, stackDepth, param, priority, handle, tskNO_AFFINITY);
+}
+
+// The main thread (Arduino's loopTask) gets its state on first use.
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+  if (!hal::currentTask()) {
+    hal::currentTask() = new hal::Task();
+  }
+  return hal::currentTask();
+}
+
+inline TickType_t xTaskGetTickCount() { return hal::clock().nowMs(); }
+
+inline void vTaskDelay(TickType_t ticks) { hal::clock().delayUs(static_cast<uint64_t>(ticks) * 1000ULL); }
+
+inline void vTaskDelayUntil(TickType_t* previousWake, TickType_t increment) {
+  *previousWake += increment;
+  hal::clock().sleepUntilUs(static_cast<uint64_t>(*previousWake) * 1000ULL);
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    ++task->notifications;
+  }
+  hal::clock().wake();
+  return pdPASS;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticks) {
+  hal::Task* self = xTaskGetCurrentTaskHandle();
+  uint64_t deadline = hal::deadlineUs(ticks);
+  auto pending = [self] {
+    std::lock_guard<std::mutex> lock(self->mutex);
+    return self->notifications > 0;
+  };
+  if (hal::clock().onMainThread()) {
+    hal::clock().advanceUntilUs(deadline, pending);
+  } else if (ticks > 0) {
+    hal::clock().taskWaitUntilUs(deadline, pending);
+  }
+  std::lock_guard<std::mutex> lock(self->mutex);
+  uint32_t count = self->notifications;
+  if (count > 0) {
+    self->notifications = clearCountOnExit ? 0 : count - 1;
+  }
+  return count;
+}
@@ -0,0 +1,324 @@
+#pragma once
+// Host-side hardware abstraction used by the [env:native] build.
+//
+// The shim headers in this directory stand in for the Arduino/ESP32 APIs the
+// firmware headers include, so the monitor core compiles unchanged on Linux.
+// Everything observable (time, serial bytes, I2C traffic, publishes, flash
+// writes) is routed through the counters below so benchmarks can report it.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace hal {
+
+// Virtual clock: real monotonic time plus every delay() the main thread has
+// fast-forwarded. The loop's delay(50) therefore costs nothing on the host.
+// Tasks run in lockstep with it: after each fast-forward the main thread
+// waits until every task whose wake-up time has passed has run up to its next
+// blocking call, so a task's work lands at the virtual time it was due.
+class Clock {
+public:
+  Clock() : start(std::chrono::steady_clock::now()), mainThread(std::this_thread::get_id()) {}
+
+  uint64_t nowUs() const {
+    auto real = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    return static_cast<uint64_t>(real) + skippedUs.load(std::memory_order_relaxed);
+  }
+
+  uint32_t nowMs() const { return static_cast<uint32_t>(nowUs() / 1000ULL); }
+
+  bool onMainThread() const { return std::this_thread::get_id() == mainThread; }
+
+  void advanceUs(uint64_t us) {
+    skippedUs.fetch_add(us, std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.notify_all();
+    // Bounded in real time so a task stuck in real work cannot hang the host.
+    cv.wait_for(lock, std::chrono::milliseconds(50), [this] {
+      return runningTasks == 0 && handOffs == 0 && (deadlines.empty() || *deadlines.begin() > nowUs());
+    });
+  }
+
+  void sleepUntilUs(uint64_t targetUs) {
+    if (onMainThread()) {
+      uint64_t now = nowUs();
+      if (targetUs > now) advanceUs(targetUs - now);
+      return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    markBlocked();
+    auto entry = deadlines.insert(targetUs);
+    cv.notify_all();
+    for (uint64_t now = nowUs(); now < targetUs; now = nowUs()) {
+      cv.wait_for(lock, std::chrono::microseconds(targetUs - now));
+    }
+    deadlines.erase(entry);
+    markRunning();
+  }
+
+  // Main thread only: fast-forwards towards targetUs one task wake-up at a
+  // time and stops as soon as ready() holds, so a blocking wait that another
+  // task can end early (a notification) wakes at the virtual time it would
+  // on the device. Returns ready().
+  bool advanceUntilUs(uint64_t targetUs, const std::function<bool()>& ready) {
+    for (;;) {
+      if (ready()) return true;
+      uint64_t now = nowUs();
+      if (now >= targetUs) return false;
+      uint64_t next = targetUs;
+      {
+        // Let running tasks park first so their next wake-up is known.
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait_for(lock, std::chrono::milliseconds(50), [this] { return runningTasks == 0 && handOffs == 0; });
+        if (!deadlines.empty() && *deadlines.begin() < next) next = *deadlines.begin();
+      }
+      if (ready()) return true;
+      now = nowUs();
+      advanceUs(next > now ? next - now : 0);
+    }
+  }
+
+  // Task side of a blocking wait another thread can end early: parks until
+  // ready() holds or the virtual clock reaches wakeUs, waking as soon as the
+  // main thread fast-forwards or wake() is called. Returns ready().
+  bool taskWaitUntilUs(uint64_t wakeUs, const std::function<bool()>& ready) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (ready()) return true;
+    markBlocked();
+    auto entry = wakeUs != UINT64_MAX ? deadlines.insert(wakeUs) : deadlines.end();
+    cv.notify_all();
+    for (uint64_t now = nowUs(); !ready() && now < wakeUs; now = nowUs()) {
+      cv.wait_for(lock, std::chrono::microseconds(std::min<uint64_t>(wakeUs - now, 1000)));
+    }
+    if (entry != deadlines.end()) deadlines.erase(entry);
+    markRunning();
+    return ready();
+  }
+
+  void wake() {
+    std::lock_guard<std::mutex> lock(mutex);
+    cv.notify_all();
+  }
+
+  // delay() semantics: the main thread fast-forwards, tasks really wait.
+  void delayUs(uint64_t us) {
+    if (onMainThread()) {
+      advanceUs(us);
+    } else {
+      sleepUntilUs(nowUs() + us);
+    }
+  }
+
+  // Hooks for the other blocking primitives (queues, notifications) so the
+  // lockstep above knows when a task is parked. A timed wait passes its
+  // timeout so the main thread fast-forwards to it rather than past it.
+  void taskBlocked(uint64_t wakeUs = UINT64_MAX) {
+    if (onMainThread()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    markBlocked();
+    if (wakeUs != UINT64_MAX) {
+      timedWait() = deadlines.insert(wakeUs);
+      inTimedWait() = true;
+    }
+    cv.notify_all();
+  }
+
+  // A new task counts as running from the moment it is created, so the main
+  // thread cannot fast-forward past its first steps before the thread has
+  // even been scheduled.
+  void taskCreated() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++runningTasks;
+  }
+
+  void taskStarted() { countedAsRunning() = true; }
+
+  // A parked task has just been given what it waits for (a queue item): it
+  // counts as running until it resumes, so the main thread does not
+  // fast-forward in the gap before the thread is scheduled.
+  void handOff() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++handOffs;
+  }
+
+  void taskResumed(bool handedOff = false) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (handedOff && handOffs > 0) {
+      --handOffs;
+    }
+    if (onMainThread()) return;
+    if (inTimedWait()) {
+      deadlines.erase(timedWait());
+      inTimedWait() = false;
+    }
+    markRunning();
+  }
+
+private:
+  static bool& countedAsRunning() {
+    thread_local bool running = false;
+    return running;
+  }
+
+  static std::multiset<uint64_t>::iterator& timedWait() {
+    thread_local std::multiset<uint64_t>::iterator entry;
+    return entry;
+  }
+
+  static bool& inTimedWait() {
+    thread_local bool waiting = false;
+    return waiting;
+  }
+
+  void markBlocked() {
+    if (countedAsRunning()) {
+      countedAsRunning() = false;
+      --runningTasks;
+    }
+  }
+
+  void markRunning() {
+    if (!countedAsRunning()) {
+      countedAsRunning() = true;
+      ++runningTasks;
+    }
+  }
+
+  std::chrono::steady_clock::time_point start;
+  std::thread::id mainThread;
+  std::atomic<uint64_t> skippedUs{0};
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::multiset<uint64_t> deadlines;
+  int runningTasks = 0;
+  int handOffs = 0;
+};
+
+// Never destroyed: firmware tasks are still parked on it when main() returns.
+inline Clock& clock() {
+  static Clock* instance = new Clock();
+  return *instance;
+}
+
+// Wall-clock seconds that advance with the virtual clock, as if NTP had
+// synced at start-up.
+inline time_t epochNow(time_t* out = nullptr) {
+  // Not ::time(), which is this function on the host
+  static const time_t bootEpoch = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()) -
+                                  static_cast<time_t>(clock().nowUs() / 1000000ULL);
+  time_t now = bootEpoch + static_cast<time_t>(clock().nowUs() / 1000000ULL);
+  if (out) {
+    *out = now;
+  }
+  return now;
+}
+
+struct SerialStats {
+  std::atomic<uint64_t> bytes{0};
+  bool echo = std::getenv("HAL_SERIAL_ECHO") != nullptr;
+};
+
+inline SerialStats& serial() {
+  static SerialStats stats;
+  return stats;
+}
+
+// Bus time assumes the ESP32 default 100 kHz clock: 9 bit times per byte
+// (8 data + ACK) plus start/stop conditions per transaction.
+struct I2CStats {
+  std::atomic<uint64_t> transactions{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> busTimeUs{0};
+
+  void transfer(uint32_t count) {
+    transactions.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(count, std::memory_order_relaxed);
+    busTimeUs.fetch_add((count * 9ULL + 2ULL) * 10ULL, std::memory_order_relaxed);
+  }
+};
+
+inline I2CStats& i2c() {
+  static I2CStats stats;
+  return stats;
+}
+
+// Simulated sensor attached to the bus. With Kind::None the firmware falls
+// back to its USE_DEBUG random walk, exactly as on a board without a sensor.
+struct SensorModel {
+  enum Kind { None, BMP180, BME280 };
+  Kind kind = None;
+  std::function<float(uint32_t ms)> temperature = [](uint32_t) { return 21.0f; };
+  std::function<float(uint32_t ms)> humidity = [](uint32_t) { return 45.0f; };
+};
+
+inline SensorModel& sensorModel() {
+  static SensorModel model;
+  return model;
+}
+
+struct PublishStats {
+  std::atomic<uint64_t> mqttMessages{0};
+  std::atomic<uint64_t> mqttBytes{0};
+  std::atomic<uint64_t> sseMessages{0};
+  std::atomic<uint64_t> sseBytes{0};
+};
+
+inline PublishStats& publishes() {
+  static PublishStats stats;
+  return stats;
+}
+
+struct FlashStats {
+  std::atomic<uint64_t> bytesWritten{0};
+  std::atomic<uint64_t> writeCalls{0};
+};
+
+inline FlashStats& flash() {
+  static FlashStats stats;
+  return stats;
+}
+
+// Network clients are unreachable unless a bench opens the network: then
+// connects and TLS handshakes take these virtual times, and a server drops a
+// connection left idle for idleDropMs (0: never).
+struct NetworkSim {
+  std::atomic<bool> reachable{false};
+  std::atomic<uint32_t> connectMs{0};
+  std::atomic<uint32_t> handshakeMs{0};
+  std::atomic<uint32_t> roundTripMs{0};
+  std::atomic<uint32_t> idleDropMs{0};
+  std::atomic<uint64_t> connects{0};
+  std::atomic<uint64_t> handshakes{0};
+  std::atomic<uint64_t> roundTrips{0};
+};
+
+inline NetworkSim& network() {
+  static NetworkSim sim;
+  return sim;
+}
+
+struct SystemState {
+  std::atomic<bool> restartRequested{false};
+  // Data partitions beyond the default table's "spiffs", by label; mounting
+  // any other label fails, as on a device without it
+  std::set<std::string> extraPartitions;
+};
+
+inline SystemState& system() {
+  static SystemState state;
+  return state;
+}
+
+}  // namespace hal
@@ -0,0 +1,193 @@
+#pragma once
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "lcd_display.h"
+
+#define DISPLAY_SPLASH_MS 2000
+#define DISPLAY_TASK_PRIORITY 1  // below the sampling task
+
+// Owns the LCD. Other tasks post what should be on the screen into a
+// latest-state mailbox (each show*() overwrites its field and wakes the
+// task) and return at once; the display task renders the newest state
+// through LCDDisplay's framebuffer, so I2C writes for the LCD never run on
+// loop(), the sampling task or the web server. It also ticks the clock once
+// a second and holds the startup message for DISPLAY_SPLASH_MS without
+// blocking boot.
+//
+// Screens take precedence in the order upload, splash, error, readings: an
+// upload message replaces whatever is being drawn from the next render on,
+// and the readings screen comes back fully redrawn when it ends.
+class DisplayTask {
+public:
+  explicit DisplayTask(LCDDisplay& lcd) : lcd(lcd) {}
+
+  bool begin(const char* version) {
+    lock = xSemaphoreCreateMutex();
+    if (!lock) {
+      return false;
+    }
+    lcd.begin(version);
+    splashUntilMs = millis() + DISPLAY_SPLASH_MS;
+    return xTaskCreatePinnedToCore(taskEntry, "DisplayTask", 4096, this, DISPLAY_TASK_PRIORITY, &handle, 1) == pdPASS;
+  }
+
+  void showReadings(float temperature, float humidity, bool hasHumidity) {
+    update([&](State& s) {
+      s.temperature = temperature;
+      s.humidity = humidity;
+      s.hasHumidity = hasHumidity;
+      s.hasReadings = true;
+    });
+  }
+
+  void showHumiditySensor(bool present) {
+    update([&](State& s) {
+      s.humiditySensorKnown = true;
+      s.humiditySensor = present;
+    });
+  }
+
+  // The IP address holds row 2 until the first printer status arrives.
+  void showIPAddress(const char* ipAddress) {
+    update([&](State& s) { copyText(s.ipAddress, sizeof(s.ipAddress), ipAddress); });
+  }
+
+  bool hasIPAddress() {
+    if (!lock) {
+      return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool known = pending.ipAddress[0] != '\0';
+    xSemaphoreGive(lock);
+    return known;
+  }
+
+  void showStatus(const char* status) {
+    update([&](State& s) { copyText(s.status, sizeof(s.status), status); });
+  }
+
+  void showError(const char* message) {
+    update([&](State& s) { copyText(s.error, sizeof(s.error), message); });
+  }
+
+  void clearError() {
+    update([&](State& s) { s.error[0] = '\0'; });
+  }
+
+  void showUpload(const char* message) {
+    update([&](State& s) { copyText(s.upload, sizeof(s.upload), message); });
+  }
+
+  void endUpload() {
+    update([&](State& s) { s.upload[0] = '\0'; });
+  }
+
+private:
+  enum Screen { READINGS, SPLASH, ERROR_SCREEN, UPLOAD };
+
+  struct State {
+    float temperature = 0.0f;
+    float humidity = 0.0f;
+    bool hasHumidity = false;
+    bool hasReadings = false;
+    bool humiditySensorKnown = false;
+    bool humiditySensor = false;
+    char ipAddress[16] = "";
+    char status[LCD_COLS + 1] = "";
+    char error[LCD_COLS + 1] = "";
+    char upload[LCD_COLS + 1] = "";
+  };
+
+  static void copyText(char* dest, size_t size, const char* text) {
+    snprintf(dest, size, "%s", text ? text : "");
+  }
+
+  template <typename Fn>
+  void update(Fn fn) {
+    if (!lock) {
+      return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    fn(pending);
+    xSemaphoreGive(lock);
+    if (handle) {
+      xTaskNotifyGive(handle);
+    }
+  }
+
+  static void taskEntry(void* param) { static_cast<DisplayTask*>(param)->run(); }
+
+  // Wakes on every posted change and at each clock second; the splash end
+  // is just another deadline.
+  void run() {
+    for (;;) {
+      uint32_t now = millis();
+      uint32_t waitMs = 1000 - now % 1000;
+      if (static_cast<int32_t>(splashUntilMs - now) > 0 && splashUntilMs - now < waitMs) {
+        waitMs = splashUntilMs - now;
+      }
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+      render();
+    }
+  }
+
+  void render() {
+    State state;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    state = pending;
+    xSemaphoreGive(lock);
+
+    Screen screen = READINGS;
+    if (state.upload[0] != '\0') {
+      screen = UPLOAD;
+    } else if (static_cast<int32_t>(millis() - splashUntilMs) < 0) {
+      screen = SPLASH;
+    } else if (state.error[0] != '\0') {
+      screen = ERROR_SCREEN;
+    }
+
+    switch (screen) {
+      case UPLOAD:
+        lcd.displayUploadMessage(state.upload);
+        break;
+      case SPLASH:
+        break;  // begin() drew it
+      case ERROR_SCREEN:
+        lcd.displayError(state.error);
+        break;
+      case READINGS:
+        if (shownScreen != READINGS) {
+          lcd.clear();
+        }
+        renderReadings(state);
+        break;
+    }
+    lcd.flush();
+    shownScreen = screen;
+  }
+
+  void renderReadings(const State& state) {
+    if (state.hasReadings) {
+      lcd.updateTemperature(state.temperature);
+      lcd.updateHumidity(state.humidity, state.hasHumidity);
+    }
+    if (state.humiditySensorKnown) {
+      lcd.displayHumidityStatus(state.humiditySensor);
+    }
+    if (state.status[0] != '\0') {
+      lcd.updateStatus(state.status);
+    } else if (state.ipAddress[0] != '\0') {
+      lcd.displayIPAddress(state.ipAddress);
+    }
+    lcd.updateTime();
+  }
+
+  LCDDisplay& lcd;
+  SemaphoreHandle_t lock = nullptr;
+  TaskHandle_t handle = nullptr;
+  State pending;
+  uint32_t splashUntilMs = 0;
+  Screen shownScreen = SPLASH;
+};
@@ -7,16 +7,46 @@
 #define ENABLE_SMTP
 #include <ReadyMail.h>
 #include <time.h>
+#include <memory>
+#include "payload_serializer.h"
 #include "settings.h"
 
-static ESP_SSLClient* gStartTlsClient = nullptr;
-static void startTlsCallback(bool &success) {
-    success = gStartTlsClient && gStartTlsClient->connectSSL();
-}
+#define SMTP_IDLE_CLOSE_MS 240000  // servers may drop an idle client after 5 minutes (RFC 5321)
+#define SMTP_NOOP_AFTER_MS 10000   // a session idle this long is checked with NOOP before reuse
+#define SMTP_NOOP_TIMEOUT_MS 5000
 
+// Sends email over one SMTP session that outlives a send: the next email
+// within SMTP_IDLE_CLOSE_MS goes out on the same authenticated connection,
+// without the TCP connect, TLS handshake and login, and without setting up
+// the TLS buffers again. closeIfIdle() gives the heap back after that.
+// A NAT or the server may still drop the connection sooner, without a
+// word, so a session idle for SMTP_NOOP_AFTER_MS is checked with a NOOP
+// (one round trip) before a message goes out on it.
+// Neither WiFiClientSecure nor ESP_SSLClient exposes TLS session
+// resumption, so a new session always costs a full handshake.
+//
+// Only ever used from the email task. The timings it keeps for /metrics are
+// plain counters, read without a lock like the scheduler's.
 class EmailNotifier {
 public:
-  static bool sendStatusEmail(const Settings& settings, float temperature, const char* status){
+  struct Phase {
+    uint32_t lastMs;
+    uint32_t maxMs;
+    uint32_t totalMs;
+    uint32_t count;
+
+    void add(uint32_t ms) {
+        lastMs = ms;
+        maxMs = ms > maxMs ? ms : maxMs;
+        totalMs += ms;
+        count++;
+    }
+  };
+
+  ~EmailNotifier() { close(); }
+
+  // Returns true once the server accepted the message.
+  bool send(const Settings& settings, const char* subject, const char* body){
     if (!settings.isEmailEnabled()) {
         return false;
     }
@@ -25,7 +55,6 @@ public:
     const char* smtpUser = settings.getSmtpUser();
     const char* smtpPassword = settings.getSmtpPassword();
     const char* senderEmail = settings.getEmailSender();
-    const char* senderName = settings.getEmailSenderName();
     const char* recipient = settings.getEmailRecipient();
 
     if (strlen(smtpHost) == 0 || strlen(smtpUser) == 0 || strlen(smtpPassword) == 0 ||
@@ -34,80 +63,235 @@ public:
         return false;
     }
 
-    auto statusCallback = [](SMTPStatus status) {
-        Serial.println(status.text);
-    };
+    // A session opened with other SMTP settings is not reused
+    char key[sizeof(sessionKey)];
+    snprintf(key, sizeof(key), "%s:%u:%d:%s:%s", smtpHost, settings.getSmtpPort(), settings.isSmtpSecure() ? 1 : 0,
+             smtpUser, smtpPassword);
+    if (smtp && (strcmp(key, sessionKey) != 0 || !smtp->isConnected())) {
+        close();
+    }
+    if (smtp && millis() - lastUsedMs >= SMTP_NOOP_AFTER_MS && !isAlive()) {
+        staleCount++;
+        close();
+    }
 
-    SMTPMessage message;
-    String fromHeader = String(senderName) + " <" + senderEmail + ">";
-    String toHeader = String("Recipient <") + recipient + ">";
-    message.headers.add(rfc822_from, fromHeader.c_str());
-    message.headers.add(rfc822_to, toHeader.c_str());
-    message.headers.add(rfc822_subject, "Temperature Monitor Status");
-
-    char timeBuffer[32] = "unknown";
-    time_t now;
-    time(&now);
-    if (now > 1609459200) {
-        struct tm timeinfo;
-        if (gmtime_r(&now, &timeinfo)) {
-            strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S UTC", &timeinfo);
-        }
+    bool reused = smtp != nullptr;
+    if (!reused && !open(settings, key)) {
+        Serial.println("Failed to send email.");
+        return false;
+    }
+
+    bool sent = sendMessage(settings, subject, body);
+    if (!sent && reused) {
+        // Most likely dropped by the server while idle; one fresh session
+        staleCount++;
+        close();
+        reused = false;
+        sent = open(settings, key) && sendMessage(settings, subject, body);
+    }
+    if (!sent) {
+        close();
+        Serial.println("Failed to send email.");
+        return false;
     }
 
-    char body[256];
-    snprintf(body, sizeof(body),
-            "Status: %s\nTemperature: %.2f C\nReading Time: %s",
-            status, temperature, timeBuffer);
+    reusedCount += reused ? 1 : 0;
+    lastUsedMs = millis();
+    Serial.println("Email sent successfully.");
+    return true;
+  }
 
-    message.text.body(body);
-    message.timestamp = time(nullptr);
+  // Closes the session once it has been idle for SMTP_IDLE_CLOSE_MS.
+  // Returns the ms until it should be called again, UINT32_MAX when closed.
+  uint32_t closeIfIdle(uint32_t now) {
+    if (!smtp) {
+        return UINT32_MAX;
+    }
+    uint32_t idleMs = now - lastUsedMs;
+    if (idleMs >= SMTP_IDLE_CLOSE_MS) {
+        close();
+        idleClosed++;
+        return UINT32_MAX;
+    }
+    return SMTP_IDLE_CLOSE_MS - idleMs;
+  }
+
+  bool isOpen() const { return smtp != nullptr; }
+  uint32_t sessions() const { return connectPhase.count; }
+  uint32_t reused() const { return reusedCount; }
+  uint32_t stale() const { return staleCount; }
+
+  // Appends `"sessions":n,...,"send_ms":{...}` (no surrounding braces).
+  // handshake_ms is the STARTTLS handshake (port 587); on port 465 the
+  // handshake is part of connect_ms.
+  void writeJsonFields(Print& out) const {
+    char line[160];
+    PayloadWriter counts(line, sizeof(line));
+    counts.append("\"open\":").append(smtp ? "true" : "false");
+    counts.append(",\"sessions\":").appendUnsigned(connectPhase.count);
+    counts.append(",\"reused\":").appendUnsigned(reusedCount);
+    counts.append(",\"stale\":").appendUnsigned(staleCount);
+    counts.append(",\"idle_closed\":").appendUnsigned(idleClosed);
+    counts.append(",\"heap_held\":").appendUnsigned(heapHeld);
+    out.print(line);
+    writePhase(out, "connect_ms", connectPhase);
+    writePhase(out, "handshake_ms", handshakePhase);
+    writePhase(out, "auth_ms", authPhase);
+    writePhase(out, "send_ms", sendPhase);
+  }
+
+private:
+  static void statusCallback(SMTPStatus status) {
+    Serial.println(status.text);
+  }
+
+  // ReadyMail's STARTTLS hook takes no context; only the notifier opening a
+  // session is ever inside it.
+  static void startTlsCallback(bool &success) {
+    uint32_t start = millis();
+    EmailNotifier* notifier = opening();
+    success = notifier && notifier->sslClient.connectSSL();
+    if (notifier) {
+        notifier->handshakeMs = millis() - start;
+    }
+  }
 
+  // NOOP straight on the connection, between two transactions, where
+  // ReadyMail has nothing in flight. True if the server answered 250.
+  bool isAlive() {
+    if (!transport || transport->print("NOOP\r\n") != 6) {
+        return false;
+    }
+    char code[4] = "";
+    size_t length = 0;
+    uint32_t start = millis();
+    while (millis() - start < SMTP_NOOP_TIMEOUT_MS && transport->connected()) {
+        int c = transport->read();
+        if (c < 0) {
+            delay(10);
+        } else if (c == '\n') {
+            break;
+        } else if (length < 3) {
+            code[length++] = static_cast<char>(c);
+        }
+    }
+    return length == 3 && strcmp(code, "250") == 0;
+  }
+
+  bool open(const Settings& settings, const char* key) {
+    const char* smtpHost = settings.getSmtpHost();
     const uint16_t smtpPort = settings.getSmtpPort();
-    const bool useSecure = settings.isSmtpSecure();
-    bool sent = false;
+    uint32_t freeBefore = ESP.getFreeHeap();
+    uint32_t start = millis();
+    handshakeMs = 0;
 
-    if (useSecure) {
+    if (settings.isSmtpSecure()) {
         if (smtpPort == 587) {
-            WiFiClient basicClient;
-            ESP_SSLClient sslClient;
-            gStartTlsClient = &sslClient;
             sslClient.setClient(&basicClient, false);
             sslClient.setInsecure();
-            SMTPClient smtp(sslClient, startTlsCallback, true);
-            smtp.connect(smtpHost, smtpPort, statusCallback);
-            if (smtp.isConnected()) {
-                smtp.authenticate(smtpUser, smtpPassword, readymail_auth_password);
-                sent = smtp.send(message);
+            transport = &sslClient;
+            opening() = this;
+            smtp.reset(new (std::nothrow) SMTPClient(sslClient, startTlsCallback, true));
+            if (smtp) {
+                smtp->connect(smtpHost, smtpPort, statusCallback);
             }
-            gStartTlsClient = nullptr;
+            opening() = nullptr;
         } else {
-            WiFiClientSecure sslClient;
-            sslClient.setInsecure();
-            SMTPClient smtp(sslClient);
-            smtp.connect(smtpHost, smtpPort, statusCallback);
-            if (smtp.isConnected()) {
-                smtp.authenticate(smtpUser, smtpPassword, readymail_auth_password);
-                sent = smtp.send(message);
+            secureClient.setInsecure();
+            transport = &secureClient;
+            smtp.reset(new (std::nothrow) SMTPClient(secureClient));
+            if (smtp) {
+                smtp->connect(smtpHost, smtpPort, statusCallback);
             }
         }
     } else {
-        WiFiClient plainClient;
-        SMTPClient smtp(plainClient);
-        smtp.connect(smtpHost, smtpPort, statusCallback, false);
-        if (smtp.isConnected()) {
-            smtp.authenticate(smtpUser, smtpPassword, readymail_auth_password);
-            sent = smtp.send(message);
+        transport = &basicClient;
+        smtp.reset(new (std::nothrow) SMTPClient(basicClient));
+        if (smtp) {
+            smtp->connect(smtpHost, smtpPort, statusCallback, false);
         }
     }
-
-    if (!sent) {
-        Serial.println("Failed to send email.");
+    if (!smtp || !smtp->isConnected()) {
+        close();
         return false;
     }
+    connectPhase.add(millis() - start - handshakeMs);
+    if (handshakeMs > 0) {
+        handshakePhase.add(handshakeMs);
+    }
 
-    Serial.println("Email sent successfully.");
+    start = millis();
+    bool authenticated = smtp->authenticate(settings.getSmtpUser(), settings.getSmtpPassword(), readymail_auth_password);
+    authPhase.add(millis() - start);
+    if (!authenticated) {
+        close();
+        return false;
+    }
 
+    uint32_t freeAfter = ESP.getFreeHeap();
+    heapHeld = freeBefore > freeAfter ? freeBefore - freeAfter : 0;
+    snprintf(sessionKey, sizeof(sessionKey), "%s", key);
+    lastUsedMs = millis();
     return true;
+  }
+
+  bool sendMessage(const Settings& settings, const char* subject, const char* body) {
+    SMTPMessage message;
+    String fromHeader = String(settings.getEmailSenderName()) + " <" + settings.getEmailSender() + ">";
+    String toHeader = String("Recipient <") + settings.getEmailRecipient() + ">";
+    message.headers.add(rfc822_from, fromHeader.c_str());
+    message.headers.add(rfc822_to, toHeader.c_str());
+    message.headers.add(rfc822_subject, subject);
+
+    message.text.body(body);
+    message.timestamp = time(nullptr);
+
+    uint32_t start = millis();
+    bool sent = smtp->send(message);
+    sendPhase.add(millis() - start);
+    return sent;
+  }
+
+  void close() {
+    if (smtp) {
+        smtp->stop();
+        smtp.reset();
     }
+    basicClient.stop();
+    secureClient.stop();
+    transport = nullptr;
+    sessionKey[0] = '\0';
+  }
+
+  static void writePhase(Print& out, const char* name, const Phase& phase) {
+    char line[96];
+    PayloadWriter json(line, sizeof(line));
+    json.append(",\"").append(name).append("\":{\"last\":").appendUnsigned(phase.lastMs);
+    json.append(",\"avg\":").appendFixed(phase.count ? static_cast<float>(phase.totalMs) / phase.count : 0.0f, 2);
+    json.append(",\"max\":").appendUnsigned(phase.maxMs).append('}');
+    out.print(line);
+  }
+
+  static EmailNotifier*& opening() {
+    static EmailNotifier* notifier = nullptr;
+    return notifier;
+  }
+
+  WiFiClient basicClient;
+  ESP_SSLClient sslClient;
+  WiFiClientSecure secureClient;
+  std::unique_ptr<SMTPClient> smtp;
+  Client* transport = nullptr;  // what smtp talks through
+  char sessionKey[232] = "";
+  uint32_t lastUsedMs = 0;
+  uint32_t handshakeMs = 0;
+
+  Phase connectPhase = {};
+  Phase handshakePhase = {};
+  Phase authPhase = {};
+  Phase sendPhase = {};
+  uint32_t reusedCount = 0;
+  uint32_t staleCount = 0;
+  uint32_t idleClosed = 0;
+  uint32_t heapHeld = 0;
 };
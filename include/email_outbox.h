@@ -0,0 +1,401 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <time.h>
+#include "history_buffer.h"
+#include "payload_serializer.h"
+#include "printer_status.h"
+
+#define EMAIL_OUTBOX_FILE "/outbox.bin"
+#define EMAIL_OUTBOX_SLOTS (PRINTER_STATUS_COUNT + 1)  // newest change to each status, then the periodic report
+#define EMAIL_DIGEST_WINDOW_MS 60000                   // everything queued within this goes out as one email
+#define EMAIL_RETRY_MIN_MS 30000
+#define EMAIL_RETRY_MAX_MS 1800000
+#define EMAIL_DIGEST_MAX_LENGTH 640
+
+// Status and report emails waiting to be sent, one slot per kind. A new
+// entry replaces an unsent one of the same kind (counted as superseded), so
+// the outbox never fills up and a flapping status costs one line, not one
+// SMTP session per change.
+//
+// The first entry to arrive opens a send window; when it closes, every
+// pending entry goes out as a single digest. A failed send keeps the
+// entries and is retried after EMAIL_RETRY_MIN_MS, doubling up to
+// EMAIL_RETRY_MAX_MS. The slots are written to EMAIL_OUTBOX_FILE after each
+// change, so what was not sent is sent after a reboot.
+//
+// add*() only copies into a slot and wakes the email task; rendering, flash
+// and SMTP all happen there.
+class EmailOutbox {
+public:
+  // Returns true once the message was accepted by the server.
+  typedef bool (*SendFunction)(const char* subject, const char* body);
+  // Run by the email task between sends, e.g. to close an idle SMTP
+  // session; returns the ms until it wants to run again, UINT32_MAX for
+  // never.
+  typedef uint32_t (*IdleFunction)(uint32_t now);
+
+  // SPIFFS must already be mounted. Without runTask nothing is sent until
+  // the caller runs service() itself.
+  bool begin(fs::FS& fs, SendFunction send, IdleFunction idle = nullptr, bool runTask = true) {
+    filesystem = &fs;
+    sender = send;
+    idler = idle;
+    lock = xSemaphoreCreateMutex();
+    storageGate = xSemaphoreCreateBinary();
+    if (!lock || !storageGate) {
+      return false;
+    }
+    xSemaphoreGive(storageGate);
+    load();
+    if (runTask && xTaskCreatePinnedToCore(emailTask, "EmailTask", 8192, this, 1, &task, 0) != pdPASS) {
+      return false;
+    }
+    return true;
+  }
+
+  void addStatusChange(PrinterStatus status, float temperature) {
+    add(status, printerStatusName(status), temperature);
+  }
+
+  void addReport(const char* status, float temperature) { add(PRINTER_STATUS_COUNT, status, temperature); }
+
+  // Saves the slots if they changed and sends the digest once it is due.
+  // Returns the ms until it next has anything to do, UINT32_MAX for nothing.
+  uint32_t service(uint32_t now) {
+    if (!lock) {
+      return UINT32_MAX;
+    }
+    persistIfDirty();
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (pendingCount() == 0) {
+      xSemaphoreGive(lock);
+      return UINT32_MAX;
+    }
+    int32_t wait = static_cast<int32_t>(dueMs - now);
+    if (wait > 0) {
+      xSemaphoreGive(lock);
+      return static_cast<uint32_t>(wait);
+    }
+    Entry sending[EMAIL_OUTBOX_SLOTS];
+    uint32_t sendingRevisions[EMAIL_OUTBOX_SLOTS];
+    memcpy(sending, stored.entries, sizeof(sending));
+    memcpy(sendingRevisions, revisions, sizeof(sendingRevisions));
+    xSemaphoreGive(lock);
+
+    char subject[48];
+    char body[EMAIL_DIGEST_MAX_LENGTH];
+    renderDigest(sending, subject, sizeof(subject), body, sizeof(body));
+    bool ok = sender && sender(subject, body);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    now = millis();
+    uint32_t retryMs = 0;
+    if (ok) {
+      // Entries replaced while the email was going out are still pending
+      for (uint8_t i = 0; i < EMAIL_OUTBOX_SLOTS; ++i) {
+        if (sending[i].pending && revisions[i] == sendingRevisions[i]) {
+          stored.entries[i].pending = 0;
+          stored.entries[i].superseded = 0;
+        }
+      }
+      stored.failures = 0;
+      sentCount++;
+      dueMs = now + EMAIL_DIGEST_WINDOW_MS;
+    } else {
+      stored.failures++;
+      failedCount++;
+      retryMs = retryDelayMs(stored.failures);
+      dueMs = now + retryMs;
+    }
+    dirty = true;
+    xSemaphoreGive(lock);
+    persistIfDirty();
+    if (ok) {
+      Serial.println("Email digest sent.");
+    } else {
+      Serial.printf("Email digest failed, retrying in %lu s\n", static_cast<unsigned long>(retryMs / 1000));
+    }
+    return 0;
+  }
+
+  // Appends `"pending":n,"sent":n,...` (no surrounding braces).
+  void writeJsonFields(Print& out) {
+    char line[160];
+    PayloadWriter fields(line, sizeof(line));
+    if (lock) {
+      xSemaphoreTake(lock, portMAX_DELAY);
+    }
+    int32_t wait = static_cast<int32_t>(dueMs - millis());
+    size_t pending = pendingCount();
+    fields.append("\"pending\":").appendUnsigned(pending);
+    fields.append(",\"sent\":").appendUnsigned(sentCount);
+    fields.append(",\"failed\":").appendUnsigned(failedCount);
+    fields.append(",\"failures_in_a_row\":").appendUnsigned(stored.failures);
+    fields.append(",\"superseded\":").appendUnsigned(supersededCount);
+    fields.append(",\"next_send_ms\":").appendUnsigned(pending > 0 && wait > 0 ? static_cast<uint32_t>(wait) : 0);
+    if (lock) {
+      xSemaphoreGive(lock);
+    }
+    out.print(line);
+  }
+
+  // Stops saving the slots, e.g. while a filesystem image is written over
+  // the partition: waits for a save in progress and writes out anything
+  // unsaved first. Emails are still queued and sent meanwhile. Binary
+  // semaphore, not a mutex: resume() may come from another task.
+  void pause() {
+    if (!lock || paused) {
+      return;
+    }
+    xSemaphoreTake(storageGate, portMAX_DELAY);
+    paused = true;
+    writeIfDirty();
+  }
+
+  // Saves again, starting with the slots as they are now.
+  void resume() {
+    if (!paused) {
+      return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    dirty = true;
+    xSemaphoreGive(lock);
+    paused = false;
+    xSemaphoreGive(storageGate);
+    if (task) {
+      xTaskNotifyGive(task);
+    }
+  }
+
+  // The slots as they would be saved to EMAIL_OUTBOX_FILE. Returns the
+  // length, 0 if out is too small.
+  size_t encode(uint8_t* out, size_t size) {
+    if (!lock || size < sizeof(Stored)) {
+      return 0;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Stored snapshot = stored;
+    xSemaphoreGive(lock);
+    snapshot.magic = MAGIC;
+    memcpy(out, &snapshot, sizeof(snapshot));
+    return sizeof(snapshot);
+  }
+
+  size_t pending() {
+    if (!lock) {
+      return 0;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    size_t count = pendingCount();
+    xSemaphoreGive(lock);
+    return count;
+  }
+
+  uint32_t sent() const { return sentCount; }
+  uint32_t failed() const { return failedCount; }
+  uint32_t superseded() const { return supersededCount; }
+
+  static uint32_t retryDelayMs(uint32_t failures) {
+    uint32_t delayMs = EMAIL_RETRY_MIN_MS;
+    while (failures > 1 && delayMs < EMAIL_RETRY_MAX_MS) {
+      delayMs *= 2;
+      --failures;
+    }
+    return delayMs < EMAIL_RETRY_MAX_MS ? delayMs : EMAIL_RETRY_MAX_MS;
+  }
+
+private:
+  // Layout of EMAIL_OUTBOX_FILE; a file of any other size is ignored.
+  struct Entry {
+    uint32_t epoch;       // Unix time, 0 before NTP sync
+    float temperature;
+    uint16_t superseded;  // unsent entries of this kind it replaced
+    uint8_t pending;
+    char status[16];
+  };
+
+  struct Stored {
+    uint32_t magic;
+    uint32_t failures;
+    Entry entries[EMAIL_OUTBOX_SLOTS];
+  };
+
+  static const uint32_t MAGIC = 0x3142454f;  // "OEB1"
+
+  static void emailTask(void* param) {
+    EmailOutbox* self = static_cast<EmailOutbox*>(param);
+    for (;;) {
+      uint32_t waitMs = self->service(millis());
+      if (self->idler) {
+        uint32_t idleMs = self->idler(millis());
+        waitMs = idleMs < waitMs ? idleMs : waitMs;
+      }
+      ulTaskNotifyTake(pdTRUE, waitMs == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(waitMs));
+    }
+  }
+
+  void add(uint8_t slot, const char* status, float temperature) {
+    if (!lock) {
+      return;
+    }
+    time_t now = time(nullptr);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (pendingCount() == 0 && stored.failures == 0) {
+      dueMs = millis() + EMAIL_DIGEST_WINDOW_MS;
+    }
+    Entry& entry = stored.entries[slot];
+    if (entry.pending) {
+      entry.superseded++;
+      supersededCount++;
+    }
+    entry.pending = 1;
+    entry.epoch = now > HISTORY_EPOCH_MIN ? static_cast<uint32_t>(now) : 0;
+    entry.temperature = temperature;
+    snprintf(entry.status, sizeof(entry.status), "%s", status);
+    revisions[slot]++;
+    dirty = true;
+    xSemaphoreGive(lock);
+    if (task) {
+      xTaskNotifyGive(task);
+    }
+  }
+
+  size_t pendingCount() const {
+    size_t count = 0;
+    for (const Entry& entry : stored.entries) {
+      count += entry.pending ? 1 : 0;
+    }
+    return count;
+  }
+
+  // Oldest first, one block per entry.
+  static void renderDigest(const Entry* entries, char* subject, size_t subjectSize, char* body, size_t bodySize) {
+    const Entry* order[EMAIL_OUTBOX_SLOTS];
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < EMAIL_OUTBOX_SLOTS; ++i) {
+      if (!entries[i].pending) {
+        continue;
+      }
+      uint8_t at = count++;
+      while (at > 0 && order[at - 1]->epoch > entries[i].epoch) {
+        order[at] = order[at - 1];
+        --at;
+      }
+      order[at] = &entries[i];
+    }
+    if (count == 1) {
+      snprintf(subject, subjectSize, "Temperature Monitor Status");
+    } else {
+      snprintf(subject, subjectSize, "Temperature Monitor Status (%u updates)", count);
+    }
+
+    size_t used = 0;
+    body[0] = '\0';
+    for (uint8_t i = 0; i < count && used < bodySize; ++i) {
+      const Entry& entry = *order[i];
+      char timeBuffer[32] = "unknown";
+      time_t at = static_cast<time_t>(entry.epoch);
+      struct tm timeinfo;
+      if (entry.epoch != 0 && gmtime_r(&at, &timeinfo)) {
+        strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S UTC", &timeinfo);
+      }
+      bool report = &entry == &entries[PRINTER_STATUS_COUNT];
+      int written = snprintf(body + used, bodySize - used, "%s%sStatus: %s\nTemperature: %.2f C\nReading Time: %s\n",
+                             i > 0 ? "\n" : "", report ? "Periodic report\n" : "", entry.status,
+                             static_cast<double>(entry.temperature), timeBuffer);
+      used += written > 0 ? static_cast<size_t>(written) : 0;
+      if (entry.superseded > 0 && used < bodySize) {
+        written = snprintf(body + used, bodySize - used, "Replaces %u earlier unsent %s\n", entry.superseded,
+                           report ? "reports" : "changes to this status");
+        used += written > 0 ? static_cast<size_t>(written) : 0;
+      }
+    }
+  }
+
+  void load() {
+    memset(&stored, 0, sizeof(stored));
+    if (!filesystem->exists(EMAIL_OUTBOX_FILE) && filesystem->exists(EMAIL_OUTBOX_FILE ".tmp")) {
+      filesystem->rename(EMAIL_OUTBOX_FILE ".tmp", EMAIL_OUTBOX_FILE);  // reset between remove and rename
+    }
+    File file = filesystem->open(EMAIL_OUTBOX_FILE, "r");
+    if (!file) {
+      return;
+    }
+    Stored loaded;
+    size_t length = file.read(reinterpret_cast<uint8_t*>(&loaded), sizeof(loaded));
+    bool extra = file.available() > 0;
+    file.close();
+    if (length != sizeof(loaded) || extra || loaded.magic != MAGIC) {
+      Serial.println("Ignoring unreadable email outbox");
+      return;
+    }
+    stored = loaded;
+    for (Entry& entry : stored.entries) {
+      entry.status[sizeof(entry.status) - 1] = '\0';
+    }
+    // Retried one window after boot, whatever the backoff was; failures
+    // carries on from where it was
+    dueMs = millis() + EMAIL_DIGEST_WINDOW_MS;
+    if (pendingCount() > 0) {
+      Serial.printf("Email outbox: %u unsent from before reboot\n", static_cast<unsigned>(pendingCount()));
+    }
+  }
+
+  // Skipped while paused; the slots stay dirty and are saved on resume().
+  void persistIfDirty() {
+    if (xSemaphoreTake(storageGate, 0) != pdTRUE) {
+      return;
+    }
+    writeIfDirty();
+    xSemaphoreGive(storageGate);
+  }
+
+  // Written beside the old file and renamed over it, so a reset mid-write
+  // leaves the previous outbox. Only with storageGate held.
+  void writeIfDirty() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (!dirty) {
+      xSemaphoreGive(lock);
+      return;
+    }
+    Stored snapshot = stored;
+    snapshot.magic = MAGIC;
+    dirty = false;
+    xSemaphoreGive(lock);
+
+    File file = filesystem->open(EMAIL_OUTBOX_FILE ".tmp", "w");
+    if (!file) {
+      Serial.println("Failed to save email outbox");
+      return;
+    }
+    size_t written = file.write(reinterpret_cast<const uint8_t*>(&snapshot), sizeof(snapshot));
+    file.close();
+    if (written != sizeof(snapshot)) {
+      Serial.println("Failed to save email outbox");
+      filesystem->remove(EMAIL_OUTBOX_FILE ".tmp");
+      return;
+    }
+    filesystem->remove(EMAIL_OUTBOX_FILE);
+    filesystem->rename(EMAIL_OUTBOX_FILE ".tmp", EMAIL_OUTBOX_FILE);
+  }
+
+  fs::FS* filesystem = nullptr;
+  SendFunction sender = nullptr;
+  IdleFunction idler = nullptr;
+  SemaphoreHandle_t lock = nullptr;
+  SemaphoreHandle_t storageGate = nullptr;  // held by a save in progress, or by pause()
+  TaskHandle_t task = nullptr;
+  Stored stored = {};
+  uint32_t revisions[EMAIL_OUTBOX_SLOTS] = {};
+  uint32_t dueMs = 0;
+  bool dirty = false;
+  bool paused = false;
+  uint32_t sentCount = 0;
+  uint32_t failedCount = 0;
+  uint32_t supersededCount = 0;
+};
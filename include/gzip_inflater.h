@@ -0,0 +1,548 @@
+#pragma once
+#include <Arduino.h>
+#include <memory>
+#include <new>
+
+#define GZIP_WINDOW_SIZE 32768  // deflate's longest back-reference
+#define GZIP_CARRY_SIZE 1024    // input held over between chunks; a dynamic block header fits
+
+// Streaming gzip (RFC 1952/1951) decoder for OTA images: compressed bytes go
+// in as they arrive, in chunks of any size, and inflated bytes come out
+// through an OutputFunction, at most GZIP_WINDOW_SIZE at a time. Memory is
+// the 32 KB window, allocated by begin(), plus about 2.3 KB in the object.
+//
+// Decoding goes one unit at a time: a header, a block header, a literal or
+// a match. A unit that runs out of input is rolled back and its bytes are
+// kept in a small carry buffer for the next chunk. A literal or match takes
+// at most 6 bytes and every stream ends with an 8-byte trailer, so those
+// only start once 8 bytes are available and never roll back.
+//
+// Huffman codes are decoded canonically, a bit at a time, after zlib's
+// puff.c: slower than table lookup, but small, and far faster than Wi-Fi.
+// The trailer's CRC-32 and length are checked.
+class GzipInflater {
+public:
+  // Receives inflated bytes; returns false to stop (e.g. a flash write
+  // failed).
+  typedef bool (*OutputFunction)(const uint8_t* data, size_t len);
+
+  enum Result { GZIP_MORE, GZIP_DONE, GZIP_ERROR };
+
+  // True for a buffer starting with the gzip magic.
+  static bool isGzip(const uint8_t* data, size_t len) { return len >= 2 && data[0] == 0x1f && data[1] == 0x8b; }
+
+  // Returns false when the window cannot be allocated.
+  bool begin(OutputFunction output) {
+    window.reset(new (std::nothrow) uint8_t[GZIP_WINDOW_SIZE]);
+    if (!window) {
+      return false;
+    }
+    out = output;
+    state = HEADER;
+    message = "";
+    outputRefused = false;
+    carryLength = 0;
+    bitBuffer = 0;
+    bitCount = 0;
+    total = 0;
+    flushed = 0;
+    crc = 0xffffffff;
+    return true;
+  }
+
+  // Feeds the next compressed bytes. GZIP_DONE once the trailer has been
+  // checked; anything after it is ignored.
+  Result write(const uint8_t* data, size_t len) {
+    if (state == DONE) {
+      return GZIP_DONE;
+    }
+    if (state == FAILED || !window) {
+      return GZIP_ERROR;
+    }
+    source = data;
+    sourceLength = len;
+    position = 0;
+    run();
+    if (state != FAILED && state != DONE) {
+      flush();
+    }
+    if (state != FAILED && state != DONE) {
+      keepUnread();
+    }
+    return state == DONE ? GZIP_DONE : state == FAILED ? GZIP_ERROR : GZIP_MORE;
+  }
+
+  bool done() const { return state == DONE; }
+  const char* error() const { return message; }
+  // True when decoding stopped because the OutputFunction refused bytes.
+  bool outputFailed() const { return outputRefused; }
+  uint32_t inflated() const { return total; }
+
+private:
+  enum State { HEADER, BLOCK, STORED, CODES, TRAILER, DONE, FAILED };
+
+  struct Huffman {
+    uint16_t count[16];  // codes of each length
+    uint16_t symbol[288];  // symbols ordered by code
+  };
+
+  struct Checkpoint {
+    size_t position;
+    uint32_t bitBuffer;
+    uint8_t bitCount;
+  };
+
+  void run() {
+    while (state != DONE && state != FAILED) {
+      Checkpoint checkpoint = save();
+      State unitState = state;
+      starved = false;
+      switch (state) {
+        case HEADER:
+          if (readHeader()) {
+            state = BLOCK;
+          }
+          break;
+        case BLOCK:
+          readBlockHeader();
+          break;
+        case STORED:
+          if (!copyStored()) {
+            return;
+          }
+          break;
+        case CODES:
+          if (!decodeCodes()) {
+            return;
+          }
+          break;
+        case TRAILER:
+          readTrailer();
+          break;
+        default:
+          return;
+      }
+      if (starved) {
+        restore(checkpoint);
+        state = unitState;
+        return;
+      }
+    }
+  }
+
+  // Header fields this decoder has no use for are skipped.
+  bool readHeader() {
+    uint8_t id1 = byteBits(), id2 = byteBits(), method = byteBits(), flags = byteBits();
+    for (int i = 0; i < 6; ++i) {
+      byteBits();  // mtime, xfl, os
+    }
+    if (starved) {
+      return false;
+    }
+    if (id1 != 0x1f || id2 != 0x8b || method != 8 || (flags & 0xe0)) {
+      return fail("not a gzip deflate stream");
+    }
+    if (flags & 0x04) {  // FEXTRA
+      uint16_t length = byteBits();
+      length |= static_cast<uint16_t>(byteBits() << 8);
+      for (uint16_t i = 0; i < length && !starved; ++i) {
+        byteBits();
+      }
+    }
+    for (uint8_t field = 0x08; field <= 0x10; field <<= 1) {  // FNAME, FCOMMENT
+      if (flags & field) {
+        while (!starved && byteBits() != 0) {
+        }
+      }
+    }
+    if (flags & 0x02) {  // FHCRC
+      byteBits();
+      byteBits();
+    }
+    return !starved;
+  }
+
+  void readBlockHeader() {
+    lastBlock = bits(1) != 0;
+    uint32_t type = bits(2);
+    if (starved) {
+      return;
+    }
+    if (type == 0) {
+      bitBuffer = 0;
+      bitCount = 0;
+      uint32_t length = bits(16);
+      uint32_t complement = bits(16);
+      if (!starved && length != (~complement & 0xffff)) {
+        fail("stored block length check failed");
+        return;
+      }
+      storedLeft = length;
+      state = STORED;
+    } else if (type == 1) {
+      buildFixed();
+      state = CODES;
+    } else if (type == 2) {
+      if (readDynamic()) {
+        state = CODES;
+      }
+    } else {
+      fail("invalid block type");
+    }
+  }
+
+  bool copyStored() {
+    while (storedLeft > 0) {
+      uint8_t b;
+      if (!nextByte(b)) {
+        return false;
+      }
+      put(b);
+      storedLeft--;
+    }
+    state = lastBlock ? TRAILER : BLOCK;
+    return state != FAILED;
+  }
+
+  // Literals and matches until the end of the block. Returns false to wait
+  // for input or after an error.
+  bool decodeCodes() {
+    static const uint16_t LENGTH_BASE[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                             31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                             2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t DIST_BASE[30] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                           33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                           1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const uint8_t DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                           6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    for (;;) {
+      if (available() < 8) {
+        return false;
+      }
+      int symbol = decode(lengthCode);
+      if (symbol < 0) {
+        return fail("invalid literal/length code");
+      }
+      if (symbol < 256) {
+        put(static_cast<uint8_t>(symbol));
+      } else if (symbol == 256) {
+        state = lastBlock ? TRAILER : BLOCK;
+        return true;
+      } else {
+        symbol -= 257;
+        if (symbol >= 29) {
+          return fail("invalid length symbol");
+        }
+        uint32_t length = LENGTH_BASE[symbol] + bits(LENGTH_EXTRA[symbol]);
+        int distSymbol = decode(distCode);
+        if (distSymbol < 0 || distSymbol >= 30) {
+          return fail("invalid distance code");
+        }
+        uint32_t distance = DIST_BASE[distSymbol] + bits(DIST_EXTRA[distSymbol]);
+        if (distance > total) {
+          return fail("distance too far back");
+        }
+        while (length-- > 0) {
+          put(window[(total - distance) & (GZIP_WINDOW_SIZE - 1)]);
+        }
+      }
+      if (state == FAILED) {
+        return false;
+      }
+    }
+  }
+
+  void readTrailer() {
+    bitBuffer = 0;
+    bitCount = 0;
+    uint32_t expectedCrc = bits(16);
+    expectedCrc |= bits(16) << 16;
+    uint32_t expectedSize = bits(16);
+    expectedSize |= bits(16) << 16;
+    if (starved) {
+      return;
+    }
+    if (!flush()) {
+      return;
+    }
+    if ((crc ^ 0xffffffff) != expectedCrc) {
+      fail("crc-32 mismatch");
+    } else if (total != expectedSize) {
+      fail("length mismatch");
+    } else {
+      state = DONE;
+    }
+  }
+
+  bool readDynamic() {
+    static const uint8_t ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    uint8_t lengths[286 + 30] = {};
+    uint32_t literals = bits(5) + 257;
+    uint32_t distances = bits(5) + 1;
+    uint32_t codeLengths = bits(4) + 4;
+    if (starved) {
+      return false;
+    }
+    if (literals > 286 || distances > 30) {
+      return fail("bad dynamic block counts");
+    }
+    uint32_t index;
+    for (index = 0; index < codeLengths; ++index) {
+      lengths[ORDER[index]] = static_cast<uint8_t>(bits(3));
+    }
+    for (; index < 19; ++index) {
+      lengths[ORDER[index]] = 0;
+    }
+    if (starved) {
+      return false;
+    }
+    if (build(lengthCode, lengths, 19) != 0) {
+      return fail("bad code length code");
+    }
+    index = 0;
+    while (index < literals + distances) {
+      int symbol = decode(lengthCode);
+      if (starved) {
+        return false;
+      }
+      if (symbol < 0) {
+        return fail("bad code lengths");
+      }
+      if (symbol < 16) {
+        lengths[index++] = static_cast<uint8_t>(symbol);
+        continue;
+      }
+      uint8_t repeated = 0;
+      uint32_t times;
+      if (symbol == 16) {
+        if (index == 0) {
+          return fail("repeat with no previous length");
+        }
+        repeated = lengths[index - 1];
+        times = 3 + bits(2);
+      } else if (symbol == 17) {
+        times = 3 + bits(3);
+      } else {
+        times = 11 + bits(7);
+      }
+      if (starved) {
+        return false;
+      }
+      if (index + times > literals + distances) {
+        return fail("too many code lengths");
+      }
+      while (times-- > 0) {
+        lengths[index++] = repeated;
+      }
+    }
+    if (lengths[256] == 0) {
+      return fail("no end-of-block code");
+    }
+    // An incomplete code is only allowed when it has a single symbol
+    int left = build(lengthCode, lengths, literals);
+    if (left < 0 || (left > 0 && literals - lengthCode.count[0] != 1)) {
+      return fail("bad literal/length code");
+    }
+    left = build(distCode, lengths + literals, distances);
+    if (left < 0 || (left > 0 && distances - distCode.count[0] != 1)) {
+      return fail("bad distance code");
+    }
+    return true;
+  }
+
+  void buildFixed() {
+    uint8_t lengths[288];
+    for (int i = 0; i < 288; ++i) {
+      lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    }
+    build(lengthCode, lengths, 288);
+    for (int i = 0; i < 30; ++i) {
+      lengths[i] = 5;
+    }
+    build(distCode, lengths, 30);
+  }
+
+  // Canonical code from code lengths. Returns 0 for a complete code, > 0
+  // for an incomplete one, < 0 when oversubscribed.
+  static int build(Huffman& h, const uint8_t* lengths, uint32_t n) {
+    memset(h.count, 0, sizeof(h.count));
+    for (uint32_t i = 0; i < n; ++i) {
+      h.count[lengths[i]]++;
+    }
+    if (h.count[0] == n) {
+      return 0;
+    }
+    int left = 1;
+    for (int len = 1; len < 16; ++len) {
+      left <<= 1;
+      left -= h.count[len];
+      if (left < 0) {
+        return left;
+      }
+    }
+    uint16_t offsets[16];
+    offsets[1] = 0;
+    for (int len = 1; len < 15; ++len) {
+      offsets[len + 1] = offsets[len] + h.count[len];
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+      if (lengths[i] != 0) {
+        h.symbol[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+      }
+    }
+    return left;
+  }
+
+  int decode(const Huffman& h) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; ++len) {
+      code |= static_cast<int>(bits(1));
+      int count = h.count[len];
+      if (code - count < first) {
+        return h.symbol[index + (code - first)];
+      }
+      index += count;
+      first += count;
+      first <<= 1;
+      code <<= 1;
+    }
+    return -1;
+  }
+
+  // Input is the carry buffer followed by the current chunk.
+  size_t available() const { return carryLength + sourceLength - position; }
+
+  bool nextByte(uint8_t& b) {
+    if (position < carryLength) {
+      b = carry[position];
+    } else if (position - carryLength < sourceLength) {
+      b = source[position - carryLength];
+    } else {
+      return false;
+    }
+    position++;
+    return true;
+  }
+
+  // Sets starved and returns 0 when the input runs out.
+  uint32_t bits(uint8_t need) {
+    while (bitCount < need) {
+      uint8_t b;
+      if (!nextByte(b)) {
+        starved = true;
+        return 0;
+      }
+      bitBuffer |= static_cast<uint32_t>(b) << bitCount;
+      bitCount += 8;
+    }
+    uint32_t value = bitBuffer & ((1UL << need) - 1);
+    bitBuffer >>= need;
+    bitCount -= need;
+    return value;
+  }
+
+  uint8_t byteBits() { return static_cast<uint8_t>(bits(8)); }
+
+  void put(uint8_t b) {
+    window[total & (GZIP_WINDOW_SIZE - 1)] = b;
+    total++;
+    if ((total & (GZIP_WINDOW_SIZE - 1)) == 0) {
+      flush();
+    }
+  }
+
+  // Hands everything inflated since the last flush to the output.
+  bool flush() {
+    while (flushed != total && state != FAILED) {
+      size_t start = flushed & (GZIP_WINDOW_SIZE - 1);
+      size_t length = total - flushed;
+      if (start + length > GZIP_WINDOW_SIZE) {
+        length = GZIP_WINDOW_SIZE - start;
+      }
+      crc = updateCrc(crc, window.get() + start, length);
+      if (!out(window.get() + start, length)) {
+        outputRefused = true;
+        fail("output refused");
+        return false;
+      }
+      flushed += length;
+    }
+    return state != FAILED;
+  }
+
+  // Moves the bytes not yet decoded into the carry buffer.
+  void keepUnread() {
+    size_t unread = available();
+    if (unread > GZIP_CARRY_SIZE) {
+      fail("unit larger than the carry buffer");
+      return;
+    }
+    if (position < carryLength) {
+      size_t fromCarry = carryLength - position;
+      memmove(carry, carry + position, fromCarry);
+      memcpy(carry + fromCarry, source, sourceLength);
+    } else {
+      memcpy(carry, source + (position - carryLength), unread);
+    }
+    carryLength = unread;
+    position = 0;
+    source = nullptr;
+    sourceLength = 0;
+  }
+
+  Checkpoint save() const { return {position, bitBuffer, bitCount}; }
+
+  void restore(const Checkpoint& checkpoint) {
+    position = checkpoint.position;
+    bitBuffer = checkpoint.bitBuffer;
+    bitCount = checkpoint.bitCount;
+  }
+
+  // Returns false so decoders can `return fail(...)`. A unit that ran out
+  // of input may fail on the zeros it read instead; run() rolls it back.
+  bool fail(const char* reason) {
+    if (!starved) {
+      message = reason;
+    }
+    state = FAILED;
+    return false;
+  }
+
+  static uint32_t updateCrc(uint32_t crc, const uint8_t* data, size_t len) {
+    // Reflected CRC-32, four bits at a time
+    static const uint32_t TABLE[16] = {0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+                                       0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+                                       0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+    for (size_t i = 0; i < len; ++i) {
+      crc ^= data[i];
+      crc = (crc >> 4) ^ TABLE[crc & 0x0f];
+      crc = (crc >> 4) ^ TABLE[crc & 0x0f];
+    }
+    return crc;
+  }
+
+  std::unique_ptr<uint8_t[]> window;
+  OutputFunction out = nullptr;
+  State state = HEADER;
+  const char* message = "";
+  bool outputRefused = false;
+  bool starved = false;
+  bool lastBlock = false;
+  uint32_t storedLeft = 0;
+
+  uint8_t carry[GZIP_CARRY_SIZE];
+  size_t carryLength = 0;
+  const uint8_t* source = nullptr;
+  size_t sourceLength = 0;
+  size_t position = 0;
+  uint32_t bitBuffer = 0;
+  uint8_t bitCount = 0;
+
+  uint32_t total = 0;    // bytes inflated
+  uint32_t flushed = 0;  // of which handed to the output
+  uint32_t crc = 0xffffffff;
+
+  Huffman lengthCode;
+  Huffman distCode;
+};
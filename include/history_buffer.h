@@ -0,0 +1,261 @@
+#pragma once
+#include <Arduino.h>
+#include <math.h>
+#include <time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "printer_status.h"
+
+#ifndef HISTORY_CAPACITY
+#define HISTORY_CAPACITY 5400  // 3 hours at the 2 s sample cadence, 9 bytes per sample
+#endif
+#define HISTORY_MIN_CAPACITY 600
+#define HISTORY_MAX_POINTS 300  // per /history response, after decimation
+
+#define HISTORY_EPOCH_MIN 1609459200  // 2021-01-01, the NTP sync cut-off
+#define HISTORY_NO_HUMIDITY 0xFFFF
+
+// History timestamps are seconds: Unix time once NTP has synced, otherwise
+// seconds since boot (always below HISTORY_EPOCH_MIN).
+inline uint32_t historyTimestamp() {
+  time_t now = time(nullptr);
+  if (now > HISTORY_EPOCH_MIN) {
+    return static_cast<uint32_t>(now);
+  }
+  return millis() / 1000;
+}
+
+// One stored sample in fixed point: centi-degrees, centi-percent humidity
+// (HISTORY_NO_HUMIDITY = none) and the PrinterStatus at the time.
+struct HistoryRecord {
+  uint32_t timestamp;
+  int16_t temperatureCenti;
+  uint16_t humidityCenti;
+  uint8_t status;
+};
+
+inline int32_t historyCenti(float value, int32_t lo, int32_t hi) {
+  int32_t centi = static_cast<int32_t>(lroundf(value * 100.0f));
+  if (centi < lo) centi = lo;
+  if (centi > hi) centi = hi;
+  return centi;
+}
+
+inline HistoryRecord makeHistoryRecord(uint32_t timestamp, float temperature, float humidity, bool hasHumidity,
+                                       PrinterStatus status) {
+  HistoryRecord record;
+  record.timestamp = timestamp;
+  record.temperatureCenti = static_cast<int16_t>(historyCenti(temperature, -32768, 32767));
+  record.humidityCenti = (hasHumidity && !isnan(humidity)) ? static_cast<uint16_t>(historyCenti(humidity, 0, 10000))
+                                                           : HISTORY_NO_HUMIDITY;
+  record.status = static_cast<uint8_t>(status);
+  return record;
+}
+
+struct HistoryBucket {
+  uint32_t timestamp;
+  float temperature;
+  float humidity;
+  bool hasHumidity;
+  PrinterStatus status;
+};
+
+// Averages time-ordered records into step-second buckets aligned to from and
+// calls visit(const HistoryBucket&) for every non-empty bucket. Records may
+// come from several sources in turn (flash log, then RAM) as long as each
+// one continues where the previous stopped.
+template <typename Visitor>
+class HistoryDecimator {
+public:
+  HistoryDecimator(uint32_t from, uint32_t step, Visitor& visit) : from(from), step(step), visit(visit) {}
+
+  void add(const HistoryRecord& record) {
+    uint32_t index = (record.timestamp - from) / step;
+    if (samples > 0 && index != bucketIndex) {
+      emit();
+    }
+    bucketIndex = index;
+    tempSum += record.temperatureCenti;
+    ++samples;
+    if (record.humidityCenti != HISTORY_NO_HUMIDITY) {
+      humSum += record.humidityCenti;
+      ++humSamples;
+    }
+    lastStatus = record.status;
+  }
+
+  size_t finish() {
+    if (samples > 0) {
+      emit();
+    }
+    return emitted;
+  }
+
+private:
+  void emit() {
+    HistoryBucket bucket;
+    bucket.timestamp = from + bucketIndex * step;
+    bucket.temperature = static_cast<float>(static_cast<double>(tempSum) / samples / 100.0);
+    bucket.hasHumidity = humSamples > 0;
+    bucket.humidity = bucket.hasHumidity ? static_cast<float>(static_cast<double>(humSum) / humSamples / 100.0) : 0.0f;
+    bucket.status = static_cast<PrinterStatus>(lastStatus);
+    visit(bucket);
+    ++emitted;
+    tempSum = humSum = 0;
+    samples = humSamples = 0;
+  }
+
+  uint32_t from;
+  uint32_t step;
+  Visitor& visit;
+  uint32_t bucketIndex = 0;
+  // One bucket can span the whole flash log (~121k records), so the counts
+  // and sums are sized for that rather than for a typical step.
+  int64_t tempSum = 0;
+  int64_t humSum = 0;
+  uint32_t samples = 0;
+  uint32_t humSamples = 0;
+  uint8_t lastStatus = 0;
+  size_t emitted = 0;
+};
+
+// Fixed-capacity ring of samples stored as struct-of-arrays in fixed point,
+// so a sample costs 9 bytes instead of a padded 12-byte HistoryRecord.
+class HistoryBuffer {
+public:
+  // Allocates the arrays once. Halves the capacity until the allocation fits
+  // so a fragmented heap degrades history length instead of failing boot.
+  bool begin(size_t requested = HISTORY_CAPACITY) {
+    lock = xSemaphoreCreateMutex();
+    if (!lock) {
+      return false;
+    }
+    for (size_t cap = requested; cap >= HISTORY_MIN_CAPACITY; cap /= 2) {
+      if (allocate(cap)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void append(const HistoryRecord& record) {
+    if (!cap) {
+      return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    size_t slot = (head + count) % cap;
+    if (count == cap) {
+      head = (head + 1) % cap;
+    } else {
+      ++count;
+    }
+    timestamps[slot] = record.timestamp;
+    temperatureCenti[slot] = record.temperatureCenti;
+    humidityCenti[slot] = record.humidityCenti;
+    statuses[slot] = record.status;
+    xSemaphoreGive(lock);
+  }
+
+  size_t size() const { return count; }
+  size_t capacity() const { return cap; }
+  size_t memoryBytes() const { return cap * BYTES_PER_SAMPLE; }
+
+  bool bounds(uint32_t& oldest, uint32_t& newest) {
+    if (!cap) {
+      return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool any = count > 0;
+    if (any) {
+      oldest = timestamps[head];
+      newest = timestamps[(head + count - 1) % cap];
+    }
+    xSemaphoreGive(lock);
+    return any;
+  }
+
+  // Calls fn(const HistoryRecord&) for every sample in [from, to], oldest
+  // first, with the ring locked.
+  template <typename Fn>
+  void forEach(uint32_t from, uint32_t to, Fn fn) {
+    if (!cap || from > to) {
+      return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (size_t i = lowerBound(from); i < count; ++i) {
+      size_t slot = (head + i) % cap;
+      if (timestamps[slot] > to) {
+        break;
+      }
+      HistoryRecord record = {timestamps[slot], temperatureCenti[slot], humidityCenti[slot], statuses[slot]};
+      fn(record);
+    }
+    xSemaphoreGive(lock);
+  }
+
+  // Copies up to max samples in [from, to] into out, oldest first, so a
+  // caller can walk the ring in small batches without holding the lock.
+  size_t copyRange(uint32_t from, uint32_t to, HistoryRecord* out, size_t max) {
+    if (!cap || from > to) {
+      return 0;
+    }
+    size_t copied = 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (size_t i = lowerBound(from); i < count && copied < max; ++i) {
+      size_t slot = (head + i) % cap;
+      if (timestamps[slot] > to) {
+        break;
+      }
+      out[copied++] = {timestamps[slot], temperatureCenti[slot], humidityCenti[slot], statuses[slot]};
+    }
+    xSemaphoreGive(lock);
+    return copied;
+  }
+
+private:
+  static const size_t BYTES_PER_SAMPLE = sizeof(uint32_t) + sizeof(int16_t) + sizeof(uint16_t) + sizeof(uint8_t);
+
+  bool allocate(size_t capacity) {
+    timestamps = static_cast<uint32_t*>(malloc(capacity * sizeof(uint32_t)));
+    temperatureCenti = static_cast<int16_t*>(malloc(capacity * sizeof(int16_t)));
+    humidityCenti = static_cast<uint16_t*>(malloc(capacity * sizeof(uint16_t)));
+    statuses = static_cast<uint8_t*>(malloc(capacity));
+    if (timestamps && temperatureCenti && humidityCenti && statuses) {
+      cap = capacity;
+      return true;
+    }
+    free(timestamps);
+    free(temperatureCenti);
+    free(humidityCenti);
+    free(statuses);
+    timestamps = nullptr;
+    temperatureCenti = nullptr;
+    humidityCenti = nullptr;
+    statuses = nullptr;
+    return false;
+  }
+
+  // First logical index with timestamp >= from; timestamps only grow.
+  size_t lowerBound(uint32_t from) const {
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (timestamps[(head + mid) % cap] < from) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  uint32_t* timestamps = nullptr;
+  int16_t* temperatureCenti = nullptr;
+  uint16_t* humidityCenti = nullptr;
+  uint8_t* statuses = nullptr;
+  size_t cap = 0;
+  size_t head = 0;
+  size_t count = 0;
+  SemaphoreHandle_t lock = nullptr;
+};
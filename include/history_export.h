@@ -0,0 +1,80 @@
+#pragma once
+#include <Arduino.h>
+#include "history_buffer.h"
+#include "history_log.h"
+#include "payload_serializer.h"
+#include "printer_status.h"
+
+// Full-resolution history as CSV or NDJSON, produced a line at a time for a
+// chunked response from a HistoryReader, so the state stays under 1 KB
+// whatever the size of the export.
+class HistoryExport {
+public:
+  enum Format { CSV, NDJSON };
+
+  HistoryExport(HistoryLog& archive, HistoryBuffer& recent, Format format, uint32_t from, uint32_t to)
+      : reader(archive, recent, from, to), format(format) {
+    if (format == CSV) {
+      PayloadWriter header(line, sizeof(line));
+      header.append("timestamp,temperature,humidity,status\n");
+      lineLength = header.length();
+    }
+  }
+
+  static const char* contentType(Format format) { return format == CSV ? "text/csv" : "application/x-ndjson"; }
+
+  // AwsResponseFiller body: copies as much as fits into buffer, splitting a
+  // line across calls when needed. Returns 0 once the export is complete.
+  size_t fill(uint8_t* buffer, size_t maxLen) {
+    size_t written = 0;
+    while (written < maxLen) {
+      if (linePos == lineLength && !nextLine()) {
+        break;
+      }
+      size_t n = lineLength - linePos;
+      if (n > maxLen - written) {
+        n = maxLen - written;
+      }
+      memcpy(buffer + written, line + linePos, n);
+      linePos += n;
+      written += n;
+    }
+    return written;
+  }
+
+private:
+  bool nextLine() {
+    HistoryRecord record;
+    if (!reader.next(record)) {
+      return false;
+    }
+    PayloadWriter out(line, sizeof(line));
+    const char* status = printerStatusName(static_cast<PrinterStatus>(record.status));
+    bool hasHumidity = record.humidityCenti != HISTORY_NO_HUMIDITY;
+    if (format == CSV) {
+      out.appendUnsigned(record.timestamp).append(',').appendFixed(record.temperatureCenti / 100.0f, 2).append(',');
+      if (hasHumidity) {
+        out.appendFixed(record.humidityCenti / 100.0f, 2);
+      }
+      out.append(',').append(status).append('\n');
+    } else {
+      out.append("{\"timestamp\":").appendUnsigned(record.timestamp);
+      out.append(",\"temperature\":").appendFixed(record.temperatureCenti / 100.0f, 2).append(",\"humidity\":");
+      if (hasHumidity) {
+        out.appendFixed(record.humidityCenti / 100.0f, 2);
+      } else {
+        out.append("null");
+      }
+      out.append(",\"status\":\"").append(status).append("\"}\n");
+    }
+    lineLength = out.length();
+    linePos = 0;
+    return true;
+  }
+
+  HistoryReader reader;
+  Format format;
+  char line[112];
+  size_t lineLength = 0;
+  size_t linePos = 0;
+};
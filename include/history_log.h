@@ -0,0 +1,630 @@
+#pragma once
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include "history_buffer.h"
+#include "payload_serializer.h"
+#include "ts_codec.h"
+
+#define HISTORY_LOG_DIR "/hist"
+#define HISTORY_LOG_PAGE_SIZE 256      // one SPIFFS page; the log only ever writes whole pages
+#define HISTORY_LOG_SEGMENT_PAGES 64   // 16 KB segment, ~2.8 h of samples
+#ifndef HISTORY_LOG_MAX_SEGMENTS
+#define HISTORY_LOG_MAX_SEGMENTS 24    // 384 KB of the 768 KB partition, ~2.8 days
+#endif
+#define HISTORY_LOG_FLUSH_DEPTH 4      // full pages the flush task may fall behind by
+#define HISTORY_LOG_FLUSH_NOW_MS 2000  // flushNow() gives up on the flush task after this
+
+// Append-only sample log in SPIFFS, split into numbered segment files under
+// /hist. Samples are encoded into a RAM page and handed to a low-priority task
+// one full page (~80 samples, ~160 s) at a time, so flash sees one 256-byte
+// append per page and the oldest segment is deleted whole when the log is
+// full. At the 2 s cadence that is ~140 KB/day spread by SPIFFS over the
+// partition's 192 blocks, well under one erase per block per day.
+//
+// Each page is one TsCodec block, decodable on its own. The per-segment
+// [first, last] index lives in RAM and is rebuilt at boot from the block
+// headers of each segment's first and last page.
+class HistoryLog {
+public:
+  struct Page {
+    uint8_t bytes[HISTORY_LOG_PAGE_SIZE];
+  };
+
+  struct Segment {
+    uint32_t id;
+    uint32_t pages;
+    uint32_t first;
+    uint32_t last;
+  };
+
+  // fs must already be mounted (UserData::begin()). Rebuilds the index and
+  // starts the flush task; append() is a no-op until this succeeds.
+  bool begin(fs::FS& fs = SPIFFS) {
+    filesystem = &fs;
+    lock = xSemaphoreCreateMutex();
+    writeGate = xSemaphoreCreateBinary();
+    flushQueue = xQueueCreate(HISTORY_LOG_FLUSH_DEPTH, sizeof(Page));
+    if (!lock || !writeGate || !flushQueue) {
+      return false;
+    }
+    xSemaphoreGive(writeGate);
+    scan();
+    if (xTaskCreatePinnedToCore(flushTask, "HistoryFlush", 4096, this, 1, nullptr, 0) != pdPASS) {
+      return false;
+    }
+    ready = true;
+    return true;
+  }
+
+  // Called from loop(). Never blocks: a page that cannot be queued because
+  // flash is behind is dropped and counted. Samples stamped before NTP sync
+  // are not logged, since their boot-relative times would not survive reboot.
+  void append(const HistoryRecord& record) {
+    if (!ready || record.timestamp < HISTORY_EPOCH_MIN || record.timestamp < lastAppended) {
+      return;
+    }
+    lastAppended = record.timestamp;
+    if (encoder.count() == 0) {
+      memset(staging.bytes, 0, sizeof(staging.bytes));
+      encoder.reset(staging.bytes, sizeof(staging.bytes));
+    }
+    if (encoder.append(record)) {
+      return;
+    }
+    if (xQueueSend(flushQueue, &staging, 0) == pdTRUE) {
+      ++queuedPages;
+    } else {
+      ++droppedPages;
+    }
+    memset(staging.bytes, 0, sizeof(staging.bytes));
+    encoder.reset(staging.bytes, sizeof(staging.bytes));
+    encoder.append(record);
+  }
+
+  // Before a planned restart, from the same task as append(): queues the
+  // partly filled page and waits until the flush task has written every
+  // queued page. The page is a complete block, so nothing is lost; the next
+  // sample starts a new one. False if paused or not done in
+  // HISTORY_LOG_FLUSH_NOW_MS.
+  bool flushNow() {
+    if (!ready || paused) {
+      return false;
+    }
+    if (encoder.count() > 0) {
+      if (xQueueSend(flushQueue, &staging, pdMS_TO_TICKS(HISTORY_LOG_FLUSH_NOW_MS)) != pdTRUE) {
+        ++droppedPages;
+        return false;
+      }
+      ++queuedPages;
+      encoder.reset(staging.bytes, sizeof(staging.bytes));
+    }
+    for (uint32_t waited = 0; handledPages != queuedPages; waited += 10) {
+      if (waited >= HISTORY_LOG_FLUSH_NOW_MS) {
+        return false;
+      }
+      vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return true;
+  }
+
+  // Holds the flush task off flash, waiting for a page it is writing, e.g.
+  // while a filesystem image is written over the partition. Pages queue up
+  // meanwhile and are dropped once HISTORY_LOG_FLUSH_DEPTH are waiting.
+  // Binary semaphore, not a mutex: resume() may come from another task.
+  void pause() {
+    if (!ready || paused) {
+      return;
+    }
+    xSemaphoreTake(writeGate, portMAX_DELAY);
+    paused = true;
+  }
+
+  void resume() {
+    if (!paused) {
+      return;
+    }
+    paused = false;
+    xSemaphoreGive(writeGate);
+  }
+
+  // Oldest and newest flushed timestamps.
+  bool bounds(uint32_t& oldest, uint32_t& newest) {
+    if (!ready) {
+      return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    size_t n = segmentCount;
+    if (n > 0 && segments[n - 1].pages == 0) {
+      --n;  // just rotated, nothing flushed into it yet
+    }
+    bool any = n > 0;
+    if (any) {
+      oldest = segments[0].first;
+      newest = segments[n - 1].last;
+    }
+    xSemaphoreGive(lock);
+    return any;
+  }
+
+  // Read position in the log that can be held across calls, e.g. by a
+  // chunked response filler. Keeps its segment file open between pages.
+  struct Cursor {
+    uint32_t segment = 0;
+    uint32_t page = 0;
+    uint32_t openSegment = UINT32_MAX;
+    File file;
+  };
+
+  // Points cursor at the first page that can hold timestamps >= from. Only
+  // the segment index and a binary search over block headers are consulted.
+  void seek(Cursor& cursor, uint32_t from) {
+    cursor.segment = 0;
+    cursor.page = 0;
+    if (!ready) {
+      return;
+    }
+    Segment target = {0, 0, 0, 0};
+    bool found = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (size_t i = 0; i < segmentCount && !found; ++i) {
+      target = segments[i];
+      found = target.pages > 0 && target.last >= from;
+    }
+    if (!found && segmentCount > 0) {
+      target = segments[segmentCount - 1];  // past the end: wait for new pages
+    }
+    xSemaphoreGive(lock);
+    cursor.segment = target.id;
+    cursor.page = target.pages;
+    if (found && openSegment(cursor)) {
+      cursor.page = firstPageFrom(cursor.file, target.pages, from);
+    }
+  }
+
+  // Reads the page at cursor, or the first flushed page after it, and
+  // advances past it. Pages are only visible once fully written. If the
+  // cursor's segment was rotated away it resumes at the oldest page left.
+  bool readNext(Cursor& cursor, Page& page) {
+    if (!ready) {
+      return false;
+    }
+    bool found = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (size_t i = 0; i < segmentCount && !found; ++i) {
+      const Segment& segment = segments[i];
+      if (segment.id == cursor.segment && cursor.page < segment.pages) {
+        found = true;
+      } else if (segment.id > cursor.segment && segment.pages > 0) {
+        cursor.segment = segment.id;
+        cursor.page = 0;
+        found = true;
+      }
+    }
+    xSemaphoreGive(lock);
+    if (!found || !openSegment(cursor) || !readPage(cursor.file, cursor.page, page)) {
+      return false;
+    }
+    ++cursor.page;
+    return true;
+  }
+
+  // Calls fn(const HistoryRecord&) for every flushed sample in [from, to],
+  // oldest first.
+  template <typename Fn>
+  void forEach(uint32_t from, uint32_t to, Fn fn) {
+    if (!ready || from > to) {
+      return;
+    }
+    Cursor cursor;
+    Page page;
+    seek(cursor, from);
+    while (readNext(cursor, page)) {
+      TsCodec::BlockDecoder decoder;
+      decoder.begin(page.bytes, sizeof(page.bytes));
+      HistoryRecord record;
+      while (decoder.next(record)) {
+        if (record.timestamp > to) {
+          return;
+        }
+        if (record.timestamp >= from) {
+          fn(record);
+        }
+      }
+    }
+  }
+
+  size_t segmentsInUse() const { return segmentCount; }
+  uint32_t pagesWritten() const { return flushedPages; }
+  uint32_t pagesDropped() const { return droppedPages; }
+
+private:
+  static void flushTask(void* param) {
+    HistoryLog* log = static_cast<HistoryLog*>(param);
+    Page page;
+    for (;;) {
+      if (xQueueReceive(log->flushQueue, &page, portMAX_DELAY) == pdTRUE) {
+        xSemaphoreTake(log->writeGate, portMAX_DELAY);
+        log->flush(page);
+        xSemaphoreGive(log->writeGate);
+        ++log->handledPages;
+      }
+    }
+  }
+
+  // Runs on the flush task only, so segments[] is only ever mutated here
+  // (and in scan() before the task exists); readers copy under the lock.
+  void flush(const Page& page) {
+    if (segmentCount == 0 || sealed || segments[segmentCount - 1].pages >= HISTORY_LOG_SEGMENT_PAGES) {
+      rotate();
+      sealed = false;
+    }
+    Segment& active = segments[segmentCount - 1];
+    char path[32];
+    segmentPath(path, sizeof(path), active.id);
+    File file = filesystem->open(path, FILE_APPEND);
+    if (!file || file.write(page.bytes, sizeof(page.bytes)) != sizeof(page.bytes)) {
+      Serial.println("History log write failed");
+      if (file) {
+        file.close();
+      }
+      return;
+    }
+    file.close();
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (active.pages == 0) {
+      active.first = TsCodec::blockFirstTimestamp(page.bytes);
+    }
+    active.last = TsCodec::blockLastTimestamp(page.bytes);
+    ++active.pages;
+    xSemaphoreGive(lock);
+    ++flushedPages;
+  }
+
+  void rotate() {
+    uint32_t nextId = segmentCount > 0 ? segments[segmentCount - 1].id + 1 : 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (segmentCount == HISTORY_LOG_MAX_SEGMENTS) {
+      dropOldest();
+    }
+    segments[segmentCount++] = {nextId, 0, 0, 0};
+    xSemaphoreGive(lock);
+  }
+
+  // Rebuilds segments[] from the files under HISTORY_LOG_DIR. A segment whose
+  // size is not a whole number of pages (power lost mid-write) is closed and
+  // the next flush starts a new one instead of appending after the tear.
+  void scan() {
+    File dir = filesystem->open(HISTORY_LOG_DIR);
+    if (!dir || !dir.isDirectory()) {
+      return;
+    }
+    bool tornTail = false;
+    for (File file = dir.openNextFile(); file; file = dir.openNextFile()) {
+      char* end = nullptr;
+      uint32_t id = strtoul(file.name(), &end, 10);
+      if (!end || strcmp(end, ".seg") != 0) {
+        file.close();
+        continue;
+      }
+      Segment segment = {id, static_cast<uint32_t>(file.size() / HISTORY_LOG_PAGE_SIZE), 0, 0};
+      bool torn = file.size() % HISTORY_LOG_PAGE_SIZE != 0;
+      Page page;
+      if (segment.pages == 0 || !readPage(file, 0, page)) {
+        file.close();
+        char path[32];
+        segmentPath(path, sizeof(path), id);
+        filesystem->remove(path);
+        continue;
+      }
+      segment.first = TsCodec::blockFirstTimestamp(page.bytes);
+      segment.last = segment.first;
+      if (readPage(file, segment.pages - 1, page)) {
+        segment.last = TsCodec::blockLastTimestamp(page.bytes);
+      }
+      file.close();
+      insertSorted(segment, torn, tornTail);
+    }
+    dir.close();
+
+    if (segmentCount > 0) {
+      lastAppended = segments[segmentCount - 1].last;
+      sealed = tornTail;
+    }
+  }
+
+  void insertSorted(const Segment& segment, bool torn, bool& tornTail) {
+    if (segmentCount == HISTORY_LOG_MAX_SEGMENTS) {
+      if (segment.id < segments[0].id) {
+        char path[32];
+        segmentPath(path, sizeof(path), segment.id);
+        filesystem->remove(path);
+        return;
+      }
+      dropOldest();
+    }
+    size_t i = segmentCount;
+    while (i > 0 && segments[i - 1].id > segment.id) {
+      segments[i] = segments[i - 1];
+      --i;
+    }
+    segments[i] = segment;
+    ++segmentCount;
+    if (i == segmentCount - 1) {
+      tornTail = torn;
+    }
+  }
+
+  bool openSegment(Cursor& cursor) {
+    if (cursor.file && cursor.openSegment == cursor.segment) {
+      return true;
+    }
+    char path[32];
+    segmentPath(path, sizeof(path), cursor.segment);
+    cursor.file = filesystem->open(path, FILE_READ);
+    cursor.openSegment = cursor.segment;
+    return static_cast<bool>(cursor.file);
+  }
+
+  void dropOldest() {
+    char path[32];
+    segmentPath(path, sizeof(path), segments[0].id);
+    filesystem->remove(path);
+    memmove(&segments[0], &segments[1], (segmentCount - 1) * sizeof(Segment));
+    --segmentCount;
+  }
+
+  // First page whose last timestamp is >= from, found from block headers
+  // alone.
+  static uint32_t firstPageFrom(File& file, uint32_t pages, uint32_t from) {
+    uint32_t lo = 0;
+    uint32_t hi = pages;
+    while (lo < hi) {
+      uint32_t mid = (lo + hi) / 2;
+      uint8_t header[TsCodec::HEADER_SIZE];
+      if (!file.seek(mid * HISTORY_LOG_PAGE_SIZE) || file.read(header, sizeof(header)) != sizeof(header)) {
+        return lo;
+      }
+      if (TsCodec::blockLastTimestamp(header) < from) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  static bool readPage(File& file, uint32_t index, Page& page) {
+    return file.seek(index * HISTORY_LOG_PAGE_SIZE) &&
+           file.read(page.bytes, sizeof(page.bytes)) == sizeof(page.bytes) &&
+           TsCodec::isBlock(page.bytes, sizeof(page.bytes));
+  }
+
+  static void segmentPath(char* out, size_t len, uint32_t id) {
+    snprintf(out, len, HISTORY_LOG_DIR "/%08lu.seg", static_cast<unsigned long>(id));
+  }
+
+  Segment segments[HISTORY_LOG_MAX_SEGMENTS];
+  size_t segmentCount = 0;
+  Page staging;
+  TsCodec::BlockEncoder encoder;
+  uint32_t lastAppended = 0;
+  uint32_t flushedPages = 0;
+  uint32_t droppedPages = 0;
+  bool sealed = false;
+  fs::FS* filesystem = &SPIFFS;
+  bool ready = false;
+  bool paused = false;
+  uint32_t queuedPages = 0;  // append() and flushNow() only
+  std::atomic<uint32_t> handledPages{0};  // written or failed by the flush task
+  QueueHandle_t flushQueue = nullptr;
+  SemaphoreHandle_t lock = nullptr;
+  SemaphoreHandle_t writeGate = nullptr;  // held by a flush in progress, or by pause()
+};
+
+// Records in [from, to] from the flash log and then from the RAM ring,
+// oldest first, one at a time for a chunked response filler. Holds one
+// decoded page and a small batch of the ring, so the state stays under 1 KB
+// whatever the size of the range.
+class HistoryReader {
+public:
+  HistoryReader(HistoryLog& archive, HistoryBuffer& recent, uint32_t from, uint32_t to)
+      : archive(archive), recent(recent), nextFrom(from), to(to) {
+    archive.seek(cursor, from);
+  }
+
+  // Log first, then whatever the RAM ring holds past the last record
+  // returned; nextFrom only moves forward, so no sample is returned twice.
+  bool next(HistoryRecord& record) {
+    while (phase == FROM_LOG) {
+      if (!decoder.next(record)) {
+        if (!archive.readNext(cursor, page)) {
+          phase = FROM_RAM;
+          break;
+        }
+        decoder.begin(page.bytes, sizeof(page.bytes));
+        continue;
+      }
+      if (record.timestamp < nextFrom) {
+        continue;
+      }
+      return emit(record);
+    }
+    while (phase == FROM_RAM) {
+      if (batchPos == batchLength) {
+        batchLength = recent.copyRange(nextFrom, to, batch, RAM_BATCH);
+        batchPos = 0;
+        if (batchLength == 0) {
+          phase = DONE;
+          break;
+        }
+      }
+      record = batch[batchPos++];
+      if (record.timestamp >= nextFrom) {
+        return emit(record);
+      }
+    }
+    return false;
+  }
+
+private:
+  enum Phase { FROM_LOG, FROM_RAM, DONE };
+  static const size_t RAM_BATCH = 16;
+
+  bool emit(const HistoryRecord& record) {
+    if (record.timestamp > to) {
+      phase = DONE;
+      return false;
+    }
+    if (record.timestamp == UINT32_MAX) {
+      phase = DONE;
+    } else {
+      nextFrom = record.timestamp + 1;
+    }
+    return true;
+  }
+
+  HistoryLog& archive;
+  HistoryBuffer& recent;
+  uint32_t nextFrom;
+  uint32_t to;
+  Phase phase = FROM_LOG;
+  HistoryLog::Cursor cursor;
+  HistoryLog::Page page;
+  TsCodec::BlockDecoder decoder;
+  HistoryRecord batch[RAM_BATCH];
+  size_t batchPos = 0;
+  size_t batchLength = 0;
+};
+
+// The /history range: from/to default to the stored range and step is
+// widened so a response never exceeds HISTORY_MAX_POINTS points.
+struct HistoryQuery {
+  uint32_t from;
+  uint32_t to;
+  uint32_t step;
+};
+
+inline HistoryQuery clampHistoryQuery(HistoryLog& archive, HistoryBuffer& recent, uint32_t from, uint32_t to,
+                                      uint32_t step) {
+  uint32_t logOldest = 0, logNewest = 0, ramOldest = 0, ramNewest = 0;
+  bool haveLog = archive.bounds(logOldest, logNewest);
+  bool haveRam = recent.bounds(ramOldest, ramNewest);
+  uint32_t oldest = haveLog ? logOldest : ramOldest;
+  uint32_t newest = (haveRam && ramNewest > logNewest) ? ramNewest : logNewest;
+  if (from < oldest) from = oldest;
+  if (to > newest) to = newest;
+  uint32_t span = to > from ? to - from : 0;
+  uint32_t minStep = span / HISTORY_MAX_POINTS + 1;
+  if (step < minStep) step = minStep;
+  return {from, to, step};
+}
+
+// Feeds the flash log followed by the RAM ring, which also covers the
+// samples still staged for the next page, through the decimator.
+template <typename Visitor>
+void forEachHistoryBucket(HistoryLog& archive, HistoryBuffer& recent, const HistoryQuery& query, Visitor& visit) {
+  uint32_t logOldest = 0, logNewest = 0, ramOldest = 0, ramNewest = 0;
+  bool haveLog = archive.bounds(logOldest, logNewest);
+  bool haveRam = recent.bounds(ramOldest, ramNewest);
+  uint32_t from = query.from;
+  uint32_t to = query.to;
+
+  HistoryDecimator<Visitor> decimator(from, query.step, visit);
+  auto add = [&](const HistoryRecord& record) { decimator.add(record); };
+
+  // The RAM ring takes over after the last flushed sample, so none is
+  // counted twice.
+  if (haveLog) {
+    if (from <= logNewest) {
+      archive.forEach(from, to < logNewest ? to : logNewest, add);
+    }
+    if (haveRam && to > logNewest) {
+      recent.forEach(from > logNewest ? from : logNewest + 1, to, add);
+    }
+  } else if (haveRam) {
+    recent.forEach(from, to, add);
+  }
+  decimator.finish();
+}
+
+// /history body as JSON.
+inline void writeHistoryJson(Print& out, HistoryLog& archive, HistoryBuffer& recent, uint32_t from, uint32_t to,
+                             uint32_t step) {
+  HistoryQuery query = clampHistoryQuery(archive, recent, from, to, step);
+
+  char line[64];
+  PayloadWriter header(line, sizeof(line));
+  header.append("{\"from\":").appendUnsigned(query.from).append(",\"to\":").appendUnsigned(query.to);
+  header.append(",\"step\":").appendUnsigned(query.step);
+  out.print(line);
+  out.print(",\"statuses\":[\"NOT READY\",\"READY\",\"TOO HOT\"],\"points\":[");
+
+  bool first = true;
+  auto writePoint = [&](const HistoryBucket& bucket) {
+    PayloadWriter point(line, sizeof(line));
+    point.append(first ? "[" : ",[").appendUnsigned(bucket.timestamp);
+    point.append(',').appendFixed(bucket.temperature, 2).append(',');
+    if (bucket.hasHumidity) {
+      point.appendFixed(bucket.humidity, 2);
+    } else {
+      point.append("null");
+    }
+    point.append(',').appendUnsigned(static_cast<uint8_t>(bucket.status)).append(']');
+    out.write(reinterpret_cast<const uint8_t*>(line), point.length());
+    first = false;
+  };
+  forEachHistoryBucket(archive, recent, query, writePoint);
+  out.print("]}");
+}
+
+// Largest MessagePack point: fixarray, uint32 timestamp, two float32, status.
+#define HISTORY_MSGPACK_POINT_MAX 17
+
+// /history body as MessagePack, same keys and point layout as the JSON one
+// (nil for a missing humidity). MessagePack arrays are prefixed with their
+// length, so points are packed into a buffer of HISTORY_MAX_POINTS first;
+// returns false if it cannot be allocated.
+inline bool writeHistoryMsgPack(Print& out, HistoryLog& archive, HistoryBuffer& recent, uint32_t from, uint32_t to,
+                                uint32_t step) {
+  HistoryQuery query = clampHistoryQuery(archive, recent, from, to, step);
+
+  const size_t capacity = (HISTORY_MAX_POINTS + 1) * HISTORY_MSGPACK_POINT_MAX;
+  std::unique_ptr<uint8_t[]> points(new (std::nothrow) uint8_t[capacity]);
+  if (!points) {
+    return false;
+  }
+  MsgPackWriter body(points.get(), capacity);
+  uint16_t count = 0;
+  auto packPoint = [&](const HistoryBucket& bucket) {
+    if (count > HISTORY_MAX_POINTS) {
+      return;
+    }
+    body.arrayHeader(4).uint(bucket.timestamp).fixed(bucket.temperature, 2);
+    if (bucket.hasHumidity) {
+      body.fixed(bucket.humidity, 2);
+    } else {
+      body.nil();
+    }
+    body.uint(static_cast<uint8_t>(bucket.status));
+    ++count;
+  };
+  forEachHistoryBucket(archive, recent, query, packPoint);
+
+  uint8_t line[80];
+  MsgPackWriter header(line, sizeof(line));
+  header.mapHeader(5);
+  header.str("from").uint(query.from).str("to").uint(query.to).str("step").uint(query.step);
+  header.str("statuses").arrayHeader(3).str("NOT READY").str("READY").str("TOO HOT");
+  header.str("points").arrayHeader(count);
+  out.write(header.data(), header.length());
+  out.write(body.data(), body.length());
+  return true;
+}
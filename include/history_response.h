@@ -0,0 +1,194 @@
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <memory>
+#include <new>
+#include "history_buffer.h"
+#include "history_log.h"
+#include "payload_serializer.h"
+
+#ifndef HISTORY_RECORDS_PER_FILL
+#define HISTORY_RECORDS_PER_FILL 2048  // ~26 log pages decoded per filler call
+#endif
+
+// The /history body of writeHistoryJson() or writeHistoryMsgPack() for a
+// chunked response, decimated a slice at a time: each filler call reads at
+// most HISTORY_RECORDS_PER_FILL records, so a query over the whole log is
+// spread over many short calls in the AsyncTCP task rather than one long
+// one. JSON points are sent as their buckets close. MessagePack prefixes the
+// points array with its length, so those points are packed into a buffer and
+// sent once the range has been read; until then each call returns
+// RESPONSE_TRY_AGAIN.
+class HistoryResponse {
+public:
+  enum Format { JSON, MSGPACK };
+
+  HistoryResponse(HistoryLog& archive, HistoryBuffer& recent, Format format, uint32_t from, uint32_t to,
+                  uint32_t step)
+      : query(clampHistoryQuery(archive, recent, from, to, step)),
+        reader(archive, recent, query.from, query.to),
+        format(format),
+        sink{this},
+        decimator(query.from, query.step, sink) {}
+
+  static const char* contentType(Format format) {
+    return format == MSGPACK ? "application/msgpack" : "application/json";
+  }
+
+  // Allocates the MessagePack points buffer; false if it cannot be.
+  bool begin() {
+    if (format != MSGPACK) {
+      return true;
+    }
+    points.reset(new (std::nothrow) uint8_t[POINTS_CAPACITY]);
+    if (!points) {
+      return false;
+    }
+    body = MsgPackWriter(points.get(), POINTS_CAPACITY);
+    return true;
+  }
+
+  // AwsResponseFiller body: copies as much as fits into buffer. Returns
+  // RESPONSE_TRY_AGAIN when this call's records gave nothing to send yet and
+  // 0 once the body is complete.
+  size_t fill(uint8_t* buffer, size_t maxLen) {
+    uint32_t budget = HISTORY_RECORDS_PER_FILL;
+    size_t written = 0;
+    while (written < maxLen) {
+      if (chunkPos == chunkLength && !nextChunk(budget)) {
+        break;
+      }
+      size_t n = chunkLength - chunkPos;
+      if (n > maxLen - written) {
+        n = maxLen - written;
+      }
+      memcpy(buffer + written, chunk + chunkPos, n);
+      chunkPos += n;
+      written += n;
+    }
+    if (written == 0 && stage != DONE) {
+      return RESPONSE_TRY_AGAIN;
+    }
+    return written;
+  }
+
+private:
+  enum Stage { HEAD, POINTS, TAIL, PACKED_POINTS, DONE };
+  static const size_t POINTS_CAPACITY = (HISTORY_MAX_POINTS + 1) * HISTORY_MSGPACK_POINT_MAX;
+
+  struct Sink {
+    HistoryResponse* owner;
+    void operator()(const HistoryBucket& bucket) { owner->point(bucket); }
+  };
+
+  // Sets the next piece of the body to copy. False once the body is
+  // complete, or when budget records were read without producing one.
+  bool nextChunk(uint32_t& budget) {
+    for (;;) {
+      switch (stage) {
+        case HEAD:
+          stage = POINTS;
+          if (format == JSON) {
+            PayloadWriter head(line, sizeof(line));
+            head.append("{\"from\":").appendUnsigned(query.from).append(",\"to\":").appendUnsigned(query.to);
+            head.append(",\"step\":").appendUnsigned(query.step);
+            head.append(",\"statuses\":[\"NOT READY\",\"READY\",\"TOO HOT\"],\"points\":[");
+            send(line, head.length());
+            return true;
+          }
+          break;
+        case POINTS: {
+          if (budget == 0) {
+            return false;
+          }
+          HistoryRecord record;
+          if (reader.next(record)) {
+            --budget;
+            decimator.add(record);
+          } else {
+            decimator.finish();
+            stage = TAIL;
+          }
+          if (chunkPos < chunkLength) {
+            return true;
+          }
+          break;
+        }
+        case TAIL:
+          if (format == JSON) {
+            stage = DONE;
+            send("]}", 2);
+            return true;
+          }
+          stage = PACKED_POINTS;
+          packHead();
+          return true;
+        case PACKED_POINTS:
+          stage = DONE;
+          send(reinterpret_cast<const char*>(body.data()), body.length());
+          return true;
+        case DONE:
+          return false;
+      }
+    }
+  }
+
+  // Same keys as the JSON head, with the points count now known.
+  void packHead() {
+    MsgPackWriter head(reinterpret_cast<uint8_t*>(line), sizeof(line));
+    head.mapHeader(5);
+    head.str("from").uint(query.from).str("to").uint(query.to).str("step").uint(query.step);
+    head.str("statuses").arrayHeader(3).str("NOT READY").str("READY").str("TOO HOT");
+    head.str("points").arrayHeader(count);
+    send(line, head.length());
+  }
+
+  // A closed bucket: rendered as the next JSON chunk, or packed after the
+  // points so far. The decimator closes at most one bucket per record.
+  void point(const HistoryBucket& bucket) {
+    if (format == JSON) {
+      PayloadWriter out(line, sizeof(line));
+      out.append(count == 0 ? "[" : ",[").appendUnsigned(bucket.timestamp);
+      out.append(',').appendFixed(bucket.temperature, 2).append(',');
+      if (bucket.hasHumidity) {
+        out.appendFixed(bucket.humidity, 2);
+      } else {
+        out.append("null");
+      }
+      out.append(',').appendUnsigned(static_cast<uint8_t>(bucket.status)).append(']');
+      send(line, out.length());
+    } else {
+      if (count > HISTORY_MAX_POINTS) {
+        return;
+      }
+      body.arrayHeader(4).uint(bucket.timestamp).fixed(bucket.temperature, 2);
+      if (bucket.hasHumidity) {
+        body.fixed(bucket.humidity, 2);
+      } else {
+        body.nil();
+      }
+      body.uint(static_cast<uint8_t>(bucket.status));
+    }
+    ++count;
+  }
+
+  void send(const char* data, size_t length) {
+    chunk = data;
+    chunkLength = length;
+    chunkPos = 0;
+  }
+
+  HistoryQuery query;
+  HistoryReader reader;
+  Format format;
+  Sink sink;
+  HistoryDecimator<Sink> decimator;
+  Stage stage = HEAD;
+  uint16_t count = 0;
+  std::unique_ptr<uint8_t[]> points;
+  MsgPackWriter body{nullptr, 0};
+  char line[128];
+  const char* chunk = nullptr;
+  size_t chunkLength = 0;
+  size_t chunkPos = 0;
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "mqtt_topics.h"
+
+#define LAST_VALUE_MAX_PAYLOAD 112
+
+// The newest payload of each MqttTopic, pre-serialized, for a new MQTT
+// subscriber (delivered as a retained message) and for /readings. Every value
+// carries the version of the data it was rendered from: the sample sequence,
+// an alert count.
+//
+// A topic with a source is filled lazily: read() re-renders it only when the
+// source has moved past the cached version, so the publish path still renders
+// nothing for an unwatched device and a burst of reads renders once. Values
+// without a source are whatever was last store()d.
+class LastValueCache {
+public:
+  typedef uint32_t (*VersionFunction)();
+  // Renders the current value into out, sets its version and returns its
+  // length; 0 when there is nothing to render yet.
+  typedef size_t (*RenderFunction)(uint8_t* out, size_t size, uint32_t& version);
+
+  bool begin() {
+    lock = xSemaphoreCreateMutex();
+    bootTag = esp_random();
+    return lock != nullptr;
+  }
+
+  void setSource(MqttTopic topic, VersionFunction currentVersion, RenderFunction render) {
+    entries[topic].currentVersion = currentVersion;
+    entries[topic].render = render;
+  }
+
+  // Payloads may be binary (the MessagePack topics); longer ones are not
+  // cached.
+  void store(MqttTopic topic, const void* payload, size_t length, uint32_t version) {
+    if (!lock || length > LAST_VALUE_MAX_PAYLOAD) {
+      return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Entry& entry = entries[topic];
+    memcpy(entry.payload, payload, length);
+    entry.length = length;
+    entry.version = version;
+    xSemaphoreGive(lock);
+  }
+
+  // Version read() would return now, without rendering. 0 when there is no
+  // value yet.
+  uint32_t version(MqttTopic topic) const {
+    const Entry& entry = entries[topic];
+    if (entry.currentVersion) {
+      return entry.currentVersion();
+    }
+    return entry.length > 0 ? entry.version : 0;
+  }
+
+  // Copies the newest value into out and returns its length, or 0 when the
+  // topic has no value yet or it does not fit. out is NUL-terminated when
+  // there is room, so JSON values can be used as strings.
+  size_t read(MqttTopic topic, void* out, size_t size, uint32_t& version) {
+    if (!lock) {
+      return 0;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Entry& entry = entries[topic];
+    if (entry.render && (entry.length == 0 || entry.version != entry.currentVersion())) {
+      // A source with nothing to show (no sample, sensor error) clears the
+      // value rather than leave an older one in its place
+      uint32_t rendered = entry.currentVersion();
+      entry.length = entry.render(entry.payload, sizeof(entry.payload), rendered);
+      entry.version = rendered;
+      renders++;
+    }
+    size_t length = 0;
+    if (entry.length > 0 && entry.length <= size) {
+      length = entry.length;
+      memcpy(out, entry.payload, length);
+      if (length < size) {
+        static_cast<uint8_t*>(out)[length] = 0;
+      }
+      version = entry.version;
+    }
+    xSemaphoreGive(lock);
+    return length;
+  }
+
+  // Strong ETag for a topic's version: the boot tag keeps a restarted
+  // device, whose versions begin again, from matching a browser's cached
+  // copy, and the topic tells the JSON and MessagePack bodies apart.
+  void etag(MqttTopic topic, uint32_t version, char* out, size_t size) const {
+    snprintf(out, size, "\"%08lx-%u-%lu\"", static_cast<unsigned long>(bootTag), static_cast<unsigned>(topic),
+             static_cast<unsigned long>(version));
+  }
+
+  uint32_t lazyRenders() const { return renders; }
+
+private:
+  struct Entry {
+    uint8_t payload[LAST_VALUE_MAX_PAYLOAD] = {};
+    size_t length = 0;  // 0: no value
+    uint32_t version = 0;
+    VersionFunction currentVersion = nullptr;
+    RenderFunction render = nullptr;
+  };
+
+  SemaphoreHandle_t lock = nullptr;
+  Entry entries[MQTT_TOPIC_COUNT];
+  uint32_t bootTag = 0;
+  uint32_t renders = 0;
+};
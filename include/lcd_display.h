@@ -2,56 +2,67 @@
 #include <Arduino.h>
 #include <LiquidCrystal_I2C.h>
 
+#define LCD_COLS 20
+#define LCD_ROWS 4
+
+// Every update renders into a 20x4 shadow frame; flush() then sends only the
+// cells that differ from what the glass already shows. Each run of changed
+// cells in a row costs one cursor move plus its characters, so the clock
+// ticking from 12:00:09 to 12:00:10 sends two characters instead of a whole
+// row, and full-screen messages never need the flickering, 2 ms clear().
+// Drawing several updates before one flush() sends only the net change.
 class LCDDisplay {
 public:
   // Default I2C address for 20x4 LCD is 0x27 (common) or 0x3F
-  LCDDisplay(uint8_t address = 0x27) : lcd(address, 20, 4), 
-    lastTemp(-999.0), lastHumidity(-999.0), ipDisplayed(false) {}
+  LCDDisplay(uint8_t address = 0x27) : lcd(address, LCD_COLS, LCD_ROWS),
+    lastTemp(-999.0), lastHumidity(-999.0) {
+    memset(frame, ' ', sizeof(frame));
+    memset(shown, ' ', sizeof(shown));
+  }
 
+  // Initializes the LCD and leaves the startup message on it; the caller
+  // decides when to clear() it.
   bool begin(const char* version = "") {
-    // Initialize I2C LCD
+    // Initialize I2C LCD (init() leaves the display blank, matching shown)
     lcd.init();
     lcd.backlight();
-    
+
     // Display startup message
-    lcd.setCursor(0, 0);
-    lcd.print("Temperature Monitor");
-    lcd.setCursor(0, 1);
-    lcd.print("Initializing...");
+    char line[LCD_COLS + 1];
+    setRow(0, "Temperature Monitor");
+    setRow(1, "Initializing...");
     if (version && version[0] != '\0') {
-      lcd.setCursor(0, 2);
-      lcd.print("Version: ");
-      lcd.print(version);
+      snprintf(line, sizeof(line), "Version: %s", version);
+      setRow(2, line);
     }
-    
-    delay(2000);
-    lcd.clear();
+    flush();
     return true;
   }
 
-  // Display IP address once at boot time
+  // Blanks the frame and forgets the last readings drawn, so the next
+  // updateTemperature()/updateHumidity() redraws them.
+  void clear() {
+    clearFrame();
+    lastTemp = -999.0;
+    lastHumidity = -999.0;
+  }
+
   void displayIPAddress(const char* ipAddress) {
-    if (!ipDisplayed) {
-      lcd.setCursor(0, 2);
-      lcd.print("                    ");  // Clear line
-      lcd.setCursor(0, 2);
-      if (ipAddress && ipAddress[0] != '\0') {
-        lcd.print("IP: ");
-        lcd.print(ipAddress);
-      } else {
-        lcd.print("IP: Connecting...");
-      }
-      ipDisplayed = true;
+    char line[LCD_COLS + 1];
+    if (ipAddress && ipAddress[0] != '\0') {
+      snprintf(line, sizeof(line), "IP: %s", ipAddress);
+    } else {
+      snprintf(line, sizeof(line), "IP: Connecting...");
     }
+    setRow(2, line);
   }
 
-    // Display IP address once at boot time
+  // Printer status shares row 2 with the boot-time IP address
   void updateStatus(const char* status) {
-    lcd.setCursor(0, 2);
-    lcd.print("                    ");  // Clear line
-    lcd.setCursor(0, 2);
-    lcd.print("Status: ");
-    lcd.print(status);
+    static const int STATUS_COLS = LCD_COLS - 8;  // after "Status: "
+    char line[LCD_COLS + 1];
+    snprintf(line, sizeof(line), "Status: %.*s", STATUS_COLS, status);
+    setRow(2, line);
   }
 
   // Update temperature only if it changed
@@ -59,10 +70,9 @@ public:
     // Only update if temperature changed by at least 0.1 degrees
     if (fabsf(temperature - lastTemp) >= 0.1) {
       lastTemp = temperature;
-      lcd.setCursor(0, 0);
-      lcd.print("Temp: ");
-      lcd.print(temperature, 1);
-      lcd.print("C  ");  // Extra spaces to clear old text
+      char line[LCD_COLS + 1];
+      snprintf(line, sizeof(line), "Temp: %.1fC", temperature);
+      setRow(0, line);
     }
   }
 
@@ -72,66 +82,87 @@ public:
       // Don't update humidity line if sensor doesn't support it
       return;
     }
-    
+
     // Only update if humidity changed by at least 1%
     if (fabsf(humidity - lastHumidity) >= 1.0) {
       lastHumidity = humidity;
-      lcd.setCursor(0, 1);
-      lcd.print("Humidity: ");
-      lcd.print(humidity, 1);
-      lcd.print("%   ");  // Extra spaces to clear old text
+      char line[LCD_COLS + 1];
+      snprintf(line, sizeof(line), "Humidity: %.1f%%", humidity);
+      setRow(1, line);
     }
   }
 
   // Display humidity sensor status (called once or when sensor type changes)
   void displayHumidityStatus(bool isBME280) {
     if (!isBME280) {
-      lcd.setCursor(0, 1);
-      lcd.print("(No Humidity Sensor)");
+      setRow(1, "(No Humidity Sensor)");
     }
   }
 
   // Update time every second
   void updateTime() {
-    lcd.setCursor(0, 3);
     unsigned long totalSeconds = millis() / 1000;
     unsigned long hours = totalSeconds / 3600;
     unsigned long minutes = (totalSeconds % 3600) / 60;
     unsigned long secs = totalSeconds % 60;
-    
-    lcd.print("Time: ");
-    if (hours < 10) lcd.print("0");
-    lcd.print(hours);
-    lcd.print(":");
-    if (minutes < 10) lcd.print("0");
-    lcd.print(minutes);
-    lcd.print(":");
-    if (secs < 10) lcd.print("0");
-    lcd.print(secs);
-    lcd.print(" ");  // Extra space to clear old text
+
+    // Sized for any uptime; setRow() cuts it at the width
+    char line[sizeof("Time: ::") + 3 * 20];
+    snprintf(line, sizeof(line), "Time: %02lu:%02lu:%02lu", hours, minutes, secs);
+    setRow(3, line);
   }
 
   void displayError(const char* errorMsg) {
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("ERROR");
-    lcd.setCursor(0, 1);
-    lcd.print(errorMsg);
-    lcd.setCursor(0, 3);
-    lcd.print("Check connections");
+    clearFrame();
+    setRow(0, "ERROR");
+    setRow(1, errorMsg);
+    setRow(3, "Check connections");
   }
 
   void displayUploadMessage(const char* message) {
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print(message);
-    lcd.setCursor(0, 2);
-    lcd.print("Please wait...");
+    clearFrame();
+    setRow(0, message);
+    setRow(2, "Please wait...");
+  }
+
+  // Writes each run of cells where frame differs from shown with a single
+  // setCursor() and a burst of characters. Runs never span rows: the
+  // HD44780 wraps row 0 into row 2, not row 1.
+  void flush() {
+    for (uint8_t row = 0; row < LCD_ROWS; ++row) {
+      uint8_t col = 0;
+      while (col < LCD_COLS) {
+        if (frame[row][col] == shown[row][col]) {
+          ++col;
+          continue;
+        }
+        uint8_t end = col + 1;
+        while (end < LCD_COLS && frame[row][end] != shown[row][end]) {
+          ++end;
+        }
+        lcd.setCursor(col, row);
+        lcd.write(reinterpret_cast<const uint8_t*>(&frame[row][col]), end - col);
+        memcpy(&shown[row][col], &frame[row][col], end - col);
+        col = end;
+      }
+    }
   }
 
 private:
+  // Copies text into a frame row, truncated or space-padded to the width.
+  void setRow(uint8_t row, const char* text) {
+    uint8_t col = 0;
+    for (; col < LCD_COLS && text[col] != '\0'; ++col) {
+      frame[row][col] = text[col];
+    }
+    memset(&frame[row][col], ' ', LCD_COLS - col);
+  }
+
+  void clearFrame() { memset(frame, ' ', sizeof(frame)); }
+
   LiquidCrystal_I2C lcd;
+  char frame[LCD_ROWS][LCD_COLS];  // what the display should show
+  char shown[LCD_ROWS][LCD_COLS];  // what has been sent to it
   float lastTemp;
   float lastHumidity;
-  bool ipDisplayed;
 };
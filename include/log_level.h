@@ -0,0 +1,5 @@
+#pragma once
+#include <Arduino.h>
+
+// Log levels for the Serial sink (settings "log_level").
+enum LogLevel : uint8_t { LOG_NONE, LOG_ERROR, LOG_INFO, LOG_DEBUG };
@@ -1,94 +1,247 @@
 #pragma once
+#include <utility>
 #include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 #include "PicoMQTT.h"   // From your chosen broker library
+#include "last_value_cache.h"
+#include "mqtt_topics.h"
 
+#define MQTT_SERVICE_ACTIVE_MS 100  // how soon a connected client is served
+#define MQTT_SERVICE_IDLE_MS 1000   // how soon a new connection is accepted
+
+// Keeps, for each MqttTopic, how many connected clients hold at least one
+// subscription matching it. A filter is matched against the topic list once,
+// when it is subscribed, and the client's per-topic match counts are updated
+// from the resulting mask, so unsubscribes and disconnects never re-run the
+// wildcard matching and the publish path checks its audience in O(1).
+// Clients are found by scanning a packed array of id hashes; only clients
+// with at least one matching subscription are kept.
 class TrackingMqttBroker : public PicoMQTT::Server {
 public:
   using PicoMQTT::Server::Server;
 
+  size_t subscriberCount(MqttTopic topic) const {
+    return audience[topic];
+  }
+
+  bool hasSubscribers(MqttTopic topic) const {
+    return audience[topic] > 0;
+  }
+
   size_t sensorSubscriberCount() const {
-    return sensorSubscribers.size();
+    return subscriberCount(MQTT_TOPIC_SENSOR);
   }
 
+  // Either encoding of the sensor topic.
   bool hasSensorSubscribers() const {
-    return !sensorSubscribers.empty();
+    return hasSubscribers(MQTT_TOPIC_SENSOR) || hasSubscribers(MQTT_TOPIC_SENSOR_MSGPACK);
+  }
+
+  size_t clientCount() const {
+    return clients.size();
+  }
+
+  // Connected clients, subscribed or not.
+  size_t connectedCount() const {
+    return connected;
+  }
+
+  // Topics that gained a subscriber since the last call and have no other:
+  // a publish on one of them reaches only the new subscriptions.
+  uint32_t takeNewSubscriptions() {
+    uint32_t topics = newSubscriptions;
+    for (Client& client : clients) {
+      for (uint8_t t = 0; t < MQTT_TOPIC_COUNT; ++t) {
+        if (client.matches[t] > 0 && !(client.fresh & (1UL << t))) {
+          topics &= ~(1UL << t);
+        }
+      }
+      client.fresh = 0;
+    }
+    newSubscriptions = 0;
+    return topics;
   }
 
 protected:
+  void on_connected(const char*) override {
+    connected++;
+  }
+
   void on_subscribe(const char* client_id, const char* topic) override {
-    if (matchesSensorTopic(topic)) {
-      updateClientSubscription(client_id, 1);
+    uint32_t mask = matchingTopics(topic);
+    if (mask == 0) {
+      return;
+    }
+    Client& client = findOrAddClient(client_id);
+    for (uint8_t t = 0; t < MQTT_TOPIC_COUNT; ++t) {
+      if ((mask & (1UL << t)) && client.matches[t]++ == 0) {
+        audience[t]++;
+        client.fresh |= 1UL << t;
+        newSubscriptions |= 1UL << t;
+      }
     }
   }
 
   void on_unsubscribe(const char* client_id, const char* topic) override {
-    if (matchesSensorTopic(topic)) {
-      updateClientSubscription(client_id, -1);
+    uint32_t mask = matchingTopics(topic);
+    if (mask == 0) {
+      return;
+    }
+    size_t index = findClient(client_id);
+    if (index == clients.size()) {
+      return;
+    }
+    Client& client = clients[index];
+    bool any = false;
+    for (uint8_t t = 0; t < MQTT_TOPIC_COUNT; ++t) {
+      if ((mask & (1UL << t)) && client.matches[t] > 0 && --client.matches[t] == 0) {
+        audience[t]--;
+      }
+      any = any || client.matches[t] > 0;
+    }
+    if (!any) {
+      removeClient(index);
     }
   }
 
   void on_disconnected(const char* client_id) override {
-    removeClient(client_id);
+    if (connected > 0) {
+      connected--;
+    }
+    size_t index = findClient(client_id);
+    if (index == clients.size()) {
+      return;
+    }
+    for (uint8_t t = 0; t < MQTT_TOPIC_COUNT; ++t) {
+      if (clients[index].matches[t] > 0) {
+        audience[t]--;
+      }
+    }
+    removeClient(index);
   }
 
 private:
-  struct ClientSubscription {
-    String clientId;
-    uint16_t matchCount;
+  struct Client {
+    String id;
+    uint16_t matches[MQTT_TOPIC_COUNT];  // subscriptions matching each topic
+    uint32_t fresh;  // topics gained since the last takeNewSubscriptions()
   };
 
-  std::vector<ClientSubscription> sensorSubscribers;
-
-  bool matchesSensorTopic(const char* topic_filter) const {
-    return PicoMQTT::Subscriber::topic_matches(topic_filter, "mqtt/sensor");
+  // FNV-1a
+  static uint32_t hashId(const char* id) {
+    uint32_t hash = 2166136261UL;
+    for (; *id; ++id) {
+      hash = (hash ^ static_cast<uint8_t>(*id)) * 16777619UL;
+    }
+    return hash;
   }
 
-  int findClientIndex(const char* client_id) const {
-    for (size_t i = 0; i < sensorSubscribers.size(); ++i) {
-      if (sensorSubscribers[i].clientId == client_id) {
-        return static_cast<int>(i);
+  static uint32_t matchingTopics(const char* topic_filter) {
+    uint32_t mask = 0;
+    for (uint8_t t = 0; t < MQTT_TOPIC_COUNT; ++t) {
+      if (PicoMQTT::Subscriber::topic_matches(topic_filter, mqttTopicName(static_cast<MqttTopic>(t)))) {
+        mask |= 1UL << t;
       }
     }
-    return -1;
+    return mask;
   }
 
-  void updateClientSubscription(const char* client_id, int delta) {
-    int index = findClientIndex(client_id);
-    if (index < 0) {
-      if (delta > 0) {
-        sensorSubscribers.push_back({String(client_id), static_cast<uint16_t>(delta)});
+  // Returns clients.size() when the client has no tracked subscriptions.
+  size_t findClient(const char* client_id) const {
+    uint32_t hash = hashId(client_id);
+    for (size_t i = 0; i < hashes.size(); ++i) {
+      if (hashes[i] == hash && clients[i].id == client_id) {
+        return i;
       }
-      return;
     }
+    return clients.size();
+  }
 
-    int newCount = static_cast<int>(sensorSubscribers[index].matchCount) + delta;
-    if (newCount <= 0) {
-      sensorSubscribers.erase(sensorSubscribers.begin() + index);
-    } else {
-      sensorSubscribers[index].matchCount = static_cast<uint16_t>(newCount);
+  Client& findOrAddClient(const char* client_id) {
+    size_t index = findClient(client_id);
+    if (index < clients.size()) {
+      return clients[index];
     }
+    hashes.push_back(hashId(client_id));
+    clients.push_back({String(client_id), {}, 0});
+    return clients.back();
   }
 
-  void removeClient(const char* client_id) {
-    int index = findClientIndex(client_id);
-    if (index >= 0) {
-      sensorSubscribers.erase(sensorSubscribers.begin() + index);
+  // Order does not matter, so the last client fills the gap.
+  void removeClient(size_t index) {
+    if (index + 1 != clients.size()) {
+      hashes[index] = hashes.back();
+      clients[index] = std::move(clients.back());
     }
+    hashes.pop_back();
+    clients.pop_back();
   }
+
+  std::vector<uint32_t> hashes;  // parallel to clients, scanned on lookup
+  std::vector<Client> clients;
+  uint16_t audience[MQTT_TOPIC_COUNT] = {};
+  uint32_t newSubscriptions = 0;
+  size_t connected = 0;
 };
 
+// PicoMQTT is polled, not driven by socket events. It is serviced from its
+// own task, every MQTT_SERVICE_ACTIVE_MS while a client is connected and
+// every MQTT_SERVICE_IDLE_MS otherwise, so loop() never wakes for it. The
+// lock keeps the task's servicing and loop()'s publishes apart.
 class LocalMqttBroker {
 public:
-  void begin() {
+  // With a cache, a client subscribing to a topic gets that topic's last
+  // value straight away instead of waiting for the next publish. Without
+  // runTask the owner calls loop() itself.
+  bool begin(LastValueCache* lastValues = nullptr, bool runTask = true) {
+    retained = lastValues;
+    lock = xSemaphoreCreateMutex();
+    if (!lock) {
+      return false;
+    }
     broker.begin();
+    return !runTask || xTaskCreatePinnedToCore(serviceTask, "MqttTask", 4096, this, 1, nullptr, 1) == pdPASS;
   }
 
-  void publish(const char* topic, const char* payload) {
-    broker.publish(topic, payload);
+  // Returns false without touching the broker when nobody is subscribed.
+  bool publish(MqttTopic topic, const char* payload) {
+    return publish(topic, payload, strlen(payload));
   }
 
+  bool publish(MqttTopic topic, const void* payload, size_t length) {
+    if (!lock || !broker.hasSubscribers(topic)) {
+      return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool sent = broker.publish(mqttTopicName(topic), payload, length);
+    xSemaphoreGive(lock);
+    return sent;
+  }
+
+  // PicoMQTT has no per-client publish or retained store, so the cached value
+  // goes out as a topic-wide publish with the retain flag. That may only
+  // reach new subscriptions (MQTT 3.1.1, 3.3.1.3), so it is sent only on a
+  // topic where every subscriber is new; one that joins clients already on
+  // the topic waits for the next publish, and misses the last alert.
   void loop() {
-    broker.loop();
+    if (!lock) {
+      return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    service();
+    xSemaphoreGive(lock);
+  }
+
+  uint32_t retainedDeliveries() const {
+    return retainedSent;
+  }
+
+  // Read without the lock: a count one service behind only costs one
+  // publish that reaches nobody, or one sample a new subscriber misses.
+  bool hasSubscribers(MqttTopic topic) const {
+    return broker.hasSubscribers(topic);
   }
 
   bool hasSensorSubscribers() const {
@@ -96,5 +249,36 @@ public:
   }
 
 private:
+  static void serviceTask(void* param) {
+    LocalMqttBroker* self = static_cast<LocalMqttBroker*>(param);
+    for (;;) {
+      self->loop();
+      vTaskDelay(pdMS_TO_TICKS(self->broker.connectedCount() > 0 || self->broker.clientCount() > 0
+                                   ? MQTT_SERVICE_ACTIVE_MS
+                                   : MQTT_SERVICE_IDLE_MS));
+    }
+  }
+
+  void service() {
+    broker.loop();
+    uint32_t topics = broker.takeNewSubscriptions();
+    if (!retained || topics == 0) {
+      return;
+    }
+    uint8_t payload[LAST_VALUE_MAX_PAYLOAD];
+    for (uint8_t t = 0; t < MQTT_TOPIC_COUNT; ++t) {
+      uint32_t version = 0;
+      MqttTopic topic = static_cast<MqttTopic>(t);
+      size_t length = (topics & (1UL << t)) ? retained->read(topic, payload, sizeof(payload), version) : 0;
+      if (length > 0) {
+        broker.publish(mqttTopicName(topic), payload, length, 0, true);
+        retainedSent++;
+      }
+    }
+  }
+
   TrackingMqttBroker broker;
+  SemaphoreHandle_t lock = nullptr;
+  LastValueCache* retained = nullptr;
+  uint32_t retainedSent = 0;
 };
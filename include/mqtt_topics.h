@@ -0,0 +1,19 @@
+#pragma once
+#include <Arduino.h>
+
+// Every topic the firmware publishes. Add new topics here so the broker
+// tracks their audience and the last-value cache has a slot for them.
+// The /msgpack variants carry the same payloads as MessagePack.
+enum MqttTopic : uint8_t {
+  MQTT_TOPIC_SENSOR,
+  MQTT_TOPIC_ALERTS,
+  MQTT_TOPIC_SENSOR_MSGPACK,
+  MQTT_TOPIC_ALERTS_MSGPACK,
+  MQTT_TOPIC_COUNT
+};
+
+inline const char* mqttTopicName(MqttTopic topic) {
+  static const char* const NAMES[MQTT_TOPIC_COUNT] = {"mqtt/sensor", "mqtt/alerts", "mqtt/sensor/msgpack",
+                                                       "mqtt/alerts/msgpack"};
+  return NAMES[topic];
+}
@@ -0,0 +1,429 @@
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <Update.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <mbedtls/sha256.h>
+#include <memory>
+#include <new>
+#include "gzip_inflater.h"
+#include "payload_serializer.h"
+#include "user_data.h"  // ASSETS_PARTITION
+
+#define OTA_REBOOT_GRACE_MS 2000     // reboot anyway if the client keeps the connection open
+#define OTA_PROGRESS_MAX_LENGTH 224  // the "ota" SSE event
+#define OTA_ERROR_MAX_LENGTH 48
+
+enum OtaTarget { OTA_FIRMWARE, OTA_FILESYSTEM };
+enum OtaState { OTA_IDLE, OTA_RECEIVING, OTA_SUCCEEDED, OTA_FAILED };
+
+// One firmware or filesystem upload at a time, from the first chunk to the
+// reboot. Every chunk is written to flash and fed to SHA-256 as it arrives;
+// the client sends the image's SHA-256 up front (form field "sha256" before
+// the file, or an X-Update-SHA256 header) and the update is only committed
+// when the two match. A short flash write, a mismatch or the client going
+// away aborts it.
+//
+// An image that starts with the gzip magic is inflated on the way to flash
+// (GzipInflater, 32 KB window allocated for the upload only); the SHA-256
+// is then that of the .gz file as sent, and the gzip CRC-32 covers the
+// inflated image.
+//
+// The upload handler never sends anything: respond(), run from the request
+// handler once the body is in, sends the one JSON answer. After a success
+// the reboot is left to the main loop (rebootDue()), once the client has
+// closed the connection or OTA_REBOOT_GRACE_MS after the answer, so the
+// async_tcp task never blocks and the answer is never cut off.
+//
+// A filesystem image replaces the whole SPIFFS partition. The first
+// function given to begin() runs before one is started, to save what is on
+// it and stop anything writing to it (UserData::prepareFilesystemUpdate());
+// if it returns false the update is refused. The second runs if the update
+// fails after that, to undo it.
+//
+// Chunks arrive on the async_tcp task and progress is read from the main
+// loop; the lock only guards the counters, not the flash writes.
+class OtaUpdate {
+public:
+  typedef bool (*PrepareFunction)();
+  typedef void (*ResumeFunction)();
+
+  bool begin(PrepareFunction beforeFilesystem = nullptr, ResumeFunction afterFailedFilesystem = nullptr) {
+    prepareFilesystem = beforeFilesystem;
+    resumeFilesystem = afterFailedFilesystem;
+    lock = xSemaphoreCreateMutex();
+    return lock != nullptr;
+  }
+
+  // The first chunk of an upload. Returns true when the update was started
+  // and this request now owns it.
+  bool start(AsyncWebServerRequest* request) {
+    if (!lock) {
+      return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (state == OTA_RECEIVING || state == OTA_SUCCEEDED) {
+      refused = request;
+      xSemaphoreGive(lock);
+      Serial.println("Update refused: another one is in progress");
+      return false;
+    }
+    owner = request;
+    state = OTA_RECEIVING;
+    written = 0;
+    imageBytes = 0;
+    compressed = false;
+    total = request->contentLength();
+    hashUs = 0;
+    flashUs = 0;
+    responded = false;
+    flushed = false;
+    error[0] = '\0';
+    sequence++;
+    xSemaphoreGive(lock);
+
+    request->onDisconnect([this, request]() { onDisconnect(request); });
+
+    String type = request->hasArg("uploadType") ? request->arg("uploadType") : String("firmware");
+    if (type == "firmware") {
+      updateTarget = OTA_FIRMWARE;
+    } else if (type == "filesystem") {
+      updateTarget = OTA_FILESYSTEM;
+    } else {
+      fail(400, "uploadType must be firmware or filesystem");
+      return false;
+    }
+
+    String hash = request->hasArg("sha256") ? request->arg("sha256") : request->header("X-Update-SHA256");
+    if (!parseHash(hash.c_str(), expected)) {
+      fail(400, "sha256 of the image required");
+      return false;
+    }
+
+    if (updateTarget == OTA_FILESYSTEM && prepareFilesystem) {
+      if (!prepareFilesystem()) {
+        fail(500, "user data could not be saved");
+        return false;
+      }
+      prepared = true;
+    }
+    // By label: with partitions_userdata.csv it is not the only spiffs partition
+    bool began = updateTarget == OTA_FILESYSTEM ? Update.begin(UPDATE_SIZE_UNKNOWN, U_SPIFFS, -1, LOW, ASSETS_PARTITION)
+                                                : Update.begin(UPDATE_SIZE_UNKNOWN, U_FLASH);
+    if (!began) {
+      Update.printError(Serial);
+      fail(500, "update could not start");
+      return false;
+    }
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    Serial.printf("Update started: %s, %u bytes in the request\n", targetName(updateTarget),
+                  static_cast<unsigned>(total));
+    return true;
+  }
+
+  // Every chunk, the first one included, after start().
+  void write(AsyncWebServerRequest* request, uint8_t* data, size_t len, bool final) {
+    if (request != owner || state != OTA_RECEIVING) {
+      return;
+    }
+    if (written == 0 && GzipInflater::isGzip(data, len)) {
+      inflater.reset(new (std::nothrow) GzipInflater());
+      if (!inflater || !inflater->begin(writeFlash)) {
+        abort();
+        fail(500, "no memory to inflate the image");
+        return;
+      }
+      compressed = true;
+      Serial.println("Update is gzip-compressed, inflating");
+    }
+    if (len > 0) {
+      uint32_t t0 = micros();
+      mbedtls_sha256_update(&sha, data, len);
+      uint32_t t1 = micros();
+      if (compressed) {
+        if (inflater->write(data, len) == GzipInflater::GZIP_ERROR) {
+          bool flashFailed = inflater->outputFailed();
+          char reason[OTA_ERROR_MAX_LENGTH];
+          snprintf(reason, sizeof(reason), "gzip: %s", inflater->error());
+          abort();
+          fail(flashFailed ? 500 : 400, flashFailed ? "flash write failed" : reason);
+          return;
+        }
+      } else if (Update.write(data, len) != len) {
+        Update.printError(Serial);
+        abort();
+        fail(500, "flash write failed");
+        return;
+      }
+      uint32_t t2 = micros();
+      xSemaphoreTake(lock, portMAX_DELAY);
+      written += len;
+      imageBytes = compressed ? inflater->inflated() : written;
+      hashUs += t1 - t0;
+      flashUs += t2 - t1;
+      sequence++;
+      xSemaphoreGive(lock);
+    }
+    if (final) {
+      finish();
+    }
+  }
+
+  // Sends the answer for a POST that carried (or tried to carry) an image.
+  void respond(AsyncWebServerRequest* request) {
+    if (!lock) {
+      request->send(500, "application/json", "{\"ok\":false,\"error\":\"updates unavailable\"}");
+      return;
+    }
+    char body[OTA_PROGRESS_MAX_LENGTH];
+    PayloadWriter json(body, sizeof(body));
+    int code = 200;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (request == owner && state == OTA_RECEIVING) {
+      xSemaphoreGive(lock);
+      // The body ended without a final chunk
+      abort();
+      fail(400, "upload incomplete");
+      xSemaphoreTake(lock, portMAX_DELAY);
+    }
+    if (request == owner && state == OTA_SUCCEEDED) {
+      json.append("{\"ok\":true,\"target\":").appendQuoted(targetName(updateTarget));
+      json.append(",\"bytes\":").appendUnsigned(written).append(",\"image_bytes\":").appendUnsigned(imageBytes);
+      json.append(",\"rebooting\":true}");
+      responded = true;
+      respondedMs = millis();
+    } else if (request == owner) {
+      code = status;
+      json.append("{\"ok\":false,\"error\":").appendQuoted(error).append('}');
+      owner = nullptr;
+    } else if (request == refused) {
+      code = 409;
+      json.append("{\"ok\":false,\"error\":\"another update is in progress\"}");
+      refused = nullptr;
+    } else {
+      code = 400;
+      json.append("{\"ok\":false,\"error\":\"no file in the request\"}");
+    }
+    xSemaphoreGive(lock);
+    request->send(code, "application/json", body);
+  }
+
+  // Renders the upload's progress into out when it changed since the last
+  // call; returns its length, 0 when nothing changed.
+  size_t takeProgress(char* out, size_t size, OtaState& current) {
+    if (!lock) {
+      return 0;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (sequence == takenSequence) {
+      xSemaphoreGive(lock);
+      return 0;
+    }
+    takenSequence = sequence;
+    current = state;
+    PayloadWriter json(out, size);
+    json.append("{\"state\":").appendQuoted(stateName(state));
+    json.append(",\"target\":").appendQuoted(targetName(updateTarget));
+    json.append(",\"written\":").appendUnsigned(written);
+    json.append(",\"total\":").appendUnsigned(total);
+    json.append(",\"image\":").appendUnsigned(imageBytes);
+    json.append(",\"compressed\":").append(compressed ? "true" : "false");
+    json.append(",\"error\":").appendQuoted(error).append('}');
+    xSemaphoreGive(lock);
+    return json.length();
+  }
+
+  // True once a successful update has been answered and the answer has
+  // left (or had OTA_REBOOT_GRACE_MS to).
+  bool rebootDue(uint32_t now) {
+    if (!lock) {
+      return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool due = state == OTA_SUCCEEDED && responded && (flushed || now - respondedMs >= OTA_REBOOT_GRACE_MS);
+    xSemaphoreGive(lock);
+    return due;
+  }
+
+  // Whether the main loop has anything to do for the update: one under
+  // way, progress not yet taken, or a reboot to come.
+  bool needsService() {
+    if (!lock) {
+      return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool busy = state == OTA_RECEIVING || state == OTA_SUCCEEDED || sequence != takenSequence;
+    xSemaphoreGive(lock);
+    return busy;
+  }
+
+  bool isReceiving() const { return state == OTA_RECEIVING; }
+  OtaTarget target() const { return updateTarget; }
+  uint32_t failures() const { return failureCount; }
+
+  // Appends `"state":"...",...,"flash_ms":n` (no surrounding braces).
+  void writeJsonFields(Print& out) {
+    if (!lock) {
+      out.print("\"state\":\"unavailable\"");
+      return;
+    }
+    char line[OTA_PROGRESS_MAX_LENGTH];
+    PayloadWriter json(line, sizeof(line));
+    xSemaphoreTake(lock, portMAX_DELAY);
+    json.append("\"state\":").appendQuoted(stateName(state));
+    json.append(",\"written\":").appendUnsigned(written);
+    json.append(",\"image\":").appendUnsigned(imageBytes);
+    json.append(",\"compressed\":").append(compressed ? "true" : "false");
+    json.append(",\"failures\":").appendUnsigned(failureCount);
+    json.append(",\"last_error\":").appendQuoted(error);
+    json.append(",\"hash_ms\":").appendUnsigned(hashUs / 1000);
+    json.append(",\"flash_ms\":").appendUnsigned(flashUs / 1000);
+    xSemaphoreGive(lock);
+    out.print(line);
+  }
+
+  static const char* stateName(OtaState state) {
+    switch (state) {
+      case OTA_RECEIVING: return "receiving";
+      case OTA_SUCCEEDED: return "succeeded";
+      case OTA_FAILED: return "failed";
+      default: return "idle";
+    }
+  }
+
+  static const char* targetName(OtaTarget target) {
+    return target == OTA_FILESYSTEM ? "filesystem" : "firmware";
+  }
+
+private:
+  void finish() {
+    uint8_t actual[32];
+    mbedtls_sha256_finish(&sha, actual);
+    if (memcmp(actual, expected, sizeof(actual)) != 0) {
+      abort();
+      fail(400, "sha256 mismatch");
+      return;
+    }
+    if (compressed && !inflater->done()) {
+      abort();
+      fail(400, "gzip stream incomplete");
+      return;
+    }
+    mbedtls_sha256_free(&sha);
+    inflater.reset();
+    if (!Update.end(true)) {
+      Update.printError(Serial);
+      fail(500, "update could not be committed");
+      return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    state = OTA_SUCCEEDED;
+    sequence++;
+    xSemaphoreGive(lock);
+    Serial.printf("Update verified and committed: %u bytes received, %u written\n", static_cast<unsigned>(written),
+                  static_cast<unsigned>(imageBytes));
+  }
+
+  void fail(int code, const char* reason) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    state = OTA_FAILED;
+    status = code;
+    snprintf(error, sizeof(error), "%s", reason);
+    failureCount++;
+    sequence++;
+    bool resume = prepared;
+    prepared = false;
+    xSemaphoreGive(lock);
+    Serial.printf("Update failed: %s\n", reason);
+    if (resume && resumeFilesystem) {
+      resumeFilesystem();
+    }
+  }
+
+  // The owner's connection closed: half way through the upload it is
+  // abandoned, after a success the answer has been flushed.
+  void onDisconnect(AsyncWebServerRequest* request) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (request != owner) {
+      xSemaphoreGive(lock);
+      return;
+    }
+    if (state == OTA_SUCCEEDED) {
+      flushed = true;
+      xSemaphoreGive(lock);
+      return;
+    }
+    bool abandoned = state == OTA_RECEIVING;
+    owner = nullptr;
+    xSemaphoreGive(lock);
+    if (abandoned) {
+      abort();
+      fail(0, "connection closed during upload");
+    }
+  }
+
+  // Drops whatever the upload had under way.
+  void abort() {
+    Update.abort();
+    mbedtls_sha256_free(&sha);
+    inflater.reset();
+  }
+
+  static bool writeFlash(const uint8_t* data, size_t len) {
+    if (Update.write(const_cast<uint8_t*>(data), len) != len) {
+      Update.printError(Serial);
+      return false;
+    }
+    return true;
+  }
+
+  // 64 hex digits, either case.
+  static bool parseHash(const char* hex, uint8_t* out) {
+    if (strlen(hex) != 64) {
+      return false;
+    }
+    for (size_t i = 0; i < 64; ++i) {
+      char c = hex[i];
+      uint8_t nibble;
+      if (c >= '0' && c <= '9') {
+        nibble = c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        nibble = c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        nibble = c - 'A' + 10;
+      } else {
+        return false;
+      }
+      out[i / 2] = (i % 2 == 0) ? static_cast<uint8_t>(nibble << 4) : static_cast<uint8_t>(out[i / 2] | nibble);
+    }
+    return true;
+  }
+
+  SemaphoreHandle_t lock = nullptr;
+  PrepareFunction prepareFilesystem = nullptr;
+  ResumeFunction resumeFilesystem = nullptr;
+  bool prepared = false;  // prepareFilesystem ran for the update under way
+  AsyncWebServerRequest* owner = nullptr;    // the request whose image is (or was) being written
+  AsyncWebServerRequest* refused = nullptr;  // turned away while owner's was in progress
+  OtaState state = OTA_IDLE;
+  OtaTarget updateTarget = OTA_FIRMWARE;
+  mbedtls_sha256_context sha;
+  uint8_t expected[32] = {};
+  std::unique_ptr<GzipInflater> inflater;
+  bool compressed = false;
+  size_t written = 0;     // request bytes taken
+  size_t imageBytes = 0;  // bytes written to flash, inflated
+  size_t total = 0;       // the whole request body, multipart framing included
+  uint32_t hashUs = 0;
+  uint32_t flashUs = 0;
+  int status = 200;
+  char error[OTA_ERROR_MAX_LENGTH] = "";
+  uint32_t failureCount = 0;
+  uint32_t sequence = 0;
+  uint32_t takenSequence = 0;
+  bool responded = false;
+  bool flushed = false;
+  uint32_t respondedMs = 0;
+};
@@ -0,0 +1,363 @@
+#pragma once
+#include <Arduino.h>
+#include <math.h>
+
+// Appends JSON fragments into a caller-owned buffer without touching the heap.
+// Output is truncated (and overflowed() reports it) rather than reallocated.
+class PayloadWriter {
+public:
+  PayloadWriter(char* buffer, size_t capacity) : buf(buffer), cap(capacity), len(0), overflow(false) {
+    if (cap > 0) {
+      buf[0] = '\0';
+    }
+  }
+
+  PayloadWriter& append(const char* text) {
+    while (*text) {
+      put(*text++);
+    }
+    terminate();
+    return *this;
+  }
+
+  PayloadWriter& append(char c) {
+    put(c);
+    terminate();
+    return *this;
+  }
+
+  // text as a quoted JSON string, escaping quotes, backslashes and control
+  // characters; for values that come from settings.
+  PayloadWriter& appendQuoted(const char* text) {
+    static const char hex[] = "0123456789abcdef";
+    put('"');
+    for (; *text; ++text) {
+      uint8_t c = static_cast<uint8_t>(*text);
+      if (c == '"' || c == '\\') {
+        put('\\');
+        put(static_cast<char>(c));
+      } else if (c < 0x20) {
+        put('\\');
+        put('u');
+        put('0');
+        put('0');
+        put(hex[c >> 4]);
+        put(hex[c & 0x0f]);
+      } else {
+        put(static_cast<char>(c));
+      }
+    }
+    put('"');
+    terminate();
+    return *this;
+  }
+
+  // Fixed-point rendering, rounding half away from zero like String(value, n).
+  // NaN/inf become null so the payload stays valid JSON.
+  PayloadWriter& appendFixed(float value, uint8_t decimals) {
+    if (isnan(value) || isinf(value)) {
+      return append("null");
+    }
+
+    uint32_t scale = 1;
+    for (uint8_t i = 0; i < decimals; ++i) {
+      scale *= 10;
+    }
+
+    double scaled = static_cast<double>(value) * scale;
+    bool negative = scaled < 0;
+    uint64_t units = static_cast<uint64_t>((negative ? -scaled : scaled) + 0.5);
+    if (negative && units != 0) {
+      put('-');
+    }
+
+    appendUnsigned(units / scale);
+    if (decimals > 0) {
+      put('.');
+      uint32_t frac = static_cast<uint32_t>(units % scale);
+      for (uint32_t div = scale / 10; div > 0; div /= 10) {
+        put(static_cast<char>('0' + (frac / div) % 10));
+      }
+    }
+    terminate();
+    return *this;
+  }
+
+  PayloadWriter& appendUnsigned(uint64_t value) {
+    char digits[20];
+    uint8_t count = 0;
+    do {
+      digits[count++] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value > 0);
+    while (count > 0) {
+      put(digits[--count]);
+    }
+    terminate();
+    return *this;
+  }
+
+  size_t length() const { return len; }
+  bool overflowed() const { return overflow; }
+
+private:
+  void put(char c) {
+    if (len + 1 < cap) {
+      buf[len++] = c;
+    } else {
+      overflow = true;
+    }
+  }
+
+  void terminate() {
+    if (cap > 0) {
+      buf[len] = '\0';
+    }
+  }
+
+  char* buf;
+  size_t cap;
+  size_t len;
+  bool overflow;
+};
+
+// Print into a caller-owned buffer with PayloadWriter's truncate-and-flag
+// overflow, for output written through a Print (history bodies) that is
+// needed as one string.
+class BufferPrint : public Print {
+public:
+  BufferPrint(char* buffer, size_t capacity) : writer(buffer, capacity) {}
+
+  size_t write(uint8_t c) override {
+    writer.append(static_cast<char>(c));
+    return 1;
+  }
+  using Print::write;
+
+  size_t length() const { return writer.length(); }
+  bool overflowed() const { return writer.overflowed(); }
+
+private:
+  PayloadWriter writer;
+};
+
+// MessagePack counterpart of PayloadWriter: same caller-owned buffer, same
+// truncate-and-flag overflow. Containers take their element count up front.
+class MsgPackWriter {
+public:
+  MsgPackWriter(uint8_t* buffer, size_t capacity) : buf(buffer), cap(capacity), len(0), overflow(false) {}
+
+  MsgPackWriter& mapHeader(uint8_t entries) { return containerHeader(0x80, 0xde, entries); }
+  MsgPackWriter& arrayHeader(uint16_t entries) { return containerHeader(0x90, 0xdc, entries); }
+
+  MsgPackWriter& str(const char* text) {
+    size_t n = strlen(text);
+    n = n < 255 ? n : 255;  // str8 at most
+    if (n < 32) {
+      put(static_cast<uint8_t>(0xa0 | n));
+    } else {
+      put(0xd9);
+      put(static_cast<uint8_t>(n));
+    }
+    for (size_t i = 0; i < n; ++i) {
+      put(static_cast<uint8_t>(text[i]));
+    }
+    return *this;
+  }
+
+  MsgPackWriter& uint(uint32_t value) {
+    if (value < 128) {
+      put(static_cast<uint8_t>(value));
+    } else if (value <= 0xff) {
+      put(0xcc);
+      put(static_cast<uint8_t>(value));
+    } else if (value <= 0xffff) {
+      put(0xcd);
+      putBigEndian(value, 2);
+    } else {
+      put(0xce);
+      putBigEndian(value, 4);
+    }
+    return *this;
+  }
+
+  // float32, rounded to `decimals` places first so a decoder sees the value
+  // the JSON payload would carry. NaN/inf become nil.
+  MsgPackWriter& fixed(float value, uint8_t decimals) {
+    if (isnan(value) || isinf(value)) {
+      return nil();
+    }
+    float scale = 1.0f;
+    for (uint8_t i = 0; i < decimals; ++i) {
+      scale *= 10.0f;
+    }
+    float rounded = roundf(value * scale) / scale;
+    uint32_t bits;
+    memcpy(&bits, &rounded, sizeof(bits));
+    put(0xca);
+    putBigEndian(bits, 4);
+    return *this;
+  }
+
+  MsgPackWriter& boolean(bool value) { return put(value ? 0xc3 : 0xc2); }
+  MsgPackWriter& nil() { return put(0xc0); }
+
+  const uint8_t* data() const { return buf; }
+  size_t length() const { return len; }
+  bool overflowed() const { return overflow; }
+
+private:
+  MsgPackWriter& containerHeader(uint8_t fixType, uint8_t wideType, uint16_t entries) {
+    if (entries < 16) {
+      return put(static_cast<uint8_t>(fixType | entries));
+    }
+    put(wideType);
+    putBigEndian(entries, 2);
+    return *this;
+  }
+
+  MsgPackWriter& put(uint8_t byte) {
+    if (len < cap) {
+      buf[len++] = byte;
+    } else {
+      overflow = true;
+    }
+    return *this;
+  }
+
+  void putBigEndian(uint32_t value, uint8_t bytes) {
+    while (bytes > 0) {
+      put(static_cast<uint8_t>(value >> (8 * --bytes)));
+    }
+  }
+
+  uint8_t* buf;
+  size_t cap;
+  size_t len;
+  bool overflow;
+};
+
+// One rendered sensor sample, shared by the SSE, MQTT and Serial sinks:
+// {"temperature": 25.00, "humidity": 60.00, "isDebug": true, "status": "READY" }
+// render() returns nullptr, and length() 0, when the payload does not fit
+// its buffer; a cut-off payload is never sent. The same goes for the
+// payload classes below.
+class SensorPayload {
+public:
+  struct Fields {
+    float temperature;
+    float humidity;
+    bool includeHumidity;
+    bool isDebug;
+    const char* status;  // omitted when null
+  };
+
+  const char* render(const Fields& fields) {
+    PayloadWriter out(json, sizeof(json));
+    out.append("{\"temperature\": ").appendFixed(fields.temperature, 2);
+    if (fields.includeHumidity) {
+      out.append(", \"humidity\": ").appendFixed(fields.humidity, 2);
+    }
+    if (fields.isDebug) {
+      out.append(", \"isDebug\": true");
+    }
+    if (fields.status) {
+      out.append(", \"status\": \"").append(fields.status).append('"');
+    }
+    out.append(" }");
+    return finish(out);
+  }
+
+  const char* c_str() const { return json; }
+  size_t length() const { return length_; }
+
+private:
+  const char* finish(const PayloadWriter& out) {
+    length_ = out.overflowed() ? 0 : out.length();
+    return out.overflowed() ? nullptr : json;
+  }
+
+  char json[112] = "{}";
+  size_t length_ = 2;
+};
+
+// {"alert": "temperature_high", "temperature": 39.10, "threshold": 30.0}
+class AlertPayload {
+public:
+  const char* render(const char* alert, float temperature, float threshold) {
+    PayloadWriter out(json, sizeof(json));
+    out.append("{\"alert\": \"").append(alert).append("\", \"temperature\": ").appendFixed(temperature, 2);
+    out.append(", \"threshold\": ").appendFixed(threshold, 1).append('}');
+    return finish(out);
+  }
+
+  const char* c_str() const { return json; }
+  size_t length() const { return length_; }
+
+private:
+  const char* finish(const PayloadWriter& out) {
+    length_ = out.overflowed() ? 0 : out.length();
+    return out.overflowed() ? nullptr : json;
+  }
+
+  char json[96] = "{}";
+  size_t length_ = 2;
+};
+
+// SensorPayload's fields as a MessagePack map with the same keys, for the
+// mqtt/sensor/msgpack topic and Accept: application/msgpack on /readings.
+class SensorMsgPack {
+public:
+  const uint8_t* render(const SensorPayload::Fields& fields) {
+    MsgPackWriter out(packed, sizeof(packed));
+    out.mapHeader(1 + (fields.includeHumidity ? 1 : 0) + (fields.isDebug ? 1 : 0) + (fields.status ? 1 : 0));
+    out.str("temperature").fixed(fields.temperature, 2);
+    if (fields.includeHumidity) {
+      out.str("humidity").fixed(fields.humidity, 2);
+    }
+    if (fields.isDebug) {
+      out.str("isDebug").boolean(true);
+    }
+    if (fields.status) {
+      out.str("status").str(fields.status);
+    }
+    return finish(out);
+  }
+
+  const uint8_t* data() const { return packed; }
+  size_t length() const { return length_; }
+
+private:
+  const uint8_t* finish(const MsgPackWriter& out) {
+    length_ = out.overflowed() ? 0 : out.length();
+    return out.overflowed() ? nullptr : packed;
+  }
+
+  uint8_t packed[80] = {0x80};
+  size_t length_ = 1;
+};
+
+// AlertPayload as MessagePack, for mqtt/alerts/msgpack.
+class AlertMsgPack {
+public:
+  const uint8_t* render(const char* alert, float temperature, float threshold) {
+    MsgPackWriter out(packed, sizeof(packed));
+    out.mapHeader(3);
+    out.str("alert").str(alert);
+    out.str("temperature").fixed(temperature, 2);
+    out.str("threshold").fixed(threshold, 1);
+    return finish(out);
+  }
+
+  const uint8_t* data() const { return packed; }
+  size_t length() const { return length_; }
+
+private:
+  const uint8_t* finish(const MsgPackWriter& out) {
+    length_ = out.overflowed() ? 0 : out.length();
+    return out.overflowed() ? nullptr : packed;
+  }
+
+  uint8_t packed[64] = {0x80};
+  size_t length_ = 1;
+};
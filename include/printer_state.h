@@ -0,0 +1,131 @@
+#pragma once
+#include <Arduino.h>
+#include <math.h>
+#include "printer_status.h"
+
+struct PrinterThresholds {
+  float ready;             // READY at or above this
+  float high;              // TOO HOT at or above this
+  float hysteresis;        // falling edges trigger this far below the threshold
+  uint32_t minDwellMs;     // a new status must hold this long before it is committed
+};
+
+struct PrinterStatusEvent {
+  PrinterStatus from;
+  PrinterStatus to;
+  bool initial;            // first classification after boot
+  const char* alert;       // MQTT alert name
+  float temperature;
+  float threshold;         // threshold of the status entered, as in the alert payload
+};
+
+namespace PrinterTransitions {
+
+enum Edge : uint8_t { RISING, FALLING };
+enum Level : uint8_t { READY_LEVEL, HIGH_LEVEL };
+
+struct Transition {
+  PrinterStatus from;
+  PrinterStatus to;
+  Edge edge;
+  Level level;
+};
+
+// Rows for the same from-state are checked in order, furthest jump first.
+const Transition TABLE[] = {
+    {NOT_READY, TOO_HOT, RISING, HIGH_LEVEL},
+    {NOT_READY, READY, RISING, READY_LEVEL},
+    {READY, TOO_HOT, RISING, HIGH_LEVEL},
+    {READY, NOT_READY, FALLING, READY_LEVEL},
+    {TOO_HOT, NOT_READY, FALLING, READY_LEVEL},
+    {TOO_HOT, READY, FALLING, HIGH_LEVEL},
+};
+
+}  // namespace PrinterTransitions
+
+// PrinterStatus transitions as a table instead of three overlapping flags.
+// Rising edges fire at the configured thresholds, falling edges only once the
+// temperature is hysteresis below them, and a candidate transition must hold
+// for minDwellMs of samples before it is committed, so a reading sitting on a
+// threshold produces one event rather than a burst of alerts and emails.
+class PrinterStateMachine {
+public:
+  // Feeds one sample. Returns true and fills event when the status changes;
+  // the first sample after boot always does, like the old flag logic.
+  bool update(float temperature, uint32_t nowMs, const PrinterThresholds& thresholds, PrinterStatusEvent& event) {
+    if (isnan(temperature)) {
+      return false;
+    }
+    if (!classified) {
+      PrinterStatus initial = classify(temperature, thresholds);
+      classified = true;
+      return commit(initial, true, temperature, thresholds, event);
+    }
+
+    PrinterStatus target = current;
+    for (const Transition& row : PrinterTransitions::TABLE) {
+      if (row.from == current && crossed(row, temperature, thresholds)) {
+        target = row.to;
+        break;
+      }
+    }
+    if (target == current) {
+      pending = current;
+      return false;
+    }
+    if (target != pending) {
+      pending = target;
+      pendingSinceMs = nowMs;
+    }
+    if (nowMs - pendingSinceMs < thresholds.minDwellMs) {
+      return false;
+    }
+    return commit(target, false, temperature, thresholds, event);
+  }
+
+  PrinterStatus status() const { return current; }
+  uint32_t transitions() const { return transitionCount; }
+
+private:
+  typedef PrinterTransitions::Transition Transition;
+  typedef PrinterTransitions::Level Level;
+
+  static float level(Level which, const PrinterThresholds& thresholds) {
+    return which == PrinterTransitions::HIGH_LEVEL ? thresholds.high : thresholds.ready;
+  }
+
+  static bool crossed(const Transition& row, float temperature, const PrinterThresholds& thresholds) {
+    float threshold = level(row.level, thresholds);
+    if (row.edge == PrinterTransitions::RISING) {
+      return temperature >= threshold;
+    }
+    return temperature < threshold - thresholds.hysteresis;
+  }
+
+  static PrinterStatus classify(float temperature, const PrinterThresholds& thresholds) {
+    if (temperature >= thresholds.high) return TOO_HOT;
+    if (temperature >= thresholds.ready) return READY;
+    return NOT_READY;
+  }
+
+  bool commit(PrinterStatus to, bool initial, float temperature, const PrinterThresholds& thresholds,
+              PrinterStatusEvent& event) {
+    static const char* const ALERTS[PRINTER_STATUS_COUNT] = {"temperature_low", "ready_to_print", "temperature_high"};
+    event.from = current;
+    event.to = to;
+    event.initial = initial;
+    event.alert = ALERTS[to];
+    event.temperature = temperature;
+    event.threshold = to == TOO_HOT ? thresholds.high : thresholds.ready;
+    current = to;
+    pending = to;
+    ++transitionCount;
+    return true;
+  }
+
+  PrinterStatus current = NOT_READY;
+  PrinterStatus pending = NOT_READY;
+  uint32_t pendingSinceMs = 0;
+  uint32_t transitionCount = 0;
+  bool classified = false;
+};
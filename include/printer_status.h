@@ -0,0 +1,16 @@
+#pragma once
+#include <Arduino.h>
+
+enum PrinterStatus {
+  NOT_READY,
+  READY,
+  TOO_HOT
+};
+
+const uint8_t PRINTER_STATUS_COUNT = 3;
+
+inline const char* printerStatusName(PrinterStatus status) {
+  if (status == READY) return "READY";
+  if (status == TOO_HOT) return "TOO HOT";
+  return "NOT READY";
+}
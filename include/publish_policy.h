@@ -0,0 +1,59 @@
+#pragma once
+#include <Arduino.h>
+#include <math.h>
+#include "printer_status.h"
+#include "sample_snapshot.h"
+
+struct PublishPolicyConfig {
+  float temperatureDeadband;  // C; 0 publishes every change
+  float humidityDeadband;     // %RH
+  uint16_t maxIntervalSeconds;  // heartbeat: publish at least this often; 0 publishes every sample
+};
+
+// Report-by-exception for one sink. A sample is sent when it moves beyond the
+// deadband from the last value *sent* (so a slow drift still gets through),
+// when the status, validity or humidity presence changes, or when the
+// heartbeat interval has passed since the last send. Everything else is
+// suppressed and counted.
+class PublishPolicy {
+public:
+  bool shouldPublish(const SensorSample& sample, PrinterStatus status, uint32_t nowMs,
+                     const PublishPolicyConfig& config) {
+    if (!hasSent || changed(sample, status, config) || config.maxIntervalSeconds == 0 ||
+        nowMs - lastSentMs >= static_cast<uint32_t>(config.maxIntervalSeconds) * 1000UL) {
+      hasSent = true;
+      last = sample;
+      lastStatus = status;
+      lastSentMs = nowMs;
+      ++sentCount;
+      return true;
+    }
+    ++suppressedCount;
+    return false;
+  }
+
+  // Forgets the last value sent, so the next sample goes out whatever it is.
+  void reset() { hasSent = false; }
+
+  uint32_t sent() const { return sentCount; }
+  uint32_t suppressed() const { return suppressedCount; }
+
+private:
+  bool changed(const SensorSample& sample, PrinterStatus status, const PublishPolicyConfig& config) const {
+    if (status != lastStatus || sample.valid != last.valid || sample.hasHumidity != last.hasHumidity ||
+        sample.isDebug != last.isDebug) {
+      return true;
+    }
+    if (fabsf(sample.temperature - last.temperature) > config.temperatureDeadband) {
+      return true;
+    }
+    return sample.hasHumidity && fabsf(sample.humidity - last.humidity) > config.humidityDeadband;
+  }
+
+  SensorSample last = {};
+  PrinterStatus lastStatus = NOT_READY;
+  uint32_t lastSentMs = 0;
+  uint32_t sentCount = 0;
+  uint32_t suppressedCount = 0;
+  bool hasSent = false;
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include "payload_serializer.h"
+
+// One sensor sample as seen by every consumer (publisher, /readings, email,
+// LCD). sequence counts samples since boot so readers can spot new ones.
+struct SensorSample {
+  float temperature;
+  float humidity;
+  uint32_t timestampMs;
+  uint32_t sequence;
+  bool hasHumidity;
+  bool isDebug;
+  bool valid;
+};
+
+inline SensorPayload::Fields payloadFields(const SensorSample& sample, const char* status = nullptr) {
+  return {sample.temperature, sample.humidity, sample.hasHumidity, sample.isDebug, status};
+}
+
+// Single-writer seqlock. The sampling task is the only writer and never waits;
+// readers on any task or core retry instead of taking a lock. A reader that
+// finds a write in progress sleeps for a tick before retrying: it may have
+// preempted the writer on its core (AsyncTCP runs above the sampling task),
+// and spinning would then keep the write from ever finishing.
+class SampleSnapshot {
+public:
+  void publish(const SensorSample& sample) {
+    uint32_t seq = version.load(std::memory_order_relaxed);
+    version.store(seq + 1, std::memory_order_relaxed);  // odd: write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+
+    temperature.store(sample.temperature, std::memory_order_relaxed);
+    humidity.store(sample.humidity, std::memory_order_relaxed);
+    timestampMs.store(sample.timestampMs, std::memory_order_relaxed);
+    flags.store(packFlags(sample), std::memory_order_relaxed);
+
+    version.store(seq + 2, std::memory_order_release);
+  }
+
+  // Returns false until the first sample has been published.
+  bool read(SensorSample& out) const {
+    for (;;) {
+      uint32_t before = version.load(std::memory_order_acquire);
+      if (before & 1U) {
+        vTaskDelay(1);
+        continue;
+      }
+
+      out.temperature = temperature.load(std::memory_order_relaxed);
+      out.humidity = humidity.load(std::memory_order_relaxed);
+      out.timestampMs = timestampMs.load(std::memory_order_relaxed);
+      uint8_t packed = flags.load(std::memory_order_relaxed);
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (version.load(std::memory_order_relaxed) == before) {
+        out.sequence = before / 2;
+        out.hasHumidity = packed & kHasHumidity;
+        out.isDebug = packed & kIsDebug;
+        out.valid = packed & kValid;
+        return before != 0;
+      }
+    }
+  }
+
+  uint32_t sequence() const {
+    return version.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+  static constexpr uint8_t kHasHumidity = 0x01;
+  static constexpr uint8_t kIsDebug = 0x02;
+  static constexpr uint8_t kValid = 0x04;
+
+  static uint8_t packFlags(const SensorSample& sample) {
+    return (sample.hasHumidity ? kHasHumidity : 0) | (sample.isDebug ? kIsDebug : 0) | (sample.valid ? kValid : 0);
+  }
+
+  std::atomic<uint32_t> version{0};
+  std::atomic<float> temperature{0.0f};
+  std::atomic<float> humidity{0.0f};
+  std::atomic<uint32_t> timestampMs{0};
+  std::atomic<uint8_t> flags{0};
+};
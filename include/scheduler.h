@@ -0,0 +1,209 @@
+#pragma once
+#include <Arduino.h>
+#include "payload_serializer.h"
+
+#define SCHEDULER_MAX_JOBS 8
+
+// Deadline scheduler for the jobs loop() runs. Jobs sit in a binary min-heap
+// keyed on their next deadline; loop() sleeps until the earliest one (or
+// until another task wakes it) instead of polling every 50 ms.
+//
+// Periodic jobs are drift-free: the next deadline is the previous deadline
+// plus the period, not "now" plus the period, so a slow iteration delays one
+// run without shifting the ones after it. A job that falls a whole period or
+// more behind skips the missed runs instead of bursting. Jobs with period 0
+// only run when trigger()ed, e.g. by a notification from another task.
+//
+// Lateness (actual start - deadline) is kept per job for /metrics.
+class Scheduler {
+public:
+  typedef void (*JobFunction)();
+
+  struct JobStats {
+    const char* name;
+    uint32_t periodMs;
+    uint32_t runs;
+    uint32_t skipped;
+    uint32_t lastLatenessMs;
+    uint32_t maxLatenessMs;
+    uint32_t totalLatenessMs;
+  };
+
+  // Returns the job id, or -1 when the table is full. Periodic jobs first run
+  // firstDelayMs from now.
+  int add(const char* name, uint32_t periodMs, JobFunction fn, uint32_t firstDelayMs = 0) {
+    if (jobCount == SCHEDULER_MAX_JOBS) {
+      return -1;
+    }
+    int id = jobCount++;
+    Job& job = jobs[id];
+    job.fn = fn;
+    job.stats = {name, periodMs, 0, 0, 0, 0, 0};
+    job.queued = false;
+    if (periodMs > 0) {
+      push(id, millis() + firstDelayMs);
+    }
+    return id;
+  }
+
+  // Re-keys a queued periodic job so its next deadline is the last one plus
+  // the new period; a shorter period can therefore make it due at once.
+  void setPeriod(int id, uint32_t periodMs) {
+    if (id < 0 || id >= jobCount || jobs[id].stats.periodMs == periodMs) {
+      return;
+    }
+    Job& job = jobs[id];
+    uint32_t oldPeriod = job.stats.periodMs;
+    job.stats.periodMs = periodMs;
+    if (job.queued && oldPeriod > 0 && periodMs > 0) {
+      job.deadline = job.deadline - oldPeriod + periodMs;
+      siftUp(job.heapIndex);
+      siftDown(job.heapIndex);
+    }
+  }
+
+  // Makes a job due at dueMs (normally "now" or when its input arrived, so
+  // lateness measures the wake-up delay). A job already queued keeps the
+  // earlier of the two deadlines.
+  void trigger(int id, uint32_t dueMs) {
+    if (id < 0 || id >= jobCount) {
+      return;
+    }
+    if (!jobs[id].queued) {
+      push(id, dueMs);
+    } else if (before(dueMs, jobs[id].deadline)) {
+      jobs[id].deadline = dueMs;
+      siftUp(jobs[id].heapIndex);
+    }
+  }
+
+  // Milliseconds until the earliest deadline (0 if one is already due), or
+  // UINT32_MAX when nothing is queued.
+  uint32_t msUntilNext(uint32_t now) const {
+    if (heapSize == 0) {
+      return UINT32_MAX;
+    }
+    uint32_t deadline = jobs[heap[0]].deadline;
+    return before(now, deadline) ? deadline - now : 0;
+  }
+
+  // Runs every job whose deadline has passed, earliest first.
+  void runDue() {
+    for (;;) {
+      uint32_t now = millis();
+      if (heapSize == 0 || before(now, jobs[heap[0]].deadline)) {
+        return;
+      }
+      int id = pop();
+      Job& job = jobs[id];
+      uint32_t lateness = now - job.deadline;
+      job.stats.runs++;
+      job.stats.lastLatenessMs = lateness;
+      job.stats.totalLatenessMs += lateness;
+      if (lateness > job.stats.maxLatenessMs) {
+        job.stats.maxLatenessMs = lateness;
+      }
+
+      job.fn();
+
+      uint32_t period = job.stats.periodMs;
+      if (period > 0) {
+        uint32_t missed = lateness / period;
+        job.stats.skipped += missed;
+        push(id, job.deadline + (missed + 1) * period);
+      }
+    }
+  }
+
+  int size() const { return jobCount; }
+  const JobStats& stats(int id) const { return jobs[id].stats; }
+
+  // /metrics "jobs" array.
+  void writeJson(Print& out) const {
+    char line[192];
+    out.print("[");
+    for (int id = 0; id < jobCount; ++id) {
+      const JobStats& s = jobs[id].stats;
+      PayloadWriter job(line, sizeof(line));
+      job.append(id == 0 ? "{\"name\":\"" : ",{\"name\":\"").append(s.name).append("\",\"period_ms\":");
+      job.appendUnsigned(s.periodMs).append(",\"runs\":").appendUnsigned(s.runs);
+      job.append(",\"skipped\":").appendUnsigned(s.skipped);
+      job.append(",\"lateness_ms\":{\"last\":").appendUnsigned(s.lastLatenessMs);
+      job.append(",\"avg\":").appendFixed(s.runs ? static_cast<float>(s.totalLatenessMs) / s.runs : 0.0f, 2);
+      job.append(",\"max\":").appendUnsigned(s.maxLatenessMs).append("}}");
+      out.print(line);
+    }
+    out.print("]");
+  }
+
+private:
+  struct Job {
+    JobFunction fn;
+    JobStats stats;
+    uint32_t deadline;
+    uint8_t heapIndex;
+    bool queued;
+  };
+
+  // Wrap-safe: millis() rolls over every ~49.7 days.
+  static bool before(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) < 0; }
+
+  bool less(uint8_t a, uint8_t b) const { return before(jobs[heap[a]].deadline, jobs[heap[b]].deadline); }
+
+  void place(uint8_t index, uint8_t id) {
+    heap[index] = id;
+    jobs[id].heapIndex = index;
+  }
+
+  void push(int id, uint32_t deadline) {
+    jobs[id].deadline = deadline;
+    jobs[id].queued = true;
+    place(heapSize, static_cast<uint8_t>(id));
+    siftUp(heapSize++);
+  }
+
+  int pop() {
+    uint8_t id = heap[0];
+    jobs[id].queued = false;
+    place(0, heap[--heapSize]);
+    siftDown(0);
+    return id;
+  }
+
+  void siftUp(uint8_t index) {
+    while (index > 0) {
+      uint8_t parent = (index - 1) / 2;
+      if (!less(index, parent)) {
+        break;
+      }
+      swap(index, parent);
+      index = parent;
+    }
+  }
+
+  void siftDown(uint8_t index) {
+    for (;;) {
+      uint8_t smallest = index;
+      uint8_t left = 2 * index + 1;
+      uint8_t right = left + 1;
+      if (left < heapSize && less(left, smallest)) smallest = left;
+      if (right < heapSize && less(right, smallest)) smallest = right;
+      if (smallest == index) {
+        return;
+      }
+      swap(index, smallest);
+      index = smallest;
+    }
+  }
+
+  void swap(uint8_t a, uint8_t b) {
+    uint8_t idA = heap[a];
+    place(a, heap[b]);
+    place(b, idA);
+  }
+
+  Job jobs[SCHEDULER_MAX_JOBS];
+  uint8_t heap[SCHEDULER_MAX_JOBS];
+  uint8_t heapSize = 0;
+  int jobCount = 0;
+};
@@ -56,54 +56,29 @@ public:
     return true;
   }
 
-  String getJSONData() {
-    float t, h;
-    static int debug_count = 0;
-    if (read(t,h)) {
-      String payload = String(F("{\"temperature\": ")) + String(t,2);
-      if (sensorType == USE_BME280) {
-        payload += String(F(", \"humidity\": ")) + String(h,2);
-      } 
-      else if(sensorType == USE_DEBUG) {
-        debug_count++;
-        // Send humidity every 5th reading for debug sensor
-        if (debug_count <= 10) {
-          payload += String(F(", \"humidity\": ")) + String(h,2);
-        } 
-        else if(debug_count > 20) {
-          debug_count = 0;
-        }
-        payload += String(F(", \"isDebug\": true"));
-      }
-      payload += F(" }");
-      return payload;
-    }
-    return String(F("{\"error\": \"Sensor read failed\"}"));
-  }
-  String getJSONData(float& temperature, float& humidity) {
-    float t, h;
-    static int debug_count = 0;
-    String payload = String(F("{\"temperature\": ")) + String(temperature,2);
+  // Whether this sample should carry humidity. The debug sensor reports it
+  // for ten samples, then omits it for ten, to exercise the dashboard.
+  bool reportsHumidity() {
     if (sensorType == USE_BME280) {
-      payload += String(F(", \"humidity\": ")) + String(humidity,2);
-    } 
-    else if(sensorType == USE_DEBUG) {
-      debug_count++;
-      // Send humidity every 5th reading for debug sensor
-      if (debug_count <= 10) {
-        payload += String(F(", \"humidity\": ")) + String(humidity ,2);
-      } 
-      else if(debug_count > 20) {
-        debug_count = 0;
-      }
-      payload += String(F(", \"isDebug\": true"));
+      return true;
+    }
+    if (sensorType != USE_DEBUG) {
+      return false;
+    }
+    debug_count++;
+    if (debug_count <= 10) {
+      return true;
     }
-    payload += F(" }");
-    return payload;
+    if (debug_count > 20) {
+      debug_count = 0;
+    }
+    return false;
   }
+
 private:
   Adafruit_BMP085 bmp;
   Adafruit_BME280 bme;
   float debug_temp = 8.0;
   float debug_hum = 50.0;
+  int debug_count = 0;
 };
@@ -3,9 +3,17 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <SPIFFS.h>
+#include "log_level.h"
+#include "publish_policy.h"
 
 #define DEFAULT_READY_THRESHOLD 20.0f
 #define DEFAULT_HIGH_THRESHOLD 30.0f
+#define DEFAULT_THRESHOLD_HYSTERESIS 0.5f
+#define DEFAULT_MIN_DWELL_SECONDS 10
+#define DEFAULT_TEMPERATURE_DEADBAND 0.1f
+#define DEFAULT_HUMIDITY_DEADBAND 0.5f
+#define DEFAULT_PUBLISH_MAX_INTERVAL_SECONDS 60
+#define DEFAULT_LOG_LEVEL LOG_INFO  // samples are logged at LOG_DEBUG
 #define DEFAULT_CAMERA_URL "http://192.168.0.18:8080/?action=stream"
 #define DEFAULT_EMAIL_ENABLED false
 #define DEFAULT_EMAIL_INTERVAL_MINUTES 15
@@ -21,15 +29,24 @@
 class Settings {
 public:
     bool save() const {
-        File file = SPIFFS.open(filePath, "w");
+        File file = filesystem->open(filePath, "w");
         if (!file) {
             Serial.println("Failed to open settings file for writing");
             return false;
         }
 
-        StaticJsonDocument<768> doc;
+        StaticJsonDocument<1536> doc;
         doc["ready_to_print_threshold"] = readyToPrintThreshold;
         doc["temperature_high_threshold"] = highTemperatureThreshold;
+        doc["threshold_hysteresis"] = thresholdHysteresis;
+        doc["min_dwell_seconds"] = minDwellSeconds;
+        doc["mqtt_temperature_deadband"] = mqttPublishPolicy.temperatureDeadband;
+        doc["mqtt_humidity_deadband"] = mqttPublishPolicy.humidityDeadband;
+        doc["mqtt_max_interval_seconds"] = mqttPublishPolicy.maxIntervalSeconds;
+        doc["sse_temperature_deadband"] = ssePublishPolicy.temperatureDeadband;
+        doc["sse_humidity_deadband"] = ssePublishPolicy.humidityDeadband;
+        doc["sse_max_interval_seconds"] = ssePublishPolicy.maxIntervalSeconds;
+        doc["log_level"] = logLevel;
         doc["camera_url"] = cameraUrl;
         doc["email_enabled"] = emailEnabled;
         doc["email_interval_minutes"] = emailIntervalMinutes;
@@ -53,17 +70,17 @@ public:
     }
 
     bool load() {
-        if (!SPIFFS.exists(filePath)) {
+        if (!filesystem->exists(filePath)) {
             return save();
         }
 
-        File file = SPIFFS.open(filePath, "r");
+        File file = filesystem->open(filePath, "r");
         if (!file) {
             Serial.println("Failed to open settings file for reading");
             return false;
         }
 
-        StaticJsonDocument<768> doc;
+        StaticJsonDocument<1536> doc;
         DeserializationError error = deserializeJson(doc, file);
         file.close();
 
@@ -76,6 +93,15 @@ public:
 
         readyToPrintThreshold = doc["ready_to_print_threshold"] | DEFAULT_READY_THRESHOLD;
         highTemperatureThreshold = doc["temperature_high_threshold"] | DEFAULT_HIGH_THRESHOLD;
+        thresholdHysteresis = doc["threshold_hysteresis"] | DEFAULT_THRESHOLD_HYSTERESIS;
+        minDwellSeconds = doc["min_dwell_seconds"] | DEFAULT_MIN_DWELL_SECONDS;
+        mqttPublishPolicy.temperatureDeadband = doc["mqtt_temperature_deadband"] | DEFAULT_TEMPERATURE_DEADBAND;
+        mqttPublishPolicy.humidityDeadband = doc["mqtt_humidity_deadband"] | DEFAULT_HUMIDITY_DEADBAND;
+        mqttPublishPolicy.maxIntervalSeconds = doc["mqtt_max_interval_seconds"] | DEFAULT_PUBLISH_MAX_INTERVAL_SECONDS;
+        ssePublishPolicy.temperatureDeadband = doc["sse_temperature_deadband"] | DEFAULT_TEMPERATURE_DEADBAND;
+        ssePublishPolicy.humidityDeadband = doc["sse_humidity_deadband"] | DEFAULT_HUMIDITY_DEADBAND;
+        ssePublishPolicy.maxIntervalSeconds = doc["sse_max_interval_seconds"] | DEFAULT_PUBLISH_MAX_INTERVAL_SECONDS;
+        setLogLevel(doc["log_level"] | static_cast<uint8_t>(DEFAULT_LOG_LEVEL));
         cameraUrl = doc["camera_url"] | DEFAULT_CAMERA_URL;
         emailEnabled = doc["email_enabled"] | DEFAULT_EMAIL_ENABLED;
         emailIntervalMinutes = doc["email_interval_minutes"] | DEFAULT_EMAIL_INTERVAL_MINUTES;
@@ -90,15 +116,20 @@ public:
         return true;
     }  
 
-    bool begin() {
-        if (!SPIFFS.begin(true)) {
-            Serial.println("SPIFFS Mount Failed");
-            return false;
-        }
+    // fs must already be mounted (UserData::begin()).
+    bool begin(fs::FS& fs = SPIFFS) {
+        filesystem = &fs;
         return load();
     }
+    fs::FS& storage() const { return *filesystem; }
     float getReadyToPrintThreshold() const { return readyToPrintThreshold; }
     float getHighTemperatureThreshold() const { return highTemperatureThreshold; }
+    float getThresholdHysteresis() const { return thresholdHysteresis; }
+    uint16_t getMinDwellSeconds() const { return minDwellSeconds; }
+    uint32_t getMinDwellMs() const { return static_cast<uint32_t>(minDwellSeconds) * 1000UL; }
+    const PublishPolicyConfig& getMqttPublishPolicy() const { return mqttPublishPolicy; }
+    const PublishPolicyConfig& getSsePublishPolicy() const { return ssePublishPolicy; }
+    uint8_t getLogLevel() const { return logLevel; }
     const char* getCameraUrl() const { return cameraUrl.c_str(); }
     bool isEmailEnabled() const { return emailEnabled; }
     uint16_t getEmailIntervalMinutes() const { return emailIntervalMinutes; }
@@ -119,9 +150,18 @@ public:
     const char* getEmailRecipient() const { return emailRecipient.c_str(); }
 
     String toJson() const {
-        StaticJsonDocument<768> doc;
+        StaticJsonDocument<1536> doc;
         doc["ready_to_print_threshold"] = readyToPrintThreshold;
         doc["temperature_high_threshold"] = highTemperatureThreshold;
+        doc["threshold_hysteresis"] = thresholdHysteresis;
+        doc["min_dwell_seconds"] = minDwellSeconds;
+        doc["mqtt_temperature_deadband"] = mqttPublishPolicy.temperatureDeadband;
+        doc["mqtt_humidity_deadband"] = mqttPublishPolicy.humidityDeadband;
+        doc["mqtt_max_interval_seconds"] = mqttPublishPolicy.maxIntervalSeconds;
+        doc["sse_temperature_deadband"] = ssePublishPolicy.temperatureDeadband;
+        doc["sse_humidity_deadband"] = ssePublishPolicy.humidityDeadband;
+        doc["sse_max_interval_seconds"] = ssePublishPolicy.maxIntervalSeconds;
+        doc["log_level"] = logLevel;
         doc["camera_url"] = cameraUrl;
         doc["email_enabled"] = emailEnabled;
         doc["email_interval_minutes"] = emailIntervalMinutes;
@@ -141,6 +181,11 @@ public:
 
     void setReadyToPrintThreshold(float value) { readyToPrintThreshold = value; }
     void setHighTemperatureThreshold(float value) { highTemperatureThreshold = value; }
+    void setThresholdHysteresis(float value) { thresholdHysteresis = value; }
+    void setMinDwellSeconds(uint16_t value) { minDwellSeconds = value; }
+    void setMqttPublishPolicy(const PublishPolicyConfig& value) { mqttPublishPolicy = value; }
+    void setSsePublishPolicy(const PublishPolicyConfig& value) { ssePublishPolicy = value; }
+    void setLogLevel(uint8_t value) { logLevel = value > LOG_DEBUG ? static_cast<uint8_t>(LOG_DEBUG) : value; }
     void setCameraUrl(const String& value) { cameraUrl = value; }
     void setEmailEnabled(bool value) { emailEnabled = value; }
     void setEmailIntervalMinutes(uint16_t value) { emailIntervalMinutes = value; }
@@ -155,6 +200,13 @@ public:
 private:
     float readyToPrintThreshold = DEFAULT_READY_THRESHOLD;
     float highTemperatureThreshold = DEFAULT_HIGH_THRESHOLD;
+    float thresholdHysteresis = DEFAULT_THRESHOLD_HYSTERESIS;
+    uint16_t minDwellSeconds = DEFAULT_MIN_DWELL_SECONDS;
+    PublishPolicyConfig mqttPublishPolicy = {DEFAULT_TEMPERATURE_DEADBAND, DEFAULT_HUMIDITY_DEADBAND,
+                                             DEFAULT_PUBLISH_MAX_INTERVAL_SECONDS};
+    PublishPolicyConfig ssePublishPolicy = {DEFAULT_TEMPERATURE_DEADBAND, DEFAULT_HUMIDITY_DEADBAND,
+                                            DEFAULT_PUBLISH_MAX_INTERVAL_SECONDS};
+    uint8_t logLevel = DEFAULT_LOG_LEVEL;
     String cameraUrl = DEFAULT_CAMERA_URL;
     bool emailEnabled = DEFAULT_EMAIL_ENABLED;
     uint16_t emailIntervalMinutes = DEFAULT_EMAIL_INTERVAL_MINUTES;
@@ -167,4 +219,5 @@ private:
     String emailSenderName = DEFAULT_EMAIL_SENDER_NAME;
     String emailRecipient = DEFAULT_EMAIL_RECIPIENT;
     const char* filePath = "/settings.json";
+    fs::FS* filesystem = &SPIFFS;
 };
\ No newline at end of file
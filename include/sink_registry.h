@@ -0,0 +1,187 @@
+#pragma once
+#include <Arduino.h>
+#include "log_level.h"
+#include "payload_serializer.h"
+#include "publish_policy.h"
+
+#define SINK_REGISTRY_MAX_SINKS 8  // the firmware registers up to 6 per kind
+
+enum PayloadEncoding : uint8_t { PAYLOAD_JSON, PAYLOAD_MSGPACK, PAYLOAD_ENCODING_COUNT };
+
+// A rendered payload; JSON ones are also NUL-terminated.
+struct Payload {
+  const uint8_t* data;
+  size_t length;
+
+  const char* c_str() const { return reinterpret_cast<const char*>(data); }
+};
+
+// The consumers of one kind of payload (sensor samples, alerts). Each sink
+// reports whether anyone is listening (SSE clients, MQTT subscribers, the
+// log level), takes one encoding and may have a PublishPolicy. publish()
+// asks every sink first and renders each encoding only if at least one sink
+// wants it, so an unwatched device never formats JSON or touches the UART and
+// MessagePack is only built while someone is subscribed to it.
+//
+// Rendering and sending are timed in CPU cycles; every publish that renders
+// nothing is counted, and the average cost of the ones that did render gives
+// an estimate of the CPU time saved.
+class SinkRegistry {
+public:
+  typedef bool (*AudienceFunction)();
+  typedef void (*SendFunction)(const Payload& payload);
+  typedef PublishPolicyConfig (*PolicyConfigFunction)();
+
+  struct SinkStats {
+    const char* name;
+    uint32_t sent;
+    uint32_t suppressed;   // had an audience, held back by the policy
+    uint32_t noAudience;   // nobody listening
+  };
+
+  // Returns the sink id, or -1 when the registry is full. A sink without a
+  // policy gets every payload while it has an audience.
+  int add(const char* name, AudienceFunction hasAudience, SendFunction send, PublishPolicy* policy = nullptr,
+          PolicyConfigFunction config = nullptr, PayloadEncoding encoding = PAYLOAD_JSON) {
+    if (sinkCount >= SINK_REGISTRY_MAX_SINKS || !hasAudience || !send || (policy && !config)) {
+      return -1;
+    }
+    Sink& sink = sinks[sinkCount];
+    sink.hasAudience = hasAudience;
+    sink.send = send;
+    sink.policy = policy;
+    sink.config = config;
+    sink.encoding = encoding;
+    sink.listening = false;
+    sink.stats = {name, 0, 0, 0};
+    return sinkCount++;
+  }
+
+  // render(PayloadEncoding) returns the payload in that encoding; it is
+  // called at most once per encoding. A payload with null data, one that
+  // did not fit its buffer, goes to none of that encoding's sinks.
+  //
+  // Sample publish: sinks with an audience run their policy on the sample.
+  template <typename RenderFunction>
+  bool publish(const SensorSample& sample, PrinterStatus status, RenderFunction render) {
+    return dispatch(&sample, status, render);
+  }
+
+  // Event publish (alerts): every sink with an audience gets it.
+  template <typename RenderFunction>
+  bool publish(RenderFunction render) {
+    return dispatch(nullptr, NOT_READY, render);
+  }
+
+  const SinkStats& stats(int id) const { return sinks[id].stats; }
+  int size() const { return sinkCount; }
+  uint32_t published() const { return renderedCount + skippedCount; }
+  uint32_t rendered() const { return renderedCount; }
+  uint32_t skipped() const { return skippedCount; }
+  uint32_t unwatched() const { return unwatchedCount; }  // skipped with no audience anywhere
+
+  uint32_t averageRenderUs() const {
+    return renderedCount ? static_cast<uint32_t>(renderCycles / renderedCount / cpuMHz()) : 0;
+  }
+
+  // Skipped publishes priced at the average rendered one.
+  uint64_t savedUs() const {
+    return renderedCount ? renderCycles * skippedCount / renderedCount / cpuMHz() : 0;
+  }
+
+  // Appends `"<sink>":{...},...,"rendered":n,...` (no surrounding braces) so
+  // the caller can place it inside its own object.
+  void writeJsonFields(Print& out) const {
+    char line[160];
+    for (int id = 0; id < sinkCount; ++id) {
+      const SinkStats& s = sinks[id].stats;
+      PayloadWriter sink(line, sizeof(line));
+      sink.append('"').append(s.name).append("\":{\"sent\":").appendUnsigned(s.sent);
+      sink.append(",\"suppressed\":").appendUnsigned(s.suppressed);
+      sink.append(",\"no_audience\":").appendUnsigned(s.noAudience).append("},");
+      out.print(line);
+    }
+    PayloadWriter totals(line, sizeof(line));
+    totals.append("\"rendered\":").appendUnsigned(renderedCount).append(",\"skipped\":").appendUnsigned(skippedCount);
+    totals.append(",\"unwatched\":").appendUnsigned(unwatchedCount);
+    totals.append(",\"render_us_avg\":").appendUnsigned(averageRenderUs());
+    totals.append(",\"saved_us\":").appendUnsigned(savedUs());
+    out.print(line);
+  }
+
+private:
+  struct Sink {
+    AudienceFunction hasAudience;
+    SendFunction send;
+    PublishPolicy* policy;
+    PolicyConfigFunction config;
+    PayloadEncoding encoding;
+    bool listening;
+    SinkStats stats;
+  };
+
+  static uint32_t cpuMHz() {
+    uint32_t mhz = ESP.getCpuFreqMHz();
+    return mhz ? mhz : 1;
+  }
+
+  template <typename RenderFunction>
+  bool dispatch(const SensorSample* sample, PrinterStatus status, RenderFunction render) {
+    uint32_t wanted = 0;
+    bool anyAudience = false;
+    for (int id = 0; id < sinkCount; ++id) {
+      Sink& sink = sinks[id];
+      bool listening = sink.hasAudience();
+      if (!listening) {
+        sink.listening = false;
+        sink.stats.noAudience++;
+        continue;
+      }
+      if (!sink.listening && sink.policy) {
+        // A new audience gets the current value, not the next change
+        sink.policy->reset();
+      }
+      sink.listening = true;
+      anyAudience = true;
+      if (sample && sink.policy && !sink.policy->shouldPublish(*sample, status, sample->timestampMs, sink.config())) {
+        sink.stats.suppressed++;
+        continue;
+      }
+      wanted |= 1UL << id;
+    }
+    if (wanted == 0) {
+      skippedCount++;
+      unwatchedCount += anyAudience ? 0 : 1;
+      return false;
+    }
+
+    uint32_t start = ESP.getCycleCount();
+    for (uint8_t encoding = 0; encoding < PAYLOAD_ENCODING_COUNT; ++encoding) {
+      Payload payload = {nullptr, 0};
+      bool rendered = false;
+      for (int id = 0; id < sinkCount; ++id) {
+        if ((wanted & (1UL << id)) && sinks[id].encoding == encoding) {
+          if (!rendered) {
+            payload = render(static_cast<PayloadEncoding>(encoding));
+            rendered = true;
+          }
+          if (!payload.data) {
+            continue;  // did not fit its buffer
+          }
+          sinks[id].send(payload);
+          sinks[id].stats.sent++;
+        }
+      }
+    }
+    renderCycles += ESP.getCycleCount() - start;
+    renderedCount++;
+    return true;
+  }
+
+  Sink sinks[SINK_REGISTRY_MAX_SINKS] = {};
+  int sinkCount = 0;
+  uint32_t renderedCount = 0;
+  uint32_t skippedCount = 0;
+  uint32_t unwatchedCount = 0;
+  uint64_t renderCycles = 0;
+};
@@ -0,0 +1,314 @@
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <memory>
+#include <new>
+#include "payload_serializer.h"
+
+#define SSE_MAX_CLIENTS 8
+#define SSE_CLIENT_MAX_QUEUED_BYTES 4096  // an alert past this closes the client
+#define SSE_TRACKED_MESSAGES 16           // sizes/times of the newest sends per client
+#define SSE_MAX_SAMPLE_LENGTH 112         // SensorPayload's buffer
+
+// Sends SSE events to each dashboard separately instead of broadcasting, so
+// one stalled connection cannot make AsyncEventSource queue every event for
+// it until the heap runs out.
+//
+// A client whose previous events are still waiting in its TCP queue is slow:
+// sensor_data for it is held back, and each newer sample replaces the held
+// one (counted as coalesced), which service() sends once the queue has
+// drained. service() only needs to run while some client holds a sample.
+// Alerts are never held or dropped; a client so far behind that an alert
+// would take its queue past SSE_CLIENT_MAX_QUEUED_BYTES is closed instead,
+// and the snapshot it gets on reconnecting brings it up to date.
+//
+// Queued bytes and lag come from the sizes and times of the newest sends,
+// matched against AsyncEventSourceClient::packetsWaiting(). Clients are
+// closed outside the lock: the library reports the disconnect from its own
+// task.
+class SseFanout {
+public:
+  // Renders the first event of a new connection into out; returns its
+  // length, 0 to send nothing.
+  typedef size_t (*GreetingFunction)(char* out, size_t size);
+
+  bool begin(AsyncEventSource& source, const char* greetingEvent, size_t greetingMaxLength, GreetingFunction greeting) {
+    lock = xSemaphoreCreateMutex();
+    if (!lock) {
+      return false;
+    }
+    greetEvent = greetingEvent;
+    greetMax = greetingMaxLength;
+    greet = greeting;
+    source.onConnect([this](AsyncEventSourceClient* client) { onConnect(client); });
+    source.onDisconnect([this](AsyncEventSourceClient* client) { onDisconnect(client); });
+    return true;
+  }
+
+  size_t count() const { return clientCount; }
+
+  // Whether service() has anything to send.
+  bool holdsSamples() {
+    if (!lock) {
+      return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool any = false;
+    for (const Client& c : clients) {
+      any = any || (c.client && !c.closing && c.hasPending);
+    }
+    xSemaphoreGive(lock);
+    return any;
+  }
+
+  void sendSample(const char* json) {
+    if (!lock) {
+      return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t now = millis();
+    for (Client& c : clients) {
+      if (!c.client || c.closing) {
+        continue;
+      }
+      trackLag(c, now);
+      if (c.client->packetsWaiting() > 0) {
+        if (c.hasPending) {
+          c.coalesced++;
+          coalescedTotal++;
+        }
+        snprintf(c.pending, sizeof(c.pending), "%s", json);
+        c.hasPending = true;
+        continue;
+      }
+      // The held sample is older than this one
+      if (c.hasPending) {
+        c.hasPending = false;
+        c.coalesced++;
+        coalescedTotal++;
+      }
+      send(c, json, "sensor_data", now);
+    }
+    xSemaphoreGive(lock);
+  }
+
+  void sendAlert(const char* json) {
+    sendEvent(json, "alert");
+  }
+
+  // Any other event that must not be dropped, like an alert.
+  void sendEvent(const char* json, const char* event) {
+    if (!lock) {
+      return;
+    }
+    AsyncEventSourceClient* overdue[SSE_MAX_CLIENTS];
+    size_t overdueCount = 0;
+    size_t length = strlen(json);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t now = millis();
+    for (Client& c : clients) {
+      if (!c.client || c.closing) {
+        continue;
+      }
+      if (queuedBytes(c) + length > SSE_CLIENT_MAX_QUEUED_BYTES) {
+        c.closing = true;
+        overdue[overdueCount++] = c.client;
+        continue;
+      }
+      send(c, json, event, now);
+    }
+    closedTotal += overdueCount;
+    xSemaphoreGive(lock);
+    closeAll(overdue, overdueCount);
+  }
+
+  // Sends held samples to clients whose queue has drained. Run it a few
+  // times a second while holdsSamples().
+  void service() {
+    if (!lock) {
+      return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t now = millis();
+    for (Client& c : clients) {
+      if (!c.client || c.closing) {
+        continue;
+      }
+      trackLag(c, now);
+      if (c.hasPending && c.client->packetsWaiting() == 0) {
+        c.hasPending = false;
+        send(c, c.pending, "sensor_data", now);
+      }
+    }
+    xSemaphoreGive(lock);
+  }
+
+  // Appends `"clients":[{...}],"coalesced":n,...` (no surrounding braces).
+  void writeJsonFields(Print& out) {
+    if (!lock) {
+      out.print("\"clients\":[]");
+      return;
+    }
+    char line[192];
+    out.print("\"clients\":[");
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t now = millis();
+    bool first = true;
+    for (Client& c : clients) {
+      if (!c.client || c.closing) {
+        continue;
+      }
+      PayloadWriter client(line, sizeof(line));
+      client.append(first ? "{\"id\":" : ",{\"id\":").appendUnsigned(c.id);
+      client.append(",\"queued\":").appendUnsigned(c.client->packetsWaiting());
+      client.append(",\"queued_bytes\":").appendUnsigned(queuedBytes(c));
+      client.append(",\"lag_ms\":").appendUnsigned(lagMs(c, now));
+      client.append(",\"max_lag_ms\":").appendUnsigned(c.maxLagMs);
+      client.append(",\"sent\":").appendUnsigned(c.sent);
+      client.append(",\"coalesced\":").appendUnsigned(c.coalesced).append('}');
+      out.print(line);
+      first = false;
+    }
+    PayloadWriter totals(line, sizeof(line));
+    totals.append("],\"coalesced\":").appendUnsigned(coalescedTotal);
+    totals.append(",\"closed_backlog\":").appendUnsigned(closedTotal);
+    totals.append(",\"rejected\":").appendUnsigned(rejectedTotal);
+    xSemaphoreGive(lock);
+    out.print(line);
+  }
+
+  uint32_t coalesced() const { return coalescedTotal; }
+  uint32_t closedForBacklog() const { return closedTotal; }
+
+private:
+  struct Client {
+    AsyncEventSourceClient* client = nullptr;  // null: free slot
+    uint32_t id = 0;
+    uint16_t sizes[SSE_TRACKED_MESSAGES] = {};
+    uint32_t sentAtMs[SSE_TRACKED_MESSAGES] = {};
+    uint32_t sent = 0;  // also the index of the next tracked send
+    uint32_t coalesced = 0;
+    uint32_t maxLagMs = 0;
+    bool hasPending = false;
+    bool closing = false;  // closed, waiting for the disconnect
+    char pending[SSE_MAX_SAMPLE_LENGTH];
+  };
+
+  void onConnect(AsyncEventSourceClient* client) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Client* slot = nullptr;
+    for (Client& c : clients) {
+      if (!c.client) {
+        slot = &c;
+        break;
+      }
+    }
+    if (slot) {
+      *slot = Client();
+      slot->client = client;
+      slot->id = ++connections;
+      clientCount++;
+    } else {
+      rejectedTotal++;
+    }
+    xSemaphoreGive(lock);
+    if (!slot) {
+      Serial.println("SSE client limit reached, closing");
+      client->close();
+      return;
+    }
+
+    // Rendered outside the lock; the buffer lives until the client has
+    // queued it
+    std::unique_ptr<char[]> greeting(greet ? new (std::nothrow) char[greetMax] : nullptr);
+    if (!greeting) {
+      return;
+    }
+    size_t length = greet(greeting.get(), greetMax);
+    if (length == 0) {
+      return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (slot->client == client) {
+      send(*slot, greeting.get(), greetEvent, millis());
+    }
+    xSemaphoreGive(lock);
+  }
+
+  void onDisconnect(AsyncEventSourceClient* client) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (Client& c : clients) {
+      if (c.client == client) {
+        c.client = nullptr;
+        clientCount--;
+      }
+    }
+    xSemaphoreGive(lock);
+  }
+
+  void send(Client& c, const char* message, const char* event, uint32_t now) {
+    size_t length = strlen(message);
+    uint8_t slot = c.sent % SSE_TRACKED_MESSAGES;
+    c.sizes[slot] = static_cast<uint16_t>(length < 0xffff ? length : 0xffff);
+    c.sentAtMs[slot] = now;
+    c.sent++;
+    c.client->send(message, event, now);
+  }
+
+  // The last packetsWaiting() sends are still queued. Past the tracked ones
+  // (only alerts and the greeting queue behind a busy client) their average
+  // stands in.
+  static size_t queuedBytes(const Client& c) {
+    size_t waiting = c.client->packetsWaiting();
+    size_t tracked = c.sent < SSE_TRACKED_MESSAGES ? c.sent : SSE_TRACKED_MESSAGES;
+    size_t bytes = 0;
+    for (size_t i = 1; i <= tracked && i <= waiting; ++i) {
+      bytes += c.sizes[(c.sent - i) % SSE_TRACKED_MESSAGES];
+    }
+    return (waiting > tracked && tracked > 0) ? bytes * waiting / tracked : bytes;
+  }
+
+  // Worst lag is sampled whenever a sample is sent or held, and by service().
+  static void trackLag(Client& c, uint32_t now) {
+    uint32_t lag = lagMs(c, now);
+    if (lag > c.maxLagMs) {
+      c.maxLagMs = lag;
+    }
+  }
+
+  // Age of the oldest event still queued.
+  static uint32_t lagMs(const Client& c, uint32_t now) {
+    size_t waiting = c.client->packetsWaiting();
+    if (waiting == 0) {
+      return 0;
+    }
+    size_t tracked = c.sent < SSE_TRACKED_MESSAGES ? c.sent : SSE_TRACKED_MESSAGES;
+    if (tracked == 0) {
+      return 0;
+    }
+    if (waiting > tracked) {
+      waiting = tracked;
+    }
+    return now - c.sentAtMs[(c.sent - waiting) % SSE_TRACKED_MESSAGES];
+  }
+
+  static void closeAll(AsyncEventSourceClient** overdue, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      Serial.println("SSE client too far behind, closing");
+      overdue[i]->close();
+    }
+  }
+
+  SemaphoreHandle_t lock = nullptr;
+  Client clients[SSE_MAX_CLIENTS];
+  size_t clientCount = 0;
+  uint32_t connections = 0;
+  uint32_t coalescedTotal = 0;
+  uint32_t closedTotal = 0;
+  uint32_t rejectedTotal = 0;
+  const char* greetEvent = nullptr;
+  size_t greetMax = 0;
+  GreetingFunction greet = nullptr;
+};
@@ -0,0 +1,147 @@
+#pragma once
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <FS.h>
+
+#define STATIC_ASSETS_MANIFEST "/assets.txt"
+#define STATIC_ASSETS_MAX 8
+#define STATIC_ASSETS_MAX_PATH 32  // SPIFFS object name limit, ".gz" included
+#define STATIC_ASSETS_MAX_LINE 96  // longest manifest line, newline excluded
+
+// The web assets as laid out by build_web_assets.py: each one gzipped on
+// flash as <url>.gz and listed in STATIC_ASSETS_MANIFEST with its content
+// hash. Stylesheets and scripts carry the hash in their URL and are sent as
+// immutable; pages keep their URL and are revalidated against the hash as a
+// strong ETag, so a dashboard reload costs a few 304s.
+//
+// Bodies are sent gzipped: every browser that can run the dashboard accepts
+// it, and the plain files are not on flash to fall back to. The exception is
+// a page with %NAME% placeholders, which is stored plain and streamed
+// through the template processor in chunks; its ETag also carries the
+// template tag (the firmware version), since its body changes with it.
+class StaticAssets {
+public:
+  struct Asset {
+    char url[STATIC_ASSETS_MAX_PATH];
+    char etag[28];  // quoted
+    char contentType[32];
+    bool immutable;
+    bool templated;
+  };
+
+  // Returns the number of assets; 0 for a filesystem image built without
+  // the asset step, whose plain files the caller serves as before.
+  size_t begin(fs::FS& fs, AwsTemplateProcessor processor = nullptr, const char* templateTag = "") {
+    filesystem = &fs;
+    templateProcessor = processor;
+    count = 0;
+    File file = fs.open(STATIC_ASSETS_MANIFEST, "r");
+    if (!file) {
+      return 0;
+    }
+    // One line at a time: "<url> <hash> <type> <immutable> <templated>"
+    char line[STATIC_ASSETS_MAX_LINE];
+    while (file.available()) {
+      size_t length = 0;
+      bool tooLong = false;
+      int c;
+      while ((c = file.read()) >= 0 && c != '\n') {
+        if (length < sizeof(line) - 1) {
+          line[length++] = static_cast<char>(c);
+        } else {
+          tooLong = true;
+        }
+      }
+      line[length] = '\0';
+      if (tooLong) {
+        Serial.printf("Asset manifest line too long: %s...\n", line);
+        continue;
+      }
+      if (length == 0) {
+        continue;
+      }
+      if (count == STATIC_ASSETS_MAX) {
+        Serial.printf("Asset manifest lists more than %d assets, %s and later not served\n", STATIC_ASSETS_MAX, line);
+        break;
+      }
+      char hash[9];
+      unsigned immutable = 0;
+      unsigned templated = 0;
+      Asset& asset = assets[count];
+      if (sscanf(line, "%28s %8s %31s %u %u", asset.url, hash, asset.contentType, &immutable, &templated) != 5) {
+        Serial.printf("Bad asset manifest line: %s\n", line);
+        continue;
+      }
+      asset.immutable = immutable != 0;
+      asset.templated = templated != 0;
+      if (asset.templated) {
+        snprintf(asset.etag, sizeof(asset.etag), "\"%s-%s\"", hash, templateTag);
+      } else {
+        snprintf(asset.etag, sizeof(asset.etag), "\"%s\"", hash);
+      }
+      count++;
+    }
+    file.close();
+    return count;
+  }
+
+  size_t size() const { return count; }
+  const Asset& at(size_t index) const { return assets[index]; }
+
+  const Asset* find(const char* url) const {
+    for (size_t i = 0; i < count; ++i) {
+      if (strcmp(assets[i].url, url) == 0) {
+        return &assets[i];
+      }
+    }
+    return nullptr;
+  }
+
+  // Returns false when url is not a listed asset.
+  bool send(AsyncWebServerRequest* request, const char* url) {
+    const Asset* asset = find(url);
+    if (!asset) {
+      return false;
+    }
+    const char* cacheControl = asset->immutable ? "public, max-age=31536000, immutable" : "no-cache";
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset->etag) {
+      AsyncWebServerResponse* response = request->beginResponse(304);
+      response->addHeader("ETag", asset->etag);
+      response->addHeader("Cache-Control", cacheControl);
+      request->send(response);
+      notModifiedCount++;
+      return true;
+    }
+    AsyncWebServerResponse* response = nullptr;
+    if (asset->templated) {
+      response = request->beginResponse(*filesystem, asset->url, asset->contentType, false, templateProcessor);
+    } else {
+      char path[STATIC_ASSETS_MAX_PATH + 3];
+      snprintf(path, sizeof(path), "%s.gz", asset->url);
+      response = request->beginResponse(*filesystem, path, asset->contentType);
+    }
+    if (!response) {
+      request->send(404, "text/plain", "File not found");
+      return true;
+    }
+    if (!asset->templated) {
+      response->addHeader("Content-Encoding", "gzip");
+    }
+    response->addHeader("ETag", asset->etag);
+    response->addHeader("Cache-Control", cacheControl);
+    request->send(response);
+    sentCount++;
+    return true;
+  }
+
+  uint32_t sent() const { return sentCount; }
+  uint32_t notModified() const { return notModifiedCount; }
+
+private:
+  fs::FS* filesystem = nullptr;
+  AwsTemplateProcessor templateProcessor;
+  Asset assets[STATIC_ASSETS_MAX];
+  size_t count = 0;
+  uint32_t sentCount = 0;
+  uint32_t notModifiedCount = 0;
+};
@@ -0,0 +1,209 @@
+#pragma once
+#include <Arduino.h>
+#include "history_buffer.h"
+
+// Block codec for HistoryRecord series, after Gorilla (Pelkonen et al.):
+// timestamps as delta-of-delta, values as deltas from the previous sample.
+// Values are already fixed point, so integer deltas replace Gorilla's float
+// XOR, and fields are byte-aligned LEB128 varints instead of a bit stream.
+// At the regular 2 s cadence with slow-moving readings a sample is 3 bytes.
+//
+// A block is self-contained (the first record is stored verbatim in the
+// header), so any block decodes without the ones before it.
+//
+// Header (16 bytes, little-endian):
+//   0 magic, 1 first status, 2-3 count, 4-7 first timestamp,
+//   8-11 last timestamp, 12-13 first centi-temperature, 14-15 first humidity
+// Each further record:
+//   varint(zigzag(delta-of-delta timestamp) << 1 | status changed)
+//   [status byte, only if changed]
+//   varint(zigzag(centi-temperature delta))
+//   varint(zigzag(humidity delta))
+namespace TsCodec {
+
+const uint8_t BLOCK_MAGIC = 0xA6;
+const size_t HEADER_SIZE = 16;
+const size_t MAX_RECORD_SIZE = 10 + 1 + 5 + 5;
+
+inline void writeU16(uint8_t* out, uint16_t value) {
+  out[0] = static_cast<uint8_t>(value);
+  out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+inline void writeU32(uint8_t* out, uint32_t value) {
+  writeU16(out, static_cast<uint16_t>(value));
+  writeU16(out + 2, static_cast<uint16_t>(value >> 16));
+}
+
+inline uint16_t readU16(const uint8_t* in) { return static_cast<uint16_t>(in[0] | (in[1] << 8)); }
+
+inline uint32_t readU32(const uint8_t* in) {
+  return static_cast<uint32_t>(readU16(in)) | (static_cast<uint32_t>(readU16(in + 2)) << 16);
+}
+
+inline uint64_t zigzag(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+
+inline int64_t unzigzag(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+inline size_t putVarint(uint8_t* out, uint64_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = static_cast<uint8_t>(value);
+  return n;
+}
+
+// Returns false on a truncated or over-long varint.
+inline bool getVarint(const uint8_t* in, size_t len, size_t& pos, uint64_t& value) {
+  value = 0;
+  for (unsigned shift = 0; shift < 64 && pos < len; shift += 7) {
+    uint8_t byte = in[pos++];
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Builds one block in a caller-owned buffer. Records must be appended in
+// timestamp order.
+class BlockEncoder {
+public:
+  void reset(uint8_t* buffer, size_t capacity) {
+    block = buffer;
+    cap = capacity;
+    used = 0;
+    records = 0;
+  }
+
+  // Appends record, or returns false and leaves the block untouched when it
+  // does not fit.
+  bool append(const HistoryRecord& record) {
+    if (records == 0) {
+      if (cap < HEADER_SIZE) {
+        return false;
+      }
+      memset(block, 0, HEADER_SIZE);
+      block[0] = BLOCK_MAGIC;
+      block[1] = record.status;
+      writeU32(&block[4], record.timestamp);
+      writeU16(&block[12], static_cast<uint16_t>(record.temperatureCenti));
+      writeU16(&block[14], record.humidityCenti);
+      used = HEADER_SIZE;
+      prevDelta = 0;
+    } else {
+      uint8_t scratch[MAX_RECORD_SIZE];
+      size_t n = 0;
+      uint32_t delta = record.timestamp - prev.timestamp;
+      int64_t deltaOfDelta = static_cast<int64_t>(delta) - static_cast<int64_t>(prevDelta);
+      bool statusChanged = record.status != prev.status;
+      n += putVarint(&scratch[n], (zigzag(deltaOfDelta) << 1) | (statusChanged ? 1 : 0));
+      if (statusChanged) {
+        scratch[n++] = record.status;
+      }
+      n += putVarint(&scratch[n], zigzag(static_cast<int64_t>(record.temperatureCenti) - prev.temperatureCenti));
+      n += putVarint(&scratch[n], zigzag(static_cast<int64_t>(record.humidityCenti) - prev.humidityCenti));
+      if (used + n > cap) {
+        return false;
+      }
+      memcpy(&block[used], scratch, n);
+      used += n;
+      prevDelta = delta;
+    }
+    prev = record;
+    ++records;
+    writeU16(&block[2], records);
+    writeU32(&block[8], record.timestamp);
+    return true;
+  }
+
+  size_t size() const { return used; }
+  uint16_t count() const { return records; }
+
+private:
+  uint8_t* block = nullptr;
+  size_t cap = 0;
+  size_t used = 0;
+  uint16_t records = 0;
+  uint32_t prevDelta = 0;
+  HistoryRecord prev = {};
+};
+
+inline bool isBlock(const uint8_t* block, size_t len) {
+  return len >= HEADER_SIZE && block[0] == BLOCK_MAGIC && readU16(&block[2]) > 0;
+}
+inline uint16_t blockCount(const uint8_t* block) { return readU16(&block[2]); }
+inline uint32_t blockFirstTimestamp(const uint8_t* block) { return readU32(&block[4]); }
+inline uint32_t blockLastTimestamp(const uint8_t* block) { return readU32(&block[8]); }
+
+// Streams records out of one block without materialising the series.
+class BlockDecoder {
+public:
+  bool begin(const uint8_t* buffer, size_t length) {
+    block = buffer;
+    len = length;
+    pos = HEADER_SIZE;
+    decoded = 0;
+    if (!isBlock(block, len)) {
+      remaining = 0;
+      return false;
+    }
+    remaining = blockCount(block);
+    return true;
+  }
+
+  // False once the block is exhausted or found to be corrupt.
+  bool next(HistoryRecord& out) {
+    if (remaining == 0) {
+      return false;
+    }
+    if (decoded == 0) {
+      prev.timestamp = blockFirstTimestamp(block);
+      prev.temperatureCenti = static_cast<int16_t>(readU16(&block[12]));
+      prev.humidityCenti = readU16(&block[14]);
+      prev.status = block[1];
+      prevDelta = 0;
+    } else {
+      uint64_t tag, temperature, humidity;
+      if (!getVarint(block, len, pos, tag)) {
+        return fail();
+      }
+      if (tag & 1) {
+        if (pos >= len) {
+          return fail();
+        }
+        prev.status = block[pos++];
+      }
+      if (!getVarint(block, len, pos, temperature) || !getVarint(block, len, pos, humidity)) {
+        return fail();
+      }
+      prevDelta = static_cast<uint32_t>(static_cast<int64_t>(prevDelta) + unzigzag(tag >> 1));
+      prev.timestamp += prevDelta;
+      prev.temperatureCenti = static_cast<int16_t>(prev.temperatureCenti + unzigzag(temperature));
+      prev.humidityCenti = static_cast<uint16_t>(prev.humidityCenti + unzigzag(humidity));
+    }
+    ++decoded;
+    --remaining;
+    out = prev;
+    return true;
+  }
+
+private:
+  bool fail() {
+    remaining = 0;
+    return false;
+  }
+
+  const uint8_t* block = nullptr;
+  size_t len = 0;
+  size_t pos = 0;
+  uint16_t decoded = 0;
+  uint16_t remaining = 0;
+  uint32_t prevDelta = 0;
+  HistoryRecord prev = {};
+};
+
+}  // namespace TsCodec
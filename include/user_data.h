@@ -0,0 +1,254 @@
+#pragma once
+#include <Arduino.h>
+#include <Preferences.h>
+#include <SPIFFS.h>
+#include <memory>
+#include <new>
+#include "email_outbox.h"
+#include "history_log.h"
+
+#define USER_DATA_PARTITION "userdata"  // optional, see partitions_userdata.csv
+#define ASSETS_PARTITION "spiffs"       // named, as userdata is the same type
+#define USER_DATA_MOUNT_POINT "/user"
+#define USER_DATA_NVS_NAMESPACE "userdata"
+#define USER_DATA_MARKER "/.userdata"  // on SPIFFS while a snapshot is pending
+#define USER_DATA_MAX_FILE_BYTES 4096
+
+// Where settings, the history log and the email outbox live, and what keeps
+// them across a filesystem update.
+//
+// With a "userdata" partition in the partition table they are kept there,
+// on a SPIFFS of their own that a filesystem image never touches; the web
+// assets alone are on "spiffs". With the default table everything shares
+// "spiffs", which a filesystem update rewrites whole. snapshot() then copies
+// the small files (settings, outbox) into NVS before the image is written,
+// and begin() puts them back on the next boot. The history log is too big
+// for NVS and is lost on that layout.
+//
+// While the image is being written nothing may write to "spiffs": the
+// history log and the outbox are paused and SPIFFS is unmounted until the
+// reboot, or until the update fails and they are resumed. What the outbox
+// queues meanwhile goes into the NVS copy just before the reboot.
+//
+// The snapshot also leaves a marker file on SPIFFS. If the marker is still
+// there at boot the filesystem was not replaced (the update failed before
+// writing, or was never committed), so only files that have gone missing
+// are restored and newer ones are kept. Each file is restored beside the
+// original and renamed over it, and the snapshot is dropped only once every
+// file is back, so a reset during the restore repeats it.
+class UserData {
+public:
+  // Mounts SPIFFS and the user data partition, if there is one, then
+  // finishes a restore left by a filesystem update. Before anything reads
+  // settings.
+  bool begin() {
+    if (!SPIFFS.begin(true, "/spiffs", 10, ASSETS_PARTITION)) {
+      Serial.println("SPIFFS Mount Failed");
+      return false;
+    }
+    separate = userFs.begin(true, USER_DATA_MOUNT_POINT, 5, USER_DATA_PARTITION);
+    if (separate) {
+      Serial.println("User data on its own partition");
+    }
+    restore();
+    return true;
+  }
+
+  // The filesystem for settings, history and the outbox.
+  fs::FS& fs() { return separate ? static_cast<fs::FS&>(userFs) : static_cast<fs::FS&>(SPIFFS); }
+  bool isSeparate() const { return separate; }
+  uint32_t restoredFiles() const { return restored; }
+
+  // Run just before a filesystem image is written over "spiffs". False if
+  // the files could not be saved, and the update should not go ahead;
+  // everything carries on as before then.
+  bool prepareFilesystemUpdate(HistoryLog& history, EmailOutbox& outbox) {
+    if (!separate) {
+      history.pause();
+      outbox.pause();
+    }
+    if (!snapshot()) {
+      history.resume();
+      outbox.resume();
+      return false;
+    }
+    SPIFFS.end();
+    return true;
+  }
+
+  // The update failed: SPIFFS is mounted again (formatted, if the image got
+  // far enough to break it), what it lost is put back from NVS and the
+  // history log and outbox write to it again.
+  void resumeAfterFailedUpdate(HistoryLog& history, EmailOutbox& outbox) {
+    if (!SPIFFS.begin(true, "/spiffs", 10, ASSETS_PARTITION)) {
+      Serial.println("SPIFFS Mount Failed");
+      return;
+    }
+    restore();
+    history.resume();
+    outbox.resume();
+  }
+
+  // Just before the reboot into a new filesystem image: the outbox as it is
+  // now replaces the copy taken before the upload.
+  void finishFilesystemUpdate(EmailOutbox& outbox) {
+    if (separate) {
+      return;
+    }
+    std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[USER_DATA_MAX_FILE_BYTES]);
+    size_t length = buffer ? outbox.encode(buffer.get(), USER_DATA_MAX_FILE_BYTES) : 0;
+    Preferences nvs;
+    if (length == 0 || !nvs.begin(USER_DATA_NVS_NAMESPACE, false)) {
+      return;
+    }
+    if (nvs.getUInt("pending", 0) != 0 && nvs.putBytes(keyFor(OUTBOX), buffer.get(), length) != length) {
+      Serial.println("User data: outbox changes during the update not saved");
+    }
+    nvs.end();
+  }
+
+  // The NVS copy on its own; prepareFilesystemUpdate() takes it.
+  bool snapshot() {
+    if (separate) {
+      return true;
+    }
+    Preferences nvs;
+    if (!nvs.begin(USER_DATA_NVS_NAMESPACE, false)) {
+      Serial.println("User data snapshot: NVS unavailable");
+      return false;
+    }
+    // A snapshot only counts once "pending" is written, after every file
+    nvs.remove("pending");
+    std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[USER_DATA_MAX_FILE_BYTES]);
+    bool ok = buffer != nullptr;
+    for (size_t i = 0; ok && i < FILE_COUNT; ++i) {
+      nvs.remove(keyFor(i));
+      size_t length = 0;
+      if (!readFile(SPIFFS, paths()[i], buffer.get(), length)) {
+        ok = false;
+      } else if (length > 0 && nvs.putBytes(keyFor(i), buffer.get(), length) != length) {
+        Serial.printf("User data snapshot: %s does not fit in NVS\n", paths()[i]);
+        ok = false;
+      }
+    }
+    uint32_t token = nvs.getUInt("serial", 0) + 1;
+    ok = ok && nvs.putUInt("serial", token) && nvs.putUInt("pending", token);
+    if (!ok) {
+      for (size_t i = 0; i < FILE_COUNT; ++i) {
+        nvs.remove(keyFor(i));
+      }
+      nvs.end();
+      return false;
+    }
+    nvs.end();
+
+    File marker = SPIFFS.open(USER_DATA_MARKER, "w");
+    if (marker) {
+      marker.write(reinterpret_cast<const uint8_t*>(&token), sizeof(token));
+      marker.close();
+    }
+    Serial.println("User data saved to NVS for the filesystem update");
+    return true;
+  }
+
+private:
+  static const size_t FILE_COUNT = 2;
+  static const size_t OUTBOX = 1;  // index in paths()
+
+  static const char* const* paths() {
+    static const char* const list[FILE_COUNT] = {"/settings.json", EMAIL_OUTBOX_FILE};  // Settings::filePath
+    return list;
+  }
+
+  static const char* keyFor(size_t index) {
+    static const char* const keys[FILE_COUNT] = {"file0", "file1"};
+    return keys[index];
+  }
+
+  void restore() {
+    Preferences nvs;
+    if (!nvs.begin(USER_DATA_NVS_NAMESPACE, false)) {
+      return;
+    }
+    uint32_t token = nvs.getUInt("pending", 0);
+    if (token == 0) {
+      nvs.end();
+      return;
+    }
+    uint32_t markerToken = 0;
+    size_t markerLength = 0;
+    bool replaced = !readFile(SPIFFS, USER_DATA_MARKER, reinterpret_cast<uint8_t*>(&markerToken), markerLength,
+                              sizeof(markerToken)) ||
+                    markerLength != sizeof(markerToken) || markerToken != token;
+
+    std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[USER_DATA_MAX_FILE_BYTES]);
+    if (!buffer) {
+      nvs.end();
+      return;
+    }
+    bool complete = true;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+      size_t length = nvs.getBytes(keyFor(i), buffer.get(), USER_DATA_MAX_FILE_BYTES);
+      if (length == 0 || (!replaced && SPIFFS.exists(paths()[i]))) {
+        continue;
+      }
+      if (writeFile(SPIFFS, paths()[i], buffer.get(), length)) {
+        restored++;
+      } else {
+        complete = false;
+      }
+    }
+    if (!complete) {
+      Serial.println("User data restore incomplete, retrying at next boot");
+      nvs.end();
+      return;
+    }
+    nvs.remove("pending");
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+      nvs.remove(keyFor(i));
+    }
+    nvs.end();
+    SPIFFS.remove(USER_DATA_MARKER);
+    Serial.printf("User data restored after %s: %u files\n",
+                  replaced ? "filesystem update" : "unfinished update", static_cast<unsigned>(restored));
+  }
+
+  // A missing file reads as empty; false only if it exists and cannot be
+  // read whole.
+  static bool readFile(fs::FS& filesystem, const char* path, uint8_t* out, size_t& length,
+                       size_t capacity = USER_DATA_MAX_FILE_BYTES) {
+    length = 0;
+    if (!filesystem.exists(path)) {
+      return true;
+    }
+    File file = filesystem.open(path, "r");
+    if (!file || file.size() > capacity) {
+      Serial.printf("User data: cannot read %s\n", path);
+      return false;
+    }
+    length = file.read(out, capacity);
+    bool whole = length == file.size();
+    file.close();
+    return whole;
+  }
+
+  static bool writeFile(fs::FS& filesystem, const char* path, const uint8_t* data, size_t length) {
+    String temporary = String(path) + ".tmp";
+    File file = filesystem.open(temporary, "w");
+    if (!file) {
+      return false;
+    }
+    bool ok = file.write(data, length) == length;
+    file.close();
+    if (!ok) {
+      filesystem.remove(temporary);
+      return false;
+    }
+    filesystem.remove(path);
+    return filesystem.rename(temporary, String(path));
+  }
+
+  fs::SPIFFSFS userFs;
+  bool separate = false;
+  uint32_t restored = 0;
+};
@@ -6,13 +6,39 @@
 #include <SPIFFS.h>
 #include <Update.h>
 #include <time.h>
-#include "sensor.h"
-#include "lcd_display.h"
+#include <memory>
+#include "sample_snapshot.h"
+#include "history_log.h"
+#include "history_export.h"
+#include "history_response.h"
+#include "last_value_cache.h"
+#include "display_task.h"
+#include "email_notifier.h"
+#include "email_outbox.h"
+#include "ota_update.h"
+#include "scheduler.h"
+#include "sink_registry.h"
+#include "sse_fanout.h"
 #include "settings.h"
+#include "static_assets.h"
+#include "user_data.h"
 
-extern Sensor sensor;
-extern LCDDisplay lcd;
+#define SNAPSHOT_HISTORY_SECONDS 1800
+#define SNAPSHOT_HISTORY_STEP 60
+#define SNAPSHOT_MAX_LENGTH 2048  // history tail of 31 points, reading, camera URL
+
+extern HistoryBuffer history;
+extern HistoryLog historyLog;
+extern DisplayTask display;
 extern Settings settings;
+extern Scheduler scheduler;
+extern SinkRegistry sampleSinks;
+extern SinkRegistry alertSinks;
+extern LastValueCache lastValues;
+extern EmailNotifier emailNotifier;
+extern EmailOutbox emailOutbox;
+extern UserData userData;
+extern TaskHandle_t loopTaskHandle;
 
 namespace WifiSetup {
     const char* SSID = "SKYPGFYX";
@@ -21,10 +47,18 @@ namespace WifiSetup {
 
     AsyncWebServer server(80);
     AsyncEventSource events("/events");
-    static bool uploadInProgress = false;
-
-    bool isUploading() {
-        return uploadInProgress;
+    SseFanout sse;
+    StaticAssets assets;
+    OtaUpdate ota;
+
+    // Accept negotiation for collectors: MessagePack when the client lists
+    // it, JSON otherwise. q-values are not weighed.
+    bool acceptsMsgPack(AsyncWebServerRequest *request) {
+        if (!request->hasHeader("Accept")) {
+            return false;
+        }
+        String accept = request->header("Accept");
+        return accept.indexOf("application/msgpack") >= 0 || accept.indexOf("application/x-msgpack") >= 0;
     }
 
     void syncTimeWithNtp() {
@@ -47,109 +81,117 @@ namespace WifiSetup {
     }
 
 
-    void handleGetUpdate(AsyncWebServerRequest *request) {
-        File file = SPIFFS.open("/update.html", "r");
-        if (!file) {
-            request->send(404, "text/plain", "File not found");
+    // %NAME% placeholders in the pages. Anything else between two percent
+    // signs is put back as it was.
+    String templateProcessor(const String& var) {
+        if (var == "VERSION") {
+            return VERSION;
+        }
+        return "%" + var + "%";
+    }
+
+    // Every file-backed route goes through here: a page or asset from the
+    // gzipped asset set, or else the plain file, streamed from SPIFFS in
+    // chunks (pages through the template processor) so serving a page never
+    // holds it in RAM.
+    void sendAsset(AsyncWebServerRequest *request, const char* url, const char* contentType) {
+        if (assets.send(request, url)) {
             return;
         }
+        bool page = strcmp(contentType, "text/html") == 0;
+        request->send(SPIFFS, url, contentType, false, page ? templateProcessor : nullptr);
+    }
 
-        String html = file.readString();
-        file.close();
+    // What the dashboard needs to draw itself, as one JSON object: the
+    // /readings payload (null before the first sample), thresholds, camera
+    // URL, firmware version and the last SNAPSHOT_HISTORY_SECONDS of /history
+    // at SNAPSHOT_HISTORY_STEP. Served at /api/snapshot and sent as the first
+    // SSE event, so a dashboard needs no other request to start. Secrets from
+    // settings are left out.
+    void writeSnapshot(Print &out) {
+        char reading[LAST_VALUE_MAX_PAYLOAD + 1];
+        uint32_t version = 0;
+        size_t length = lastValues.read(MQTT_TOPIC_SENSOR, reading, sizeof(reading), version);
+
+        char line[256];
+        PayloadWriter head(line, sizeof(line));
+        head.append("{\"version\":").appendQuoted(VERSION).append(",\"reading\":");
+        out.print(line);
+        out.print(length > 0 ? reading : "null");
+
+        PayloadWriter fields(line, sizeof(line));
+        fields.append(",\"thresholds\":{\"ready\":").appendFixed(settings.getReadyToPrintThreshold(), 1);
+        fields.append(",\"high\":").appendFixed(settings.getHighTemperatureThreshold(), 1);
+        fields.append("},\"camera_url\":");
+        out.print(line);
+        // A URL too long for the line is left out rather than cut short
+        PayloadWriter camera(line, sizeof(line));
+        camera.appendQuoted(settings.getCameraUrl());
+        out.print(camera.overflowed() ? "null" : line);
+        out.print(",\"history\":");
+
+        uint32_t oldest = 0, newest = 0;
+        history.bounds(oldest, newest);
+        uint32_t from = newest > SNAPSHOT_HISTORY_SECONDS ? newest - SNAPSHOT_HISTORY_SECONDS : 0;
+        writeHistoryJson(out, historyLog, history, from, newest, SNAPSHOT_HISTORY_STEP);
+        out.print("}");
+    }
 
-        request->send(200, "text/html", html);
+    // SseFanout greeting; a snapshot too long for the buffer is not sent.
+    size_t renderSnapshot(char *out, size_t size) {
+        BufferPrint snapshot(out, size);
+        writeSnapshot(snapshot);
+        if (snapshot.overflowed()) {
+            Serial.println("SSE snapshot truncated, not sent");
+            return 0;
+        }
+        return snapshot.length();
     }
 
+    void handleGetUpdate(AsyncWebServerRequest *request) {
+        sendAsset(request, "/update.html", "text/html");
+    }
+
+    // Runs once the whole body is in; the only place an update is answered
     void handlePostUpdate(AsyncWebServerRequest *request) {
-        String response = (Update.hasError()) ? "Update Failed" : "Update Successful. Rebooting...";
-        request->send(200, "text/plain", response);
-        delay(3000);
-        ESP.restart();
+        ota.respond(request);
     }
 
     void handlePostUpload(AsyncWebServerRequest *request, const String& filename, size_t index, 
                         uint8_t *data, size_t len, bool final) {
-        static uint32_t updateSize = 0;
-        static String uploadType = "";
-
         if (index == 0) {
             Serial.printf("Upload Start: %s\n", filename.c_str());
-            updateSize = 0;
-            uploadInProgress = true;
-
-            // Determine upload type from HTTP argument
-            if (request->hasArg("uploadType")) {
-                uploadType = request->arg("uploadType");
-            } else {
-                uploadType = "firmware"; // default to firmware
-            }
-
-            Serial.printf("Upload Type: %s\n", uploadType.c_str());
-
-            // Handle firmware update
-            if (uploadType == "firmware") {
-                lcd.displayUploadMessage("Uploading firmware");
-                if (!Update.begin(UPDATE_SIZE_UNKNOWN, U_FLASH)) {
-                    Update.printError(Serial);
-                    uploadInProgress = false;
-                    request->send(500, "text/plain", "OTA begin failed");
-                    return;
-                }
-                Serial.println("Started firmware update...");
-            }
-            // Handle filesystem upload
-            else if (uploadType == "filesystem") {
-                lcd.displayUploadMessage("Uploading filesystem");
-                // Backup settings.json if the upload type is filesystem
-                if (uploadType == "filesystem") {
-                    if (SPIFFS.exists("/settings.json")) {
-                        // settings.loadSettings();
-                        // Serial.println("settings.json backed up successfully.");
-                    }
-                }            
-                if (!Update.begin(UPDATE_SIZE_UNKNOWN, U_SPIFFS)) {
-                    Update.printError(Serial);
-                    uploadInProgress = false;
-                    request->send(500, "text/plain", "OTA begin failed");
-                    return;
-                }
-                Serial.println("Started filesystem update...");
+            if (ota.start(request)) {
+                display.showUpload(ota.target() == OTA_FILESYSTEM ? "Uploading filesystem" : "Uploading firmware");
             }
-            else {
-                uploadInProgress = false;
-                request->send(400, "text/plain", "Invalid uploadType parameter. Use 'firmware' or 'filesystem'");
-                return;
+            // loop() runs serviceOta() only while an update needs it
+            if (loopTaskHandle) {
+                xTaskNotifyGive(loopTaskHandle);
             }
         }
+        ota.write(request, data, len, final);
+    }
 
-        if (!Update.hasError()) {
-            if (Update.write(data, len) != len) {
-                Update.printError(Serial);
+    // Main loop side of an update: progress to the dashboards as "ota"
+    // events, the LCD back once one fails, and the reboot after a success.
+    void serviceOta() {
+        char progress[OTA_PROGRESS_MAX_LENGTH];
+        OtaState state = OTA_IDLE;
+        if (ota.takeProgress(progress, sizeof(progress), state) > 0) {
+            sse.sendEvent(progress, "ota");
+            if (state == OTA_FAILED) {
+                display.endUpload();
             }
-            updateSize += len;
         }
-
-        if (final) {
-            if (Update.end(true)) {
-                Serial.printf("Update Success: %u bytes\nRebooting...\n", updateSize);
-
-                // Restore settings.json if the upload type is filesystem
-                if (uploadType == "filesystem") {
-                    // settings.saveSettings();
-                    // Serial.println("settings.json restored successfully.");
-                }
-                // request->send(200, "text/html",
-                //     "<html><body><p>Firmware update successful!</p>"
-                //     "<p>Rebooting ESP32...</p>"
-                //     "<meta http-equiv='refresh' content='3; url=/' />"
-                //     "</body></html>");
-                delay(3000);
-                ESP.restart();
-            } else {
-                Update.printError(Serial);
-                uploadInProgress = false;
-                request->send(500, "text/plain", "OTA end failed");
+        if (ota.rebootDue(millis())) {
+            if (ota.target() == OTA_FILESYSTEM) {
+                userData.finishFilesystemUpdate(emailOutbox);
             }
+            // The samples since the last full page; paused, and skipped, while
+            // a filesystem image is written over the log
+            historyLog.flushNow();
+            Serial.println("Rebooting into the update...");
+            ESP.restart();
         }
     }
 
@@ -172,28 +214,50 @@ namespace WifiSetup {
         }
     }
 
+    // After userData.begin(), which mounts SPIFFS
     void initWebServer() {
-        if (!SPIFFS.begin(true)) {
-            Serial.println("SPIFFS Mount Failed");
-            return;
+        if (assets.begin(SPIFFS, templateProcessor, VERSION) == 0) {
+            Serial.println("No asset manifest, serving plain files");
         }
+        // Settings and the outbox are saved, and nothing writes to SPIFFS,
+        // while a filesystem image is written
+        if (!ota.begin([] { return userData.prepareFilesystemUpdate(historyLog, emailOutbox); },
+                       [] { userData.resumeAfterFailedUpdate(historyLog, emailOutbox); })) {
+            Serial.println("OTA update initialization failed");
+        }
+
     // Serve root
         server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-            request->send(SPIFFS, "/index.html", "text/html");
+            sendAsset(request, "/index.html", "text/html");
         });
 
         server.on("/index", HTTP_GET, [](AsyncWebServerRequest *request) {
-            request->send(SPIFFS, "/index.html", "text/html");
+            sendAsset(request, "/index.html", "text/html");
         });
 
-            // Serve style.css for GET /style.css
+        // Every listed asset under its own URL, content-hashed names included
+        for (size_t i = 0; i < assets.size(); ++i) {
+            const char* url = assets.at(i).url;
+            server.on(url, HTTP_GET, [url](AsyncWebServerRequest *request) {
+                assets.send(request, url);
+            });
+        }
+
+        // Unhashed names, for images built without the asset step
         server.on("/style.css", HTTP_GET, [](AsyncWebServerRequest *request) {
-            request->send(SPIFFS, "/style.css", "text/css");
+            sendAsset(request, "/style.css", "text/css");
         });
 
-        // Serve common.js for GET /index.js
         server.on("/script.js", HTTP_GET, [](AsyncWebServerRequest *request) {
-            request->send(SPIFFS, "/script.js", "application/javascript");
+            sendAsset(request, "/script.js", "application/javascript");
+        });
+
+        server.on("/gauge.js", HTTP_GET, [](AsyncWebServerRequest *request) {
+            sendAsset(request, "/gauge.js", "application/javascript");
+        });
+
+        server.on("/update.js", HTTP_GET, [](AsyncWebServerRequest *request) {
+            sendAsset(request, "/update.js", "application/javascript");
         });
 
         // Serve update.html for GET /update
@@ -201,7 +265,7 @@ namespace WifiSetup {
             WifiSetup::handleGetUpdate(request);
         });
 
-        // Handle POST /update for OTA firmware update
+        // Handle POST /update for OTA firmware and filesystem updates
         server.on("/update", HTTP_POST, [](AsyncWebServerRequest *request) {
             WifiSetup::handlePostUpdate(request);
         }, [](AsyncWebServerRequest *request, const String& filename, size_t index, uint8_t *data, size_t len, bool final) {
@@ -210,7 +274,7 @@ namespace WifiSetup {
 
         // Settings file GET
         server.on("/settings", HTTP_GET, [](AsyncWebServerRequest *request) {
-            if (!SPIFFS.exists("/settings.json")) {
+            if (!settings.storage().exists("/settings.json")) {
                 settings.save();
             }
             request->send(200, "application/json", settings.toJson());
@@ -227,7 +291,7 @@ namespace WifiSetup {
             [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
                 static File file;
                 if (index == 0) {
-                    file = SPIFFS.open("/settings.json", "w");
+                    file = settings.storage().open("/settings.json", "w");
                     if (!file) {
                         request->send(500, "application/json", "{\"error\": \"Failed to open settings file\"}");
                         return;
@@ -253,11 +317,125 @@ namespace WifiSetup {
             }
         );
 
-        // Request for the latest sensor readings
+        // Latest readings from the last-value cache, as JSON or (Accept:
+        // application/msgpack) MessagePack: rendered at most once per sample
+        // however often it is polled, and a browser revalidating with the
+        // current ETag gets a bodiless 304
         server.on("/readings", HTTP_GET, [](AsyncWebServerRequest *request){
-            String json = sensor.getJSONData ();
-            request->send(200, "application/json", json);
-            json = String();
+            bool msgpack = acceptsMsgPack(request);
+            MqttTopic topic = msgpack ? MQTT_TOPIC_SENSOR_MSGPACK : MQTT_TOPIC_SENSOR;
+            char etag[32];
+            uint32_t version = lastValues.version(topic);
+            lastValues.etag(topic, version, etag, sizeof(etag));
+            if (version != 0 && request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+                AsyncWebServerResponse *response = request->beginResponse(304);
+                response->addHeader("ETag", etag);
+                response->addHeader("Vary", "Accept");
+                request->send(response);
+                return;
+            }
+            uint8_t payload[LAST_VALUE_MAX_PAYLOAD];
+            size_t length = lastValues.read(topic, payload, sizeof(payload), version);
+            if (length == 0) {
+                request->send(200, "application/json", "{\"error\": \"Sensor read failed\"}");
+                return;
+            }
+            lastValues.etag(topic, version, etag, sizeof(etag));
+            AsyncWebServerResponse *response =
+                request->beginResponse(200, msgpack ? "application/msgpack" : "application/json", payload, length);
+            response->addHeader("ETag", etag);
+            response->addHeader("Cache-Control", "no-cache");
+            response->addHeader("Vary", "Accept");
+            request->send(response);
+        });
+
+        // Full-resolution export: /history/export?format=csv|ndjson&from=<s>&to=<s>.
+        // Streamed as a chunked response from a cursor over the log, so heap
+        // use does not grow with the export. Registered before /history,
+        // which would otherwise match this URL as a sub-path.
+        server.on("/history/export", HTTP_GET, [](AsyncWebServerRequest *request){
+            String format = request->hasArg("format") ? request->arg("format") : String("csv");
+            HistoryExport::Format exportFormat;
+            if (format == "csv") {
+                exportFormat = HistoryExport::CSV;
+            } else if (format == "ndjson") {
+                exportFormat = HistoryExport::NDJSON;
+            } else {
+                request->send(400, "text/plain", "Invalid format parameter. Use 'csv' or 'ndjson'");
+                return;
+            }
+            uint32_t from = request->hasArg("from") ? strtoul(request->arg("from").c_str(), nullptr, 10) : 0;
+            uint32_t to = request->hasArg("to") ? strtoul(request->arg("to").c_str(), nullptr, 10) : UINT32_MAX;
+
+            std::shared_ptr<HistoryExport> exporter =
+                std::make_shared<HistoryExport>(historyLog, history, exportFormat, from, to);
+            AsyncWebServerResponse *response = request->beginChunkedResponse(HistoryExport::contentType(exportFormat),
+                [exporter](uint8_t *buffer, size_t maxLen, size_t) -> size_t {
+                    return exporter->fill(buffer, maxLen);
+                });
+            response->addHeader("Content-Disposition",
+                                exportFormat == HistoryExport::CSV ? "attachment; filename=\"history.csv\""
+                                                                   : "attachment; filename=\"history.ndjson\"");
+            request->send(response);
+        });
+
+        // Decimated history from the SPIFFS log and the in-RAM ring buffer:
+        // /history?from=<s>&to=<s>&step=<s>, all optional; JSON or, for
+        // Accept: application/msgpack, MessagePack. Decimated into a chunked
+        // response a slice of records per call, so a query over the whole
+        // log does not hold up the AsyncTCP task.
+        server.on("/history", HTTP_GET, [](AsyncWebServerRequest *request){
+            uint32_t from = request->hasArg("from") ? strtoul(request->arg("from").c_str(), nullptr, 10) : 0;
+            uint32_t to = request->hasArg("to") ? strtoul(request->arg("to").c_str(), nullptr, 10) : UINT32_MAX;
+            uint32_t step = request->hasArg("step") ? strtoul(request->arg("step").c_str(), nullptr, 10) : 0;
+
+            HistoryResponse::Format format = acceptsMsgPack(request) ? HistoryResponse::MSGPACK : HistoryResponse::JSON;
+            std::shared_ptr<HistoryResponse> body =
+                std::make_shared<HistoryResponse>(historyLog, history, format, from, to, step);
+            if (!body->begin()) {
+                request->send(503, "text/plain", "Out of memory");
+                return;
+            }
+            AsyncWebServerResponse *response = request->beginChunkedResponse(HistoryResponse::contentType(format),
+                [body](uint8_t *buffer, size_t maxLen, size_t) -> size_t {
+                    return body->fill(buffer, maxLen);
+                });
+            response->addHeader("Vary", "Accept");
+            request->send(response);
+        });
+
+        // Scheduler jobs with run counts and lateness against their deadlines,
+        // and per sink how many samples and alerts were sent, held back by the
+        // publish policy or had nobody to go to, with the CPU time saved, and
+        // the email outbox's pending entries, sends and retries with the SMTP
+        // session's reuse and per-phase timings, and the OTA update
+        server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request){
+            AsyncResponseStream *response = request->beginResponseStream("application/json");
+            response->printf("{\"uptime_ms\":%lu,\"free_heap\":%u,\"jobs\":",
+                             static_cast<unsigned long>(millis()), static_cast<unsigned>(ESP.getFreeHeap()));
+            scheduler.writeJson(*response);
+            response->print(",\"publish\":{");
+            sampleSinks.writeJsonFields(*response);
+            response->print("},\"alerts\":{");
+            alertSinks.writeJsonFields(*response);
+            response->print("},\"sse\":{");
+            sse.writeJsonFields(*response);
+            response->print("},\"email\":{");
+            emailOutbox.writeJsonFields(*response);
+            response->print(",\"smtp\":{");
+            emailNotifier.writeJsonFields(*response);
+            response->print("}},\"ota\":{");
+            ota.writeJsonFields(*response);
+            response->printf("},\"assets\":{\"sent\":%lu,\"not_modified\":%lu}}",
+                             static_cast<unsigned long>(assets.sent()), static_cast<unsigned long>(assets.notModified()));
+            request->send(response);
+        });
+
+        server.on("/api/snapshot", HTTP_GET, [](AsyncWebServerRequest *request){
+            AsyncResponseStream *response = request->beginResponseStream("application/json");
+            response->addHeader("Cache-Control", "no-cache");
+            writeSnapshot(*response);
+            request->send(response);
         });
 
         // Serve firmware version
@@ -266,6 +444,10 @@ namespace WifiSetup {
             request->send(200, "text/json", "{\"version\":\"" + String(VERSION) +  "\"}");
         });
 
+        // A connecting dashboard gets the snapshot as its first event
+        if (!sse.begin(events, "snapshot", SNAPSHOT_MAX_LENGTH, renderSnapshot)) {
+            Serial.println("SSE fan-out initialization failed");
+        }
         server.addHandler(&events);
 
         server.begin();
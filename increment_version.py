@@ -24,8 +24,13 @@ def increment_version(version_file):
 def before_build(env):
     version_file = os.path.join(env["PROJECT_DIR"], "version.txt")
     if os.path.exists(version_file):
-        new_version = increment_version(version_file)
-        print(f"Updated firmware version to: {new_version}")
+        # Host builds only report the current version; firmware builds bump it
+        if env.get("PIOPLATFORM") == "native":
+            with open(version_file, "r") as file:
+                new_version = file.read().strip()
+        else:
+            new_version = increment_version(version_file)
+            print(f"Updated firmware version to: {new_version}")
         env.Append(CPPDEFINES=[("VERSION", f'\\"{new_version}\\"')])
 
 # Register the build script
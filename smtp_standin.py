@@ -0,0 +1,149 @@
+"""Local SMTP server for trying the firmware's email path without a mail
+provider.
+
+Accepts any AUTH, prints every message it receives and appends it to an
+mbox file. --fail N refuses the first N sessions with a 421, to watch the
+outbox back off and retry. Plain SMTP only: point the device at it with
+"smtp_host": "<this machine's IP>", "smtp_port": 2525, "smtp_secure": false.
+
+    python smtp_standin.py [--port 2525] [--mbox standin.mbox] [--fail N]
+"""
+
+import argparse
+import datetime
+import socketserver
+import threading
+
+
+class Session(socketserver.StreamRequestHandler):
+    def reply(self, line):
+        self.wfile.write((line + "\r\n").encode("ascii"))
+
+    def handle(self):
+        server = self.server
+        with server.lock:
+            server.sessions += 1
+            refuse = server.sessions <= server.fail
+        peer = self.client_address[0]
+        if refuse:
+            print(f"[{peer}] session {server.sessions} refused (--fail)")
+            self.reply("421 standin.local Service not available, try later")
+            return
+
+        self.reply("220 standin.local ESMTP stand-in")
+        sender = None
+        recipients = []
+        while True:
+            raw = self.rfile.readline()
+            if not raw:
+                return
+            line = raw.decode("utf-8", "replace").rstrip("\r\n")
+            verb = line.split(" ", 1)[0].upper()
+            if verb in ("EHLO", "HELO"):
+                if verb == "EHLO":
+                    self.wfile.write(b"250-standin.local\r\n250-AUTH PLAIN LOGIN\r\n250 8BITMIME\r\n")
+                else:
+                    self.reply("250 standin.local")
+            elif verb == "AUTH":
+                self.auth(line)
+            elif verb == "MAIL":
+                sender = line[len("MAIL FROM:"):].strip()
+                recipients = []
+                self.reply("250 OK")
+            elif verb == "RCPT":
+                recipients.append(line[len("RCPT TO:"):].strip())
+                self.reply("250 OK")
+            elif verb == "DATA":
+                if sender is None or not recipients:
+                    self.reply("503 Need MAIL and RCPT first")
+                    continue
+                self.reply("354 End data with <CR><LF>.<CR><LF>")
+                self.receive(peer, sender, recipients)
+                sender = None
+                recipients = []
+            elif verb == "RSET":
+                sender = None
+                recipients = []
+                self.reply("250 OK")
+            elif verb == "NOOP":
+                self.reply("250 OK")
+            elif verb == "QUIT":
+                self.reply("221 Bye")
+                return
+            else:
+                self.reply("502 Command not implemented")
+
+    def auth(self, line):
+        parts = line.split()
+        mechanism = parts[1].upper() if len(parts) > 1 else ""
+        if mechanism == "PLAIN" and len(parts) == 2:
+            self.reply("334 ")
+            self.rfile.readline()
+        elif mechanism == "LOGIN":
+            if len(parts) == 2:
+                self.reply("334 VXNlcm5hbWU6")  # "Username:"
+                self.rfile.readline()
+            self.reply("334 UGFzc3dvcmQ6")  # "Password:"
+            self.rfile.readline()
+        elif mechanism != "PLAIN":
+            self.reply("504 Unrecognized authentication type")
+            return
+        self.reply("235 Authentication successful")
+
+    def receive(self, peer, sender, recipients):
+        lines = []
+        while True:
+            raw = self.rfile.readline()
+            if not raw:
+                return
+            line = raw.decode("utf-8", "replace").rstrip("\r\n")
+            if line == ".":
+                break
+            lines.append(line[1:] if line.startswith("..") else line)
+        message = "\n".join(lines)
+        server = self.server
+        with server.lock:
+            server.messages += 1
+            print(f"--- message {server.messages} from {peer}: {sender} -> {', '.join(recipients)}")
+            print(message)
+            if server.mbox:
+                stamp = datetime.datetime.now().strftime("%a %b %d %H:%M:%S %Y")
+                with open(server.mbox, "a", encoding="utf-8") as file:
+                    file.write(f"From {sender.strip('<>') or 'unknown'} {stamp}\n")
+                    for body_line in lines:
+                        file.write((">" + body_line if body_line.startswith("From ") else body_line) + "\n")
+                    file.write("\n")
+        self.reply("250 OK: queued")
+
+
+class StandinServer(socketserver.ThreadingTCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+    def __init__(self, address, fail, mbox):
+        super().__init__(address, Session)
+        self.lock = threading.Lock()
+        self.fail = fail
+        self.mbox = mbox
+        self.sessions = 0
+        self.messages = 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Local SMTP stand-in for the email outbox")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=2525)
+    parser.add_argument("--mbox", default="standin.mbox", help="file to append messages to, '' for none")
+    parser.add_argument("--fail", type=int, default=0, help="refuse the first N sessions")
+    args = parser.parse_args()
+
+    with StandinServer((args.host, args.port), args.fail, args.mbox) as server:
+        print(f"SMTP stand-in on {args.host}:{args.port}, refusing the first {args.fail} sessions")
+        try:
+            server.serve_forever()
+        except KeyboardInterrupt:
+            pass
+
+
+if __name__ == "__main__":
+    main()
@@ -2,10 +2,22 @@
 #include "sensor.h"
 #include "mqtt_broker_wrapper.h"
 #include "lcd_display.h"
+#include "display_task.h"
 #include "settings.h"
 #include "email_notifier.h"
+#include "email_outbox.h"
+#include "payload_serializer.h"
+#include "sample_snapshot.h"
+#include "printer_status.h"
+#include "printer_state.h"
+#include "publish_policy.h"
+#include "sink_registry.h"
+#include "last_value_cache.h"
+#include "history_buffer.h"
+#include "history_log.h"
+#include "scheduler.h"
+#include "user_data.h"
 #include <freertos/FreeRTOS.h>
-#include <freertos/queue.h>
 #include <freertos/task.h>
 #define BMP180
 
@@ -13,57 +25,227 @@
 Sensor sensor;
 LocalMqttBroker mqtt;
 LCDDisplay lcd;  // I2C address 0x27 by default
+DisplayTask display(lcd);
 Settings settings;
+SampleSnapshot latestSample;
+HistoryBuffer history;
+HistoryLog historyLog;
+Scheduler scheduler;
 
-struct EmailRequest {
-  float temperature;
-  char status[16];
-};
+EmailNotifier emailNotifier;
+EmailOutbox emailOutbox;
+UserData userData;
 
-QueueHandle_t emailQueue = nullptr;
-TaskHandle_t emailTaskHandle = nullptr;
+TaskHandle_t samplingTaskHandle = nullptr;
+TaskHandle_t loopTaskHandle = nullptr;
 
-unsigned long lastPublish = 0;
 const unsigned long publishIntervalMs = 2000;
-unsigned long lastTimeUpdate = 0;
-const unsigned long timeUpdateIntervalMs = 1000;  // Update time every 1 second
-unsigned long lastEmailSend = 0;
+const unsigned long sseServiceIntervalMs = 250;
+const unsigned long otaServiceIntervalMs = 250;
+uint32_t lastPublishedSequence = 0;
+int publishJob = -1;
+int sseJob = -1;
+int otaJob = -1;
+int emailJob = -1;
 bool sensorInitialized = false;
-bool temperatureAboveThreshold = false;  // Track alert state for ready_to_print
-bool temperatureAboveHighThreshold = false;  // Track alert state for temperature_high
-bool temperatureBelowThreshold = false;  // Track alert state for temperature_low
-float lastTemperature = 0.0f;
-bool lastReadingValid = false;
-String lastStatus = "UNKNOWN";
-enum PrinterStatus{
-  NOT_READY,
-  READY,
-  TOO_HOT
-} printerStatus;
-bool printerStatusChanged = false;
-
-void emailTask(void* param) {
-  EmailRequest request;
+const char* lastStatus = "UNKNOWN";
+PrinterStateMachine printerState;
+PublishPolicy mqttPublishPolicy;
+PublishPolicy mqttMsgPackPublishPolicy;
+PublishPolicy ssePublishPolicy;
+SinkRegistry sampleSinks;
+SinkRegistry alertSinks;
+LastValueCache lastValues;
+SensorPayload samplePayload;
+SensorMsgPack samplePacked;
+AlertPayload alertPayload;
+AlertMsgPack alertPacked;
+
+// Owns the sensor: reads it on a fixed cadence and publishes into
+// latestSample. Everything else reads the snapshot and never touches the bus
+// for sensor data, so /readings can no longer race the main loop.
+void samplingTask(void*) {
+  TickType_t lastWake = xTaskGetTickCount();
   for (;;) {
-    if (xQueueReceive(emailQueue, &request, portMAX_DELAY) == pdTRUE) {
-      if (!EmailNotifier::sendStatusEmail(settings, request.temperature, request.status)) {
-        Serial.println("Email send attempt failed.");
-      }
+    SensorSample sample = {};
+    sample.valid = sensor.read(sample.temperature, sample.humidity);
+    sample.hasHumidity = sensor.reportsHumidity();
+    sample.isDebug = (sensor.sensorType == USE_DEBUG);
+    sample.timestampMs = millis();
+    latestSample.publish(sample);
+    if (loopTaskHandle) {
+      xTaskNotifyGive(loopTaskHandle);
+    }
+
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(publishIntervalMs));
+  }
+}
+
+// Both run on the outbox's email task, which owns the SMTP session
+bool sendEmail(const char* subject, const char* body) {
+  return emailNotifier.send(settings, subject, body);
+}
+
+uint32_t closeIdleEmailSession(uint32_t now) {
+  return emailNotifier.closeIfIdle(now);
+}
+
+// Every channel that reports a status change is fed from here: MQTT and SSE
+// alerts, the email outbox and the LCD.
+void onPrinterStatusChange(const PrinterStatusEvent& event) {
+  alertSinks.publish([&](PayloadEncoding encoding) {
+    if (encoding == PAYLOAD_MSGPACK) {
+      return Payload{alertPacked.render(event.alert, event.temperature, event.threshold), alertPacked.length()};
     }
+    const char* json = alertPayload.render(event.alert, event.temperature, event.threshold);
+    return Payload{reinterpret_cast<const uint8_t*>(json), alertPayload.length()};
+  });
+  if (settings.isEmailEnabled()) {
+    emailOutbox.addStatusChange(event.to, event.temperature);
   }
+  display.showStatus(printerStatusName(event.to));
+}
+
+// Registers who consumes sample and alert payloads and how to tell whether
+// anyone is listening there right now. False if a registry had no room
+// for one of them (SINK_REGISTRY_MAX_SINKS).
+bool registerSinks() {
+  int failed = 0;
+  failed += sampleSinks.add("mqtt", [] { return mqtt.hasSubscribers(MQTT_TOPIC_SENSOR); },
+                  [](const Payload& payload) { mqtt.publish(MQTT_TOPIC_SENSOR, payload.c_str()); },
+                  &mqttPublishPolicy, [] { return settings.getMqttPublishPolicy(); }) < 0;
+  failed += sampleSinks.add("mqtt_msgpack", [] { return mqtt.hasSubscribers(MQTT_TOPIC_SENSOR_MSGPACK); },
+                  [](const Payload& payload) { mqtt.publish(MQTT_TOPIC_SENSOR_MSGPACK, payload.data, payload.length); },
+                  &mqttMsgPackPublishPolicy, [] { return settings.getMqttPublishPolicy(); }, PAYLOAD_MSGPACK) < 0;
+  failed += sampleSinks.add("sse", [] { return WifiSetup::sse.count() > 0; },
+                  [](const Payload& payload) { WifiSetup::sse.sendSample(payload.c_str()); },
+                  &ssePublishPolicy, [] { return settings.getSsePublishPolicy(); }) < 0;
+  failed += sampleSinks.add("serial", [] { return settings.getLogLevel() >= LOG_DEBUG; },
+                  [](const Payload& payload) { Serial.println(payload.c_str()); }) < 0;
+
+  failed += alertSinks.add("mqtt", [] { return mqtt.hasSubscribers(MQTT_TOPIC_ALERTS); },
+                 [](const Payload& payload) { mqtt.publish(MQTT_TOPIC_ALERTS, payload.c_str()); }) < 0;
+  failed += alertSinks.add("mqtt_msgpack", [] { return mqtt.hasSubscribers(MQTT_TOPIC_ALERTS_MSGPACK); },
+                 [](const Payload& payload) { mqtt.publish(MQTT_TOPIC_ALERTS_MSGPACK, payload.data, payload.length); },
+                 nullptr, nullptr, PAYLOAD_MSGPACK) < 0;
+  failed += alertSinks.add("sse", [] { return WifiSetup::sse.count() > 0; },
+                 [](const Payload& payload) { WifiSetup::sse.sendAlert(payload.c_str()); }) < 0;
+  failed += alertSinks.add("serial", [] { return settings.getLogLevel() >= LOG_INFO; }, [](const Payload& payload) {
+    Serial.print("Alert Published: ");
+    Serial.println(payload.c_str());
+  }) < 0;
+  // Alerts are rare; always keep the last one, in both encodings, for late
+  // MQTT subscribers
+  failed += alertSinks.add("retained", [] { return true; }, [](const Payload& payload) {
+    static uint32_t alerts = 0;
+    lastValues.store(MQTT_TOPIC_ALERTS, payload.data, payload.length, ++alerts);
+  }) < 0;
+  failed += alertSinks.add("retained_msgpack", [] { return true; }, [](const Payload& payload) {
+    static uint32_t alerts = 0;
+    lastValues.store(MQTT_TOPIC_ALERTS_MSGPACK, payload.data, payload.length, ++alerts);
+  }, nullptr, nullptr, PAYLOAD_MSGPACK) < 0;
+  return failed == 0;
 }
 
-bool enqueueEmail(float temperature, const char* status) {
-  if (!emailQueue) {
-    return false;
+// Last-value sources for mqtt/sensor(/msgpack) and /readings: render the
+// newest snapshot when the cache is asked for it and the publish path has
+// not already stored that sample.
+size_t renderLatestSample(uint8_t* out, size_t size, uint32_t& version) {
+  SensorSample sample;
+  if (!latestSample.read(sample) || !sample.valid) {
+    return 0;
   }
+  SensorPayload payload;
+  if (!payload.render(payloadFields(sample, lastStatus)) || payload.length() > size) {
+    return 0;
+  }
+  memcpy(out, payload.c_str(), payload.length());
+  version = sample.sequence;
+  return payload.length();
+}
 
-  EmailRequest request;
-  request.temperature = temperature;
-  strncpy(request.status, status, sizeof(request.status) - 1);
-  request.status[sizeof(request.status) - 1] = '\0';
+size_t renderLatestSampleMsgPack(uint8_t* out, size_t size, uint32_t& version) {
+  SensorSample sample;
+  if (!latestSample.read(sample) || !sample.valid) {
+    return 0;
+  }
+  SensorMsgPack packed;
+  if (!packed.render(payloadFields(sample, lastStatus)) || packed.length() > size) {
+    return 0;
+  }
+  memcpy(out, packed.data(), packed.length());
+  version = sample.sequence;
+  return packed.length();
+}
+
+// Runs when the sampling task has published a new snapshot: feeds every
+// sink, the status machine, history and the LCD readings.
+void publishSample() {
+  SensorSample sample;
+  if (!latestSample.read(sample) || sample.sequence == lastPublishedSequence) {
+    return;
+  }
+  lastPublishedSequence = sample.sequence;
+
+  float temperature = sample.temperature;
+  float humidity = sample.humidity;
+  if (sample.valid) {
+    // Rendered once per encoding into the preallocated buffers shared by
+    // every sink, and only if some sink of that encoding has an audience
+    // whose publish policy wants it; whatever is rendered also refreshes
+    // the last-value cache
+    PrinterStatus status = printerState.status();
+    const char* statusStr = printerStatusName(status);
+    SensorPayload::Fields fields = payloadFields(sample, statusStr);
+    sampleSinks.publish(sample, status, [&](PayloadEncoding encoding) {
+      if (encoding == PAYLOAD_MSGPACK) {
+        const uint8_t* packed = samplePacked.render(fields);
+        if (packed) {
+          lastValues.store(MQTT_TOPIC_SENSOR_MSGPACK, packed, samplePacked.length(), sample.sequence);
+        }
+        return Payload{packed, samplePacked.length()};
+      }
+      const char* json = samplePayload.render(fields);
+      if (json) {
+        lastValues.store(MQTT_TOPIC_SENSOR, json, samplePayload.length(), sample.sequence);
+      }
+      return Payload{reinterpret_cast<const uint8_t*>(json), samplePayload.length()};
+    });
+
+    lastStatus = statusStr;
+
+    PrinterThresholds thresholds = {settings.getReadyToPrintThreshold(), settings.getHighTemperatureThreshold(),
+                                    settings.getThresholdHysteresis(), settings.getMinDwellMs()};
+    PrinterStatusEvent event;
+    if (printerState.update(temperature, sample.timestampMs, thresholds, event)) {
+      onPrinterStatusChange(event);
+    }
+
+    HistoryRecord record = makeHistoryRecord(historyTimestamp(), temperature, humidity, sample.hasHumidity, printerState.status());
+    history.append(record);
+    historyLog.append(record);
+
+    // Post to the display task; it draws when it gets to it
+    if (!display.hasIPAddress()) {
+      display.showIPAddress(WiFi.localIP().toString().c_str());
+    }
+    if (sensorInitialized) {
+      bool isBME280 = (sensor.sensorType == USE_BME280);
+      display.showReadings(temperature, humidity, isBME280);
+      display.clearError();
+    }
+  } else {
+    display.showError("Sensor Error");
+  }
+}
 
-  return xQueueSend(emailQueue, &request, 0) == pdTRUE;
+void sendPeriodicEmail() {
+  SensorSample sample;
+  if (settings.isEmailEnabled() && latestSample.read(sample) && sample.valid && !mqtt.hasSensorSubscribers() &&
+      WiFi.status() == WL_CONNECTED) {
+    Serial.println("Queueing periodic email report...");
+    emailOutbox.addReport(lastStatus, sample.temperature);
+  }
 }
 
 void setup() {
@@ -71,185 +253,101 @@ void setup() {
 
   Serial.println("Firmware version " + String(VERSION));
 
-  // Initialize LCD display
-  if (!lcd.begin(VERSION)) {
+  // Initialize LCD display; the display task takes the splash screen down
+  if (!display.begin(VERSION)) {
     Serial.println("LCD Initialization failed");
   }
 
   WifiSetup::connect();
-  if (!settings.begin()) {
+  // Settings, history and the outbox, back from a filesystem update if one
+  // just replaced SPIFFS
+  if (!userData.begin()) {
+    Serial.println("Filesystem initialization failed");
+  }
+  if (!settings.begin(userData.fs())) {
     Serial.println("Settings initialization failed");
   }
 
   WifiSetup::syncTimeWithNtp();
 
+  if (history.begin()) {
+    Serial.printf("History buffer: %u samples (%u bytes)\n", static_cast<unsigned>(history.capacity()),
+                  static_cast<unsigned>(history.memoryBytes()));
+  } else {
+    Serial.println("History buffer allocation failed");
+  }
+  if (historyLog.begin(userData.fs())) {
+    Serial.printf("History log: %u segments\n", static_cast<unsigned>(historyLog.segmentsInUse()));
+  } else {
+    Serial.println("History log initialization failed");
+  }
+
   WifiSetup::initWebServer();
 
   if (!sensor.begin()) {
     Serial.println("Sensor Initialization failed");
-    lcd.displayError("Sensor Init Failed");
+    display.showError("Sensor Init Failed");
     // while (true) delay(1000);
   } else {
     sensorInitialized = true;
     // Display humidity status once at startup
     bool isBME280 = (sensor.sensorType == USE_BME280);
-    lcd.displayHumidityStatus(isBME280);
+    display.showHumiditySensor(isBME280);
   }
 
-  printerStatus = NOT_READY;
-  mqtt.begin();
+  if (!lastValues.begin()) {
+    Serial.println("Last-value cache initialization failed");
+  }
+  lastValues.setSource(MQTT_TOPIC_SENSOR, [] { return latestSample.sequence(); }, renderLatestSample);
+  lastValues.setSource(MQTT_TOPIC_SENSOR_MSGPACK, [] { return latestSample.sequence(); }, renderLatestSampleMsgPack);
+  if (!mqtt.begin(&lastValues)) {
+    Serial.println("MQTT broker initialization failed");
+  }
+  if (!registerSinks()) {
+    Serial.println("Sink registration failed");
+  }
 
-  emailQueue = xQueueCreate(6, sizeof(EmailRequest));
-  if (emailQueue) {
-    xTaskCreatePinnedToCore(emailTask, "EmailTask", 8192, nullptr, 1, &emailTaskHandle, 0);
-  } else {
-    Serial.println("Failed to create email queue.");
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
+  publishJob = scheduler.add("publish", 0, publishSample);
+  // Hands slow dashboards their newest held sample once they have caught
+  // up; triggered by loop() while one is held
+  sseJob = scheduler.add("sse", 0, [] { WifiSetup::sse.service(); });
+  // Update progress for the /update page, and the reboot once one is in;
+  // triggered by loop() while an update needs it
+  otaJob = scheduler.add("ota", 0, WifiSetup::serviceOta);
+  emailJob = scheduler.add("email", settings.getEmailIntervalMs(), sendPeriodicEmail, settings.getEmailIntervalMs());
+
+  // Sample on the app core at a higher priority than loop() so LCD writes,
+  // MQTT servicing and email never delay a reading.
+  xTaskCreatePinnedToCore(samplingTask, "SamplingTask", 4096, nullptr, 2, &samplingTaskHandle, 1);
+
+  // Sends on its own task; whatever was unsent before a reboot goes first
+  if (!emailOutbox.begin(userData.fs(), sendEmail, closeIdleEmailSession)) {
+    Serial.println("Email outbox initialization failed");
   }
 }
 
+// Sleeps until the next job is due or another task wakes it (the sampling
+// task with a new snapshot, the web server with a new update), whichever
+// comes first, then runs whatever is due.
 void loop() {
-  unsigned long now = millis();
-  bool uploading = WifiSetup::isUploading();
-  
-  if (now - lastPublish >= publishIntervalMs) {
-    lastPublish = now;
-
-    float temperature, humidity;
-    if (sensor.read(temperature, humidity)) {
-
-      String payload = sensor.getJSONData(temperature, humidity);
-      
-      // Add printer status to payload for web interface
-      String statusStr = "NOT READY";
-      if (printerStatus == READY) statusStr = "READY";
-      else if (printerStatus == TOO_HOT) statusStr = "TOO HOT";
-      
-      // Create enhanced payload with status
-      String webPayload = payload;
-      webPayload.remove(webPayload.length() - 2); // Remove closing brace and space
-      webPayload += String(F(", \"status\": \"")) + statusStr + F("\" }");
-      
-      WifiSetup::events.send(webPayload.c_str(), "sensor_data", millis());
-      mqtt.publish("mqtt/sensor", payload.c_str());
-      Serial.println(webPayload);
-
-      lastTemperature = temperature;
-      lastReadingValid = true;
-      lastStatus = statusStr;
-
-      float readyThreshold = settings.getReadyToPrintThreshold();
-      float highThreshold = settings.getHighTemperatureThreshold();
-
-      // Check for temperature threshold not reached (temperature_low)
-      if (temperature < readyThreshold && !temperatureBelowThreshold) {
-        // Temperature just fell below threshold
-        temperatureBelowThreshold = true;
-        String alertPayload = String(F("{\"alert\": \"temperature_low\", \"temperature\": ")) + 
-                            String(temperature, 2) + F(", \"threshold\": ") + 
-                            String(readyThreshold, 1) + F("}");
-        mqtt.publish("mqtt/alerts", alertPayload.c_str());
-        Serial.print("Alert Published: ");
-        Serial.println(alertPayload);
-        printerStatus = NOT_READY;
-        if (!enqueueEmail(lastTemperature, "NOT READY")) {
-          Serial.println("Email enqueue failed.");
-        }
-
-        printerStatusChanged = true;
-      } else if (temperature >= readyThreshold && temperatureBelowThreshold) {
-        // Temperature rose back above threshold - reset flag
-        temperatureBelowThreshold = false;
-      }
-
-      // Check for temperature threshold crossing (ready_to_print)
-      if (temperature >= readyThreshold && temperature < highThreshold && (!temperatureAboveThreshold || temperatureAboveHighThreshold)) {
-        // Temperature just crossed above threshold
-        temperatureAboveThreshold = true;
-        String alertPayload = String(F("{\"alert\": \"ready_to_print\", \"temperature\": ")) + 
-                            String(temperature, 2) + F(", \"threshold\": ") + 
-                            String(readyThreshold, 1) + F("}");
-        mqtt.publish("mqtt/alerts", alertPayload.c_str());
-        Serial.print("Alert Published: ");
-        Serial.println(alertPayload);
-        printerStatus = READY;
-        if (!enqueueEmail(lastTemperature, "READY")) {
-          Serial.println("Email enqueue failed.");
-        }
-        printerStatusChanged = true;
-      } else if (temperature < readyThreshold && temperatureAboveThreshold) {
-        // Temperature fell back below threshold - reset flag
-        temperatureAboveThreshold = false;
-      }
-      
-      // Check for high temperature threshold crossing (temperature_high)
-      if (temperature >= highThreshold && !temperatureAboveHighThreshold) {
-        // Temperature just crossed above high threshold
-        temperatureAboveHighThreshold = true;
-        String alertPayload = String(F("{\"alert\": \"temperature_high\", \"temperature\": ")) + 
-                            String(temperature, 2) + F(", \"threshold\": ") + 
-                            String(highThreshold, 1) + F("}");
-        mqtt.publish("mqtt/alerts", alertPayload.c_str());
-        Serial.print("High Temp Alert Published: ");
-        Serial.println(alertPayload);
-        printerStatus = TOO_HOT;
-        if (!enqueueEmail(lastTemperature, "TOO HOT")) {
-          Serial.println("Email enqueue failed.");
-        }
-        printerStatusChanged = true;
-      } else if (temperature < highThreshold && temperatureAboveHighThreshold) {
-        // Temperature fell back below high threshold - reset flag
-        temperatureAboveHighThreshold = false;
-      }
-
-      // Update LCD display if not uploading
-      if (!uploading) {
-        // Display IP address once at first publish
-        String ipAddr = WiFi.localIP().toString();
-        lcd.displayIPAddress(ipAddr.c_str());
-        
-        // Update sensor readings
-        if (sensorInitialized) {
-            bool isBME280 = (sensor.sensorType == USE_BME280);
-            lcd.updateTemperature(temperature);
-            lcd.updateHumidity(humidity, isBME280);
-            if (printerStatusChanged){
-              printerStatusChanged = false;
-              if (printerStatus == READY) {
-                lcd.updateStatus("READY");  // Refresh to show ready status
-              } else if (printerStatus == NOT_READY) {
-                lcd.updateStatus("NOT READY");  // Refresh to show ready status
-              } else if (printerStatus == TOO_HOT) {
-                lcd.updateStatus("TOO HOT");  // Refresh to show ready status
-              }
-            }
-            
-        }
-      }
-    } else {
-      lcd.displayError("Sensor Error");
-    }
-    mqtt.loop();
+  // Pick up a changed email interval from /settings
+  scheduler.setPeriod(emailJob, settings.getEmailIntervalMs());
+  // Every otaServiceIntervalMs while an update is in progress, never otherwise
+  if (WifiSetup::ota.needsService()) {
+    scheduler.trigger(otaJob, millis() + otaServiceIntervalMs);
   }
-
-  if (now - lastEmailSend >= settings.getEmailIntervalMs()) {
-    lastEmailSend = now;
-    if (lastReadingValid && !mqtt.hasSensorSubscribers() && WiFi.status() == WL_CONNECTED) {
-      Serial.println("Attempting to send email notification...");
-      if (!enqueueEmail(lastTemperature, lastStatus.c_str())) {
-        Serial.println("Email enqueue failed.");
-      }
-    }
+  // Likewise while a slow dashboard has a sample held for it
+  if (WifiSetup::sse.holdsSamples()) {
+    scheduler.trigger(sseJob, millis() + sseServiceIntervalMs);
   }
 
-  // Update time every second
-  if (!uploading && now - lastTimeUpdate >= timeUpdateIntervalMs) {
-    lastTimeUpdate = now;
-    lcd.updateTime();
+  uint32_t waitMs = scheduler.msUntilNext(millis());
+  if (ulTaskNotifyTake(pdTRUE, waitMs == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(waitMs)) > 0) {
+    SensorSample sample;
+    if (latestSample.read(sample) && sample.sequence != lastPublishedSequence) {
+      scheduler.trigger(publishJob, sample.timestampMs);
+    }
   }
-
-  delay(50);
-
-  // Broker loop if required by your library
-  // broker.loop();  // depends on implementation
+  scheduler.runDue();
 }
-
@@ -0,0 +1,88 @@
+// HistoryDecimator: records are averaged into step-aligned buckets, samples
+// without humidity leave the humidity average alone, and a single bucket
+// holding more records than a 16-bit count (a whole-log /history query)
+// still averages correctly.
+//
+//   pio test -e native -f test_history_decimator
+
+#include <Arduino.h>
+#include <math.h>
+#include <vector>
+#include <unity.h>
+#include "history_buffer.h"
+
+namespace {
+
+struct Collect {
+  std::vector<HistoryBucket> buckets;
+  void operator()(const HistoryBucket& bucket) { buckets.push_back(bucket); }
+};
+
+HistoryRecord record(uint32_t timestamp, int16_t temperatureCenti, uint16_t humidityCenti) {
+  HistoryRecord r = {timestamp, temperatureCenti, humidityCenti, static_cast<uint8_t>(READY)};
+  return r;
+}
+
+bool near(float expected, float actual) { return fabsf(expected - actual) < 0.005f; }
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_records_average_per_bucket() {
+  Collect collect;
+  HistoryDecimator<Collect> decimator(100, 10, collect);
+  decimator.add(record(100, 2000, 5000));
+  decimator.add(record(105, 3000, 6000));
+  decimator.add(record(112, 4000, 7000));
+  TEST_ASSERT_EQUAL_UINT32(2, decimator.finish());
+
+  TEST_ASSERT_EQUAL_UINT32(100, collect.buckets[0].timestamp);
+  TEST_ASSERT_TRUE(near(25.0f, collect.buckets[0].temperature));
+  TEST_ASSERT_TRUE(near(55.0f, collect.buckets[0].humidity));
+  TEST_ASSERT_EQUAL_UINT32(110, collect.buckets[1].timestamp);
+  TEST_ASSERT_TRUE(near(40.0f, collect.buckets[1].temperature));
+}
+
+void test_missing_humidity_is_left_out() {
+  Collect collect;
+  HistoryDecimator<Collect> decimator(0, 60, collect);
+  decimator.add(record(0, 2000, HISTORY_NO_HUMIDITY));
+  decimator.add(record(2, 2000, 4000));
+  decimator.add(record(4, 2000, HISTORY_NO_HUMIDITY));
+  decimator.finish();
+  TEST_ASSERT_TRUE(collect.buckets[0].hasHumidity);
+  TEST_ASSERT_TRUE(near(40.0f, collect.buckets[0].humidity));
+
+  Collect none;
+  HistoryDecimator<Collect> dry(0, 60, none);
+  dry.add(record(0, 2000, HISTORY_NO_HUMIDITY));
+  dry.finish();
+  TEST_ASSERT_FALSE(none.buckets[0].hasHumidity);
+}
+
+void test_bucket_larger_than_16_bits() {
+  const uint32_t count = 70000;
+  Collect collect;
+  HistoryDecimator<Collect> decimator(0, 1000000, collect);
+  for (uint32_t i = 0; i < count; ++i) {
+    // Alternating hot samples keep the sum past int32_t if it were summed
+    // there, and the average at an exact 200.00 / 80.00.
+    decimator.add(record(i * 2, i % 2 ? 30000 : 10000, i % 2 ? 9000 : 7000));
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, decimator.finish());
+  TEST_ASSERT_EQUAL_UINT32(1, collect.buckets.size());
+  TEST_ASSERT_TRUE(near(200.0f, collect.buckets[0].temperature));
+  TEST_ASSERT_TRUE(collect.buckets[0].hasHumidity);
+  TEST_ASSERT_TRUE(near(80.0f, collect.buckets[0].humidity));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_records_average_per_bucket);
+  RUN_TEST(test_missing_humidity_is_left_out);
+  RUN_TEST(test_bucket_larger_than_16_bits);
+  return UNITY_END();
+}
@@ -0,0 +1,143 @@
+// HistoryResponse, the chunked /history body: drained filler call by filler
+// call it matches writeHistoryJson() and writeHistoryMsgPack() byte for
+// byte, over samples on flash and in the RAM ring, and no call reads more
+// than HISTORY_RECORDS_PER_FILL records, even when the whole range falls
+// into one bucket and there is nothing to send until the end.
+//
+//   pio test -e native -f test_history_response
+
+#define HISTORY_RECORDS_PER_FILL 64
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <SPIFFS.h>
+#include <string>
+#include <unity.h>
+#include "history_buffer.h"
+#include "history_log.h"
+#include "history_response.h"
+
+namespace {
+
+const uint32_t START = 1700000000UL;
+const uint32_t SAMPLES = 2000;
+const uint32_t UNFLUSHED = 50;  // newest samples only in the staged page and the ring
+
+HistoryLog archive;
+HistoryBuffer recent;
+
+class BodyPrint : public Print {
+public:
+  size_t write(uint8_t c) override {
+    body.push_back(static_cast<char>(c));
+    return 1;
+  }
+  size_t write(const uint8_t* data, size_t len) override {
+    body.append(reinterpret_cast<const char*>(data), len);
+    return len;
+  }
+  using Print::write;
+  std::string body;
+};
+
+struct Drained {
+  std::string body;
+  uint32_t calls = 0;
+  uint32_t retries = 0;
+};
+
+Drained drain(HistoryResponse& response) {
+  Drained out;
+  uint8_t buffer[1436];
+  for (;;) {
+    size_t n = response.fill(buffer, sizeof(buffer));
+    ++out.calls;
+    if (n == RESPONSE_TRY_AGAIN) {
+      ++out.retries;
+      continue;
+    }
+    if (n == 0) {
+      break;
+    }
+    out.body.append(reinterpret_cast<const char*>(buffer), n);
+  }
+  return out;
+}
+
+// Both stores as the device fills them: every sample into the ring and the
+// log, with all but the newest few on flash. Flushed every 64 samples so the
+// flush task keeps up with samples that arrive here without the 2 s gap.
+void record() {
+  for (uint32_t i = 0; i < SAMPLES; ++i) {
+    HistoryRecord sample = {START + 2 * i, static_cast<int16_t>(2000 + (i * 37) % 900),
+                            static_cast<uint16_t>(i % 9 == 0 ? HISTORY_NO_HUMIDITY : 4000 + i % 500),
+                            static_cast<uint8_t>(i / 700)};
+    recent.append(sample);
+    archive.append(sample);
+    if (i % 64 == 63 && i < SAMPLES - UNFLUSHED) {
+      archive.flushNow();
+    }
+  }
+}
+
+}  // namespace
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_json_matches_the_buffered_body() {
+  BodyPrint expected;
+  writeHistoryJson(expected, archive, recent, 0, UINT32_MAX, 0);
+  HistoryResponse response(archive, recent, HistoryResponse::JSON, 0, UINT32_MAX, 0);
+  TEST_ASSERT_TRUE(response.begin());
+  Drained drained = drain(response);
+  TEST_ASSERT_EQUAL_STRING(expected.body.c_str(), drained.body.c_str());
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(SAMPLES / HISTORY_RECORDS_PER_FILL, drained.calls);
+}
+
+void test_msgpack_matches_the_buffered_body() {
+  BodyPrint expected;
+  TEST_ASSERT_TRUE(writeHistoryMsgPack(expected, archive, recent, 0, UINT32_MAX, 0));
+  HistoryResponse response(archive, recent, HistoryResponse::MSGPACK, 0, UINT32_MAX, 0);
+  TEST_ASSERT_TRUE(response.begin());
+  Drained drained = drain(response);
+  TEST_ASSERT_EQUAL_UINT32(expected.body.size(), drained.body.size());
+  TEST_ASSERT_EQUAL_MEMORY(expected.body.data(), drained.body.data(), expected.body.size());
+  // Nothing can be sent before the points count is known.
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(SAMPLES / HISTORY_RECORDS_PER_FILL, drained.retries);
+}
+
+void test_one_bucket_is_read_over_many_calls() {
+  BodyPrint expected;
+  writeHistoryJson(expected, archive, recent, 0, UINT32_MAX, 1000000);
+  HistoryResponse response(archive, recent, HistoryResponse::JSON, 0, UINT32_MAX, 1000000);
+  TEST_ASSERT_TRUE(response.begin());
+  Drained drained = drain(response);
+  TEST_ASSERT_EQUAL_STRING(expected.body.c_str(), drained.body.c_str());
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(SAMPLES / HISTORY_RECORDS_PER_FILL - 1, drained.retries);
+}
+
+void test_range_inside_the_log() {
+  uint32_t from = START + 1000;
+  uint32_t to = START + 1999;
+  BodyPrint expected;
+  writeHistoryJson(expected, archive, recent, from, to, 10);
+  HistoryResponse response(archive, recent, HistoryResponse::JSON, from, to, 10);
+  TEST_ASSERT_TRUE(response.begin());
+  TEST_ASSERT_EQUAL_STRING(expected.body.c_str(), drain(response).body.c_str());
+}
+
+int main() {
+  SPIFFS.begin();
+  archive.begin(SPIFFS);
+  recent.begin(SAMPLES);
+  record();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_json_matches_the_buffered_body);
+  RUN_TEST(test_msgpack_matches_the_buffered_body);
+  RUN_TEST(test_one_bucket_is_read_over_many_calls);
+  RUN_TEST(test_range_inside_the_log);
+  return UNITY_END();
+}
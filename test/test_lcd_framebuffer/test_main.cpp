@@ -0,0 +1,173 @@
+// LCDDisplay's shadow frame against the simulated glass: every update shows
+// the expected text once flushed, full-screen messages leave nothing behind,
+// and flush() sends only the cells that changed.
+//
+//   pio test -e native -f test_lcd_framebuffer
+
+#include <Arduino.h>
+#include <LiquidCrystal_I2C.h>
+#include <string>
+#include <unity.h>
+#include "lcd_display.h"
+
+namespace {
+
+LCDDisplay* display = nullptr;
+LiquidCrystal_I2C* glass = nullptr;
+
+std::string row(uint8_t r) {
+  char text[LCD_COLS + 1];
+  std::string line = glass->rowText(r, text);
+  line.erase(line.find_last_not_of(' ') + 1);
+  return line;
+}
+
+uint64_t dataBytes() { return hal::lcd().dataBytes.load(); }
+
+// Half way into second s of uptime, so the clock reads s.
+void setUptime(uint32_t s) {
+  uint32_t target = s * 1000 + 500;
+  if (millis() < target) {
+    delay(target - millis());
+  }
+}
+
+}  // namespace
+
+void setUp() {
+  display = new LCDDisplay();
+  glass = LiquidCrystal_I2C::instances().back();
+  display->begin("1.1.96");
+  display->clear();
+  display->flush();
+}
+
+// The glass keeps its registration; only the newest one is looked at
+void tearDown() { delete display; }
+
+void test_begin_shows_the_version() {
+  display->begin("1.2.3");
+  TEST_ASSERT_EQUAL_STRING("Temperature Monitor", row(0).c_str());
+  TEST_ASSERT_EQUAL_STRING("Initializing...", row(1).c_str());
+  TEST_ASSERT_EQUAL_STRING("Version: 1.2.3", row(2).c_str());
+}
+
+void test_readings_and_status_are_drawn() {
+  display->updateTemperature(23.44f);
+  display->updateHumidity(41.0f, true);
+  display->updateStatus("READY");
+  display->flush();
+  TEST_ASSERT_EQUAL_STRING("Temp: 23.4C", row(0).c_str());
+  TEST_ASSERT_EQUAL_STRING("Humidity: 41.0%", row(1).c_str());
+  TEST_ASSERT_EQUAL_STRING("Status: READY", row(2).c_str());
+}
+
+void test_small_changes_are_not_redrawn() {
+  display->updateTemperature(23.40f);
+  display->updateHumidity(41.0f, true);
+  display->flush();
+  display->updateTemperature(23.46f);
+  display->updateHumidity(41.6f, true);
+  display->flush();
+  TEST_ASSERT_EQUAL_STRING("Temp: 23.4C", row(0).c_str());
+  TEST_ASSERT_EQUAL_STRING("Humidity: 41.0%", row(1).c_str());
+}
+
+void test_humidity_row_left_alone_without_bme280() {
+  display->displayHumidityStatus(false);
+  display->updateHumidity(41.0f, false);
+  display->flush();
+  TEST_ASSERT_EQUAL_STRING("(No Humidity Sensor)", row(1).c_str());
+}
+
+void test_unchanged_frame_sends_nothing() {
+  display->updateTemperature(23.4f);
+  display->flush();
+  uint64_t before = dataBytes();
+  display->updateTemperature(23.4f);
+  display->flush();
+  TEST_ASSERT_EQUAL_UINT32(0, dataBytes() - before);
+}
+
+// hh:mm:09 -> hh:mm:10 changes two cells.
+void test_clock_tick_sends_only_changed_digits() {
+  uint32_t s = (millis() / 60000 + 1) * 60 + 9;
+  setUptime(s);
+  display->updateTime();
+  display->flush();
+  uint64_t before = dataBytes();
+  setUptime(s + 1);
+  display->updateTime();
+  display->flush();
+  TEST_ASSERT_EQUAL_UINT32(2, dataBytes() - before);
+  TEST_ASSERT_EQUAL_STRING(":10", row(3).substr(11).c_str());
+}
+
+// Only the net change of several updates reaches the glass.
+void test_updates_between_flushes_coalesce() {
+  display->updateStatus("READY");
+  display->flush();
+  uint64_t before = dataBytes();
+  display->updateStatus("TOO HOT");
+  display->updateStatus("READY");
+  display->flush();
+  TEST_ASSERT_EQUAL_UINT32(0, dataBytes() - before);
+  TEST_ASSERT_EQUAL_STRING("Status: READY", row(2).c_str());
+}
+
+void test_error_screen_leaves_nothing_behind() {
+  display->updateTemperature(23.4f);
+  display->updateStatus("READY");
+  display->updateTime();
+  display->flush();
+  display->displayError("Sensor Error");
+  display->flush();
+  TEST_ASSERT_EQUAL_STRING("ERROR", row(0).c_str());
+  TEST_ASSERT_EQUAL_STRING("Sensor Error", row(1).c_str());
+  TEST_ASSERT_EQUAL_STRING("", row(2).c_str());
+  TEST_ASSERT_EQUAL_STRING("Check connections", row(3).c_str());
+}
+
+void test_upload_message_replaces_the_screen() {
+  display->updateTemperature(23.4f);
+  display->updateTime();
+  display->flush();
+  display->displayUploadMessage("Uploading firmware");
+  display->flush();
+  TEST_ASSERT_EQUAL_STRING("Uploading firmware", row(0).c_str());
+  TEST_ASSERT_EQUAL_STRING("", row(1).c_str());
+  TEST_ASSERT_EQUAL_STRING("Please wait...", row(2).c_str());
+  TEST_ASSERT_EQUAL_STRING("", row(3).c_str());
+}
+
+// After clear() the same reading is drawn again.
+void test_readings_redrawn_after_clear() {
+  display->updateTemperature(23.4f);
+  display->flush();
+  display->clear();
+  display->updateTemperature(23.4f);
+  display->flush();
+  TEST_ASSERT_EQUAL_STRING("Temp: 23.4C", row(0).c_str());
+}
+
+void test_long_text_is_cut_at_the_width() {
+  display->updateStatus("WAITING FOR THE HEATER");
+  display->flush();
+  TEST_ASSERT_EQUAL_STRING("Status: WAITING FOR", row(2).c_str());
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_shows_the_version);
+  RUN_TEST(test_readings_and_status_are_drawn);
+  RUN_TEST(test_small_changes_are_not_redrawn);
+  RUN_TEST(test_humidity_row_left_alone_without_bme280);
+  RUN_TEST(test_unchanged_frame_sends_nothing);
+  RUN_TEST(test_clock_tick_sends_only_changed_digits);
+  RUN_TEST(test_updates_between_flushes_coalesce);
+  RUN_TEST(test_error_screen_leaves_nothing_behind);
+  RUN_TEST(test_upload_message_replaces_the_screen);
+  RUN_TEST(test_readings_redrawn_after_clear);
+  RUN_TEST(test_long_text_is_cut_at_the_width);
+  return UNITY_END();
+}
@@ -0,0 +1,105 @@
+// LocalMqttBroker's last-value delivery: a subscriber that is alone on a
+// topic gets the cached value with the retain flag, and nobody already on
+// the topic ever sees it again (MQTT 3.1.1, 3.3.1.3).
+//
+//   pio test -e native -f test_mqtt_retained
+
+#include <Arduino.h>
+#include <PicoMQTT.h>
+#include <unity.h>
+#include "last_value_cache.h"
+#include "mqtt_broker_wrapper.h"
+
+namespace {
+
+const char ALERT[] = "{\"alert\": \"ready_to_print\", \"temperature\": 25.10, \"threshold\": 25.0}";
+
+LastValueCache* cache = nullptr;
+LocalMqttBroker* mqtt = nullptr;
+PicoMQTT::Server* server = nullptr;
+
+uint64_t published() { return hal::publishes().mqttMessages.load(); }
+
+}  // namespace
+
+void setUp() {
+  cache = new LastValueCache();
+  cache->begin();
+  cache->store(MQTT_TOPIC_ALERTS, ALERT, strlen(ALERT), 1);
+  mqtt = new LocalMqttBroker();
+  mqtt->begin(cache, false);
+  server = PicoMQTT::Server::instances().back();
+}
+
+void tearDown() {
+  delete mqtt;
+  delete cache;
+}
+
+void test_first_subscriber_gets_the_last_alert() {
+  uint64_t before = published();
+  server->simulateSubscribe("collector-1", "mqtt/alerts");
+  mqtt->loop();
+  TEST_ASSERT_EQUAL_UINT32(1, published() - before);
+  TEST_ASSERT_EQUAL_UINT32(1, mqtt->retainedDeliveries());
+}
+
+void test_existing_subscriber_is_not_sent_the_alert_again() {
+  server->simulateSubscribe("collector-1", "mqtt/alerts");
+  mqtt->loop();
+  uint64_t before = published();
+  server->simulateSubscribe("collector-2", "mqtt/alerts");
+  mqtt->loop();
+  TEST_ASSERT_EQUAL_UINT32(0, published() - before);
+  TEST_ASSERT_EQUAL_UINT32(1, mqtt->retainedDeliveries());
+}
+
+// The wildcard covers the alert topic collector-1 is already on.
+void test_wildcard_subscriber_does_not_replay_a_shared_topic() {
+  server->simulateSubscribe("collector-1", "mqtt/alerts");
+  mqtt->loop();
+  uint64_t before = published();
+  server->simulateSubscribe("dashboard", "mqtt/#");
+  mqtt->loop();
+  TEST_ASSERT_EQUAL_UINT32(0, published() - before);
+}
+
+// Both are new, so the one publish reaches only new subscriptions.
+void test_subscribers_arriving_together_share_one_delivery() {
+  uint64_t before = published();
+  server->simulateSubscribe("collector-1", "mqtt/alerts");
+  server->simulateSubscribe("collector-2", "mqtt/alerts");
+  mqtt->loop();
+  TEST_ASSERT_EQUAL_UINT32(1, published() - before);
+}
+
+void test_overlapping_filter_from_the_same_client_is_not_new() {
+  server->simulateSubscribe("collector-1", "mqtt/alerts");
+  mqtt->loop();
+  uint64_t before = published();
+  server->simulateSubscribe("collector-1", "mqtt/+");
+  mqtt->loop();
+  TEST_ASSERT_EQUAL_UINT32(0, published() - before);
+}
+
+void test_resubscribing_alone_gets_the_alert_again() {
+  server->simulateSubscribe("collector-1", "mqtt/alerts");
+  mqtt->loop();
+  server->simulateUnsubscribe("collector-1", "mqtt/alerts");
+  mqtt->loop();
+  uint64_t before = published();
+  server->simulateSubscribe("collector-1", "mqtt/alerts");
+  mqtt->loop();
+  TEST_ASSERT_EQUAL_UINT32(1, published() - before);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_subscriber_gets_the_last_alert);
+  RUN_TEST(test_existing_subscriber_is_not_sent_the_alert_again);
+  RUN_TEST(test_wildcard_subscriber_does_not_replay_a_shared_topic);
+  RUN_TEST(test_subscribers_arriving_together_share_one_delivery);
+  RUN_TEST(test_overlapping_filter_from_the_same_client_is_not_new);
+  RUN_TEST(test_resubscribing_alone_gets_the_alert_again);
+  return UNITY_END();
+}
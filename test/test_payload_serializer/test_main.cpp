@@ -0,0 +1,93 @@
+// The fixed-buffer payload renderers: each payload renders in full, one
+// that does not fit its buffer renders as nullptr instead of cut short,
+// and SinkRegistry sends a payload that did not fit to no sink.
+//
+//   pio test -e native -f test_payload_serializer
+
+#include <Arduino.h>
+#include <string>
+#include <unity.h>
+#include "payload_serializer.h"
+#include "sink_registry.h"
+
+namespace {
+
+const char* const LONG_NAME = "A STATUS NAME FAR TOO LONG FOR ANY OF THE PAYLOAD BUFFERS TO HOLD, EVEN THE JSON ONES";
+
+uint32_t sends = 0;
+
+bool always() { return true; }
+void countSend(const Payload&) { sends++; }
+
+}  // namespace
+
+void setUp() { sends = 0; }
+
+void tearDown() {}
+
+void test_sample_renders_in_full() {
+  SensorPayload json;
+  const char* out = json.render({25.0f, 60.0f, true, true, "READY"});
+  TEST_ASSERT_NOT_NULL(out);
+  TEST_ASSERT_EQUAL_STRING("{\"temperature\": 25.00, \"humidity\": 60.00, \"isDebug\": true, \"status\": \"READY\" }", out);
+  TEST_ASSERT_EQUAL_UINT32(strlen(out), json.length());
+
+  SensorMsgPack packed;
+  TEST_ASSERT_NOT_NULL(packed.render({25.0f, 60.0f, true, true, "READY"}));
+  TEST_ASSERT_GREATER_THAN_UINT32(0, packed.length());
+}
+
+void test_alert_renders_in_full() {
+  AlertPayload json;
+  TEST_ASSERT_EQUAL_STRING("{\"alert\": \"temperature_high\", \"temperature\": 39.10, \"threshold\": 30.0}",
+                           json.render("temperature_high", 39.1f, 30.0f));
+  AlertMsgPack packed;
+  TEST_ASSERT_NOT_NULL(packed.render("temperature_high", 39.1f, 30.0f));
+}
+
+void test_sample_too_long_is_not_rendered() {
+  SensorPayload json;
+  TEST_ASSERT_NULL(json.render({25.0f, 60.0f, true, true, LONG_NAME}));
+  TEST_ASSERT_EQUAL_UINT32(0, json.length());
+  SensorMsgPack packed;
+  TEST_ASSERT_NULL(packed.render({25.0f, 60.0f, true, true, LONG_NAME}));
+  TEST_ASSERT_EQUAL_UINT32(0, packed.length());
+}
+
+void test_alert_too_long_is_not_rendered() {
+  AlertPayload json;
+  TEST_ASSERT_NULL(json.render(LONG_NAME, 39.1f, 30.0f));
+  AlertMsgPack packed;
+  TEST_ASSERT_NULL(packed.render(LONG_NAME, 39.1f, 30.0f));
+  TEST_ASSERT_EQUAL_UINT32(0, packed.length());
+}
+
+// The MessagePack alert does not fit; its sink is skipped, the JSON one
+// still gets the alert.
+void test_registry_skips_payload_that_did_not_fit() {
+  SinkRegistry sinks;
+  int json = sinks.add("json", always, countSend);
+  int packed = sinks.add("msgpack", always, countSend, nullptr, nullptr, PAYLOAD_MSGPACK);
+  AlertPayload alertJson;
+  AlertMsgPack alertPacked;
+  sinks.publish([&](PayloadEncoding encoding) {
+    if (encoding == PAYLOAD_MSGPACK) {
+      return Payload{alertPacked.render(LONG_NAME, 39.1f, 30.0f), alertPacked.length()};
+    }
+    const char* out = alertJson.render("temperature_high", 39.1f, 30.0f);
+    return Payload{reinterpret_cast<const uint8_t*>(out), alertJson.length()};
+  });
+  TEST_ASSERT_EQUAL_UINT32(1, sends);
+  TEST_ASSERT_EQUAL_UINT32(1, sinks.stats(json).sent);
+  TEST_ASSERT_EQUAL_UINT32(0, sinks.stats(packed).sent);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_sample_renders_in_full);
+  RUN_TEST(test_alert_renders_in_full);
+  RUN_TEST(test_sample_too_long_is_not_rendered);
+  RUN_TEST(test_alert_too_long_is_not_rendered);
+  RUN_TEST(test_registry_skips_payload_that_did_not_fit);
+  return UNITY_END();
+}
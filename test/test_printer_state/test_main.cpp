@@ -0,0 +1,148 @@
+// PrinterStateMachine with the default settings on noisy temperature traces:
+// each real status change commits exactly once, noise around a threshold
+// never flaps, and a clean step commits only after the dwell time.
+//
+//   pio test -e native -f test_printer_state
+
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+#include "printer_state.h"
+#include "settings.h"
+
+namespace {
+
+const uint32_t SAMPLE_MS = 2000;
+const uint32_t SPURIOUS_WINDOW_MS = 60000;
+
+const PrinterThresholds DEFAULTS = {DEFAULT_READY_THRESHOLD, DEFAULT_HIGH_THRESHOLD, DEFAULT_THRESHOLD_HYSTERESIS,
+                                    DEFAULT_MIN_DWELL_SECONDS * 1000UL};
+
+struct Transition {
+  uint32_t atMs;
+  PrinterStatus to;
+};
+
+float noise(int centi) { return static_cast<float>(random(-centi, centi + 1)) / 100.0f; }
+
+std::vector<Transition> replay(const std::vector<float>& temperatures) {
+  PrinterStateMachine machine;
+  PrinterStatusEvent event;
+  std::vector<Transition> transitions;
+  for (size_t i = 0; i < temperatures.size(); ++i) {
+    uint32_t nowMs = static_cast<uint32_t>(i) * SAMPLE_MS;
+    if (machine.update(temperatures[i], nowMs, DEFAULTS, event)) {
+      transitions.push_back({nowMs, event.to});
+    }
+  }
+  return transitions;
+}
+
+// Transitions undone within a minute.
+uint32_t spurious(const std::vector<Transition>& transitions) {
+  uint32_t count = 0;
+  for (size_t i = 1; i + 1 < transitions.size(); ++i) {
+    bool reverted = transitions[i + 1].to == transitions[i - 1].to;
+    if (reverted && transitions[i + 1].atMs - transitions[i].atMs < SPURIOUS_WINDOW_MS) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+}  // namespace
+
+void setUp() { randomSeed(42); }
+
+void tearDown() {}
+
+void test_first_sample_is_classified() {
+  PrinterStateMachine machine;
+  PrinterStatusEvent event;
+  TEST_ASSERT_TRUE(machine.update(DEFAULT_HIGH_THRESHOLD + 1.0f, 0, DEFAULTS, event));
+  TEST_ASSERT_TRUE(event.initial);
+  TEST_ASSERT_EQUAL(TOO_HOT, event.to);
+  TEST_ASSERT_FALSE(machine.update(DEFAULT_HIGH_THRESHOLD + 1.0f, SAMPLE_MS, DEFAULTS, event));
+}
+
+// A minute at 18 C, then an hour on the ready threshold with +/-0.3 C of
+// sensor noise: one real NOT READY -> READY transition.
+void test_hover_on_threshold_does_not_flap() {
+  std::vector<float> trace;
+  for (uint32_t i = 0; i < 1800; ++i) {
+    trace.push_back(i < 30 ? 18.0f : DEFAULT_READY_THRESHOLD + 0.05f + noise(30));
+  }
+  std::vector<Transition> transitions = replay(trace);
+  TEST_ASSERT_EQUAL_UINT32(2, transitions.size());
+  TEST_ASSERT_EQUAL(READY, transitions.back().to);
+  TEST_ASSERT_EQUAL_UINT32(0, spurious(transitions));
+}
+
+// Enclosure warm-up from 14 C to ~33 C: NOT READY, READY, TOO HOT.
+void test_warmup_passes_each_status_once() {
+  std::vector<float> trace;
+  for (uint32_t i = 0; i < 1800; ++i) {
+    float minutes = static_cast<float>(i * SAMPLE_MS) / 60000.0f;
+    trace.push_back(14.0f + 19.0f * (1.0f - expf(-minutes / 7.0f)) + noise(15));
+  }
+  std::vector<Transition> transitions = replay(trace);
+  TEST_ASSERT_EQUAL_UINT32(3, transitions.size());
+  TEST_ASSERT_EQUAL(NOT_READY, transitions[0].to);
+  TEST_ASSERT_EQUAL(READY, transitions[1].to);
+  TEST_ASSERT_EQUAL(TOO_HOT, transitions[2].to);
+}
+
+// Steady 25 C with a one-sample glitch above the high threshold every ~5 min.
+void test_single_sample_glitch_is_ignored() {
+  std::vector<float> trace;
+  for (uint32_t i = 0; i < 1800; ++i) {
+    trace.push_back(i % 150 == 75 ? 38.0f : 25.0f + noise(15));
+  }
+  std::vector<Transition> transitions = replay(trace);
+  TEST_ASSERT_EQUAL_UINT32(1, transitions.size());
+  TEST_ASSERT_EQUAL(READY, transitions[0].to);
+}
+
+// Thermostat cycling 18-32 C with a 20 minute period: four real transitions
+// per cycle after the first classification.
+void test_thermostat_cycle_commits_every_real_change() {
+  std::vector<float> trace;
+  for (uint32_t i = 0; i < 1800; ++i) {
+    float phase = static_cast<float>(i * SAMPLE_MS) / 1200000.0f * 2.0f * static_cast<float>(M_PI);
+    trace.push_back(25.0f - 7.0f * cosf(phase) + noise(30));
+  }
+  std::vector<Transition> transitions = replay(trace);
+  TEST_ASSERT_EQUAL_UINT32(1 + 4 * 3, transitions.size());
+  TEST_ASSERT_EQUAL_UINT32(0, spurious(transitions));
+}
+
+// A clean step across the ready threshold commits exactly once, no sooner
+// than the dwell time and within one sample after it.
+void test_step_commits_after_dwell() {
+  PrinterStateMachine machine;
+  PrinterStatusEvent event;
+  const uint32_t stepMs = 60000;
+  uint32_t committedMs = 0;
+  uint32_t events = 0;
+  for (uint32_t nowMs = 0; nowMs < 180000; nowMs += SAMPLE_MS) {
+    float temperature = nowMs < stepMs ? 15.0f : 25.0f;
+    if (machine.update(temperature, nowMs, DEFAULTS, event) && !event.initial) {
+      committedMs = nowMs;
+      ++events;
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, events);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(DEFAULTS.minDwellMs, committedMs - stepMs);
+  TEST_ASSERT_LESS_THAN_UINT32(DEFAULTS.minDwellMs + SAMPLE_MS, committedMs - stepMs);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_sample_is_classified);
+  RUN_TEST(test_hover_on_threshold_does_not_flap);
+  RUN_TEST(test_warmup_passes_each_status_once);
+  RUN_TEST(test_single_sample_glitch_is_ignored);
+  RUN_TEST(test_thermostat_cycle_commits_every_real_change);
+  RUN_TEST(test_step_commits_after_dwell);
+  return UNITY_END();
+}